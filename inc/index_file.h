@@ -0,0 +1,280 @@
+#ifndef INDEX_FILE_H_
+#define INDEX_FILE_H_
+
+/*******************************************
+ *                INCLUDES
+ ******************************************/
+#include <stdio.h>  /* FILE     */
+#include <stdint.h> /* uint64_t */
+#include "utils.h"  /* ByteBuffer */
+
+/*******************************************
+ *                DEFINES
+ ******************************************/
+
+/* The index is the result of the reduce phase in a binary form, made to be mapped into memory and queried:
+ *
+ *   header  : INDEX_MAGIC (8 bytes) | uint64 blocks | uint64 block_offsets[blocks + 1]
+ *   blocks  : one for every key range, in the order of the ranges
+ *
+ * and every block is
+ *
+ *   records : sorted by term, every record being
+ *             uint32 term_length | uint32 documents_count | term (padded to 4 bytes) |
+ *             int32 last_documents[packs] | uint32 pack_offsets[packs] (from the end of pack_offsets) |
+ *             packs (padded to 4 bytes)
+ *   padding : to 8 bytes
+ *   table   : uint64 record_offsets[terms] (from the start of the block) | uint64 terms
+ *
+ * The postings are sorted by document ID and cut into packs of INDEX_PACK_SIZE postings, every pack being
+ *
+ *   uint8 document_bits | uint8 count_bits | (docID - previous docID - 1) x document_bits | count x count_bits
+ *
+ * with the bits of every value stored from the lowest one, starting at the lowest bit of the first byte.
+ * last_documents lets a reader skip the packs which are before a document without decoding them.
+ *
+ * The table is at the end, so a block is written while its terms are merged. It also means that
+ * at least 8 bytes follow every record, so the packs are read with 8 bytes loads. */
+#define INDEX_FILE_NAME "index.dmr"
+#define PREVIOUS_INDEX_FILE_NAME "index.dmr.old" /* The index of the previous run, while the key ranges which didn't change are copied */
+#define INDEX_MAGIC "DMRIDX2"
+#define INDEX_MAGIC_SIZE 8
+#define INDEX_PACK_SIZE 128
+
+/*******************************************
+ *                TYPES
+ ******************************************/
+
+/* struct used by a worker to write the block of its key range. The block is written into a file of the worker,
+ * which is copied into the index once the bytes of all the blocks are known. */
+typedef struct IndexWriter_
+{
+    FILE *file;               /* Not owned by the writer */
+    uint64_t length;          /* Bytes of the block written so far */
+    ByteBuffer record;        /* The encoded record */
+    uint64_t *record_offsets;
+    uint64_t terms;
+    uint64_t terms_capacity;
+    int error_code;
+} IndexWriter;
+
+/* struct used to read an index mapped into memory */
+typedef struct IndexReader_
+{
+    const unsigned char *data;
+    size_t size;
+    uint64_t blocks;
+    const uint64_t *block_offsets;
+} IndexReader;
+
+/* struct used to store a term of an index and its packed postings. They point into the index. */
+typedef struct IndexTerm_
+{
+    const char *term;                /* Not NUL terminated */
+    size_t term_length;
+    int documents_count;
+    int packs;
+    const int32_t *last_documents;   /* The last document ID of every pack */
+    const uint32_t *pack_offsets;
+    const unsigned char *packs_data;
+    uint64_t packs_size;             /* Bytes from packs_data to the end of the records of the block */
+} IndexTerm;
+
+/* struct used to read the postings of a term in order, one pack at a time */
+typedef struct IndexPostings_
+{
+    const IndexTerm *term;
+    int pack;                        /* The decoded pack, -1 before the first one */
+    int position;                    /* The next posting of the decoded pack */
+    int length;                      /* Postings of the decoded pack */
+    int32_t documents[INDEX_PACK_SIZE];
+    int32_t counts[INDEX_PACK_SIZE];
+} IndexPostings;
+
+/* struct used to iterate the terms of an index in order, from a given term */
+typedef struct IndexCursor_
+{
+    const IndexReader *reader;
+    uint64_t block;
+    uint64_t record;          /* The next record of the block */
+} IndexCursor;
+
+/* struct used to store the documents found by a query, sorted by ID, with the sum of the counts of the terms.
+ * An IndexDocuments initialized with 0 is empty and valid. */
+typedef struct IndexDocuments_
+{
+    int *documents;
+    int *counts;
+    int length;
+    int capacity;
+} IndexDocuments;
+
+/*******************************************
+ *          FUNCTION DECLARATION
+ ******************************************/
+
+/**
+ * @brief   Function used to encode a record of the index
+ * @param[out] output         - The buffer in which the record is appended
+ * @param[in] term            - The term (not NUL terminated)
+ * @param[in] term_length     - The term length
+ * @param[in] documents       - Document IDs, sorted and different
+ * @param[in] counts          - Counts
+ * @param[in] documents_count - Number of postings
+ * @return  0 for success or -1 in case of error
+ **/
+int index_encode_record(ByteBuffer *output, const char *term, size_t term_length, const int *documents, const int *counts, int documents_count);
+
+/**
+ * @brief   Function used to compute the bytes of a block of the index
+ * @param[in] terms        - Number of terms of the block
+ * @param[in] records_size - Bytes of the records of the block
+ * @return  The bytes of the block
+ **/
+uint64_t index_block_size(uint64_t terms, uint64_t records_size);
+
+/**
+ * @brief   Function used to encode the header of the index
+ * @param[out] output       - The buffer in which the header is appended
+ * @param[in] block_lengths - The bytes of every block
+ * @param[in] blocks        - Number of blocks
+ * @return  0 for success or -1 in case of error
+ **/
+int index_encode_header(ByteBuffer *output, const uint64_t *block_lengths, int blocks);
+
+/**
+ * @brief   Function used to compute the bytes of the header of the index
+ * @param[in] blocks - Number of blocks
+ * @return  The bytes of the header
+ **/
+uint64_t index_header_size(int blocks);
+
+/**
+ * @brief   Function used to start writing a block of the index
+ * @param[out] writer - The writer
+ * @param[in] file    - The file in which the block is written
+ * @return  void
+ **/
+void index_writer_begin(IndexWriter *writer, FILE *file);
+
+/**
+ * @brief   Function used to write the next term of a block. The terms must be added in order.
+ * @param[in] writer          - The writer
+ * @param[in] term            - The term (not NUL terminated)
+ * @param[in] term_length     - The term length
+ * @param[in] documents       - Document IDs, sorted and different
+ * @param[in] counts          - Counts
+ * @param[in] documents_count - Number of postings
+ * @return  0 for success or -1 in case of error
+ **/
+int index_writer_add(IndexWriter *writer, const char *term, size_t term_length, const int *documents, const int *counts, int documents_count);
+
+/**
+ * @brief   Function used to write the table of a block and to free the writer
+ * @param[in] writer  - The writer
+ * @param[out] length - The bytes of the block
+ * @return  0 for success or -1 in case of error
+ **/
+int index_writer_end(IndexWriter *writer, uint64_t *length);
+
+/**
+ * @brief   Function used to map an index into memory
+ * @param[out] reader - The reader
+ * @param[in] path    - The index path
+ * @return  0 for success or -1 in case of error
+ **/
+int index_reader_open(IndexReader *reader, const char *path);
+
+/**
+ * @brief   Function used to unmap an index
+ * @param[in] reader - The reader
+ * @return  void
+ **/
+void index_reader_close(IndexReader *reader);
+
+/**
+ * @brief   Function used to find a term into an index
+ * @param[in] reader      - The reader
+ * @param[in] term        - The term (it doesn't have to be NUL terminated)
+ * @param[in] term_length - The term length
+ * @param[out] found      - The term and its postings
+ * @return  1 if the term was found, 0 otherwise
+ **/
+int index_reader_find(const IndexReader *reader, const char *term, size_t term_length, IndexTerm *found);
+
+/**
+ * @brief   Function used to place a cursor on the first term which is not smaller than a given one
+ * @param[out] cursor     - The cursor
+ * @param[in] reader      - The reader
+ * @param[in] term        - The term (it doesn't have to be NUL terminated)
+ * @param[in] term_length - The term length
+ * @return  void
+ **/
+void index_cursor_seek(IndexCursor *cursor, const IndexReader *reader, const char *term, size_t term_length);
+
+/**
+ * @brief   Function used to read the next term of a cursor
+ * @param[in] cursor - The cursor
+ * @param[out] term  - The term and its postings
+ * @return  1 if there was a term, 0 at the end of the index
+ **/
+int index_cursor_next(IndexCursor *cursor, IndexTerm *term);
+
+/**
+ * @brief   Function used to decode all the postings of a term
+ * @param[in] term        - The term
+ * @param[out] documents  - term->documents_count document IDs
+ * @param[out] counts     - term->documents_count counts
+ * @return  void
+ **/
+void index_decode_postings(const IndexTerm *term, int *documents, int *counts);
+
+/**
+ * @brief   Function used to start reading the postings of a term
+ * @param[out] postings - The postings
+ * @param[in] term      - The term, which must stay valid while the postings are read
+ * @return  void
+ **/
+void index_postings_begin(IndexPostings *postings, const IndexTerm *term);
+
+/**
+ * @brief   Function used to move to the first posting whose document ID is not smaller than a given one.
+ *          Only the pack of that posting is decoded. The postings must be sought in increasing order.
+ * @param[in] postings     - The postings
+ * @param[in] document_id  - The document ID
+ * @param[out] found_id    - The document ID of the posting
+ * @param[out] count       - The count of the posting
+ * @return  1 if there is such a posting, 0 otherwise
+ **/
+int index_postings_seek(IndexPostings *postings, int document_id, int *found_id, int *count);
+
+/**
+ * @brief   Function used to find the first element of a sorted list which is not smaller than a value,
+ *          with an exponential search from a given position
+ * @param[in] list   - The sorted list
+ * @param[in] length - The list length
+ * @param[in] from   - The position from which the search starts
+ * @param[in] value  - The value
+ * @return  The position or length if all the elements are smaller
+ **/
+int index_gallop(const int32_t *list, int length, int from, int value);
+
+/**
+ * @brief   Function used to find the documents which have all the terms (AND) or any of them (OR)
+ * @param[in] reader      - The reader
+ * @param[in] terms       - The terms (NUL terminated)
+ * @param[in] terms_count - Number of terms
+ * @param[in] all_terms   - 1 for AND, 0 for OR
+ * @param[out] result     - The documents. The previous ones are removed.
+ * @return  0 for success or -1 in case of error
+ **/
+int index_query(const IndexReader *reader, const char **terms, int terms_count, int all_terms, IndexDocuments *result);
+
+/**
+ * @brief   Function used to free the memory of the documents found by a query
+ * @param[in] documents - The documents
+ * @return  void
+ **/
+void index_documents_free(IndexDocuments *documents);
+
+#endif /* INDEX_FILE_H_ */
@@ -0,0 +1,82 @@
+#ifndef JOB_H_
+#define JOB_H_
+
+/*******************************************
+ *                INCLUDES
+ ******************************************/
+#include <stddef.h>    /* size_t                   */
+#include "utils.h"     /* MapTaskItem, ByteBuffer  */
+#include "tokenizer.h" /* WordCallback             */
+
+/*******************************************
+ *                DEFINES
+ ******************************************/
+#define DEFAULT_JOB_NAME "index"
+#define JOB_NAME_SIZE 32 /* Bytes of a job name, including the '\0' */
+#define NGRAM_SIZE 2     /* Words of an n-gram of the ngram job */
+
+/*******************************************
+ *                TYPES
+ ******************************************/
+
+/**
+ * @brief   Function called by a worker to map a byte range of a file durring map phase.
+ *          Every key found is given to emit, which counts it once for the document of the range.
+ *          The range owns the keys which start inside it, like a split, so consecutive ranges map every key once.
+ * @param[in] item           - The byte range of the file and its document ID
+ * @param[in] emit           - Function called for every key. It is called from several threads at once.
+ * @param[in] contexts       - Context given to emit, one for every thread
+ * @param[in] contexts_count - Number of contexts
+ * @return  0 for success or -1 in case of error
+ **/
+typedef int (*JobMap)(const MapTaskItem *item, WordCallback emit, void **contexts, int contexts_count);
+
+/**
+ * @brief   Function called by a worker to fold the postings of a key of a map task, before they leave the task
+ *          (into its run, a spilled run or the MPI shuffle). It can't add postings.
+ * @param[in,out] documents   - The document IDs
+ * @param[in,out] counts      - The counts
+ * @param[in] postings_length - Number of postings
+ * @return  The new number of postings
+ **/
+typedef int (*JobCombine)(int *documents, int *counts, int postings_length);
+
+/**
+ * @brief   Function called by a worker to reduce the merged postings of a key into a line of the result
+ * @param[in] key             - The key (not NUL terminated)
+ * @param[in] key_length      - The key length
+ * @param[in] documents       - The document IDs, sorted
+ * @param[in] counts          - The counts
+ * @param[in] postings_length - Number of postings
+ * @param[out] line           - The buffer in which the line is appended
+ * @return  0 for success or -1 in case of error
+ **/
+typedef int (*JobReduce)(const char *key, size_t key_length, const int *documents, const int *counts, int postings_length, ByteBuffer *line);
+
+/* struct used to describe a job run by the workers.
+ * The engine keeps the map output as <key, {docID : count}[]> postings, partitions the keys into sorted key ranges,
+ * merges them and writes the result, the index and the manifest. A job only chooses the keys of a document
+ * and how the postings of a key become a line of the result. The keys are sorted and partitioned by their bytes. */
+struct Job_
+{
+    const char *name;
+    JobMap map;
+    JobCombine combine; /* NULL to keep a posting for every document */
+    JobReduce reduce;
+};
+
+/*******************************************
+ *          FUNCTION DECLARATION
+ ******************************************/
+
+/**
+ * @brief   Function used to find a built-in job by name:
+ *          "index"     - the inverted index of the words, the postings of every document
+ *          "wordcount" - the number of occurrences of every word
+ *          "ngram"     - the number of occurrences of every NGRAM_SIZE consecutive words
+ * @param[in] name - The job name
+ * @return  The job or NULL if there is no job with this name
+ **/
+const Job *job_find(const char *name);
+
+#endif /* JOB_H_ */
@@ -0,0 +1,71 @@
+#ifndef LOGGER_H_
+#define LOGGER_H_
+
+/*******************************************
+ *                INCLUDES
+ ******************************************/
+#include <stdio.h> /* FILE */
+
+/*******************************************
+ *                DEFINES
+ ******************************************/
+
+/* Severity levels. A message is logged only if its level is <= the configured one. */
+#define LOG_ERROR 0
+#define LOG_INFO 1
+#define LOG_DEBUG 2
+
+/* Messages above this level are removed at compile time (e.g. -DLOG_COMPILE_LEVEL=LOG_INFO) */
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_DEBUG
+#endif
+
+/* Environment variable used to configure the level at runtime: error, info or debug */
+#define LOG_LEVEL_ENV "DMR_LOG_LEVEL"
+
+/**
+ * @brief   Macro called to log a message with a severity level.
+ *          The errors are printed to stderr, the rest to stdout. After logger_init()
+ *          the message is also written into the log file of the current rank.
+ * @param[in] level  - The severity level of the message (LOG_ERROR, LOG_INFO, LOG_DEBUG)
+ * @param[in] format - The format of the message
+ * @param[in] ...    - Variable length parameters list
+ **/
+#define log_message(level, ...)                     \
+    do                                              \
+    {                                               \
+        if ((level) <= LOG_COMPILE_LEVEL)           \
+        {                                           \
+            logger_write((level), __VA_ARGS__);     \
+        }                                           \
+    } while (0)
+
+/*******************************************
+ *          FUNCTION DECLARATION
+ ******************************************/
+
+/**
+ * @brief   Function called to start the logger of the current rank.
+ *          The messages are buffered into memory and a background thread
+ *          flushes them into log<rank>.txt.
+ * @param[in] rank - The current process rank
+ * @return  0 for success or -1 in case of error (the messages are printed only to the console)
+ **/
+int logger_init(const int rank);
+
+/**
+ * @brief   Function called to flush the buffered messages and stop the logger
+ * @return  void
+ **/
+void logger_shutdown(void);
+
+/**
+ * @brief   Function called to log a message. Use the log_message() macro instead.
+ * @param[in] level  - The severity level of the message
+ * @param[in] format - The format of the message
+ * @param[in] ...    - Variable length parameters list
+ * @return  void
+ **/
+void logger_write(const int level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+#endif /* LOGGER_H_ */
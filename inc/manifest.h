@@ -0,0 +1,188 @@
+#ifndef MANIFEST_H_
+#define MANIFEST_H_
+
+/*******************************************
+ *                INCLUDES
+ ******************************************/
+#include <stdio.h>  /* FILE     */
+#include <stdint.h> /* uint64_t */
+#include "utils.h"  /* KeySplits, MAX_PATH */
+#include "job.h"    /* JOB_NAME_SIZE */
+
+/*******************************************
+ *                DEFINES
+ ******************************************/
+
+/* The manifest describes the output directory of the previous run, so that the next one maps only the changed files:
+ *
+ *   DMR-MANIFEST 5
+ *   job <name>
+ *   workers <partitions>
+ *   next <next_task_id> <next_document_id>
+ *   split <hex key>                                          (partitions - 1 lines)
+ *   partition <result bytes> <index bytes>                   (partitions lines, in result order)
+ *   file <document_id> <first_task> <last_task> <size> <mtime> <has_hash> <hash> <path>
+ *
+ * The postings of a file are in the runs of the tasks [first_task, last_task]. A packed task holds several files.
+ * has_hash is 0 if a worker which mapped the file failed to hash its range, then the file is mapped again when it is touched. */
+#define MANIFEST_FILE_NAME "manifest.txt"
+#define MANIFEST_HEADER "DMR-MANIFEST 5"
+
+/* The journal records what a job commits before its manifest is saved, so that a job which didn't finish is resumed:
+ *
+ *   DMR-JOURNAL 3
+ *   job <name>
+ *   file <document_id> <first_task> <last_task> <size> <mtime> <has_hash> <hash> <path>   (a file whose runs are all committed)
+ *   workers <partitions>                                     (once the map phase is over)
+ *   split <hex key>                                          (partitions - 1 lines)
+ *
+ * It is only appended to. A restarted job appends to the same journal, so a later line of a file replaces the earlier
+ * ones. It is removed when the manifest of a job is saved. The journal of another job is not resumed. */
+#define JOURNAL_FILE_NAME "journal.txt"
+#define JOURNAL_HEADER "DMR-JOURNAL 3"
+
+/*******************************************
+ *                TYPES
+ ******************************************/
+
+/* struct used to store what the manifest knows about an input file */
+typedef struct ManifestFile_
+{
+    int document_id;
+    int first_task;          /* INVALID_TASK_ID untill the file is sent in a task */
+    int last_task;
+    uint64_t size;
+    int64_t mtime;           /* Nanoseconds */
+    uint64_t hash;           /* Hash of the content (see manifest_hash_file()), set when the file is mapped */
+    int has_hash;            /* 0 if the hash is unknown */
+    char path[MAX_PATH];
+} ManifestFile;
+
+/* struct used to store a manifest. A Manifest initialized with 0 is empty and valid. */
+typedef struct Manifest_
+{
+    char job[JOB_NAME_SIZE];     /* The job which wrote the output directory */
+    KeySplits splits;            /* The key ranges of the result, partitions_count is 0 if there is no result */
+    uint64_t *partition_lengths; /* Bytes of every key range in the result file */
+    uint64_t *index_lengths;     /* Bytes of every key range in the index */
+    int next_task_id;
+    int next_document_id;
+    ManifestFile *files;
+    int files_length;
+    int files_capacity;
+} Manifest;
+
+/*******************************************
+ *          FUNCTION DECLARATION
+ ******************************************/
+
+/**
+ * @brief   Function used to read a manifest
+ * @param[out] manifest - The manifest. It is empty if the function failed.
+ * @param[in] path      - The manifest path
+ * @return  0 for success or -1 in case of error (a missing manifest is an error too)
+ **/
+int manifest_load(Manifest *manifest, const char *path);
+
+/**
+ * @brief   Function used to write a manifest. It is written into a temporary file which replaces the previous one.
+ * @param[in] manifest - The manifest
+ * @param[in] path     - The manifest path
+ * @return  0 for success or -1 in case of error
+ **/
+int manifest_save(const Manifest *manifest, const char *path);
+
+/**
+ * @brief   Function used to add the files and the key ranges of a journal to a manifest.
+ *          A file of the journal replaces the one of the manifest. The key ranges are taken only if the manifest
+ *          doesn't have its own and they have partitions_count partitions.
+ * @param[in,out] manifest     - The manifest
+ * @param[in] path             - The journal path
+ * @param[in] partitions_count - The number of partitions of the current job
+ * @param[in] job              - The name of the current job
+ * @return  0 for success or -1 in case of error (a missing journal or the journal of another job is an error too)
+ **/
+int manifest_load_journal(Manifest *manifest, const char *path, const int partitions_count, const char *job);
+
+/**
+ * @brief   Function used to open a journal to append to it. A new journal gets its header and the job name.
+ * @param[out] journal - The journal
+ * @param[in] path     - The journal path
+ * @param[in] job      - The name of the current job
+ * @return  0 for success or -1 in case of error
+ **/
+int manifest_journal_open(FILE **journal, const char *path, const char *job);
+
+/**
+ * @brief   Function used to record into a journal a file whose runs are all committed
+ * @param[in] journal - The journal
+ * @param[in] file    - The file
+ * @return  0 for success or -1 in case of error
+ **/
+int manifest_journal_add_file(FILE *journal, const ManifestFile *file);
+
+/**
+ * @brief   Function used to record into a journal the key ranges of the job
+ * @param[in] journal - The journal
+ * @param[in] splits  - The key ranges
+ * @return  0 for success or -1 in case of error
+ **/
+int manifest_journal_add_splits(FILE *journal, const KeySplits *splits);
+
+/**
+ * @brief   Function used to write the recorded lines of a journal to the disk
+ * @param[in] journal - The journal
+ * @return  0 for success or -1 in case of error
+ **/
+int manifest_journal_sync(FILE *journal);
+
+/**
+ * @brief   Function used to add a file to a manifest
+ * @param[in] manifest - The manifest
+ * @param[in] file     - The file, which is copied
+ * @return  0 for success or -1 in case of error
+ **/
+int manifest_add_file(Manifest *manifest, const ManifestFile *file);
+
+/**
+ * @brief   Function used to sort the files of a manifest by path, for manifest_find_file()
+ * @param[in] manifest - The manifest
+ * @return  void
+ **/
+void manifest_sort_files(Manifest *manifest);
+
+/**
+ * @brief   Function used to find a file into a manifest sorted with manifest_sort_files()
+ * @param[in] manifest - The manifest
+ * @param[in] path     - The file path
+ * @return  The file or NULL if it is missing
+ **/
+ManifestFile *manifest_find_file(const Manifest *manifest, const char *path);
+
+/**
+ * @brief   Function used to free the memory of a manifest
+ * @param[in] manifest - The manifest
+ * @return  void
+ **/
+void manifest_free(Manifest *manifest);
+
+/**
+ * @brief   Function used to hash the content of a file
+ * @param[in] path  - The file path
+ * @param[out] hash - The hash
+ * @return  0 for success or -1 in case of error
+ **/
+int manifest_hash_file(const char *path, uint64_t *hash);
+
+/**
+ * @brief   Function used to hash a byte range of a file. The hashes of the ranges which cover a file once
+ *          add up (modulo 2^64) to the hash of the file, so the splits of a file are hashed by the workers which map them.
+ * @param[in] path   - The file path
+ * @param[in] offset - Offset of the range
+ * @param[in] length - Length of the range (it may go past the end of the file)
+ * @param[out] hash  - The hash of the range
+ * @return  0 for success or -1 in case of error
+ **/
+int manifest_hash_range(const char *path, uint64_t offset, uint64_t length, uint64_t *hash);
+
+#endif /* MANIFEST_H_ */
@@ -1,16 +1,21 @@
 #ifndef MASTER_H_
 #define MASTER_H_
 
+/*******************************************
+ *                INCLUDES
+ ******************************************/
+#include "utils.h" /* Options */
+
 /*******************************************
  *          FUNCTION DECLARATION
  ******************************************/
 
 /**
  * @brief Function called by master to schedule the workers
- * @param[in] input_dir_path - Input directory path
+ * @param[in] options - The command line options
  * @param[in] number_of_workers - Number of workers
  * @return void
  **/
-void do_master(const char *input_dir_path, const int number_of_workers);
+void do_master(const Options *options, const int number_of_workers);
 
 #endif /* MASTER_H_ */
\ No newline at end of file
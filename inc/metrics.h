@@ -0,0 +1,59 @@
+#ifndef METRICS_H_
+#define METRICS_H_
+
+/*******************************************
+ *                DEFINES
+ ******************************************/
+#define METRICS_FILE_NAME "metrics.json" /* The report written by master into the output directory */
+
+/* The metrics measured by every rank. The timers are in seconds.
+ * The master times its update, map, partition and reduce phases, the reduce including the store. */
+#define METRIC_UPDATE_SECONDS 0
+#define METRIC_MAP_SECONDS 1
+#define METRIC_PARTITION_SECONDS 2
+#define METRIC_SHUFFLE_SECONDS 3       /* Only with the MPI shuffle */
+#define METRIC_REDUCE_SECONDS 4
+#define METRIC_STORE_SECONDS 5
+#define METRIC_JOB_SECONDS 6
+#define METRIC_RECV_BLOCKED_SECONDS 7  /* Time spent blocked waiting for a message of another rank */
+#define METRIC_BYTES_READ 8            /* Bytes of the input files tokenized */
+#define METRIC_TOKENS 9
+#define METRIC_UNIQUE_TERMS 10         /* Terms merged in the reduce phase */
+#define METRIC_DICTIONARY_PROBES 11    /* Slots of the dictionary key tables looked at */
+#define METRIC_BYTES_SHUFFLED 12       /* Bytes sent to the other workers in the MPI shuffle */
+#define METRIC_BACKUP_TASKS 13         /* Backup copies of slow map tasks sent by master */
+#define METRIC_CANCELLED_TASKS 14      /* Copies of map tasks dropped by a worker, because the other copy was done first */
+#define METRICS_COUNT 15
+#define METRIC_FIRST_COUNTER METRIC_BYTES_READ /* The metrics from here on are counters, the ones before are timers */
+
+/*******************************************
+ *          FUNCTION DECLARATION
+ ******************************************/
+
+/**
+ * @brief   Function used to add a value to a metric of the current rank. Not thread safe.
+ * @param[in] metric - The metric (METRIC_*)
+ * @param[in] value  - The value
+ * @return  void
+ **/
+void metrics_add(const int metric, double value);
+
+/**
+ * @brief   Function used to add the time elapsed since a moment to a timer of the current rank.
+ *          The time is also recorded as a span of the trace.
+ * @param[in] metric - The timer (METRIC_*_SECONDS)
+ * @param[in] start  - The moment, from MPI_Wtime()
+ * @return  The current time, so the next timer can start from it
+ **/
+double metrics_add_time(const int metric, double start);
+
+/**
+ * @brief   Function called by all the ranks at the end of the job to gather their metrics to master.
+ *          The master writes the min/avg/max of the workers and its own metrics as JSON into the output directory.
+ * @param[in] rank            - The current process rank
+ * @param[in] output_dir_path - Path of the output directory
+ * @return  0 for success or -1 in case of error
+ **/
+int metrics_report(const int rank, const char *output_dir_path);
+
+#endif /* METRICS_H_ */
@@ -0,0 +1,259 @@
+#ifndef RUN_FILE_H_
+#define RUN_FILE_H_
+
+/*******************************************
+ *                INCLUDES
+ ******************************************/
+#include <stdio.h>  /* FILE     */
+#include <stdint.h> /* uint64_t */
+#include "utils.h"  /* ByteBuffer, Dictionary */
+
+/*******************************************
+ *                DEFINES
+ ******************************************/
+
+/* A run is the sorted binary output of a map task:
+ *
+ *   header  : RUN_MAGIC (8 bytes)
+ *   records : sorted by term, every record being
+ *             varint term_length | term | varint postings | postings x (varint zigzag(docID - previous docID) | varint count)
+ *   index   : every RUN_INDEX_INTERVAL-th record: varint term_length | term | varint record_offset
+ *   trailer : uint64 index_offset | uint64 index_entries | uint64 records | RUN_MAGIC
+ *
+ * The index lets the readers seek straight to the first term of their key range.
+ *
+ * A partitioned run file holds one run (segment) for every key range (see KeySplits), followed by
+ *
+ *   table   : uint64 segment_offsets[partitions + 1] | uint64 partitions | PARTITION_MAGIC
+ *
+ * so that a reader maps and reads only the segment it needs. */
+#define RUN_FILE_SUFFIX ".run"
+#define MAP_RUN_FILE_FORMAT "task%d" RUN_FILE_SUFFIX /* The run of a map task */
+#define PARTIAL_RUN_FILE_FORMAT "partial%d_%d" /* The run of a map task while a worker writes it */
+#define SPILL_FILE_FORMAT "spill%d_%d" /* Words spilled by a map task, not a run of the map output */
+#define RUN_MAGIC "DMRRUN2"
+#define RUN_MAGIC_SIZE 8
+#define RUN_INDEX_INTERVAL 64
+#define PARTITION_MAGIC "DMRPART"
+#define PARTITION_MAGIC_SIZE 8
+
+/*******************************************
+ *                TYPES
+ ******************************************/
+
+/* struct used to write a run. The records must be added in term order. */
+typedef struct RunWriter_
+{
+    FILE *file;           /* Not owned by the writer (NULL if the run is written into output) */
+    ByteBuffer *output;   /* Not owned by the writer (NULL if the run is written into file) */
+    ByteBuffer records;   /* Encoded records not yet written into the file */
+    ByteBuffer index;     /* Encoded index entries */
+    uint64_t offset;      /* Offset of the next record in the run */
+    uint64_t records_count;
+    uint64_t index_entries;
+} RunWriter;
+
+/* struct used to read a run from memory (a mapped file or a received buffer) */
+typedef struct RunReader_
+{
+    const unsigned char *data;
+    size_t size;
+    void *mapping;        /* Not NULL if data is inside a mapping owned by the reader */
+    size_t mapped_size;
+    size_t records_end;   /* The offset of the index */
+    size_t position;      /* Offset of the next record */
+    const unsigned char **index_terms;
+    size_t *index_terms_lengths;
+    uint64_t *index_offsets;
+    uint64_t index_entries;
+    uint64_t records_count;
+
+    /* The current record */
+    const char *term;     /* Not NUL terminated */
+    size_t term_length;
+    int *documents;
+    int *counts;
+    int postings_length;
+    int postings_capacity;
+} RunReader;
+
+/* struct used to store a merged posting */
+typedef struct RunPosting_
+{
+    int document_id;
+    int count;
+} RunPosting;
+
+/* struct used to merge several runs (a k-way merge with a binary heap of the runs).
+ * The memory depends on the number of runs and on the postings of a single term. */
+typedef struct RunMerger_
+{
+    RunReader *runs;
+    int runs_length;
+    int runs_capacity;
+    int *heap;            /* Indexes of the runs which have a current record, the smallest term first */
+    int heap_length;
+    const KeySplits *splits;
+    int partition;
+    RunPosting *postings; /* The postings of the current term before they are merged */
+    int postings_capacity;
+    /* The current merged term. The postings are sorted by document ID, the counts of the same document are added. */
+    const char *term;     /* Not NUL terminated, it points into a run */
+    size_t term_length;
+    int *documents;
+    int *counts;
+    int postings_length;
+} RunMerger;
+
+/*******************************************
+ *          FUNCTION DECLARATION
+ ******************************************/
+
+/**
+ * @brief   Function used to start writing a run at the current position of a file
+ * @param[out] writer - The writer
+ * @param[in] file    - The file. It must stay open untill the run is ended
+ * @return  0 for success or -1 in case of error
+ **/
+int run_writer_begin(RunWriter *writer, FILE *file);
+
+/**
+ * @brief   Function used to start writing a run at the end of a memory buffer
+ * @param[out] writer - The writer
+ * @param[in] output  - The buffer. It must stay valid untill the run is ended
+ * @return  0 for success or -1 in case of error
+ **/
+int run_writer_begin_buffer(RunWriter *writer, ByteBuffer *output);
+
+/**
+ * @brief   Function used to add a record to a run. The terms must be added in increasing order.
+ * @param[in] writer          - The writer
+ * @param[in] term            - The term (it doesn't have to be NUL terminated)
+ * @param[in] term_length     - The term length
+ * @param[in] documents       - The document IDs of the postings
+ * @param[in] counts          - The counts of the postings
+ * @param[in] postings_length - Number of postings
+ * @return  0 for success or -1 in case of error
+ **/
+int run_writer_add(RunWriter *writer, const char *term, size_t term_length,
+                   const int *documents, const int *counts, int postings_length);
+
+/**
+ * @brief   Function used to write the index and the trailer of a run
+ * @param[in] writer - The writer
+ * @return  0 for success or -1 in case of error
+ **/
+int run_writer_end(RunWriter *writer);
+
+/**
+ * @brief   Function used to write all the terms of a Dictionary as a partitioned run file.
+ *          Every term goes into the segment given by term_partition(), in term order.
+ * @param[in] dic              - The dictionary (< termk, {docIDx : countk} [] >)
+ * @param[in] file_path        - Path of the run file
+ * @param[in] splits           - The split points of the partitions (reducers)
+ * @return  0 for success or -1 in case of error
+ **/
+int write_partitioned_run(Dictionary *dic, const char *file_path, const KeySplits *splits);
+
+/**
+ * @brief   Function used to encode all the terms of a Dictionary as one run for every partition, in memory.
+ *          The runs are appended to output one after another, in partition order.
+ * @param[in] dic              - The dictionary (< termk, {docIDx : countk} [] >)
+ * @param[out] output          - The buffer in which the runs are appended
+ * @param[in] splits           - The split points of the partitions (reducers)
+ * @param[out] segment_offsets - splits->partitions_count + 1 offsets of the runs into output
+ * @return  0 for success or -1 in case of error
+ **/
+int encode_partitioned_runs(Dictionary *dic, ByteBuffer *output, const KeySplits *splits, uint64_t *segment_offsets);
+
+/**
+ * @brief   Function used to open a segment of a partitioned run file. Only the segment is mapped into memory.
+ * @param[out] reader   - The reader
+ * @param[in] file_path - Path of the run file
+ * @param[in] partition - The partition of the segment
+ * @return  0 for success or -1 in case of error
+ **/
+int run_reader_open_partition(RunReader *reader, const char *file_path, int partition);
+
+/**
+ * @brief   Function used to open a run stored into memory
+ * @param[out] reader - The reader
+ * @param[in] data    - The run bytes. They must stay valid untill the reader is closed
+ * @param[in] size    - Number of bytes
+ * @return  0 for success or -1 in case of error
+ **/
+int run_reader_open_buffer(RunReader *reader, const unsigned char *data, size_t size);
+
+/**
+ * @brief   Function used to position the reader before the first record with term >= the given one
+ * @param[in] reader      - The reader
+ * @param[in] term        - The term (it doesn't have to be NUL terminated)
+ * @param[in] term_length - The term length
+ * @return  void
+ **/
+void run_reader_seek(RunReader *reader, const char *term, size_t term_length);
+
+/**
+ * @brief   Function used to read the next record (term, documents, counts, postings_length)
+ * @param[in] reader - The reader
+ * @return  1 if a record was read, 0 at the end of the run or -1 in case of error
+ **/
+int run_reader_next(RunReader *reader);
+
+/**
+ * @brief   Function used to close a reader and free its memory
+ * @param[in] reader - The reader
+ * @return  void
+ **/
+void run_reader_close(RunReader *reader);
+
+/**
+ * @brief   Function used to add a run to a merger
+ * @param[in] merger - The merger (initialized with 0 when it is empty)
+ * @param[in] reader - The run. The merger owns it from now on and closes it.
+ * @return  0 for success or -1 in case of error (the run is closed)
+ **/
+int run_merger_add(RunMerger *merger, RunReader *reader);
+
+/**
+ * @brief   Function used to start (or restart) merging the terms of a key range of all the runs
+ * @param[in] merger    - The merger
+ * @param[in] splits    - The key ranges
+ * @param[in] partition - The key range that is merged
+ * @return  void
+ **/
+void run_merger_begin(RunMerger *merger, const KeySplits *splits, int partition);
+
+/**
+ * @brief   Function used to merge the next term (term, documents, counts, postings_length) in term order
+ * @param[in] merger - The merger
+ * @return  1 if a term was merged, 0 at the end of the key range or -1 in case of error
+ **/
+int run_merger_next(RunMerger *merger);
+
+/**
+ * @brief   Function used to merge all the terms of all the runs into a partitioned run file with a single segment
+ * @param[in] merger     - The merger
+ * @param[in] file_path  - Path of the run file
+ * @param[out] histogram - Number of postings of every 2 bytes prefix, which is increased (may be NULL)
+ * @return  0 for success or -1 in case of error
+ **/
+int write_merged_run(RunMerger *merger, const char *file_path, uint64_t *histogram);
+
+/**
+ * @brief   Function used to close all the runs of a merger and free its memory
+ * @param[in] merger - The merger
+ * @return  void
+ **/
+void run_merger_close(RunMerger *merger);
+
+/**
+ * @brief   Function used to remove the files left in a directory by the workers of a job which failed:
+ *          the partial runs and the spilled words
+ * @param[in] dir_path    - The directory
+ * @param[in] worker_rank - The worker whose files are removed, or 0 for the files of all the workers
+ * @return  void
+ **/
+void remove_temporary_runs(const char *dir_path, int worker_rank);
+
+#endif /* RUN_FILE_H_ */
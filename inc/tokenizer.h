@@ -0,0 +1,96 @@
+#ifndef TOKENIZER_H_
+#define TOKENIZER_H_
+
+/*******************************************
+ *                INCLUDES
+ ******************************************/
+#include <stddef.h> /* size_t   */
+#include <stdint.h> /* uint64_t */
+
+/*******************************************
+ *                DEFINES
+ ******************************************/
+
+/* Every byte from this string separates two words. The white spaces are also delimiters. */
+#define WORD_DELIMITER "\xef\xbf\xbd!?.,_-*&()[]{}|/:;~\" \t\n1234567890"
+
+/* Environment variable used to force an implementation: scalar, sse2 or avx2 */
+#define TOKENIZER_ENV "DMR_TOKENIZER"
+
+/* A file is split between threads only in chunks of at least this size */
+#define PARALLEL_CHUNK_MIN_SIZE (1024 * 1024)
+
+/*******************************************
+ *                TYPES
+ ******************************************/
+
+/**
+ * @brief   Function called by the tokenizer for every word found
+ * @param[in] word    - Pointer to the first byte of the word (lower case, not NUL terminated)
+ * @param[in] length  - The word length
+ * @param[in] context - The context given to the tokenizer
+ * @return  0 for success or -1 in case of error
+ **/
+typedef int (*WordCallback)(const char *word, size_t length, void *context);
+
+/*******************************************
+ *          FUNCTION DECLARATION
+ ******************************************/
+
+/**
+ * @brief   Function used to get the name of the implementation selected for the current CPU
+ * @return  "scalar", "sse2" or "avx2"
+ **/
+const char *tokenizer_implementation(void);
+
+/**
+ * @brief   Function used to split a buffer into words. Every word with at least min_word_size bytes
+ *          is given to the callback in lower case. The buffer isn't modified.
+ * @param[in] data            - The buffer
+ * @param[in] size            - The buffer size
+ * @param[in] min_word_size   - The words shorter than this are skipped
+ * @param[in] callback        - Function called for every word
+ * @param[in] context         - Context given to the callback
+ * @return  0 for success or -1 if a callback failed
+ **/
+int tokenize_buffer(const char *data, size_t size, size_t min_word_size, WordCallback callback, void *context);
+
+/**
+ * @brief   Function used to split a file into words. The file is mapped into memory (read only),
+ *          so the words in lower case are given to the callback without being copied.
+ * @param[in] file_path     - Path of the file
+ * @param[in] min_word_size - The words shorter than this are skipped
+ * @param[in] callback      - Function called for every word
+ * @param[in] context       - Context given to the callback
+ * @return  0 for success or -1 in case of error
+ **/
+int tokenize_file(const char *file_path, size_t min_word_size, WordCallback callback, void *context);
+
+/**
+ * @brief   Function used to split a byte range of a file into words on multiple threads (OpenMP).
+ *          The range owns the words which start inside it: the word cut by its start is skipped
+ *          and the word cut by its end is read untill its last byte, so consecutive ranges count every word once.
+ *          The range is cut into up to contexts_count chunks which end at a delimiter, so no word is split.
+ *          The words of the chunk i are given to the callback with contexts[i].
+ * @param[in] file_path      - Path of the file
+ * @param[in] offset         - Offset of the range
+ * @param[in] length         - Length of the range (it may go past the end of the file)
+ * @param[in] min_word_size  - The words shorter than this are skipped
+ * @param[in] callback       - Function called for every word. It is called from several threads at once.
+ * @param[in] contexts       - Context given to the callback for every chunk
+ * @param[in] contexts_count - Maximum number of chunks
+ * @return  0 for success or -1 in case of error
+ **/
+int tokenize_file_range(const char *file_path, uint64_t offset, uint64_t length, size_t min_word_size,
+                        WordCallback callback, void **contexts, int contexts_count);
+
+/**
+ * @brief   Function used to find the first delimiter from a buffer, starting with a given offset
+ * @param[in] data   - The buffer
+ * @param[in] size   - The buffer size
+ * @param[in] offset - The offset from which the search starts
+ * @return  The offset of the delimiter or size if there is none
+ **/
+size_t tokenizer_next_delimiter(const char *data, size_t size, size_t offset);
+
+#endif /* TOKENIZER_H_ */
@@ -0,0 +1,50 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+/*******************************************
+ *                DEFINES
+ ******************************************/
+
+/* The timeline of all the ranks, written by master into the output directory as Chrome trace events.
+ * It can be opened with Perfetto (ui.perfetto.dev) or chrome://tracing. */
+#define TRACE_FILE_NAME "trace.json"
+#define TRACE_MAX_EVENTS (64 * 1024)   /* Events recorded by a rank, the next ones are dropped */
+#define TRACE_CATEGORY_SIZE 16
+#define TRACE_NAME_SIZE 32
+#define TRACE_DETAIL_SIZE 96           /* Longer details (e.g. file paths) keep their end */
+#define TRACE_SYNC_ROUNDS 8            /* Round trips used to measure the clock offset of a worker */
+
+/*******************************************
+ *          FUNCTION DECLARATION
+ ******************************************/
+
+/**
+ * @brief   Function called to start recording the timeline of the current rank.
+ *          Without it, trace_span() records nothing.
+ * @return  0 for success or -1 in case of error
+ **/
+int trace_init(void);
+
+/**
+ * @brief   Function used to record a span of the current rank. It can be called by several threads at once.
+ * @param[in] category - The category (e.g. "phase", "mpi")
+ * @param[in] name     - The span name
+ * @param[in] id       - The ID of the task or document, -1 for none
+ * @param[in] detail   - A detail (e.g. a file path) or NULL
+ * @param[in] begin    - The begin, from MPI_Wtime()
+ * @param[in] end      - The end, from MPI_Wtime()
+ * @return  void
+ **/
+void trace_span(const char *category, const char *name, int id, const char *detail, double begin, double end);
+
+/**
+ * @brief   Function called by all the ranks at the end of the job, when the trace was started, to gather the
+ *          spans to master. The master measures the clock offset of every worker, moves its spans on the
+ *          master's clock and writes them as Chrome trace events into the output directory.
+ * @param[in] rank            - The current process rank
+ * @param[in] output_dir_path - Path of the output directory
+ * @return  0 for success or -1 in case of error
+ **/
+int trace_report(const int rank, const char *output_dir_path);
+
+#endif /* TRACE_H_ */
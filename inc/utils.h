@@ -4,17 +4,31 @@
 /*******************************************
  *                INCLUDES
  ******************************************/
-#include <dirent.h> /* DIR */
+#include <dirent.h> /* DIR      */
+#include <stddef.h> /* size_t   */
+#include <stdint.h> /* uint64_t */
+#include "mpi.h"    /* MPI_File */
 
 /*******************************************
  *                DEFINES
  ******************************************/
 #define TAG_WORK 0
 #define TAG_SLEEP 1
+#define TAG_CANCEL 2 /* The map task sent with it was done by another worker, its copy is dropped */
 
-#define INVALID_FILE "${NOTAFILE}"
+#define INVALID_TASK_ID -1
+#define MAX_TASK_ITEMS 16 /* Maximum number of small files packed into a map task */
+#define DEFAULT_SPLIT_SIZE (64 * 1024 * 1024) /* Bytes of input in a map task */
+#define MAX_BATCH_TASKS 16 /* Maximum number of map tasks sent to a worker in a message */
 #define MAX_PATH 257
 
+#define DOCUMENTS_FILE_NAME "documents.txt"
+#define RESULT_FILE_NAME "result.txt"
+#define PREVIOUS_RESULT_FILE_NAME "result.txt.old" /* The result of the previous run, while the key ranges which didn't change are copied */
+#define PREFIX_HISTOGRAM_SIZE (1 << 16) /* Number of 2 bytes prefixes */
+#define SPLIT_KEY_SIZE 4 /* Bytes of a split key, including the '\0' */
+#define ORDERED_FILE_CHUNK_SIZE (16 * 1024 * 1024) /* Bytes of a collective write of an OrderedFile */
+
 /*******************************************
  *                TYPES
  ******************************************/
@@ -22,37 +36,160 @@
 /* typedef for struct dirent used as a File */
 typedef struct dirent File;
 
-/* struct used to store pair of <key, {value:count}[]> */
+/* A job run by the workers (defined in job.h) */
+typedef struct Job_ Job;
+
+/* struct used to store the command line options */
+typedef struct Options_
+{
+    const char *input_dir_path;
+    const char *output_dir_path;
+    int text_map_output; /* Also write the map output as text (map<rank>.txt), for debugging */
+    int memory_shuffle;  /* Exchange the map output with MPI instead of the output directory */
+    uint64_t split_size; /* Bytes of input in a map task */
+    uint64_t memory_budget;       /* Bytes of words a map task keeps in memory before it spills them, 0 for no limit */
+    const char *scratch_dir_path; /* Directory of the spilled words */
+    int trace;                    /* Record the timeline of the ranks into the output directory */
+    const Job *job;               /* The job run by the workers */
+} Options;
+
+/* struct used to store the split points of the reduce partitions (the key ranges of the reducers).
+ * The partition p holds the terms in [split p - 1, split p), the first and last ones are unbounded. */
+typedef struct KeySplits_
+{
+    int partitions_count;
+    char *splits; /* partitions_count - 1 NUL terminated keys, every one of SPLIT_KEY_SIZE bytes */
+} KeySplits;
+
+/* struct used to store a byte range of an input file, part of a map task.
+ * The master gives every input file a compact document ID, which is the only
+ * thing stored in the postings. The ID -> path table is DOCUMENTS_FILE_NAME. */
+typedef struct MapTaskItem_
+{
+    int document_id;
+    uint64_t offset;
+    uint64_t length;
+    char file_path[MAX_PATH];
+} MapTaskItem;
+
+/* struct used by master to assign work to a worker durring map phase.
+ * A task is either a split of a big file or several small files packed together. */
+typedef struct MapTask_
+{
+    int task_id;
+    int items_length;
+    MapTaskItem items[MAX_TASK_ITEMS];
+} MapTask;
+
+/* struct used by a worker to send master the hash of the range of a file mapped by a task (see manifest_hash_range()).
+ * The workers hash the ranges while they map them, master adds up the hashes of the ranges of every file. */
+typedef struct FileHash_
+{
+    int task_id;
+    int document_id;
+    uint64_t length; /* Bytes of the range which were hashed */
+    uint64_t hash;
+} FileHash;
+
+/* struct used by a worker to ask master for the next batch of map tasks.
+ * The timing of the tasks done since the previous request sizes the next batch.
+ * A worker asks when it starts its last task, so it does at most MAX_BATCH_TASKS tasks between two requests. */
+typedef struct TaskRequest_
+{
+    int tasks_done;
+    double tasks_seconds;
+    int idle;                            /* 0 if a task is still running, 1 if the worker waits for the batch */
+    int finished_tasks[MAX_BATCH_TASKS]; /* The IDs of the tasks done, used by master to back up the slow tasks */
+    int tasks_failed;                    /* Number of tasks whose run couldn't be written, they are not committed */
+    int hashes_length;
+    FileHash file_hashes[MAX_BATCH_TASKS * MAX_TASK_ITEMS]; /* The ranges mapped by the tasks done, for the manifest */
+} TaskRequest;
+
+/* struct used by master to assign a key range to a worker durring reduce phase.
+ * A key range without changes since the previous run is copied from the previous result and index.
+ * The worker sends it back with the lengths of its result and of its index block when the reduce is done,
+ * or with the failed flag set, so that master doesn't save the manifest of an incomplete output. */
+typedef struct ReduceTask_
+{
+    int partition;
+    int copy_previous;     /* The result is copied from PREVIOUS_RESULT_FILE_NAME */
+    uint64_t offset;       /* Offset of the key range in the previous result */
+    uint64_t length;       /* Bytes of the key range */
+    uint64_t index_offset; /* Offset of the key range in the previous index */
+    uint64_t index_length; /* Bytes of the block of the key range in the index */
+    int failed;            /* The worker failed to read or merge its runs */
+} ReduceTask;
+
+/* struct used to store a growable array of bytes.
+ * A ByteBuffer initialized with 0 is empty and valid. */
+typedef struct ByteBuffer_
+{
+    unsigned char *data;
+    size_t length;
+    size_t capacity;
+} ByteBuffer;
+
+/* struct used by all the processes to write a file together, the data of every process after the one of the lower ranks.
+ * The data is written in chunks of ORDERED_FILE_CHUNK_SIZE bytes with collective writes. */
+typedef struct OrderedFile_
+{
+    MPI_File file;
+    uint64_t offset;      /* Offset of the next chunk of this process */
+    uint64_t length;      /* Bytes of this process not yet written */
+    uint64_t rounds;      /* Number of collective writes, the same for all the processes */
+    uint64_t rounds_done;
+    ByteBuffer buffer;    /* Bytes of this process not yet written */
+    int error_code;
+} OrderedFile;
+
+/* Chunk of memory from which an Arena allocates (defined in utils.c) */
+typedef struct ArenaChunk_ ArenaChunk;
+
+/* struct used as a bump allocator. All the memory is released at once by arena_release().
+ * An Arena initialized with 0 is empty and valid. */
+typedef struct Arena_
+{
+    ArenaChunk *chunks;
+    size_t allocated_bytes;
+} Arena;
+
+/* struct used to store pair of <key, {docID:count}[]>
+ * The key is a NUL terminated copy owned by the arena of the Dictionary.
+ * When values_length is big enough, the document IDs are indexed by an open addressing hash table
+ * (values_slots) which stores value_index + 1 for every used slot and 0 for the empty ones. */
 typedef struct Pair_
 {
     char *key;
-    char **values;
+    unsigned int key_hash;
+    unsigned int key_length;
+    int *documents;
     int *counts;
     int values_length;
+    int values_capacity;
+    int *values_slots;
+    int values_slots_length;
 } Pair;
 
-/* struct used to store an array of pairs */
+/* struct used to store an array of pairs
+ * The keys are indexed by an open addressing hash table (slots)
+ * which stores element_index + 1 for every used slot and 0 for the empty ones.
+ * The elements array keeps the insertion order, so iterating it is deterministic.
+ * A key is copied into the arena when its Pair is added and all the memory is owned by the arena. */
 typedef struct Dictionary_
 {
     Pair *elements;
     int elements_length;
+    int elements_capacity;
+    int *slots;
+    int slots_length;
+    uint64_t probes;  /* Slots of the key tables looked at, for the metrics */
+    Arena arena;
 } Dictionary;
 
 /*******************************************
  *          FUNCTION DECLARATION
  ******************************************/
 
-/**
- * @brief   Function called to log a message
- *          to the provided stream (stdio, stderr)
- *          and into log.txt file
- * @param[in] stream - The stream in which the message will be printed
- * @param[in] format - The format of the message
- * @param[in] ...    - Variable length parameters list
- * @return  void
- **/
-void log_message(FILE *stream, const char *format, ...);
-
 /**
  * @brief   Function called to retrieve the next 'File' found in a directory given as argument
  * @param[in] input_dir - The directory structure from which the file will be retrieved
@@ -63,43 +200,176 @@ void log_message(FILE *stream, const char *format, ...);
 File *get_next_file_from_dir(DIR *input_dir);
 
 /**
- * @brief   The implementation for built-in strlwr funtion
- * @param[in] str - The string that will be processed
- * @return  The input pointer.
- * @note    The input string is modified and the retrieved pointer to string is returned.
- *          Do not try to free it.
+ * @brief   Function used to build the path of a file from a directory
+ * @param[out] path    - Buffer of MAX_PATH bytes in which the path is stored
+ * @param[in] dir_path - The directory path (with or without the trailing '/')
+ * @param[in] name     - The file name
+ * @return  void
+ **/
+void utils_join_path(char *path, const char *dir_path, const char *name);
+
+/**
+ * @brief   Function used by all the processes to open a file which they write together, one after another in rank order.
+ *          The offsets are computed with MPI_Exscan from the data lengths and the whole file is allocated.
+ *          It is collective over MPI_COMM_WORLD.
+ * @param[out] file  - The file
+ * @param[in] path   - The file path. A previous file is overwritten.
+ * @param[in] length - Number of bytes this process writes
+ * @return  0 for success or -1 in case of error
+ * @note    The file must be closed with ordered_file_close() even if the function failed.
+ **/
+int ordered_file_open(OrderedFile *file, const char *path, uint64_t length);
+
+/**
+ * @brief   Function used to write the next bytes of this process into an OrderedFile.
+ *          Every ORDERED_FILE_CHUNK_SIZE bytes are written with a collective write.
+ * @param[in] file   - The file
+ * @param[in] data   - The data
+ * @param[in] length - The data length
+ * @return  0 for success or -1 in case of error (more bytes than the ones given to ordered_file_open() is an error)
+ **/
+int ordered_file_write(OrderedFile *file, const void *data, size_t length);
+
+/**
+ * @brief   Function used to write the last bytes of this process and to close an OrderedFile.
+ *          It is collective over MPI_COMM_WORLD.
+ * @param[in] file - The file
+ * @return  0 for success or -1 in case of error
+ **/
+int ordered_file_close(OrderedFile *file);
+
+/**
+ * @brief   Function used to compare two terms byte by byte (as unsigned chars)
+ * @param[in] first         - The first term
+ * @param[in] first_length  - The first term length
+ * @param[in] second        - The second term
+ * @param[in] second_length - The second term length
+ * @return  < 0, 0 or > 0 if the first term is smaller, equal or greater than the second one
+ **/
+int compare_terms(const char *first, size_t first_length, const char *second, size_t second_length);
+
+/**
+ * @brief   Function used to get the 2 bytes prefix of a term. The prefixes keep the order of the terms.
+ * @param[in] term        - The term (it doesn't have to be NUL terminated)
+ * @param[in] term_length - The term length
+ * @return  The prefix, in range [0, PREFIX_HISTOGRAM_SIZE)
+ **/
+int term_prefix(const char *term, size_t term_length);
+
+/**
+ * @brief   Function used to add two counts of a posting. The sum saturates at INT_MAX, like the counts of the counting jobs.
+ * @param[in] first  - The first count, not negative
+ * @param[in] second - The second count, not negative
+ * @return  The sum, at most INT_MAX
+ **/
+int add_counts(int first, int second);
+
+/**
+ * @brief   Function used to get the partition (the reducer) of a term
+ * @param[in] splits      - The split points of the partitions
+ * @param[in] term        - The term (it doesn't have to be NUL terminated)
+ * @param[in] term_length - The term length
+ * @return  The partition, in range [0, splits->partitions_count)
+ **/
+int term_partition(const KeySplits *splits, const char *term, size_t term_length);
+
+/**
+ * @brief   Function used to compute balanced split points from a histogram of the terms' prefixes
+ * @param[in] histogram - PREFIX_HISTOGRAM_SIZE weights (the number of postings of every prefix)
+ * @param[out] splits   - The split points. splits->partitions_count must be set and splits->splits allocated
+ * @return  void
+ **/
+void compute_key_splits(const uint64_t *histogram, KeySplits *splits);
+
+/**
+ * @brief   Function used to append bytes to a ByteBuffer. The buffer grows geometrically.
+ * @param[in] buffer - The buffer
+ * @param[in] data   - The bytes
+ * @param[in] length - Number of bytes
+ * @return  0 for success or -1 in case of error
+ **/
+int byte_buffer_append(ByteBuffer *buffer, const void *data, size_t length);
+
+/**
+ * @brief   Function used to append an unsigned integer to a ByteBuffer as a varint (LEB128)
+ * @param[in] buffer - The buffer
+ * @param[in] value  - The value
+ * @return  0 for success or -1 in case of error
+ **/
+int byte_buffer_append_varint(ByteBuffer *buffer, uint64_t value);
+
+/**
+ * @brief   Function used to free the memory of a ByteBuffer
+ * @param[in] buffer - The buffer
+ * @return  void
  **/
-char *utils_strlwr(char *str);
+void byte_buffer_free(ByteBuffer *buffer);
 
 /**
- * @brief   Function used to insert a new pair file_name, word into a Dictionary.
- *          This function consider the dictionary as being of type: < docIDx, {termk : countk} [] >
- * @param[in] dic       - Dictionary in which the pair will be stored
- * @param[in] file_name - Name of the file
- * @param[in] word      - Word
+ * @brief   Function used to decode a varint (LEB128)
+ * @param[in] data   - The encoded bytes
+ * @param[in] size   - Number of bytes available
+ * @param[out] value - The decoded value
+ * @return  Number of bytes read or 0 if the varint is truncated or invalid
+ **/
+size_t varint_decode(const unsigned char *data, size_t size, uint64_t *value);
+
+/**
+ * @brief   Function used to allocate memory from an Arena
+ * @param[in] arena - The arena from which the memory is allocated
+ * @param[in] size  - Number of bytes
+ * @return  Pointer to the zero initialized memory or NULL in case of error
+ * @note    The memory is released only by arena_release(). Do not try to free it.
+ **/
+void *arena_alloc(Arena *arena, size_t size);
+
+/**
+ * @brief   Function used to release all the memory allocated from an Arena
+ * @param[in] arena - The arena which will be released
+ * @return  void
+ **/
+void arena_release(Arena *arena);
+
+/**
+ * @brief   Function used to count a word found in a document.
+ *          This function consider the dictionary as being of type: < termk, {docIDx : countk} [] >
+ * @param[in] dic         - Dictionary in which the pair will be stored
+ * @param[in] document_id - ID of the document
+ * @param[in] word        - Word (it doesn't have to be NUL terminated)
+ * @param[in] word_length - The length of the word
  * @return  0 for success or -1 in case or error
  * @note    Doesn't matter if the dictionary is empty.
- *          If it is initialized with 0, the memory will be allocated with malloc.
+ *          If it is initialized with 0, the memory will be allocated from its arena.
  **/
-int insert_word_into_dictionary(Dictionary *dic, const char *file_name, const char *word);
+int insert_word_into_dictionary(Dictionary *dic, int document_id, const char *word, size_t word_length);
 
 /**
- * @brief   Function used to insert a new pair word, file_name into a Dictionary.
- *          This function consider the dictionary as being of type: < termk,{docIDx : countk} >
- * @param[in] dic       - Dictionary in which the pair will be stored
- * @param[in] word      - Word
- * @param[in] file_name - Name of the file
- * @param[in] count     - Word count
+ * @brief   Function used to insert a new pair word, document_id into a Dictionary.
+ *          This function consider the dictionary as being of type: < termk, {docIDx : countk} [] >
+ * @param[in] dic         - Dictionary in which the pair will be stored
+ * @param[in] word        - Word (it doesn't have to be NUL terminated)
+ * @param[in] word_length - The length of the word
+ * @param[in] document_id - ID of the document
+ * @param[in] count       - Word count. It is added to the count of the document if it exists.
  * @return  0 for success or -1 in case or error
  * @note    Doesn't matter if the dictionary is empty.
- *          If it is initialized with 0, the memory will be allocated with malloc.
+ *          If it is initialized with 0, the memory will be allocated from its arena.
+ **/
+int insert_document_into_dictionary(Dictionary *dic, const char *word, size_t word_length, int document_id, int count);
+
+/**
+ * @brief   Function used to sort the elements of a Dictionary by key
+ * @param[in] dic - The dictionary
+ * @return  Array of dic->elements_length indexes of the elements in key order or NULL in case of error
+ * @note    The array is allocated from the dictionary's arena. Do not try to free it.
  **/
-int insert_file_into_dictionary(Dictionary *dic, const char *word, const char *file_name, int count);
+int *sort_dictionary(Dictionary *dic);
 
 /**
  * @brief   Function used to free the dynamically allocated memory from a Dictionary.
  * @param[in] dic - Dictionary which will be deleted
  * @return  void
+ * @note    The memory is owned by the dictionary's arena, so it is released at once.
  **/
 void free_dictionary(Dictionary *dic);
 
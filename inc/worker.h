@@ -1,6 +1,11 @@
 #ifndef WORKER_H_
 #define WORKER_H_
 
+/*******************************************
+ *                INCLUDES
+ ******************************************/
+#include "utils.h" /* Options */
+
 /*******************************************
  *          FUNCTION DECLARATION
  ******************************************/
@@ -8,9 +13,9 @@
 /**
  * @brief   Function called by a worker to do the tasks assigned by master
  * @param[in] worker_rank - The curently process rank
- * @param[in] output_dir_path - The directory path in which the result will be stored
+ * @param[in] options     - The command line options
  * @return void
  **/
-void do_worker(const int worker_rank, const char *output_dir_path);
+void do_worker(const int worker_rank, const Options *options);
 
 #endif /* WORKER_H_ */
\ No newline at end of file
@@ -0,0 +1,976 @@
+/*******************************************
+ *              INCLUDES
+ ******************************************/
+#include <stdio.h>     /* FILE            */
+#include <stdlib.h>    /* dynamic memory  */
+#include <string.h>    /* memcmp          */
+#include <errno.h>     /* errno           */
+#include <limits.h>    /* INT_MAX         */
+#include <fcntl.h>     /* open            */
+#include <unistd.h>    /* close           */
+#include <sys/mman.h>  /* mmap            */
+#include <sys/stat.h>  /* fstat           */
+#include "index_file.h"
+#include "logger.h"
+
+/*******************************************
+ *                DEFINES
+ ******************************************/
+#define INDEX_RECORD_HEADER_SIZE (2 * sizeof(uint32_t))
+#define MIN_INDEX_CAPACITY 1024
+#define ALIGN(value, alignment) (((value) + (alignment) - 1) / (alignment) * (alignment))
+
+/*******************************************
+ *       STATIC FUNCTION DECLARATION
+ ******************************************/
+
+/**
+ * @brief   Function used to get the table of a block of an index
+ * @param[in] reader  - The reader
+ * @param[in] block   - The block
+ * @param[out] terms  - Number of terms of the block
+ * @return  The record offsets of the block
+ **/
+static const uint64_t *index_block_table(const IndexReader *reader, uint64_t block, uint64_t *terms);
+
+/**
+ * @brief   Function used to read a record of an index
+ * @param[in] reader - The reader
+ * @param[in] block  - The block
+ * @param[in] record - The record
+ * @param[out] term  - The term and its postings (an empty term if the record is corrupted)
+ * @return  void
+ **/
+static void index_read_record(const IndexReader *reader, uint64_t block, uint64_t record, IndexTerm *term);
+
+/**
+ * @brief   Function used to compute the bits needed by a value
+ * @param[in] value - The value
+ * @return  The number of bits (0 for 0)
+ **/
+static int index_value_bits(uint32_t value);
+
+/**
+ * @brief   Function used to pack values with a fixed number of bits
+ * @param[out] output - The buffer in which the packed values are appended
+ * @param[in] values  - The values
+ * @param[in] length  - Number of values, at most INDEX_PACK_SIZE
+ * @param[in] bits    - Bits of every value
+ * @return  0 for success or -1 in case of error
+ **/
+static int index_pack_values(ByteBuffer *output, const uint32_t *values, int length, int bits);
+
+/**
+ * @brief   Function used to unpack values packed with a fixed number of bits
+ * @param[in] data    - The packed values, followed by at least 8 bytes
+ * @param[in] bits    - Bits of every value
+ * @param[in] length  - Number of values
+ * @param[out] values - The values
+ * @return  void
+ **/
+static void index_unpack_values(const unsigned char *data, int bits, int length, uint32_t *values);
+
+/**
+ * @brief   Function used to decode a pack of postings of a term
+ * @param[in] term       - The term
+ * @param[in] pack       - The pack
+ * @param[out] documents - The document IDs of the pack
+ * @param[out] counts    - The counts of the pack
+ * @return  Number of postings of the pack
+ **/
+static int index_decode_pack(const IndexTerm *term, int pack, int32_t *documents, int32_t *counts);
+
+/**
+ * @brief   Function used to make room for documents into the result of a query
+ * @param[in] documents - The documents
+ * @param[in] capacity  - The number of documents
+ * @return  0 for success or -1 in case of error
+ **/
+static int index_documents_reserve(IndexDocuments *documents, int capacity);
+
+/**
+ * @brief   Function used to write bytes of a block into the file of a writer
+ * @param[in] writer - The writer
+ * @param[in] data   - The bytes
+ * @param[in] length - Number of bytes
+ * @return  0 for success or -1 in case of error
+ **/
+static int index_writer_write(IndexWriter *writer, const void *data, size_t length);
+
+/*******************************************
+ *       STATIC FUNCTION DEFINITION
+ ******************************************/
+
+/**
+ * @brief   Function used to get the table of a block of an index
+ * @param[in] reader  - The reader
+ * @param[in] block   - The block
+ * @param[out] terms  - Number of terms of the block
+ * @return  The record offsets of the block
+ **/
+static const uint64_t *index_block_table(const IndexReader *reader, uint64_t block, uint64_t *terms)
+{
+    const unsigned char *block_end = reader->data + reader->block_offsets[block + 1];
+
+    /* The blocks were checked when the index was opened */
+    memcpy(terms, block_end - sizeof(uint64_t), sizeof(uint64_t));
+
+    return (const uint64_t *)(block_end - (*terms + 1) * sizeof(uint64_t));
+}
+
+/**
+ * @brief   Function used to read a record of an index
+ * @param[in] reader - The reader
+ * @param[in] block  - The block
+ * @param[in] record - The record
+ * @param[out] term  - The term and its postings (an empty term if the record is corrupted)
+ * @return  void
+ **/
+static void index_read_record(const IndexReader *reader, uint64_t block, uint64_t record, IndexTerm *term)
+{
+    uint64_t terms = 0;
+    const uint64_t *table = index_block_table(reader, block, &terms);
+    uint64_t offset = reader->block_offsets[block] + table[record];
+    uint64_t records_end = (const unsigned char *)table - reader->data;
+    uint64_t tables = 0;
+    uint64_t packs = 0;
+    uint32_t header[2] = {0};
+
+    memset(term, 0, sizeof(IndexTerm));
+
+    if (offset + INDEX_RECORD_HEADER_SIZE <= records_end)
+    {
+        memcpy(header, reader->data + offset, INDEX_RECORD_HEADER_SIZE);
+        packs = ((uint64_t)header[1] + INDEX_PACK_SIZE - 1) / INDEX_PACK_SIZE;
+        tables = offset + INDEX_RECORD_HEADER_SIZE + ALIGN((uint64_t)header[0], sizeof(int32_t));
+    }
+
+    /* The packs are checked when they are decoded */
+    if ((0 == tables) || (INT_MAX < header[1]) || (tables + packs * 2 * sizeof(uint32_t) > records_end))
+    {
+        log_message(LOG_ERROR, "Index: %s(): The record %llu of block %llu is corrupted.\n", __FUNCTION__,
+                    (unsigned long long)record, (unsigned long long)block);
+        return;
+    }
+
+    term->term = (const char *)reader->data + offset + INDEX_RECORD_HEADER_SIZE;
+    term->term_length = header[0];
+    term->documents_count = header[1];
+    term->packs = packs;
+    term->last_documents = (const int32_t *)(reader->data + tables);
+    term->pack_offsets = (const uint32_t *)(term->last_documents + packs);
+    term->packs_data = (const unsigned char *)(term->pack_offsets + packs);
+    term->packs_size = records_end - (term->packs_data - reader->data);
+}
+
+/**
+ * @brief   Function used to compute the bits needed by a value
+ * @param[in] value - The value
+ * @return  The number of bits (0 for 0)
+ **/
+static int index_value_bits(uint32_t value)
+{
+    return (0 == value) ? 0 : 32 - __builtin_clz(value);
+}
+
+/**
+ * @brief   Function used to pack values with a fixed number of bits
+ * @param[out] output - The buffer in which the packed values are appended
+ * @param[in] values  - The values
+ * @param[in] length  - Number of values, at most INDEX_PACK_SIZE
+ * @param[in] bits    - Bits of every value
+ * @return  0 for success or -1 in case of error
+ **/
+static int index_pack_values(ByteBuffer *output, const uint32_t *values, int length, int bits)
+{
+    unsigned char packed[INDEX_PACK_SIZE * sizeof(uint32_t) + sizeof(uint64_t)] = {0};
+
+    for (int i = 0; i < length; ++i)
+    {
+        uint64_t bit = (uint64_t)i * bits;
+        uint64_t word = 0;
+
+        memcpy(&word, packed + bit / 8, sizeof(uint64_t));
+        word |= (uint64_t)values[i] << (bit % 8);
+        memcpy(packed + bit / 8, &word, sizeof(uint64_t));
+    }
+
+    return byte_buffer_append(output, packed, ((uint64_t)length * bits + 7) / 8);
+}
+
+/**
+ * @brief   Function used to unpack values packed with a fixed number of bits
+ * @param[in] data    - The packed values, followed by at least 8 bytes
+ * @param[in] bits    - Bits of every value
+ * @param[in] length  - Number of values
+ * @param[out] values - The values
+ * @return  void
+ **/
+static void index_unpack_values(const unsigned char *data, int bits, int length, uint32_t *values)
+{
+    uint64_t mask = ((uint64_t)1 << bits) - 1;
+
+    /* A value is at most 32 bits, so one unaligned 8 bytes load holds it whatever its first bit is */
+    for (int i = 0; i < length; ++i)
+    {
+        uint64_t bit = (uint64_t)i * bits;
+        uint64_t word = 0;
+
+        memcpy(&word, data + bit / 8, sizeof(uint64_t));
+        values[i] = (word >> (bit % 8)) & mask;
+    }
+}
+
+/**
+ * @brief   Function used to decode a pack of postings of a term
+ * @param[in] term       - The term
+ * @param[in] pack       - The pack
+ * @param[out] documents - The document IDs of the pack
+ * @param[out] counts    - The counts of the pack
+ * @return  Number of postings of the pack
+ **/
+static int index_decode_pack(const IndexTerm *term, int pack, int32_t *documents, int32_t *counts)
+{
+    int first = pack * INDEX_PACK_SIZE;
+    int length = (INDEX_PACK_SIZE < term->documents_count - first) ? INDEX_PACK_SIZE : term->documents_count - first;
+    uint64_t offset = term->pack_offsets[pack];
+    const unsigned char *data = term->packs_data + offset;
+    int32_t previous = (0 == pack) ? -1 : term->last_documents[pack - 1];
+
+    if ((offset + 2 > term->packs_size) || (32 < data[0]) || (32 < data[1]) ||
+        (offset + 2 + ((uint64_t)length * data[0] + 7) / 8 + ((uint64_t)length * data[1] + 7) / 8 > term->packs_size))
+    {
+        log_message(LOG_ERROR, "Index: %s(): The pack %d of term '%.*s' is corrupted.\n", __FUNCTION__, pack, (int)term->term_length, term->term);
+        memset(documents, 0, length * sizeof(int32_t));
+        memset(counts, 0, length * sizeof(int32_t));
+        return length;
+    }
+
+    index_unpack_values(data + 2, data[0], length, (uint32_t *)documents);
+    index_unpack_values(data + 2 + ((uint64_t)length * data[0] + 7) / 8, data[1], length, (uint32_t *)counts);
+
+    /* The document IDs are the differences - 1 from the previous ones */
+    for (int i = 0; i < length; ++i)
+    {
+        previous += documents[i] + 1;
+        documents[i] = previous;
+    }
+
+    return length;
+}
+
+/**
+ * @brief   Function used to make room for documents into the result of a query
+ * @param[in] documents - The documents
+ * @param[in] capacity  - The number of documents
+ * @return  0 for success or -1 in case of error
+ **/
+static int index_documents_reserve(IndexDocuments *documents, int capacity)
+{
+    if (capacity > documents->capacity)
+    {
+        int *new_documents = (int *)realloc(documents->documents, capacity * sizeof(int));
+        int *new_counts = (NULL == new_documents) ? NULL : (int *)realloc(documents->counts, capacity * sizeof(int));
+
+        if (NULL != new_documents)
+        {
+            documents->documents = new_documents;
+        }
+
+        if (NULL == new_counts)
+        {
+            log_message(LOG_ERROR, "Index: %s(): Out of memory! .\n", __FUNCTION__);
+            return -1;
+        }
+
+        documents->counts = new_counts;
+        documents->capacity = capacity;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief   Function used to write bytes of a block into the file of a writer
+ * @param[in] writer - The writer
+ * @param[in] data   - The bytes
+ * @param[in] length - Number of bytes
+ * @return  0 for success or -1 in case of error
+ **/
+static int index_writer_write(IndexWriter *writer, const void *data, size_t length)
+{
+    if (length != fwrite(data, 1, length, writer->file))
+    {
+        log_message(LOG_ERROR, "Index: %s(): Failed to write the block. Errno: %s.\n", __FUNCTION__, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/*******************************************
+ *          FUNCTION DEFINITION
+ ******************************************/
+
+/**
+ * @brief   Function used to encode a record of the index
+ * @param[out] output         - The buffer in which the record is appended
+ * @param[in] term            - The term (not NUL terminated)
+ * @param[in] term_length     - The term length
+ * @param[in] documents       - Document IDs, sorted and different
+ * @param[in] counts          - Counts
+ * @param[in] documents_count - Number of postings
+ * @return  0 for success or -1 in case of error
+ **/
+int index_encode_record(ByteBuffer *output, const char *term, size_t term_length, const int *documents, const int *counts, int documents_count)
+{
+    static const char padding[sizeof(int32_t)] = {0};
+    uint32_t header[2] = {(uint32_t)term_length, (uint32_t)documents_count};
+    uint32_t deltas[INDEX_PACK_SIZE] = {0};
+    uint32_t pack_counts[INDEX_PACK_SIZE] = {0};
+    int packs = (documents_count + INDEX_PACK_SIZE - 1) / INDEX_PACK_SIZE;
+    size_t start = output->length;
+    size_t pack_offsets = 0;
+    size_t packs_start = 0;
+    int error_code = 0;
+
+    error_code |= byte_buffer_append(output, header, INDEX_RECORD_HEADER_SIZE);
+    error_code |= byte_buffer_append(output, term, term_length);
+    error_code |= byte_buffer_append(output, padding, ALIGN(term_length, sizeof(int32_t)) - term_length);
+
+    for (int i = 0; i < packs; ++i)
+    {
+        int last = ((i + 1) * INDEX_PACK_SIZE < documents_count) ? (i + 1) * INDEX_PACK_SIZE - 1 : documents_count - 1;
+
+        error_code |= byte_buffer_append(output, &documents[last], sizeof(int32_t));
+    }
+
+    /* The offsets are known after the packs are encoded */
+    pack_offsets = output->length;
+
+    for (int i = 0; i < packs; ++i)
+    {
+        error_code |= byte_buffer_append(output, padding, sizeof(uint32_t));
+    }
+
+    packs_start = output->length;
+
+    for (int i = 0; (0 == error_code) && (i < packs); ++i)
+    {
+        int first = i * INDEX_PACK_SIZE;
+        int length = (INDEX_PACK_SIZE < documents_count - first) ? INDEX_PACK_SIZE : documents_count - first;
+        int64_t previous = (0 == i) ? -1 : documents[first - 1];
+        uint32_t offset = output->length - packs_start;
+        uint32_t max_delta = 0;
+        uint32_t max_count = 0;
+        unsigned char bits[2] = {0};
+
+        for (int j = 0; j < length; ++j)
+        {
+            if ((documents[first + j] <= previous) || (0 > counts[first + j]))
+            {
+                log_message(LOG_ERROR, "Index: %s(): The postings of term '%.*s' are not sorted.\n", __FUNCTION__, (int)term_length, term);
+                return -1;
+            }
+
+            deltas[j] = documents[first + j] - previous - 1;
+            pack_counts[j] = counts[first + j];
+            previous = documents[first + j];
+            max_delta |= deltas[j];
+            max_count |= pack_counts[j];
+        }
+
+        bits[0] = index_value_bits(max_delta);
+        bits[1] = index_value_bits(max_count);
+        memcpy(output->data + pack_offsets + i * sizeof(uint32_t), &offset, sizeof(uint32_t));
+
+        error_code |= byte_buffer_append(output, bits, sizeof(bits));
+        error_code |= index_pack_values(output, deltas, length, bits[0]);
+        error_code |= index_pack_values(output, pack_counts, length, bits[1]);
+    }
+
+    error_code |= byte_buffer_append(output, padding, ALIGN(output->length - start, sizeof(int32_t)) - (output->length - start));
+
+    return (0 == error_code) ? 0 : -1;
+}
+
+/**
+ * @brief   Function used to compute the bytes of a block of the index
+ * @param[in] terms        - Number of terms of the block
+ * @param[in] records_size - Bytes of the records of the block
+ * @return  The bytes of the block
+ **/
+uint64_t index_block_size(uint64_t terms, uint64_t records_size)
+{
+    return ALIGN(records_size, sizeof(uint64_t)) + (terms + 1) * sizeof(uint64_t);
+}
+
+/**
+ * @brief   Function used to compute the bytes of the header of the index
+ * @param[in] blocks - Number of blocks
+ * @return  The bytes of the header
+ **/
+uint64_t index_header_size(int blocks)
+{
+    return INDEX_MAGIC_SIZE + sizeof(uint64_t) + (blocks + 1) * sizeof(uint64_t);
+}
+
+/**
+ * @brief   Function used to encode the header of the index
+ * @param[out] output       - The buffer in which the header is appended
+ * @param[in] block_lengths - The bytes of every block
+ * @param[in] blocks        - Number of blocks
+ * @return  0 for success or -1 in case of error
+ **/
+int index_encode_header(ByteBuffer *output, const uint64_t *block_lengths, int blocks)
+{
+    uint64_t value = blocks;
+    int error_code = 0;
+
+    error_code |= byte_buffer_append(output, INDEX_MAGIC, INDEX_MAGIC_SIZE);
+    error_code |= byte_buffer_append(output, &value, sizeof(uint64_t));
+    value = index_header_size(blocks);
+
+    for (int i = 0; i <= blocks; ++i)
+    {
+        error_code |= byte_buffer_append(output, &value, sizeof(uint64_t));
+        value += (i < blocks) ? block_lengths[i] : 0;
+    }
+
+    return error_code;
+}
+
+/**
+ * @brief   Function used to start writing a block of the index
+ * @param[out] writer - The writer
+ * @param[in] file    - The file in which the block is written
+ * @return  void
+ **/
+void index_writer_begin(IndexWriter *writer, FILE *file)
+{
+    memset(writer, 0, sizeof(IndexWriter));
+    writer->file = file;
+}
+
+/**
+ * @brief   Function used to write the next term of a block. The terms must be added in order.
+ * @param[in] writer          - The writer
+ * @param[in] term            - The term (not NUL terminated)
+ * @param[in] term_length     - The term length
+ * @param[in] documents       - Document IDs, sorted
+ * @param[in] counts          - Counts
+ * @param[in] documents_count - Number of postings
+ * @return  0 for success or -1 in case of error
+ **/
+int index_writer_add(IndexWriter *writer, const char *term, size_t term_length, const int *documents, const int *counts, int documents_count)
+{
+    writer->record.length = 0;
+
+    if (0 != index_encode_record(&writer->record, term, term_length, documents, counts, documents_count))
+    {
+        writer->error_code = -1;
+        return -1;
+    }
+
+    if (writer->terms == writer->terms_capacity)
+    {
+        uint64_t capacity = (0 == writer->terms_capacity) ? MIN_INDEX_CAPACITY : 2 * writer->terms_capacity;
+        uint64_t *record_offsets = (uint64_t *)realloc(writer->record_offsets, capacity * sizeof(uint64_t));
+
+        if (NULL == record_offsets)
+        {
+            log_message(LOG_ERROR, "Index: %s(): Out of memory! .\n", __FUNCTION__);
+            writer->error_code = -1;
+            return -1;
+        }
+
+        writer->record_offsets = record_offsets;
+        writer->terms_capacity = capacity;
+    }
+
+    writer->record_offsets[writer->terms++] = writer->length;
+    writer->length += writer->record.length;
+    writer->error_code |= index_writer_write(writer, writer->record.data, writer->record.length);
+
+    return writer->error_code;
+}
+
+/**
+ * @brief   Function used to write the table of a block and to free the writer
+ * @param[in] writer  - The writer
+ * @param[out] length - The bytes of the block
+ * @return  0 for success or -1 in case of error
+ **/
+int index_writer_end(IndexWriter *writer, uint64_t *length)
+{
+    static const char padding[sizeof(uint64_t)] = {0};
+    int error_code = writer->error_code;
+
+    *length = index_block_size(writer->terms, writer->length);
+    error_code |= index_writer_write(writer, padding, ALIGN(writer->length, sizeof(uint64_t)) - writer->length);
+    error_code |= index_writer_write(writer, writer->record_offsets, writer->terms * sizeof(uint64_t));
+    error_code |= index_writer_write(writer, &writer->terms, sizeof(uint64_t));
+
+    free(writer->record_offsets);
+    byte_buffer_free(&writer->record);
+    memset(writer, 0, sizeof(IndexWriter));
+
+    return error_code;
+}
+
+/**
+ * @brief   Function used to map an index into memory
+ * @param[out] reader - The reader
+ * @param[in] path    - The index path
+ * @return  0 for success or -1 in case of error
+ **/
+int index_reader_open(IndexReader *reader, const char *path)
+{
+    int error_code = -1;
+    int fd = open(path, O_RDONLY);
+    struct stat file_stat = {0};
+    void *data = MAP_FAILED;
+
+    memset(reader, 0, sizeof(IndexReader));
+
+    if ((-1 == fd) || (0 != fstat(fd, &file_stat)))
+    {
+        log_message(LOG_ERROR, "Index: %s(): Failed to open file '%s'. Errno: %s.\n", __FUNCTION__, path, strerror(errno));
+    }
+    else if (((size_t)file_stat.st_size < index_header_size(0)) ||
+             (MAP_FAILED == (data = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0))))
+    {
+        log_message(LOG_ERROR, "Index: %s(): Failed to map file '%s'.\n", __FUNCTION__, path);
+    }
+    else
+    {
+        reader->data = (const unsigned char *)data;
+        reader->size = file_stat.st_size;
+        memcpy(&reader->blocks, reader->data + INDEX_MAGIC_SIZE, sizeof(uint64_t));
+        reader->block_offsets = (const uint64_t *)(reader->data + INDEX_MAGIC_SIZE + sizeof(uint64_t));
+
+        /* The queries jump through the index */
+        madvise(data, reader->size, MADV_RANDOM);
+
+        error_code = ((0 == memcmp(reader->data, INDEX_MAGIC, INDEX_MAGIC_SIZE)) &&
+                      (reader->blocks < reader->size / sizeof(uint64_t)) &&
+                      (index_header_size(reader->blocks) <= reader->size) &&
+                      (index_header_size(reader->blocks) == reader->block_offsets[0]) &&
+                      (reader->size == reader->block_offsets[reader->blocks])) ? 0 : -1;
+
+        /* Check the tables, so that the queries only check the records */
+        for (uint64_t i = 0; (0 == error_code) && (i < reader->blocks); ++i)
+        {
+            uint64_t block_size = reader->block_offsets[i + 1] - reader->block_offsets[i];
+            uint64_t terms = 0;
+
+            if ((reader->block_offsets[i + 1] < reader->block_offsets[i]) || (reader->block_offsets[i + 1] > reader->size) ||
+                (0 != reader->block_offsets[i] % sizeof(uint64_t)) || (sizeof(uint64_t) > block_size))
+            {
+                error_code = -1;
+                break;
+            }
+
+            index_block_table(reader, i, &terms);
+            error_code = (terms < block_size / sizeof(uint64_t)) ? 0 : -1;
+        }
+
+        if (0 != error_code)
+        {
+            log_message(LOG_ERROR, "Index: %s(): The file '%s' is not a valid index.\n", __FUNCTION__, path);
+            munmap(data, file_stat.st_size);
+            memset(reader, 0, sizeof(IndexReader));
+        }
+    }
+
+    if (-1 != fd)
+    {
+        close(fd);
+    }
+
+    return error_code;
+}
+
+/**
+ * @brief   Function used to unmap an index
+ * @param[in] reader - The reader
+ * @return  void
+ **/
+void index_reader_close(IndexReader *reader)
+{
+    if (NULL != reader->data)
+    {
+        munmap((void *)reader->data, reader->size);
+    }
+
+    memset(reader, 0, sizeof(IndexReader));
+}
+
+/**
+ * @brief   Function used to find a term into an index
+ * @param[in] reader      - The reader
+ * @param[in] term        - The term (it doesn't have to be NUL terminated)
+ * @param[in] term_length - The term length
+ * @param[out] found      - The term and its postings
+ * @return  1 if the term was found, 0 otherwise
+ **/
+int index_reader_find(const IndexReader *reader, const char *term, size_t term_length, IndexTerm *found)
+{
+    IndexCursor cursor = {0};
+
+    index_cursor_seek(&cursor, reader, term, term_length);
+
+    return (0 != index_cursor_next(&cursor, found)) && (0 == compare_terms(found->term, found->term_length, term, term_length));
+}
+
+/**
+ * @brief   Function used to place a cursor on the first term which is not smaller than a given one
+ * @param[out] cursor     - The cursor
+ * @param[in] reader      - The reader
+ * @param[in] term        - The term (it doesn't have to be NUL terminated)
+ * @param[in] term_length - The term length
+ * @return  void
+ **/
+void index_cursor_seek(IndexCursor *cursor, const IndexReader *reader, const char *term, size_t term_length)
+{
+    IndexTerm current = {0};
+
+    cursor->reader = reader;
+    cursor->record = 0;
+
+    /* The blocks are key ranges in order, so the term is in the first block whose last term is not smaller */
+    for (cursor->block = 0; cursor->block < reader->blocks; ++cursor->block)
+    {
+        uint64_t terms = 0;
+        uint64_t low = 0;
+        uint64_t high = 0;
+
+        index_block_table(reader, cursor->block, &terms);
+
+        if (0 == terms)
+        {
+            continue;
+        }
+
+        index_read_record(reader, cursor->block, terms - 1, &current);
+
+        if (0 > compare_terms(current.term, current.term_length, term, term_length))
+        {
+            continue;
+        }
+
+        /* Binary search of the first record which is not smaller */
+        high = terms - 1;
+
+        while (low < high)
+        {
+            uint64_t middle = low + (high - low) / 2;
+
+            index_read_record(reader, cursor->block, middle, &current);
+
+            if (0 > compare_terms(current.term, current.term_length, term, term_length))
+            {
+                low = middle + 1;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+
+        cursor->record = low;
+        break;
+    }
+}
+
+/**
+ * @brief   Function used to read the next term of a cursor
+ * @param[in] cursor - The cursor
+ * @param[out] term  - The term and its postings
+ * @return  1 if there was a term, 0 at the end of the index
+ **/
+int index_cursor_next(IndexCursor *cursor, IndexTerm *term)
+{
+    while (cursor->block < cursor->reader->blocks)
+    {
+        uint64_t terms = 0;
+
+        index_block_table(cursor->reader, cursor->block, &terms);
+
+        if (cursor->record < terms)
+        {
+            index_read_record(cursor->reader, cursor->block, cursor->record++, term);
+            return 1;
+        }
+
+        ++cursor->block;
+        cursor->record = 0;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief   Function used to decode all the postings of a term
+ * @param[in] term        - The term
+ * @param[out] documents  - term->documents_count document IDs
+ * @param[out] counts     - term->documents_count counts
+ * @return  void
+ **/
+void index_decode_postings(const IndexTerm *term, int *documents, int *counts)
+{
+    for (int i = 0; i < term->packs; ++i)
+    {
+        index_decode_pack(term, i, documents + i * INDEX_PACK_SIZE, counts + i * INDEX_PACK_SIZE);
+    }
+}
+
+/**
+ * @brief   Function used to start reading the postings of a term
+ * @param[out] postings - The postings
+ * @param[in] term      - The term, which must stay valid while the postings are read
+ * @return  void
+ **/
+void index_postings_begin(IndexPostings *postings, const IndexTerm *term)
+{
+    postings->term = term;
+    postings->pack = -1;
+    postings->position = 0;
+    postings->length = 0;
+}
+
+/**
+ * @brief   Function used to move to the first posting whose document ID is not smaller than a given one.
+ *          Only the pack of that posting is decoded. The postings must be sought in increasing order.
+ * @param[in] postings     - The postings
+ * @param[in] document_id  - The document ID
+ * @param[out] found_id    - The document ID of the posting
+ * @param[out] count       - The count of the posting
+ * @return  1 if there is such a posting, 0 otherwise
+ **/
+int index_postings_seek(IndexPostings *postings, int document_id, int *found_id, int *count)
+{
+    const IndexTerm *term = postings->term;
+
+    if ((0 > postings->pack) || (term->last_documents[postings->pack] < document_id))
+    {
+        /* Skip the packs which end before the document without decoding them */
+        int pack = index_gallop(term->last_documents, term->packs, postings->pack + 1, document_id);
+
+        if (pack == term->packs)
+        {
+            postings->pack = term->packs - 1;
+            postings->length = 0;
+            return 0;
+        }
+
+        postings->pack = pack;
+        postings->position = 0;
+        postings->length = index_decode_pack(term, pack, postings->documents, postings->counts);
+    }
+
+    postings->position = index_gallop(postings->documents, postings->length, postings->position, document_id);
+
+    if (postings->position == postings->length)
+    {
+        return 0;
+    }
+
+    *found_id = postings->documents[postings->position];
+    *count = postings->counts[postings->position];
+
+    return 1;
+}
+
+/**
+ * @brief   Function used to find the first element of a sorted list which is not smaller than a value,
+ *          with an exponential search from a given position
+ * @param[in] list   - The sorted list
+ * @param[in] length - The list length
+ * @param[in] from   - The position from which the search starts
+ * @param[in] value  - The value
+ * @return  The position or length if all the elements are smaller
+ **/
+int index_gallop(const int32_t *list, int length, int from, int value)
+{
+    int step = 1;
+    int low = from;
+    int high = from;
+
+    /* Double the step untill an element is not smaller, then search between the last two probes */
+    while ((high < length) && (list[high] < value))
+    {
+        low = high + 1;
+        high = from + step;
+        step *= 2;
+    }
+
+    high = (high < length) ? high : length;
+
+    while (low < high)
+    {
+        int middle = low + (high - low) / 2;
+
+        if (list[middle] < value)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+/**
+ * @brief   Function used to find the documents which have all the terms (AND) or any of them (OR)
+ * @param[in] reader      - The reader
+ * @param[in] terms       - The terms (NUL terminated)
+ * @param[in] terms_count - Number of terms
+ * @param[in] all_terms   - 1 for AND, 0 for OR
+ * @param[out] result     - The documents. The previous ones are removed.
+ * @return  0 for success or -1 in case of error
+ **/
+int index_query(const IndexReader *reader, const char **terms, int terms_count, int all_terms, IndexDocuments *result)
+{
+    IndexTerm *found = (IndexTerm *)calloc(terms_count + 1, sizeof(IndexTerm));
+    IndexPostings *postings = (IndexPostings *)malloc(sizeof(IndexPostings));
+    IndexDocuments decoded = {0};
+    IndexDocuments merged = {0};
+    int found_count = 0;
+    int error_code = 0;
+
+    result->length = 0;
+
+    if ((NULL == found) || (NULL == postings))
+    {
+        log_message(LOG_ERROR, "Index: %s(): Out of memory! .\n", __FUNCTION__);
+        free(found);
+        free(postings);
+        return -1;
+    }
+
+    for (int i = 0; i < terms_count; ++i)
+    {
+        if (0 != index_reader_find(reader, terms[i], strlen(terms[i]), &found[found_count]))
+        {
+            ++found_count;
+        }
+        else if (0 != all_terms)
+        {
+            /* A missing term leaves no document */
+            found_count = 0;
+            break;
+        }
+    }
+
+    /* The shortest lists first, so the intersection only gets shorter */
+    for (int i = 1; i < found_count; ++i)
+    {
+        IndexTerm term = found[i];
+        int j = i;
+
+        for (; (0 < j) && (found[j - 1].documents_count > term.documents_count); --j)
+        {
+            found[j] = found[j - 1];
+        }
+
+        found[j] = term;
+    }
+
+    for (int i = 0; (0 == error_code) && (i < found_count); ++i)
+    {
+        const IndexTerm *term = &found[i];
+        int position = 0;
+        int length = 0;
+
+        if ((0 != all_terms) && (0 != i))
+        {
+            /* Intersect in place: look for every document of the result into the longer list.
+             * Only the packs which may hold them are decoded. */
+            index_postings_begin(postings, term);
+
+            for (int j = 0; j < result->length; ++j)
+            {
+                int document_id = 0;
+                int count = 0;
+
+                if (0 == index_postings_seek(postings, result->documents[j], &document_id, &count))
+                {
+                    break;
+                }
+
+                if (document_id == result->documents[j])
+                {
+                    result->documents[length] = document_id;
+                    result->counts[length++] = result->counts[j] + count;
+                }
+            }
+
+            result->length = length;
+        }
+        else if ((0 != (error_code = index_documents_reserve(&merged, result->length + term->documents_count))) ||
+                 (0 != (error_code = index_documents_reserve(&decoded, term->documents_count))))
+        {
+            break;
+        }
+        else
+        {
+            /* Union of the sorted lists into merged, which becomes the result */
+            int j = 0;
+
+            index_decode_postings(term, decoded.documents, decoded.counts);
+
+            while ((j < result->length) || (position < term->documents_count))
+            {
+                if ((position == term->documents_count) ||
+                    ((j < result->length) && (result->documents[j] < decoded.documents[position])))
+                {
+                    merged.documents[length] = result->documents[j];
+                    merged.counts[length++] = result->counts[j++];
+                }
+                else if ((j == result->length) || (result->documents[j] > decoded.documents[position]))
+                {
+                    merged.documents[length] = decoded.documents[position];
+                    merged.counts[length++] = decoded.counts[position++];
+                }
+                else
+                {
+                    merged.documents[length] = result->documents[j];
+                    merged.counts[length++] = result->counts[j++] + decoded.counts[position++];
+                }
+            }
+
+            merged.length = length;
+
+            /* Swap the buffers */
+            {
+                IndexDocuments swapped = *result;
+
+                *result = merged;
+                merged = swapped;
+            }
+        }
+    }
+
+    index_documents_free(&decoded);
+    index_documents_free(&merged);
+    free(postings);
+    free(found);
+
+    return error_code;
+}
+
+/**
+ * @brief   Function used to free the memory of the documents found by a query
+ * @param[in] documents - The documents
+ * @return  void
+ **/
+void index_documents_free(IndexDocuments *documents)
+{
+    free(documents->documents);
+    free(documents->counts);
+    memset(documents, 0, sizeof(IndexDocuments));
+}
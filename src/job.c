@@ -0,0 +1,496 @@
+/*******************************************
+ *              INCLUDES
+ ******************************************/
+#include <stdio.h>     /* snprintf        */
+#include <stdlib.h>    /* dynamic memory  */
+#include <string.h>    /* strcmp          */
+#include <limits.h>    /* INT_MAX         */
+#include <sys/stat.h>  /* stat            */
+#include "job.h"
+#include "logger.h"
+
+/*******************************************
+ *                DEFINES
+ ******************************************/
+#define MIN_WORD_SIZE 3
+#define MAX_POSTING_TEXT_SIZE 32 /* "<document_id: count>" */
+#define MAX_COUNT_TEXT_SIZE 32   /* ": count" */
+#define NGRAM_LOOKAHEAD_SIZE 4096 /* Bytes read after a range for the last words of its n-grams, doubled untill they are found */
+
+/*******************************************
+ *                TYPES
+ ******************************************/
+
+/* struct used to keep the last words of a document while its n-grams are mapped */
+typedef struct NgramWindow_
+{
+    ByteBuffer words; /* Up to NGRAM_SIZE - 1 words, separated by a space */
+    int words_count;
+} NgramWindow;
+
+/* struct used by a thread to map the n-grams of its chunk of a range */
+typedef struct NgramMapper_
+{
+    WordCallback emit;
+    void *context;    /* Context given to emit */
+    NgramWindow head; /* The first words of the chunk, used for the n-grams which start in the previous chunks */
+    NgramWindow tail; /* The last words of the chunk */
+} NgramMapper;
+
+/*******************************************
+ *       STATIC FUNCTION DECLARATION
+ ******************************************/
+
+/**
+ * @brief   Function used to map the words of a byte range of a file
+ * @param[in] item           - The byte range of the file and its document ID
+ * @param[in] emit           - Function called for every word
+ * @param[in] contexts       - Context given to emit, one for every thread
+ * @param[in] contexts_count - Number of contexts
+ * @return  0 for success or -1 in case of error
+ **/
+static int job_map_words(const MapTaskItem *item, WordCallback emit, void **contexts, int contexts_count);
+
+/**
+ * @brief   Function used to map the n-grams of a byte range of a file: NGRAM_SIZE consecutive words, separated by a space.
+ *          The range owns the n-grams whose first word starts inside it.
+ * @param[in] item           - The byte range of the file and its document ID
+ * @param[in] emit           - Function called for every n-gram
+ * @param[in] contexts       - Context given to emit, one for every thread
+ * @param[in] contexts_count - Number of contexts
+ * @return  0 for success or -1 in case of error
+ **/
+static int job_map_ngrams(const MapTaskItem *item, WordCallback emit, void **contexts, int contexts_count);
+
+/**
+ * @brief   Function called by the tokenizer for every word of a chunk mapped into n-grams
+ * @param[in] word    - The word (not NUL terminated)
+ * @param[in] length  - The word length
+ * @param[in] context - The NgramMapper of the chunk
+ * @return  0 for success or -1 in case of error
+ **/
+static int job_ngram_word(const char *word, size_t length, void *context);
+
+/**
+ * @brief   Function called by the tokenizer for every word after a range, to keep the first NGRAM_SIZE - 1 of them
+ * @param[in] word    - The word (not NUL terminated)
+ * @param[in] length  - The word length
+ * @param[in] context - The NgramWindow in which the words are kept
+ * @return  0 for success or -1 in case of error
+ **/
+static int job_ngram_keep_word(const char *word, size_t length, void *context);
+
+/**
+ * @brief   Function used to add a word to a window. When the window holds NGRAM_SIZE words, they are emitted
+ *          as an n-gram and the first one is dropped.
+ * @param[in,out] window - The window
+ * @param[in] word       - The word (not NUL terminated)
+ * @param[in] length     - The word length
+ * @param[in] emit       - Function called for the n-gram
+ * @param[in] context    - Context given to emit
+ * @return  0 for success or -1 in case of error
+ **/
+static int job_ngram_push(NgramWindow *window, const char *word, size_t length, WordCallback emit, void *context);
+
+/**
+ * @brief   Function used to add all the words of a window to another window
+ * @param[in,out] window - The window to which the words are added
+ * @param[in] words      - The window with the words
+ * @param[in] emit       - Function called for every n-gram
+ * @param[in] context    - Context given to emit
+ * @return  0 for success or -1 in case of error
+ **/
+static int job_ngram_push_all(NgramWindow *window, const NgramWindow *words, WordCallback emit, void *context);
+
+/**
+ * @brief   Function used to find the first NGRAM_SIZE - 1 words which start at or after an offset of a file
+ * @param[in] file_path - Path of the file
+ * @param[in] offset    - The offset
+ * @param[out] words    - The words. There are less of them if the file ends before.
+ * @return  0 for success or -1 in case of error
+ **/
+static int job_ngram_lookahead(const char *file_path, uint64_t offset, NgramWindow *words);
+
+/**
+ * @brief   Function used to add the counts of all the postings of a key into its first posting.
+ *          A map task keeps a single count for every key, which is the only thing a counting job needs.
+ *          The count is an int like every posting, so it saturates at INT_MAX.
+ * @param[in,out] documents   - The document IDs
+ * @param[in,out] counts      - The counts
+ * @param[in] postings_length - Number of postings
+ * @return  The new number of postings (1, or 0 if there was none)
+ **/
+static int job_combine_counts(int *documents, int *counts, int postings_length);
+
+/**
+ * @brief   Function used to reduce a key into a line "key: <document_id: count>..." of the inverted index
+ * @param[in] key             - The key (not NUL terminated)
+ * @param[in] key_length      - The key length
+ * @param[in] documents       - The document IDs, sorted
+ * @param[in] counts          - The counts
+ * @param[in] postings_length - Number of postings
+ * @param[out] line           - The buffer in which the line is appended
+ * @return  0 for success or -1 in case of error
+ **/
+static int job_reduce_postings(const char *key, size_t key_length, const int *documents, const int *counts, int postings_length, ByteBuffer *line);
+
+/**
+ * @brief   Function used to reduce a key into a line "key: count" with the sum of its counts
+ * @param[in] key             - The key (not NUL terminated)
+ * @param[in] key_length      - The key length
+ * @param[in] documents       - The document IDs, sorted
+ * @param[in] counts          - The counts
+ * @param[in] postings_length - Number of postings
+ * @param[out] line           - The buffer in which the line is appended
+ * @return  0 for success or -1 in case of error
+ **/
+static int job_reduce_count(const char *key, size_t key_length, const int *documents, const int *counts, int postings_length, ByteBuffer *line);
+
+/*******************************************
+ *              STATIC DATA
+ ******************************************/
+
+/* The counting jobs combine the counts of a task, so their runs keep one posting for every key of a task */
+static const Job jobs[] = {{"index", job_map_words, NULL, job_reduce_postings},
+                           {"wordcount", job_map_words, job_combine_counts, job_reduce_count},
+                           {"ngram", job_map_ngrams, job_combine_counts, job_reduce_count}};
+
+/*******************************************
+ *       STATIC FUNCTION DEFINITION
+ ******************************************/
+
+/**
+ * @brief   Function used to map the words of a byte range of a file
+ * @param[in] item           - The byte range of the file and its document ID
+ * @param[in] emit           - Function called for every word
+ * @param[in] contexts       - Context given to emit, one for every thread
+ * @param[in] contexts_count - Number of contexts
+ * @return  0 for success or -1 in case of error
+ **/
+static int job_map_words(const MapTaskItem *item, WordCallback emit, void **contexts, int contexts_count)
+{
+    return tokenize_file_range(item->file_path, item->offset, item->length, MIN_WORD_SIZE, emit, contexts, contexts_count);
+}
+
+/**
+ * @brief   Function used to map the n-grams of a byte range of a file: NGRAM_SIZE consecutive words, separated by a space.
+ *          The range owns the n-grams whose first word starts inside it.
+ * @param[in] item           - The byte range of the file and its document ID
+ * @param[in] emit           - Function called for every n-gram
+ * @param[in] contexts       - Context given to emit, one for every thread
+ * @param[in] contexts_count - Number of contexts
+ * @return  0 for success or -1 in case of error
+ **/
+static int job_map_ngrams(const MapTaskItem *item, WordCallback emit, void **contexts, int contexts_count)
+{
+    int error_code = -1;
+    NgramMapper *mappers = (NgramMapper *)calloc(contexts_count, sizeof(NgramMapper));
+    void **mapper_contexts = (void **)calloc(contexts_count, sizeof(void *));
+    NgramWindow last_words = {0};
+    NgramWindow next_words = {0};
+
+    if ((NULL == mappers) || (NULL == mapper_contexts))
+    {
+        log_message(LOG_ERROR, "Job: %s(): Out of memory! .\n", __FUNCTION__);
+    }
+    else
+    {
+        for (int i = 0; i < contexts_count; ++i)
+        {
+            mappers[i].emit = emit;
+            mappers[i].context = contexts[i];
+            mapper_contexts[i] = &mappers[i];
+        }
+
+        error_code = tokenize_file_range(item->file_path, item->offset, item->length, MIN_WORD_SIZE, job_ngram_word, mapper_contexts, contexts_count);
+
+        /* Every thread mapped the n-grams inside its chunk, the ones across two chunks are mapped from their first and last words */
+        for (int i = 0; (0 == error_code) && (i < contexts_count); ++i)
+        {
+            const NgramMapper *mapper = &mappers[i];
+
+            if (0 == mapper->head.words_count)
+            {
+                /* The chunk has no word */
+                continue;
+            }
+
+            if (0 != last_words.words_count)
+            {
+                error_code = job_ngram_push_all(&last_words, &mapper->head, emit, contexts[i]);
+            }
+
+            /* A chunk with less words than a window only adds them to the previous ones */
+            if ((0 == error_code) && ((0 == last_words.words_count) || (NGRAM_SIZE - 1 == mapper->tail.words_count)))
+            {
+                last_words.words.length = 0;
+                last_words.words_count = mapper->tail.words_count;
+                error_code = byte_buffer_append(&last_words.words, mapper->tail.words.data, mapper->tail.words.length);
+            }
+        }
+
+        /* The last n-grams of the range end with the first words of the next one */
+        if ((0 == error_code) && (0 != last_words.words_count))
+        {
+            error_code = job_ngram_lookahead(item->file_path, item->offset + item->length, &next_words);
+            error_code = (0 == error_code) ? job_ngram_push_all(&last_words, &next_words, emit, contexts[0]) : error_code;
+        }
+    }
+
+    for (int i = 0; (NULL != mappers) && (i < contexts_count); ++i)
+    {
+        byte_buffer_free(&mappers[i].head.words);
+        byte_buffer_free(&mappers[i].tail.words);
+    }
+
+    byte_buffer_free(&last_words.words);
+    byte_buffer_free(&next_words.words);
+    free(mappers);
+    free(mapper_contexts);
+
+    return error_code;
+}
+
+/**
+ * @brief   Function called by the tokenizer for every word of a chunk mapped into n-grams
+ * @param[in] word    - The word (not NUL terminated)
+ * @param[in] length  - The word length
+ * @param[in] context - The NgramMapper of the chunk
+ * @return  0 for success or -1 in case of error
+ **/
+static int job_ngram_word(const char *word, size_t length, void *context)
+{
+    NgramMapper *mapper = (NgramMapper *)context;
+    int error_code = job_ngram_keep_word(word, length, &mapper->head);
+
+    return (0 == error_code) ? job_ngram_push(&mapper->tail, word, length, mapper->emit, mapper->context) : error_code;
+}
+
+/**
+ * @brief   Function called by the tokenizer for every word after a range, to keep the first NGRAM_SIZE - 1 of them
+ * @param[in] word    - The word (not NUL terminated)
+ * @param[in] length  - The word length
+ * @param[in] context - The NgramWindow in which the words are kept
+ * @return  0 for success or -1 in case of error
+ **/
+static int job_ngram_keep_word(const char *word, size_t length, void *context)
+{
+    NgramWindow *window = (NgramWindow *)context;
+
+    /* The window never gets full, so nothing is emitted */
+    return (NGRAM_SIZE - 1 > window->words_count) ? job_ngram_push(window, word, length, NULL, NULL) : 0;
+}
+
+/**
+ * @brief   Function used to add a word to a window. When the window holds NGRAM_SIZE words, they are emitted
+ *          as an n-gram and the first one is dropped.
+ * @param[in,out] window - The window
+ * @param[in] word       - The word (not NUL terminated)
+ * @param[in] length     - The word length
+ * @param[in] emit       - Function called for the n-gram
+ * @param[in] context    - Context given to emit
+ * @return  0 for success or -1 in case of error
+ **/
+static int job_ngram_push(NgramWindow *window, const char *word, size_t length, WordCallback emit, void *context)
+{
+    int error_code = 0;
+
+    if (0 != window->words_count)
+    {
+        error_code |= byte_buffer_append(&window->words, " ", 1);
+    }
+
+    error_code |= byte_buffer_append(&window->words, word, length);
+    ++window->words_count;
+
+    if ((0 == error_code) && (NGRAM_SIZE == window->words_count))
+    {
+        /* The words have no space, so the first one ends at the first space */
+        const unsigned char *space = (const unsigned char *)memchr(window->words.data, ' ', window->words.length);
+        size_t dropped_length = (NULL == space) ? window->words.length : (size_t)(space - window->words.data) + 1;
+
+        error_code = emit((const char *)window->words.data, window->words.length, context);
+        memmove(window->words.data, window->words.data + dropped_length, window->words.length - dropped_length);
+        window->words.length -= dropped_length;
+        --window->words_count;
+    }
+
+    return error_code;
+}
+
+/**
+ * @brief   Function used to add all the words of a window to another window
+ * @param[in,out] window - The window to which the words are added
+ * @param[in] words      - The window with the words
+ * @param[in] emit       - Function called for every n-gram
+ * @param[in] context    - Context given to emit
+ * @return  0 for success or -1 in case of error
+ **/
+static int job_ngram_push_all(NgramWindow *window, const NgramWindow *words, WordCallback emit, void *context)
+{
+    int error_code = 0;
+    size_t start = 0;
+
+    for (int i = 0; (0 == error_code) && (i < words->words_count); ++i)
+    {
+        const unsigned char *space = (const unsigned char *)memchr(words->words.data + start, ' ', words->words.length - start);
+        size_t end = (NULL == space) ? words->words.length : (size_t)(space - words->words.data);
+
+        error_code = job_ngram_push(window, (const char *)words->words.data + start, end - start, emit, context);
+        start = end + 1;
+    }
+
+    return error_code;
+}
+
+/**
+ * @brief   Function used to find the first NGRAM_SIZE - 1 words which start at or after an offset of a file
+ * @param[in] file_path - Path of the file
+ * @param[in] offset    - The offset
+ * @param[out] words    - The words. There are less of them if the file ends before.
+ * @return  0 for success or -1 in case of error
+ **/
+static int job_ngram_lookahead(const char *file_path, uint64_t offset, NgramWindow *words)
+{
+    struct stat file_stat = {0};
+
+    if (0 != stat(file_path, &file_stat))
+    {
+        log_message(LOG_ERROR, "Job: %s(): Failed to stat file '%s'.\n", __FUNCTION__, file_path);
+        return -1;
+    }
+
+    /* A few bytes hold the next words, unless they are far behind delimiters or short words */
+    for (uint64_t length = NGRAM_LOOKAHEAD_SIZE; ; length *= 2)
+    {
+        void *context = words;
+
+        words->words.length = 0;
+        words->words_count = 0;
+
+        if (0 != tokenize_file_range(file_path, offset, length, MIN_WORD_SIZE, job_ngram_keep_word, &context, 1))
+        {
+            return -1;
+        }
+
+        if ((NGRAM_SIZE - 1 <= words->words_count) || (offset + length >= (uint64_t)file_stat.st_size))
+        {
+            return 0;
+        }
+    }
+}
+
+/**
+ * @brief   Function used to add the counts of all the postings of a key into its first posting.
+ *          A map task keeps a single count for every key, which is the only thing a counting job needs.
+ *          The count is an int like every posting, so it saturates at INT_MAX.
+ * @param[in,out] documents   - The document IDs
+ * @param[in,out] counts      - The counts
+ * @param[in] postings_length - Number of postings
+ * @return  The new number of postings (1, or 0 if there was none)
+ **/
+static int job_combine_counts(int *documents, int *counts, int postings_length)
+{
+    uint64_t count = 0;
+
+    (void)documents;
+
+    for (int i = 0; i < postings_length; ++i)
+    {
+        count += counts[i];
+    }
+
+    if (0 < postings_length)
+    {
+        counts[0] = (INT_MAX < count) ? INT_MAX : (int)count;
+    }
+
+    return (0 < postings_length) ? 1 : 0;
+}
+
+/**
+ * @brief   Function used to reduce a key into a line "key: <document_id: count>..." of the inverted index
+ * @param[in] key             - The key (not NUL terminated)
+ * @param[in] key_length      - The key length
+ * @param[in] documents       - The document IDs, sorted
+ * @param[in] counts          - The counts
+ * @param[in] postings_length - Number of postings
+ * @param[out] line           - The buffer in which the line is appended
+ * @return  0 for success or -1 in case of error
+ **/
+static int job_reduce_postings(const char *key, size_t key_length, const int *documents, const int *counts, int postings_length, ByteBuffer *line)
+{
+    char posting[MAX_POSTING_TEXT_SIZE] = {'\0'};
+    int error_code = 0;
+
+    error_code |= byte_buffer_append(line, key, key_length);
+    error_code |= byte_buffer_append(line, ": ", 2);
+
+    for (int i = 0; i < postings_length; ++i)
+    {
+        int posting_length = snprintf(posting, MAX_POSTING_TEXT_SIZE, "<%d: %d>", documents[i], counts[i]);
+
+        error_code |= byte_buffer_append(line, posting, posting_length);
+    }
+
+    error_code |= byte_buffer_append(line, "\n", 1);
+
+    return error_code;
+}
+
+/**
+ * @brief   Function used to reduce a key into a line "key: count" with the sum of its counts
+ * @param[in] key             - The key (not NUL terminated)
+ * @param[in] key_length      - The key length
+ * @param[in] documents       - The document IDs, sorted
+ * @param[in] counts          - The counts
+ * @param[in] postings_length - Number of postings
+ * @param[out] line           - The buffer in which the line is appended
+ * @return  0 for success or -1 in case of error
+ **/
+static int job_reduce_count(const char *key, size_t key_length, const int *documents, const int *counts, int postings_length, ByteBuffer *line)
+{
+    char count_text[MAX_COUNT_TEXT_SIZE] = {'\0'};
+    int count_length = 0;
+    uint64_t count = 0;
+    int error_code = 0;
+
+    (void)documents;
+
+    /* Every map task has its own count, the sum may not fit an int */
+    for (int i = 0; i < postings_length; ++i)
+    {
+        count += counts[i];
+    }
+
+    count_length = snprintf(count_text, MAX_COUNT_TEXT_SIZE, ": %llu\n", (unsigned long long)count);
+    error_code |= byte_buffer_append(line, key, key_length);
+    error_code |= byte_buffer_append(line, count_text, count_length);
+
+    return error_code;
+}
+
+/*******************************************
+ *          FUNCTION DEFINITION
+ ******************************************/
+
+/**
+ * @brief   Function used to find a built-in job by name:
+ *          "index"     - the inverted index of the words, the postings of every document
+ *          "wordcount" - the number of occurrences of every word
+ *          "ngram"     - the number of occurrences of every NGRAM_SIZE consecutive words
+ * @param[in] name - The job name
+ * @return  The job or NULL if there is no job with this name
+ **/
+const Job *job_find(const char *name)
+{
+    for (size_t i = 0; i < sizeof(jobs) / sizeof(jobs[0]); ++i)
+    {
+        if (0 == strcmp(jobs[i].name, name))
+        {
+            return &jobs[i];
+        }
+    }
+
+    return NULL;
+}
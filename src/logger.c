@@ -0,0 +1,308 @@
+/*******************************************
+ *              INCLUDES
+ ******************************************/
+#include <stdio.h>   /* stdout/stderr   */
+#include <stdarg.h>  /* varargs         */
+#include <stdlib.h>  /* getenv          */
+#include <string.h>  /* memcpy          */
+#include <strings.h> /* strcasecmp      */
+#include <time.h>    /* clock_gettime   */
+#include <pthread.h> /* flush thread    */
+#include "logger.h"
+
+/*******************************************
+ *                DEFINES
+ ******************************************/
+#define LOG_FILE_FORMAT "log%d.txt"
+#define LOG_FILE_NAME_SIZE 32
+#define LOG_RING_SIZE (1024 * 1024)  /* Bytes buffered before the writers have to wait */
+#define LOG_MAX_MESSAGE_SIZE 1024    /* Longer messages are truncated */
+#define LOG_FLUSH_PERIOD_NS 200000000L /* The flush thread wakes up at least every 200 ms */
+
+/*******************************************
+ *                TYPES
+ ******************************************/
+
+/* struct used to store the state of the logger of the current rank */
+typedef struct Logger_
+{
+    int initialized;
+    int stopping;
+    int rank;
+    int level;
+    FILE *file;
+    char *ring;
+    size_t head; /* Next byte written by the producers */
+    size_t tail; /* Next byte written into the file by the flush thread */
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    pthread_t flush_thread;
+} Logger;
+
+/*******************************************
+ *              STATIC DATA
+ ******************************************/
+static Logger logger = {.level = LOG_INFO,
+                        .lock = PTHREAD_MUTEX_INITIALIZER,
+                        .not_empty = PTHREAD_COND_INITIALIZER,
+                        .not_full = PTHREAD_COND_INITIALIZER};
+
+static const char *level_names[] = {"ERROR", "INFO", "DEBUG"};
+
+/*******************************************
+ *       STATIC FUNCTION DECLARATION
+ ******************************************/
+
+/**
+ * @brief   Function used to read the runtime log level from the environment
+ * @return  The configured level or LOG_INFO if it is not set
+ **/
+static int logger_level_from_env(void);
+
+/**
+ * @brief   Function run by the background thread which writes the ring buffer into the log file
+ * @param[in] arg - Unused
+ * @return  NULL
+ **/
+static void *logger_flush_thread(void *arg);
+
+/**
+ * @brief   Function used to copy a message into the ring buffer. The caller must hold the lock.
+ * @param[in] message - The message
+ * @param[in] length  - The message length
+ * @return  void
+ **/
+static void logger_push(const char *message, size_t length);
+
+/*******************************************
+ *       STATIC FUNCTION DEFINITION
+ ******************************************/
+
+/**
+ * @brief   Function used to read the runtime log level from the environment
+ * @return  The configured level or LOG_INFO if it is not set
+ **/
+static int logger_level_from_env(void)
+{
+    const char *value = getenv(LOG_LEVEL_ENV);
+    int level = LOG_INFO;
+
+    if (NULL != value)
+    {
+        for (int i = LOG_ERROR; i <= LOG_DEBUG; ++i)
+        {
+            if (0 == strcasecmp(value, level_names[i]))
+            {
+                level = i;
+            }
+        }
+    }
+
+    return level;
+}
+
+/**
+ * @brief   Function run by the background thread which writes the ring buffer into the log file
+ * @param[in] arg - Unused
+ * @return  NULL
+ **/
+static void *logger_flush_thread(void *arg)
+{
+    (void)arg;
+
+    pthread_mutex_lock(&logger.lock);
+
+    while ((0 == logger.stopping) || (logger.head != logger.tail))
+    {
+        if (logger.head == logger.tail)
+        {
+            struct timespec deadline = {0};
+
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += LOG_FLUSH_PERIOD_NS;
+
+            if (1000000000L <= deadline.tv_nsec)
+            {
+                deadline.tv_nsec -= 1000000000L;
+                ++deadline.tv_sec;
+            }
+
+            pthread_cond_timedwait(&logger.not_empty, &logger.lock, &deadline);
+        }
+        else
+        {
+            /* Write the contiguous part of the ring without holding the lock */
+            size_t tail = logger.tail;
+            size_t head = logger.head;
+            size_t length = (tail < head) ? head - tail : LOG_RING_SIZE - tail;
+
+            pthread_mutex_unlock(&logger.lock);
+            fwrite(logger.ring + tail, 1, length, logger.file);
+            fflush(logger.file);
+            pthread_mutex_lock(&logger.lock);
+
+            logger.tail = (tail + length) % LOG_RING_SIZE;
+            pthread_cond_broadcast(&logger.not_full);
+        }
+    }
+
+    pthread_mutex_unlock(&logger.lock);
+
+    return NULL;
+}
+
+/**
+ * @brief   Function used to copy a message into the ring buffer. The caller must hold the lock.
+ * @param[in] message - The message
+ * @param[in] length  - The message length
+ * @return  void
+ **/
+static void logger_push(const char *message, size_t length)
+{
+    /* One byte is kept free to tell a full ring from an empty one */
+    while (LOG_RING_SIZE - 1 - (logger.head - logger.tail + LOG_RING_SIZE) % LOG_RING_SIZE < length)
+    {
+        pthread_cond_signal(&logger.not_empty);
+        pthread_cond_wait(&logger.not_full, &logger.lock);
+    }
+
+    for (size_t copied = 0; copied < length;)
+    {
+        size_t chunk = LOG_RING_SIZE - logger.head;
+
+        if (length - copied < chunk)
+        {
+            chunk = length - copied;
+        }
+
+        memcpy(logger.ring + logger.head, message + copied, chunk);
+        logger.head = (logger.head + chunk) % LOG_RING_SIZE;
+        copied += chunk;
+    }
+}
+
+/*******************************************
+ *          FUNCTION DEFINITION
+ ******************************************/
+
+/**
+ * @brief   Function called to start the logger of the current rank.
+ *          The messages are buffered into memory and a background thread
+ *          flushes them into log<rank>.txt.
+ * @param[in] rank - The current process rank
+ * @return  0 for success or -1 in case of error (the messages are printed only to the console)
+ **/
+int logger_init(const int rank)
+{
+    int error_code = -1;
+    char file_name[LOG_FILE_NAME_SIZE] = {'\0'};
+
+    logger.rank = rank;
+    logger.level = logger_level_from_env();
+
+    snprintf(file_name, LOG_FILE_NAME_SIZE, LOG_FILE_FORMAT, rank);
+    logger.file = fopen(file_name, "a");
+    logger.ring = (char *)malloc(LOG_RING_SIZE);
+
+    if ((NULL == logger.file) || (NULL == logger.ring))
+    {
+        fprintf(stderr, "Logger: %s(): Failed to open the log file '%s'.\n", __FUNCTION__, file_name);
+    }
+    else if (0 != pthread_create(&logger.flush_thread, NULL, logger_flush_thread, NULL))
+    {
+        fprintf(stderr, "Logger: %s(): Failed to start the flush thread.\n", __FUNCTION__);
+    }
+    else
+    {
+        logger.initialized = 1;
+        error_code = 0;
+    }
+
+    if (0 != error_code)
+    {
+        if (NULL != logger.file)
+        {
+            fclose(logger.file);
+            logger.file = NULL;
+        }
+
+        free(logger.ring);
+        logger.ring = NULL;
+    }
+
+    return error_code;
+}
+
+/**
+ * @brief   Function called to flush the buffered messages and stop the logger
+ * @return  void
+ **/
+void logger_shutdown(void)
+{
+    if (0 != logger.initialized)
+    {
+        pthread_mutex_lock(&logger.lock);
+        logger.stopping = 1;
+        pthread_cond_signal(&logger.not_empty);
+        pthread_mutex_unlock(&logger.lock);
+
+        pthread_join(logger.flush_thread, NULL);
+
+        fclose(logger.file);
+        free(logger.ring);
+        logger.file = NULL;
+        logger.ring = NULL;
+        logger.initialized = 0;
+    }
+}
+
+/**
+ * @brief   Function called to log a message. Use the log_message() macro instead.
+ * @param[in] level  - The severity level of the message
+ * @param[in] format - The format of the message
+ * @param[in] ...    - Variable length parameters list
+ * @return  void
+ **/
+void logger_write(const int level, const char *format, ...)
+{
+    char message[LOG_MAX_MESSAGE_SIZE] = {'\0'};
+    struct timespec now = {0};
+    int prefix_length = 0;
+    int length = 0;
+    va_list vargs;
+
+    if (level > logger.level)
+    {
+        return;
+    }
+
+    /* Every line starts with the timestamp, so the per rank files can be merged with sort -m */
+    clock_gettime(CLOCK_REALTIME, &now);
+    prefix_length = snprintf(message, LOG_MAX_MESSAGE_SIZE, "%010ld.%06ld [%d] %-5s ",
+                             (long)now.tv_sec, now.tv_nsec / 1000, logger.rank, level_names[level]);
+
+    va_start(vargs, format);
+    length = prefix_length + vsnprintf(message + prefix_length, LOG_MAX_MESSAGE_SIZE - prefix_length, format, vargs);
+    va_end(vargs);
+
+    if (LOG_MAX_MESSAGE_SIZE - 1 <= length)
+    {
+        length = LOG_MAX_MESSAGE_SIZE - 2;
+    }
+
+    if ('\n' != message[length - 1])
+    {
+        message[length++] = '\n';
+        message[length] = '\0';
+    }
+
+    fputs(message + prefix_length, (LOG_ERROR == level) ? stderr : stdout);
+
+    if (0 != logger.initialized)
+    {
+        pthread_mutex_lock(&logger.lock);
+        logger_push(message, length);
+        pthread_mutex_unlock(&logger.lock);
+    }
+}
@@ -3,11 +3,64 @@
  ******************************************/
 #include <stdio.h>  /* stdout/stderr   */
 #include <stdlib.h> /* dynamic memory  */
+#include <errno.h>  /* errno           */
+#include <ctype.h>  /* isdigit         */
+#include <unistd.h> /* getopt          */
 #include "master.h" /* master          */
 #include "worker.h" /* worker          */
-#include "utils.h"  /* log             */
+#include "utils.h"  /* utils           */
+#include "logger.h" /* log             */
+#include "metrics.h" /* metrics        */
+#include "trace.h"  /* timeline       */
+#include "job.h"    /* jobs           */
 #include "mpi.h"
 
+/*******************************************
+ *      STATIC FUNCTION DECLARATION
+ ******************************************/
+
+/**
+ * @brief Function used to parse a positive number of bytes given as an option
+ * @param[in] text  - The option argument
+ * @param[out] size - The number of bytes
+ * @return 0 for success or -1 if the argument is not a positive decimal number
+ **/
+static int parse_size_option(const char *text, uint64_t *size);
+
+/*******************************************
+ *      STATIC FUNCTION DEFINITION
+ ******************************************/
+
+/**
+ * @brief Function used to parse a positive number of bytes given as an option
+ * @param[in] text  - The option argument
+ * @param[out] size - The number of bytes
+ * @return 0 for success or -1 if the argument is not a positive decimal number
+ **/
+static int parse_size_option(const char *text, uint64_t *size)
+{
+    char *end = NULL;
+    unsigned long long value = 0;
+
+    /* strtoull accepts blanks and a sign, so "-1" would wrap into a huge size */
+    if (0 == isdigit((unsigned char)text[0]))
+    {
+        return -1;
+    }
+
+    errno = 0;
+    value = strtoull(text, &end, 10);
+
+    if ((0 != errno) || ('\0' != *end) || (0 == value))
+    {
+        return -1;
+    }
+
+    *size = (uint64_t)value;
+
+    return 0;
+}
+
 /*******************************************
  *                 MAIN
  ******************************************/
@@ -15,28 +68,108 @@ int main(int argc, char **argv)
 {
     int my_rank = -1;
     int workers_count = -1;
+    int option = -1;
+    int invalid_option = 0;
+    Options options = {0};
+
+    options.split_size = DEFAULT_SPLIT_SIZE;
+    options.job = job_find(DEFAULT_JOB_NAME);
+
+    /* -t: also write the map output as text (map<rank>.txt), for debugging
+     * -m: keep the map output in memory and exchange it with MPI instead of the output directory
+     * -s: the number of input bytes of a map task
+     * -b: the memory budget (bytes) of the words of a map task, the words over it are spilled into the scratch directory.
+     *     It can't be combined with -m, which keeps the whole map output of a worker in memory.
+     * -d: the scratch directory (the output directory by default)
+     * -T: record the timeline of the ranks into trace.json, in the output directory
+     * -j: the job run by the workers (index, wordcount or ngram) */
+    while (-1 != (option = getopt(argc, argv, "tms:b:d:Tj:")))
+    {
+        switch (option)
+        {
+            case 't':
+                options.text_map_output = 1;
+                break;
+            case 'm':
+                options.memory_shuffle = 1;
+                break;
+            case 's':
+                invalid_option |= (0 != parse_size_option(optarg, &options.split_size));
+                break;
+            case 'b':
+                invalid_option |= (0 != parse_size_option(optarg, &options.memory_budget));
+                break;
+            case 'd':
+                options.scratch_dir_path = optarg;
+                break;
+            case 'T':
+                options.trace = 1;
+                break;
+            case 'j':
+                options.job = job_find(optarg);
+                invalid_option |= (NULL == options.job);
+                break;
+            default:
+                invalid_option = 1;
+                break;
+        }
+    }
+
+    /* The memory budget would only bound a task, not the map output kept for the shuffle */
+    invalid_option |= ((0 != options.memory_shuffle) && (0 != options.memory_budget));
 
-    if (3 != argc)
+    if ((0 != invalid_option) || (2 != argc - optind))
     {
-        log_message(stderr, "%s():Invalid number of input parameters! Expected %d, received %d.\n", __FUNCTION__, 3, argc);
+        log_message(LOG_ERROR, "%s():Invalid input parameters! Usage: %s [-t] [-m | -b memory_budget] [-s split_size] [-d scratch_dir] [-T] [-j index|wordcount|ngram] input_dir output_dir.\n", __FUNCTION__, argv[0]);
     }
     else
     {
+        options.input_dir_path = argv[optind];
+        options.output_dir_path = argv[optind + 1];
+
+        if (NULL == options.scratch_dir_path)
+        {
+            options.scratch_dir_path = options.output_dir_path;
+        }
+
         MPI_Init(&argc, &argv);
         MPI_Comm_size(MPI_COMM_WORLD, &workers_count);
         MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
 
         --workers_count; /* the master assign tasks to workers */
 
-        if (0 == my_rank)
+        logger_init(my_rank);
+
+        if (0 == workers_count)
         {
-            do_master(argv[1], workers_count);
+            /* Only the master is running, nobody would do the tasks */
+            log_message(LOG_ERROR, "%s():Invalid number of processes! Run %s with at least 2 processes (the master and a worker).\n", __FUNCTION__, argv[0]);
         }
         else
         {
-            do_worker(my_rank, argv[2]);
+            if (0 != options.trace)
+            {
+                trace_init();
+            }
+
+            if (0 == my_rank)
+            {
+                do_master(&options, workers_count);
+            }
+            else
+            {
+                do_worker(my_rank, &options);
+            }
+
+            metrics_report(my_rank, options.output_dir_path);
+
+            if (0 != options.trace)
+            {
+                trace_report(my_rank, options.output_dir_path);
+            }
         }
 
+        logger_shutdown();
         MPI_Finalize();
     }
 
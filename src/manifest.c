@@ -0,0 +1,811 @@
+/*******************************************
+ *              INCLUDES
+ ******************************************/
+#include <stdio.h>     /* FILE            */
+#include <stdlib.h>    /* dynamic memory  */
+#include <string.h>    /* strcmp          */
+#include <errno.h>     /* errno           */
+#include <fcntl.h>     /* open            */
+#include <unistd.h>    /* close, fsync    */
+#include <sys/mman.h>  /* mmap            */
+#include <sys/stat.h>  /* fstat           */
+#include "manifest.h"
+#include "logger.h"
+
+/*******************************************
+ *                DEFINES
+ ******************************************/
+#define MANIFEST_LINE_SIZE (MAX_PATH + 128)
+#define MANIFEST_TEMPORARY_SUFFIX ".tmp"
+#define JOB_LINE_FORMAT "job %31s" /* JOB_NAME_SIZE - 1 characters */
+#define MIN_MANIFEST_CAPACITY 64
+#define HASH_SEED 0xcbf29ce484222325ULL
+#define HASH_MULTIPLIER 0x9e3779b97f4a7c15ULL
+
+/*******************************************
+ *       STATIC FUNCTION DECLARATION
+ ******************************************/
+
+/**
+ * @brief   Function used to read the next line of a manifest, without the end of line
+ * @param[out] line - Buffer of MANIFEST_LINE_SIZE bytes
+ * @param[in] file  - The manifest file
+ * @return  0 for success or -1 at the end of the file or in case of error
+ **/
+static int manifest_read_line(char *line, FILE *file);
+
+/**
+ * @brief   Function used to read a split key written in hex
+ * @param[in] line   - The line "split <hex key>"
+ * @param[out] split - Buffer of SPLIT_KEY_SIZE bytes, filled with 0 before
+ * @return  0 for success or -1 in case of error
+ **/
+static int manifest_parse_split(const char *line, char *split);
+
+/**
+ * @brief   Function used to write a split key in hex
+ * @param[in] file  - The manifest or journal file
+ * @param[in] split - The split key, NUL terminated
+ * @return  void
+ **/
+static void manifest_write_split(FILE *file, const char *split);
+
+/**
+ * @brief   Function used to read a file line
+ * @param[in] line   - The line "file <document_id> <first_task> <last_task> <size> <mtime> <has_hash> <hash> <path>"
+ * @param[out] entry - The file
+ * @return  0 for success or -1 in case of error
+ **/
+static int manifest_parse_file(const char *line, ManifestFile *entry);
+
+/**
+ * @brief   Function used to write a file line
+ * @param[in] file  - The manifest or journal file
+ * @param[in] entry - The file
+ * @return  void
+ **/
+static void manifest_write_file(FILE *file, const ManifestFile *entry);
+
+/**
+ * @brief   Function used by qsort and bsearch to compare two files of a manifest by path
+ * @param[in] first  - The first file
+ * @param[in] second - The second file
+ * @return  < 0, 0 or > 0 if the first path is smaller, equal or greater than the second one
+ **/
+static int compare_manifest_files(const void *first, const void *second);
+
+/**
+ * @brief   Function used by qsort to compare two files of a journal by path, then by last task.
+ *          The file of a later job has greater task IDs.
+ * @param[in] first  - The first file
+ * @param[in] second - The second file
+ * @return  < 0, 0 or > 0 if the first file is smaller, equal or greater than the second one
+ **/
+static int compare_journal_files(const void *first, const void *second);
+
+/**
+ * @brief   Function used to mix 8 bytes into a hash
+ * @param[in] hash  - The hash
+ * @param[in] value - The bytes
+ * @return  The new hash
+ **/
+static uint64_t hash_mix(uint64_t hash, uint64_t value);
+
+/**
+ * @brief   Function used to hash bytes of a file. The word of the file at the offset 8 * i adds its value times
+ *          a key of i to the hash, so the bytes of a word hashed in two ranges add up to the hash of the word.
+ * @param[in] data   - The bytes
+ * @param[in] offset - Offset of the bytes into the file
+ * @param[in] length - Number of bytes
+ * @return  The hash of the bytes
+ **/
+static uint64_t hash_bytes(const unsigned char *data, uint64_t offset, size_t length);
+
+/*******************************************
+ *       STATIC FUNCTION DEFINITION
+ ******************************************/
+
+/**
+ * @brief   Function used to read the next line of a manifest, without the end of line
+ * @param[out] line - Buffer of MANIFEST_LINE_SIZE bytes
+ * @param[in] file  - The manifest file
+ * @return  0 for success or -1 at the end of the file or in case of error
+ **/
+static int manifest_read_line(char *line, FILE *file)
+{
+    size_t length = 0;
+
+    if (NULL == fgets(line, MANIFEST_LINE_SIZE, file))
+    {
+        return -1;
+    }
+
+    length = strlen(line);
+
+    /* A line without its end of line was cut */
+    if ((0 == length) || ('\n' != line[length - 1]))
+    {
+        return -1;
+    }
+
+    line[length - 1] = '\0';
+
+    return 0;
+}
+
+/**
+ * @brief   Function used to read a split key written in hex
+ * @param[in] line   - The line "split <hex key>"
+ * @param[out] split - Buffer of SPLIT_KEY_SIZE bytes, filled with 0 before
+ * @return  0 for success or -1 in case of error
+ **/
+static int manifest_parse_split(const char *line, char *split)
+{
+    char hex[2 * SPLIT_KEY_SIZE + 1] = {'\0'};
+    size_t hex_length = 0;
+    int error_code = (1 == sscanf(line, "split %8s", hex)) ? 0 : -1;
+
+    hex_length = strlen(hex);
+
+    for (size_t j = 0; (0 == error_code) && (j < hex_length / 2) && (j < SPLIT_KEY_SIZE - 1); ++j)
+    {
+        unsigned int byte = 0;
+
+        error_code = (1 == sscanf(hex + 2 * j, "%2x", &byte)) ? 0 : -1;
+        split[j] = (char)byte;
+    }
+
+    return error_code;
+}
+
+/**
+ * @brief   Function used to write a split key in hex
+ * @param[in] file  - The manifest or journal file
+ * @param[in] split - The split key, NUL terminated
+ * @return  void
+ **/
+static void manifest_write_split(FILE *file, const char *split)
+{
+    const unsigned char *key = (const unsigned char *)split;
+
+    fprintf(file, "split ");
+
+    for (int j = 0; (j < SPLIT_KEY_SIZE - 1) && ('\0' != key[j]); ++j)
+    {
+        fprintf(file, "%02x", key[j]);
+    }
+
+    /* An empty key still needs a word for sscanf */
+    fprintf(file, ('\0' == key[0]) ? "00\n" : "\n");
+}
+
+/**
+ * @brief   Function used to read a file line
+ * @param[in] line   - The line "file <document_id> <first_task> <last_task> <size> <mtime> <has_hash> <hash> <path>"
+ * @param[out] entry - The file
+ * @return  0 for success or -1 in case of error
+ **/
+static int manifest_parse_file(const char *line, ManifestFile *entry)
+{
+    unsigned long long size = 0;
+    long long mtime = 0;
+    unsigned long long hash = 0;
+    int path_offset = 0;
+
+    memset(entry, 0, sizeof(ManifestFile));
+
+    if ((7 != sscanf(line, "file %d %d %d %llu %lld %d %llx %n", &entry->document_id, &entry->first_task, &entry->last_task,
+                     &size, &mtime, &entry->has_hash, &hash, &path_offset)) ||
+        (0 == path_offset) || ('\0' == line[path_offset]) || (MAX_PATH <= strlen(line + path_offset)))
+    {
+        return -1;
+    }
+
+    entry->size = size;
+    entry->mtime = mtime;
+    entry->hash = hash;
+    strcpy(entry->path, line + path_offset);
+
+    return 0;
+}
+
+/**
+ * @brief   Function used to write a file line
+ * @param[in] file  - The manifest or journal file
+ * @param[in] entry - The file
+ * @return  void
+ **/
+static void manifest_write_file(FILE *file, const ManifestFile *entry)
+{
+    fprintf(file, "file %d %d %d %llu %lld %d %llx %s\n", entry->document_id, entry->first_task, entry->last_task,
+            (unsigned long long)entry->size, (long long)entry->mtime, entry->has_hash, (unsigned long long)entry->hash, entry->path);
+}
+
+/**
+ * @brief   Function used by qsort and bsearch to compare two files of a manifest by path
+ * @param[in] first  - The first file
+ * @param[in] second - The second file
+ * @return  < 0, 0 or > 0 if the first path is smaller, equal or greater than the second one
+ **/
+static int compare_manifest_files(const void *first, const void *second)
+{
+    return strcmp(((const ManifestFile *)first)->path, ((const ManifestFile *)second)->path);
+}
+
+/**
+ * @brief   Function used by qsort to compare two files of a journal by path, then by last task.
+ *          The file of a later job has greater task IDs.
+ * @param[in] first  - The first file
+ * @param[in] second - The second file
+ * @return  < 0, 0 or > 0 if the first file is smaller, equal or greater than the second one
+ **/
+static int compare_journal_files(const void *first, const void *second)
+{
+    const ManifestFile *first_file = (const ManifestFile *)first;
+    const ManifestFile *second_file = (const ManifestFile *)second;
+    int result = strcmp(first_file->path, second_file->path);
+
+    if (0 == result)
+    {
+        result = (first_file->last_task > second_file->last_task) - (first_file->last_task < second_file->last_task);
+    }
+
+    return result;
+}
+
+/**
+ * @brief   Function used to mix 8 bytes into a hash
+ * @param[in] hash  - The hash
+ * @param[in] value - The bytes
+ * @return  The new hash
+ **/
+static uint64_t hash_mix(uint64_t hash, uint64_t value)
+{
+    hash ^= value * HASH_MULTIPLIER;
+    hash = (hash << 31) | (hash >> 33);
+
+    return hash * HASH_MULTIPLIER;
+}
+
+/**
+ * @brief   Function used to hash bytes of a file. The word of the file at the offset 8 * i adds its value times
+ *          a key of i to the hash, so the bytes of a word hashed in two ranges add up to the hash of the word.
+ * @param[in] data   - The bytes
+ * @param[in] offset - Offset of the bytes into the file
+ * @param[in] length - Number of bytes
+ * @return  The hash of the bytes
+ **/
+static uint64_t hash_bytes(const unsigned char *data, uint64_t offset, size_t length)
+{
+    uint64_t hash = 0;
+    size_t i = 0;
+
+    while (i < length)
+    {
+        uint64_t word_index = (offset + i) / sizeof(uint64_t);
+        size_t word_offset = (offset + i) % sizeof(uint64_t);
+        size_t count = (sizeof(uint64_t) - word_offset < length - i) ? sizeof(uint64_t) - word_offset : length - i;
+        uint64_t value = 0;
+
+        /* A part of a word keeps the place of its bytes, the others are 0. The key is odd, so no change is lost. */
+        if (sizeof(uint64_t) == count)
+        {
+            memcpy(&value, data + i, sizeof(uint64_t));
+        }
+        else
+        {
+            memcpy((unsigned char *)&value + word_offset, data + i, count);
+        }
+
+        hash += value * (hash_mix(HASH_SEED, word_index) | 1);
+        i += count;
+    }
+
+    return hash;
+}
+
+/*******************************************
+ *          FUNCTION DEFINITION
+ ******************************************/
+
+/**
+ * @brief   Function used to read a manifest
+ * @param[out] manifest - The manifest. It is empty if the function failed.
+ * @param[in] path      - The manifest path
+ * @return  0 for success or -1 in case of error (a missing manifest is an error too)
+ **/
+int manifest_load(Manifest *manifest, const char *path)
+{
+    char line[MANIFEST_LINE_SIZE] = {'\0'};
+    int error_code = -1;
+    int partitions_count = 0;
+    FILE *file = fopen(path, "r");
+
+    memset(manifest, 0, sizeof(Manifest));
+
+    if (NULL == file)
+    {
+        return -1;
+    }
+
+    if ((0 == manifest_read_line(line, file)) && (0 == strcmp(line, MANIFEST_HEADER)) &&
+        (0 == manifest_read_line(line, file)) && (1 == sscanf(line, JOB_LINE_FORMAT, manifest->job)) &&
+        (0 == manifest_read_line(line, file)) && (1 == sscanf(line, "workers %d", &partitions_count)) && (0 < partitions_count) &&
+        (0 == manifest_read_line(line, file)) && (2 == sscanf(line, "next %d %d", &manifest->next_task_id, &manifest->next_document_id)))
+    {
+        manifest->splits.splits = (char *)calloc(partitions_count, SPLIT_KEY_SIZE);
+        manifest->partition_lengths = (uint64_t *)calloc(partitions_count, sizeof(uint64_t));
+        manifest->index_lengths = (uint64_t *)calloc(partitions_count, sizeof(uint64_t));
+        error_code = ((NULL == manifest->splits.splits) || (NULL == manifest->partition_lengths) ||
+                      (NULL == manifest->index_lengths)) ? -1 : 0;
+    }
+
+    /* The split keys are stored in hex, they are raw bytes */
+    for (int i = 0; (0 == error_code) && (i < partitions_count - 1); ++i)
+    {
+        error_code = ((0 == manifest_read_line(line, file)) &&
+                      (0 == manifest_parse_split(line, manifest->splits.splits + i * SPLIT_KEY_SIZE))) ? 0 : -1;
+    }
+
+    for (int i = 0; (0 == error_code) && (i < partitions_count); ++i)
+    {
+        unsigned long long length = 0;
+        unsigned long long index_length = 0;
+
+        error_code = ((0 == manifest_read_line(line, file)) && (2 == sscanf(line, "partition %llu %llu", &length, &index_length))) ? 0 : -1;
+        manifest->partition_lengths[i] = length;
+        manifest->index_lengths[i] = index_length;
+    }
+
+    while ((0 == error_code) && (0 == manifest_read_line(line, file)))
+    {
+        ManifestFile entry = {0};
+
+        if (0 != manifest_parse_file(line, &entry))
+        {
+            error_code = -1;
+            break;
+        }
+
+        error_code = manifest_add_file(manifest, &entry);
+    }
+
+    if ((0 == error_code) && (0 == ferror(file)) && (0 != feof(file)))
+    {
+        manifest->splits.partitions_count = partitions_count;
+    }
+    else
+    {
+        log_message(LOG_ERROR, "Manifest: %s(): The file '%s' is not a valid manifest.\n", __FUNCTION__, path);
+        manifest_free(manifest);
+        error_code = -1;
+    }
+
+    fclose(file);
+
+    return error_code;
+}
+
+/**
+ * @brief   Function used to write a manifest. It is written into a temporary file which replaces the previous one.
+ * @param[in] manifest - The manifest
+ * @param[in] path     - The manifest path
+ * @return  0 for success or -1 in case of error
+ **/
+int manifest_save(const Manifest *manifest, const char *path)
+{
+    char temporary_path[MAX_PATH + sizeof(MANIFEST_TEMPORARY_SUFFIX)] = {'\0'};
+    int error_code = 0;
+    FILE *file = NULL;
+
+    snprintf(temporary_path, sizeof(temporary_path), "%s%s", path, MANIFEST_TEMPORARY_SUFFIX);
+
+    if (NULL == (file = fopen(temporary_path, "w")))
+    {
+        log_message(LOG_ERROR, "Manifest: %s(): Failed to open file '%s'. Errno: %s.\n", __FUNCTION__, temporary_path, strerror(errno));
+        return -1;
+    }
+
+    fprintf(file, "%s\njob %s\nworkers %d\nnext %d %d\n", MANIFEST_HEADER, manifest->job, manifest->splits.partitions_count,
+            manifest->next_task_id, manifest->next_document_id);
+
+    for (int i = 0; i < manifest->splits.partitions_count - 1; ++i)
+    {
+        manifest_write_split(file, manifest->splits.splits + i * SPLIT_KEY_SIZE);
+    }
+
+    for (int i = 0; i < manifest->splits.partitions_count; ++i)
+    {
+        fprintf(file, "partition %llu %llu\n", (unsigned long long)manifest->partition_lengths[i],
+                (unsigned long long)manifest->index_lengths[i]);
+    }
+
+    for (int i = 0; i < manifest->files_length; ++i)
+    {
+        manifest_write_file(file, &manifest->files[i]);
+    }
+
+    error_code = (0 != ferror(file)) ? -1 : 0;
+
+    if ((0 != fclose(file)) || (0 != error_code))
+    {
+        log_message(LOG_ERROR, "Manifest: %s(): Failed to write file '%s'.\n", __FUNCTION__, temporary_path);
+        error_code = -1;
+    }
+    else if (0 != rename(temporary_path, path))
+    {
+        log_message(LOG_ERROR, "Manifest: %s(): Failed to rename file '%s'. Errno: %s.\n", __FUNCTION__, temporary_path, strerror(errno));
+        error_code = -1;
+    }
+
+    if (0 != error_code)
+    {
+        remove(temporary_path);
+    }
+
+    return error_code;
+}
+
+/**
+ * @brief   Function used to add the files and the key ranges of a journal to a manifest.
+ *          A file of the journal replaces the one of the manifest. The key ranges are taken only if the manifest
+ *          doesn't have its own and they have partitions_count partitions.
+ * @param[in,out] manifest     - The manifest
+ * @param[in] path             - The journal path
+ * @param[in] partitions_count - The number of partitions of the current job
+ * @param[in] job              - The name of the current job
+ * @return  0 for success or -1 in case of error (a missing journal or the journal of another job is an error too)
+ **/
+int manifest_load_journal(Manifest *manifest, const char *path, const int partitions_count, const char *job)
+{
+    char line[MANIFEST_LINE_SIZE] = {'\0'};
+    char journal_job[JOB_NAME_SIZE] = {'\0'};
+    char *splits = (char *)calloc(partitions_count, SPLIT_KEY_SIZE);
+    char *added = NULL;
+    int splits_found = 0;
+    int error_code = 0;
+    Manifest journal = {0};
+    FILE *file = fopen(path, "r");
+
+    if (NULL == file)
+    {
+        free(splits);
+        return -1;
+    }
+
+    if ((NULL == splits) || (0 != manifest_read_line(line, file)) || (0 != strcmp(line, JOURNAL_HEADER)) ||
+        (0 != manifest_read_line(line, file)) || (1 != sscanf(line, JOB_LINE_FORMAT, journal_job)))
+    {
+        log_message(LOG_ERROR, "Manifest: %s(): The file '%s' is not a valid journal.\n", __FUNCTION__, path);
+        free(splits);
+        fclose(file);
+        return -1;
+    }
+
+    if (0 != strcmp(journal_job, job))
+    {
+        /* The runs of another job can't be used by this one */
+        log_message(LOG_INFO, "Manifest: %s(): The journal '%s' is of the job '%s'.\n", __FUNCTION__, path, journal_job);
+        free(splits);
+        fclose(file);
+        return -1;
+    }
+
+    /* The journal of a job which failed may end with a cut line, the lines which can't be read are skipped */
+    while ((0 == error_code) && (0 == manifest_read_line(line, file)))
+    {
+        ManifestFile entry = {0};
+        int workers = 0;
+
+        if (0 == manifest_parse_file(line, &entry))
+        {
+            error_code = manifest_add_file(&journal, &entry);
+        }
+        else if ((1 == sscanf(line, "workers %d", &workers)) && (partitions_count == workers))
+        {
+            memset(splits, 0, partitions_count * SPLIT_KEY_SIZE);
+            splits_found = 1;
+
+            for (int i = 0; (0 != splits_found) && (i < partitions_count - 1); ++i)
+            {
+                splits_found = ((0 == manifest_read_line(line, file)) && (0 == manifest_parse_split(line, splits + i * SPLIT_KEY_SIZE))) ? 1 : 0;
+            }
+        }
+    }
+
+    fclose(file);
+
+    if ((0 == error_code) && (0 != journal.files_length) && (NULL == (added = (char *)calloc(journal.files_length, sizeof(char)))))
+    {
+        log_message(LOG_ERROR, "Manifest: %s(): Out of memory! .\n", __FUNCTION__);
+        error_code = -1;
+    }
+
+    if (0 == error_code)
+    {
+        /* A file recorded by several jobs keeps the line of the last one */
+        qsort(journal.files, journal.files_length, sizeof(ManifestFile), compare_journal_files);
+        manifest_sort_files(manifest);
+
+        for (int i = 0; i < journal.files_length; ++i)
+        {
+            const ManifestFile *entry = &journal.files[i];
+            ManifestFile *previous_file = NULL;
+
+            if ((i + 1 < journal.files_length) && (0 == strcmp(entry->path, journal.files[i + 1].path)))
+            {
+                continue;
+            }
+
+            if (NULL == (previous_file = manifest_find_file(manifest, entry->path)))
+            {
+                added[i] = 1;
+            }
+            else
+            {
+                *previous_file = *entry;
+            }
+
+            manifest->next_task_id = (entry->last_task >= manifest->next_task_id) ? entry->last_task + 1 : manifest->next_task_id;
+            manifest->next_document_id = (entry->document_id >= manifest->next_document_id) ? entry->document_id + 1 : manifest->next_document_id;
+        }
+
+        /* The new files are added after the search, which needs the files sorted */
+        for (int i = 0; (0 == error_code) && (i < journal.files_length); ++i)
+        {
+            error_code = (0 != added[i]) ? manifest_add_file(manifest, &journal.files[i]) : 0;
+        }
+    }
+
+    if ((0 == error_code) && (0 != splits_found) && (0 == manifest->splits.partitions_count))
+    {
+        manifest->partition_lengths = (uint64_t *)calloc(partitions_count, sizeof(uint64_t));
+        manifest->index_lengths = (uint64_t *)calloc(partitions_count, sizeof(uint64_t));
+
+        if ((NULL == manifest->partition_lengths) || (NULL == manifest->index_lengths))
+        {
+            log_message(LOG_ERROR, "Manifest: %s(): Out of memory! .\n", __FUNCTION__);
+            error_code = -1;
+        }
+        else
+        {
+            free(manifest->splits.splits);
+            manifest->splits.splits = splits;
+            manifest->splits.partitions_count = partitions_count;
+            splits = NULL;
+        }
+    }
+
+    free(splits);
+    free(added);
+    manifest_free(&journal);
+
+    return error_code;
+}
+
+/**
+ * @brief   Function used to open a journal to append to it. A new journal gets its header and the job name.
+ * @param[out] journal - The journal
+ * @param[in] path     - The journal path
+ * @param[in] job      - The name of the current job
+ * @return  0 for success or -1 in case of error
+ **/
+int manifest_journal_open(FILE **journal, const char *path, const char *job)
+{
+    FILE *file = fopen(path, "a+");
+    long length = 0;
+
+    *journal = NULL;
+
+    if ((NULL == file) || (0 != fseek(file, 0, SEEK_END)) || (0 > (length = ftell(file))))
+    {
+        log_message(LOG_ERROR, "Manifest: %s(): Failed to open file '%s'. Errno: %s.\n", __FUNCTION__, path, strerror(errno));
+
+        if (NULL != file)
+        {
+            fclose(file);
+        }
+
+        return -1;
+    }
+
+    if (0 == length)
+    {
+        fprintf(file, "%s\njob %s\n", JOURNAL_HEADER, job);
+    }
+    else if ((0 == fseek(file, -1, SEEK_END)) && ('\n' != fgetc(file)))
+    {
+        /* The last line was cut by the failed job, the next one starts on its own line */
+        fprintf(file, "\n");
+    }
+
+    *journal = file;
+
+    return manifest_journal_sync(file);
+}
+
+/**
+ * @brief   Function used to record into a journal a file whose runs are all committed
+ * @param[in] journal - The journal
+ * @param[in] file    - The file
+ * @return  0 for success or -1 in case of error
+ **/
+int manifest_journal_add_file(FILE *journal, const ManifestFile *file)
+{
+    manifest_write_file(journal, file);
+
+    return (0 != ferror(journal)) ? -1 : 0;
+}
+
+/**
+ * @brief   Function used to record into a journal the key ranges of the job
+ * @param[in] journal - The journal
+ * @param[in] splits  - The key ranges
+ * @return  0 for success or -1 in case of error
+ **/
+int manifest_journal_add_splits(FILE *journal, const KeySplits *splits)
+{
+    fprintf(journal, "workers %d\n", splits->partitions_count);
+
+    for (int i = 0; i < splits->partitions_count - 1; ++i)
+    {
+        manifest_write_split(journal, splits->splits + i * SPLIT_KEY_SIZE);
+    }
+
+    return (0 != ferror(journal)) ? -1 : 0;
+}
+
+/**
+ * @brief   Function used to write the recorded lines of a journal to the disk
+ * @param[in] journal - The journal
+ * @return  0 for success or -1 in case of error
+ **/
+int manifest_journal_sync(FILE *journal)
+{
+    if ((0 != fflush(journal)) || (0 != fsync(fileno(journal))))
+    {
+        log_message(LOG_ERROR, "Manifest: %s(): Failed to write the journal. Errno: %s.\n", __FUNCTION__, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief   Function used to add a file to a manifest
+ * @param[in] manifest - The manifest
+ * @param[in] file     - The file, which is copied
+ * @return  0 for success or -1 in case of error
+ **/
+int manifest_add_file(Manifest *manifest, const ManifestFile *file)
+{
+    if (manifest->files_length == manifest->files_capacity)
+    {
+        int capacity = (0 == manifest->files_capacity) ? MIN_MANIFEST_CAPACITY : 2 * manifest->files_capacity;
+        ManifestFile *files = (ManifestFile *)realloc(manifest->files, capacity * sizeof(ManifestFile));
+
+        if (NULL == files)
+        {
+            log_message(LOG_ERROR, "Manifest: %s(): Out of memory! .\n", __FUNCTION__);
+            return -1;
+        }
+
+        manifest->files = files;
+        manifest->files_capacity = capacity;
+    }
+
+    manifest->files[manifest->files_length++] = *file;
+
+    return 0;
+}
+
+/**
+ * @brief   Function used to sort the files of a manifest by path, for manifest_find_file()
+ * @param[in] manifest - The manifest
+ * @return  void
+ **/
+void manifest_sort_files(Manifest *manifest)
+{
+    if (0 != manifest->files_length)
+    {
+        qsort(manifest->files, manifest->files_length, sizeof(ManifestFile), compare_manifest_files);
+    }
+}
+
+/**
+ * @brief   Function used to find a file into a manifest sorted with manifest_sort_files()
+ * @param[in] manifest - The manifest
+ * @param[in] path     - The file path
+ * @return  The file or NULL if it is missing
+ **/
+ManifestFile *manifest_find_file(const Manifest *manifest, const char *path)
+{
+    ManifestFile key = {0};
+
+    if (0 == manifest->files_length)
+    {
+        return NULL;
+    }
+
+    snprintf(key.path, MAX_PATH, "%s", path);
+
+    return (ManifestFile *)bsearch(&key, manifest->files, manifest->files_length, sizeof(ManifestFile), compare_manifest_files);
+}
+
+/**
+ * @brief   Function used to free the memory of a manifest
+ * @param[in] manifest - The manifest
+ * @return  void
+ **/
+void manifest_free(Manifest *manifest)
+{
+    free(manifest->splits.splits);
+    free(manifest->partition_lengths);
+    free(manifest->index_lengths);
+    free(manifest->files);
+    memset(manifest, 0, sizeof(Manifest));
+}
+
+/**
+ * @brief   Function used to hash the content of a file
+ * @param[in] path  - The file path
+ * @param[out] hash - The hash
+ * @return  0 for success or -1 in case of error
+ **/
+int manifest_hash_file(const char *path, uint64_t *hash)
+{
+    return manifest_hash_range(path, 0, UINT64_MAX, hash);
+}
+
+/**
+ * @brief   Function used to hash a byte range of a file. The hashes of the ranges which cover a file once
+ *          add up (modulo 2^64) to the hash of the file, so the splits of a file are hashed by the workers which map them.
+ * @param[in] path   - The file path
+ * @param[in] offset - Offset of the range
+ * @param[in] length - Length of the range (it may go past the end of the file)
+ * @param[out] hash  - The hash of the range
+ * @return  0 for success or -1 in case of error
+ **/
+int manifest_hash_range(const char *path, uint64_t offset, uint64_t length, uint64_t *hash)
+{
+    int error_code = -1;
+    int fd = open(path, O_RDONLY);
+    struct stat file_stat = {0};
+
+    *hash = 0;
+
+    if ((-1 == fd) || (0 != fstat(fd, &file_stat)))
+    {
+        log_message(LOG_ERROR, "Manifest: %s(): Failed to open file '%s'. Errno: %s.\n", __FUNCTION__, path, strerror(errno));
+    }
+    else if (offset >= (uint64_t)file_stat.st_size)
+    {
+        error_code = 0;
+    }
+    else
+    {
+        uint64_t map_offset = offset - offset % sysconf(_SC_PAGESIZE);
+        uint64_t end = (length < (uint64_t)file_stat.st_size - offset) ? offset + length : (uint64_t)file_stat.st_size;
+        size_t size = end - map_offset;
+        const unsigned char *data = (const unsigned char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, map_offset);
+
+        if (MAP_FAILED == data)
+        {
+            log_message(LOG_ERROR, "Manifest: %s(): Failed to map file '%s'. Errno: %s.\n", __FUNCTION__, path, strerror(errno));
+        }
+        else
+        {
+            madvise((void *)data, size, MADV_SEQUENTIAL);
+            *hash = hash_bytes(data + (offset - map_offset), offset, end - offset);
+            munmap((void *)data, size);
+            error_code = 0;
+        }
+    }
+
+    if (-1 != fd)
+    {
+        close(fd);
+    }
+
+    return error_code;
+}
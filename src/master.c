@@ -6,256 +6,1568 @@
 #include <errno.h>  /* errno           */
 #include <string.h> /* strerror        */
 #include <stdlib.h> /* dynamic memory  */
+#include <unistd.h> /* unlink, usleep  */
+#include <sys/stat.h> /* stat          */
 #include "mpi.h"
 #include "master.h"
 #include "utils.h"
+#include "logger.h"
+#include "run_file.h"
+#include "manifest.h"
+#include "index_file.h"
+#include "metrics.h"
 
 /*******************************************
  *                DEFINES
  ******************************************/
-#define ENGLISH_ALPHABET_SIZE ('z' - 'a' + 1)
-#define RESULT_FILE_NAME "result.txt"
+#define BATCH_TARGET_SECONDS 0.25 /* A batch of map tasks should keep a worker busy for about this long */
+
+/* A map task is backed up on an idle worker when it runs this many times longer than the mean task, and at least
+ * SPECULATION_MIN_SECONDS. The copy which is done first is kept, the other one is cancelled. */
+#define SPECULATION_FACTOR 2.0
+#define SPECULATION_MIN_SECONDS 0.1
+#define SPECULATION_POLL_MICROSECONDS 1000 /* Wait between two checks of the running tasks while a worker is idle */
+
+/*******************************************
+ *                TYPES
+ ******************************************/
+
+/* struct used by master to build the map tasks from the files of the input directory */
+typedef struct TaskSource_
+{
+    Manifest *files;           /* The input files, the ones without a task are mapped */
+    int next_file;
+    uint64_t split_size;       /* Bytes of input in a task */
+    int next_task_id;
+    MapTaskItem split_file;    /* The big file which is being split, if split_file_size != 0 */
+    uint64_t split_file_size;
+    int split_file_index;      /* Index of the big file into files */
+    MapTask *ready_tasks;      /* Tasks built ahead while the workers are busy, a ring of MAX_BATCH_TASKS */
+    int ready_first;
+    int ready_length;
+    int *document_files;       /* Index into files of every document ID, for the hashes sent by the workers */
+    uint64_t *hashed_lengths;  /* Bytes of every file hashed by the tasks done, the hash is known once they cover the file */
+} TaskSource;
+
+/* struct used by master to follow a map task sent to a worker untill one of its copies is done */
+typedef struct RunningTask_
+{
+    MapTask task;
+    int worker_rank;
+    int backup_rank;   /* The worker of the backup copy, 0 if the task wasn't backed up */
+    double start_time; /* Estimated from the position of the task in its batch, exact for the last one */
+} RunningTask;
+
+/* struct used by master to back up the slow map tasks (speculative execution).
+ * The idle workers are held, instead of being stopped, untill all the tasks are done. */
+typedef struct TaskTracker_
+{
+    int speculate;       /* 0 if the copies of a task would not write the same output (-m or -t) */
+    int number_of_workers;
+    RunningTask *tasks;
+    int length;
+    int *last_tasks;     /* The ID of the last task sent in a batch to every worker */
+    char *idle_workers;  /* The held workers, their requests are answered when a backup is sent or at the end */
+    int idle_count;
+    int tasks_done;      /* The timing of all the tasks done, the mean task is the reference of a slow one */
+    double tasks_seconds;
+} TaskTracker;
+
+/* struct used by master to record into the journal the files whose runs are committed (see manifest.h) */
+typedef struct TaskJournal_
+{
+    FILE *file;        /* NULL if the map output is not kept (-m) */
+    int first_task_id; /* The first task of the job */
+    char *done_tasks;  /* The committed tasks, from first_task_id on */
+    int done_capacity;
+    char *recorded_files; /* The files recorded or kept from the previous run, by index */
+    int next_file;        /* The files before it are all recorded or kept */
+} TaskJournal;
+
+/* struct used by master to update the output directory of the previous run instead of rebuilding it (see manifest.h) */
+typedef struct IndexUpdate_
+{
+    Manifest previous; /* Empty if the output directory is rebuilt */
+    Manifest current;
+    char *reduced;     /* The key ranges which are reduced, the other ones are copied from the previous result */
+    TaskJournal journal;
+} IndexUpdate;
 
 /*******************************************
  *       STATIC FUNCTION DECLARATION
  ******************************************/
 
 /**
- * @brief Function called by master to assign files the workers durring map phase
- * @param[in] input_dir_path    - Input directory's path
+ * @brief Function called by master to compare the input directory with the manifest of the previous run.
+ *        The files with the same size and modification time, or with the same content, keep their runs.
+ *        The runs of the changed and deleted files are removed, with the ones of the files packed in the same tasks.
+ * @param[in] options           - The command line options
+ * @param[in] number_of_workers - Number of workers
+ * @param[out] update           - The files to map and the key ranges to reduce
+ * @return void
+ **/
+static void master_update_phase(const Options *options, const int number_of_workers, IndexUpdate *update);
+
+/**
+ * @brief Function called by master to remove a run which is not used anymore.
+ *        The key ranges of its terms are reduced again.
+ * @param[in,out] update     - The update of the output directory
+ * @param[in] run_file_path  - Path of the run
+ * @return void
+ **/
+static void master_drop_run(IndexUpdate *update, const char *run_file_path);
+
+/**
+ * @brief Function called by master to assign tasks the workers durring map phase
+ * @param[in] number_of_workers - Number of workers
+ * @param[in] options           - The command line options
+ * @param[in,out] update        - The files to map. Their tasks are stored into it.
+ * @return void
+ **/
+static void master_map_phase(const Options *options, const int number_of_workers, IndexUpdate *update);
+
+/**
+ * @brief Function called by master to build the next map task. The files bigger than the split size
+ *        are cut into splits of that size, the smaller ones are packed together untill they reach it.
+ *        The files which kept their runs from the previous run are skipped.
+ * @param[in,out] source - The input files
+ * @param[out] task      - The task
+ * @return 1 if a task was built or 0 if there is no input left
+ **/
+static int master_next_task(TaskSource *source, MapTask *task);
+
+/**
+ * @brief Function called by master to build a task ahead, while no worker waits for one
+ * @param[in,out] source - The input files
+ * @return 1 if a task was built or 0 if there is no input left or the ready tasks are full
+ **/
+static int master_prepare_task(TaskSource *source);
+
+/**
+ * @brief Function called by master to get the next task to send, a ready one or a new one
+ * @param[in,out] source - The input files
+ * @param[out] task      - The task
+ * @return 1 if there is a task or 0 if there is no input left
+ **/
+static int master_take_task(TaskSource *source, MapTask *task);
+
+/**
+ * @brief Function called by master to check if there are tasks left to send
+ * @param[in,out] source - The input files
+ * @return 1 if there is a task or 0 if there is no input left
+ **/
+static int master_tasks_left(TaskSource *source);
+
+/**
+ * @brief Function called by master to send the next batch of tasks to a worker.
+ *        The batch is sized from the worker's timing, so that it keeps the worker busy for BATCH_TARGET_SECONDS.
+ *        If there is no task left, the worker is signaled that the map phase is over, unless it is still parsing
+ *        a task and the tasks are backed up. Then it gets an empty batch and asks again when it is idle.
+ * @param[in,out] source  - The input files
+ * @param[in,out] tracker - The running tasks, the sent ones are added
+ * @param[in] worker_rank - The worker's rank
+ * @param[in] request     - The worker's request
+ * @return 1 if a batch was sent or 0 if the stop signal was sent
+ **/
+static int master_send_next_batch(TaskSource *source, TaskTracker *tracker, const int worker_rank, const TaskRequest *request);
+
+/**
+ * @brief Function called by master to remove the tasks done by a worker from the running ones.
+ *        The other copy of a backed up task is cancelled.
+ * @param[in,out] tracker - The running tasks
+ * @param[in] worker_rank - The worker's rank
+ * @param[in,out] request - The worker's request. The tasks which the other copy did first are marked with INVALID_TASK_ID.
+ * @return void
+ **/
+static void master_finish_tasks(TaskTracker *tracker, const int worker_rank, TaskRequest *request);
+
+/**
+ * @brief Function called by master to give work to the held workers, when there is no task left to send.
+ *        A held worker gets a backup copy of the slowest running task. All of them are stopped when no task runs.
+ * @param[in,out] tracker     - The running tasks
+ * @param[in,out] requests    - The posted receives of the workers' requests
+ * @param[out] worker_requests - The buffers of the workers' requests
+ * @return The number of workers which received the stop signal
+ **/
+static int master_serve_idle_workers(TaskTracker *tracker, MPI_Request *requests, TaskRequest *worker_requests);
+
+/**
+ * @brief Function called by master to add the hashes of the ranges mapped by the tasks done by a worker to their files.
+ *        A file gets its hash when the hashed ranges cover it.
+ * @param[in,out] source - The input files
+ * @param[in] request    - The worker's request
+ * @return void
+ **/
+static void master_store_hashes(TaskSource *source, const TaskRequest *request);
+
+/**
+ * @brief Function called by master to mark the tasks done by a worker as committed and to record the files
+ *        whose runs are all committed into the journal
+ * @param[in,out] update  - The update of the output directory, with the journal
+ * @param[in] source      - The input files
+ * @param[in] request     - The worker's request
+ * @return void
+ **/
+static void master_journal_tasks(IndexUpdate *update, const TaskSource *source, const TaskRequest *request);
+
+/**
+ * @brief Function called by master to make room for the tasks built so far in the committed tasks of the journal.
+ *        The journal is closed if there is no memory.
+ * @param[in,out] journal  - The journal
+ * @param[in] next_task_id - The ID of the next task which is built
+ * @return 0 for success or -1 in case of error
+ **/
+static int master_journal_reserve(TaskJournal *journal, int next_task_id);
+
+/**
+ * @brief Function called by master to record into the journal the files whose runs are all committed.
+ *        Only the files after the first one which is not recorded are looked at.
+ * @param[in,out] update  - The update of the output directory, with the journal
+ * @param[in] built_files - Number of files whose tasks are all built
+ * @return void
+ **/
+static void master_journal_files(IndexUpdate *update, int built_files);
+
+/**
+ * @brief Function called by master to compute the key ranges of the reducers from the histograms of the workers.
+ *        An update keeps the key ranges of the previous run and reduces only the ones with new postings.
  * @param[in] number_of_workers - Number of workers
+ * @param[in,out] update        - The update of the output directory
  * @return void
  **/
-static void master_map_phase(const char *input_dir_path, const int number_of_workers);
+static void master_partition_phase(const int number_of_workers, IndexUpdate *update);
 
 /**
  * @brief Function called by master to signal workers to start the reduce phase
+ * @param[in] output_dir_path   - Path of the directory in which the result is stored
  * @param[in] number_of_workers - Number of workers
+ * @param[in,out] update        - The update of the output directory
  * @return void
  **/
-static void master_reduce_phase(const int number_of_workers);
+static void master_reduce_phase(const char *output_dir_path, const int number_of_workers, IndexUpdate *update);
 
 /**
- * @brief Function called by master to signal workers to write the result
- * @param[in] output_file_name  - The output file name in which the result will be stored
+ * @brief Function called by master to wait for the reduce phase and to take part in the write of the result and index.
+ *        The workers write their key ranges together into the result file, the master writes nothing.
+ *        Then the workers write their blocks into the index, after the header written by the master.
+ *        Then the manifest is written if no rank failed to write, so that the next run updates the output directory.
+ * @param[in] options           - The command line options
  * @param[in] number_of_workers - Number of workers
+ * @param[in,out] update        - The update of the output directory
+ * @return void
+ **/
+static void master_store_result_phase(const Options *options, const int number_of_workers, IndexUpdate *update);
+
+/**
+ * @brief Function called by master to log the wall time of a phase and to add it to the metrics
+ * @param[in] phase           - The phase name
+ * @param[in] metric          - The timer of the phase (METRIC_*_SECONDS)
+ * @param[in,out] phase_start - The start of the phase, which becomes the start of the next one
  * @return void
  **/
-static void master_store_result_phase(const char *output_file_name, const int number_of_workers);
+static void master_phase_done(const char *phase, const int metric, double *phase_start);
 
 /*******************************************
  *       STATIC FUNCTION DEFINITION
  ******************************************/
 
 /**
- * @brief Function called by master to assign files the workers durring map phase
- * @param[in] input_dir_path    - Input directory's path
+ * @brief Function called by master to compare the input directory with the manifest of the previous run.
+ *        The files with the same size and modification time, or with the same content, keep their runs.
+ *        The runs of the changed and deleted files are removed, with the ones of the files packed in the same tasks.
+ * @param[in] options           - The command line options
  * @param[in] number_of_workers - Number of workers
+ * @param[out] update           - The files to map and the key ranges to reduce
  * @return void
  **/
-static void master_map_phase(const char *input_dir_path, const int number_of_workers)
+static void master_update_phase(const Options *options, const int number_of_workers, IndexUpdate *update)
 {
-    DIR *input_directory = opendir(input_dir_path);
-    File *input_file = NULL;
-    char input_file_path[MAX_PATH] = {'\0'};
-    int files_count = 0; /* Number of files sent to be parsed */
+    char manifest_file_path[MAX_PATH] = {'\0'};
+    char journal_file_path[MAX_PATH] = {'\0'};
+    char documents_file_path[MAX_PATH] = {'\0'};
+    char result_file_path[MAX_PATH] = {'\0'};
+    char index_file_path[MAX_PATH] = {'\0'};
+    char run_file_path[MAX_PATH] = {'\0'};
+    char run_file_name[MAX_PATH] = {'\0'};
+    Manifest *previous = &update->previous;
+    Manifest *current = &update->current;
+    char *previous_kept = NULL; /* The files of the previous run which didn't change */
+    char *kept_tasks = NULL;    /* The runs of the previous run which are kept */
+    int next_document_id = 0;
+    int kept_files = 0;
+    int changed = 1;
+    int resumed = 0;
+    uint64_t result_length = 0;
+    uint64_t index_length = 0;
+    struct stat file_stat = {0};
+    struct stat index_stat = {0};
+    DIR *directory = NULL;
+    File *file_from_dir = NULL;
+    FILE *documents_file = NULL;
+
+    utils_join_path(manifest_file_path, options->output_dir_path, MANIFEST_FILE_NAME);
+    utils_join_path(journal_file_path, options->output_dir_path, JOURNAL_FILE_NAME);
+    utils_join_path(documents_file_path, options->output_dir_path, DOCUMENTS_FILE_NAME);
+    utils_join_path(result_file_path, options->output_dir_path, RESULT_FILE_NAME);
+    utils_join_path(index_file_path, options->output_dir_path, INDEX_FILE_NAME);
+
+    if (0 != options->memory_shuffle)
+    {
+        /* The map output is not kept, so the next run rebuilds the output directory */
+        remove(manifest_file_path);
+        remove(journal_file_path);
+    }
+    else
+    {
+        if ((0 == manifest_load(previous, manifest_file_path)) &&
+            ((number_of_workers != previous->splits.partitions_count) || (0 != strcmp(previous->job, options->job->name))))
+        {
+            int next_task_id = previous->next_task_id;
+
+            log_message(LOG_INFO, "Master: %s(): The previous run was the job '%s' with %d workers. The output directory is rebuilt.\n",
+                        __FUNCTION__, previous->job, previous->splits.partitions_count);
+            manifest_free(previous);
+
+            /* The task IDs are not reused, so a run left by a failure of this job is never taken for one of the previous run */
+            previous->next_task_id = next_task_id;
+        }
+
+        /* A job which didn't finish left its journal. The runs don't depend on the number of workers, so they are kept. */
+        if (0 == manifest_load_journal(previous, journal_file_path, number_of_workers, options->job->name))
+        {
+            log_message(LOG_INFO, "Master: %s(): The previous job didn't finish. Its committed map tasks are kept, all the key ranges are reduced.\n",
+                        __FUNCTION__);
+            resumed = 1;
+        }
+        else if (0 == stat(journal_file_path, &file_stat))
+        {
+            /* The journal of another job is not resumed, but that job may have removed runs or written a part of the result */
+            log_message(LOG_INFO, "Master: %s(): The previous job didn't finish and it is not resumed. All the key ranges are reduced.\n",
+                        __FUNCTION__);
+            remove(journal_file_path);
+            resumed = 1;
+        }
+
+        /* The journal is opened before any run is removed, so a failure of this job is resumed too */
+        manifest_journal_open(&update->journal.file, journal_file_path, options->job->name);
+    }
+
+    for (int i = 0; i < previous->splits.partitions_count; ++i)
+    {
+        result_length += previous->partition_lengths[i];
+        index_length += previous->index_lengths[i];
+    }
+
+    update->reduced = (char *)malloc(number_of_workers);
+    previous_kept = (char *)calloc(previous->files_length + 1, sizeof(char));
+    kept_tasks = (char *)calloc(previous->next_task_id + 1, sizeof(char));
+
+    if ((NULL == update->reduced) || (NULL == previous_kept) || (NULL == kept_tasks))
+    {
+        /* The workers are waiting for tasks, so this can't be recovered */
+        log_message(LOG_ERROR, "Master: %s(): Out of memory! .\n", __FUNCTION__);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    /* Without the previous result and index every key range is reduced.
+     * A job which didn't finish may have removed runs whose key ranges are still copied, or written a part of the result. */
+    memset(update->reduced, ((0 != resumed) || (0 == previous->splits.partitions_count) || (0 != stat(result_file_path, &file_stat)) ||
+                             ((uint64_t)file_stat.st_size != result_length) || (0 != stat(index_file_path, &index_stat)) ||
+                             ((uint64_t)index_stat.st_size != index_header_size(number_of_workers) + index_length)) ? 1 : 0,
+           number_of_workers);
 
-    if (NULL == input_directory)
+    snprintf(current->job, JOB_NAME_SIZE, "%s", options->job->name);
+    current->next_task_id = previous->next_task_id;
+    next_document_id = previous->next_document_id;
+    manifest_sort_files(previous);
+
+    if (NULL == (directory = opendir(options->input_dir_path)))
     {
-        log_message(stderr, "Master: %s(): Failed to open dir: %s. Errno: %s.\n", __FUNCTION__, input_dir_path, strerror(errno));
+        /* The workers still ask for tasks, they receive the stop signal */
+        log_message(LOG_ERROR, "Master: %s(): Failed to open dir: %s. Errno: %s.\n", __FUNCTION__, options->input_dir_path, strerror(errno));
     }
     else
     {
-        /* assign the first number_of_workers files to the workers */
-        for (int i = 0; i < number_of_workers; ++i)
+        while (NULL != (file_from_dir = get_next_file_from_dir(directory)))
         {
-            errno = 0;
-            input_file = get_next_file_from_dir(input_directory);
+            ManifestFile input_file = {0};
+            ManifestFile *previous_file = NULL;
+            uint64_t hash = 0;
+
+            utils_join_path(input_file.path, options->input_dir_path, file_from_dir->d_name);
 
-            /* In case of end of stream or error */
-            if (NULL == input_file)
+            if (0 != stat(input_file.path, &file_stat))
             {
-                /* If errno changed means that a problem occured while trying to read file from directory.
-                 * Print error message and continue as usual */
-                if (0 != errno)
-                {
-                    log_message(stderr, "Master: %s(): Failed to read file from directory. Errno %s", __FUNCTION__, strerror(errno));
-                }
+                log_message(LOG_ERROR, "Master: %s(): Failed to stat file '%s'. Errno %s", __FUNCTION__, input_file.path, strerror(errno));
+                continue;
+            }
+
+            input_file.size = file_stat.st_size;
+            input_file.mtime = (int64_t)file_stat.st_mtim.tv_sec * 1000000000LL + file_stat.st_mtim.tv_nsec;
+            input_file.first_task = INVALID_TASK_ID;
+            input_file.last_task = INVALID_TASK_ID;
+            previous_file = manifest_find_file(previous, input_file.path);
 
-                log_message(stdout, "Master: %s(): There is no more work to do. Send the stop signal to the worker %d.\n", __FUNCTION__, i + 1);
-                /* Send to worker that he has nothing to do in the phase */
-                MPI_Send(INVALID_FILE, strlen(INVALID_FILE), MPI_CHAR, i + 1, TAG_SLEEP, MPI_COMM_WORLD);
+            if (NULL == previous_file)
+            {
+                input_file.document_id = next_document_id++;
             }
             else
             {
-                /* Send the file to worker */
-                if ('/' != input_dir_path[strlen(input_dir_path) - 1])
-                {
-                    snprintf(input_file_path, MAX_PATH, "%s/%s", input_dir_path, input_file->d_name);
-                }
-                else
+                /* A changed file keeps its document ID. A touched file with the same content is not mapped again. */
+                input_file.document_id = previous_file->document_id;
+
+                if ((input_file.size == previous_file->size) &&
+                    ((input_file.mtime == previous_file->mtime) ||
+                     ((0 != previous_file->has_hash) &&
+                      (0 == manifest_hash_file(input_file.path, &hash)) && (hash == previous_file->hash))))
                 {
-                    snprintf(input_file_path, MAX_PATH, "%s%s", input_dir_path, input_file->d_name);
+                    input_file.first_task = previous_file->first_task;
+                    input_file.last_task = previous_file->last_task;
+                    input_file.hash = previous_file->hash;
+                    input_file.has_hash = previous_file->has_hash;
+                    previous_kept[previous_file - previous->files] = 1;
                 }
+            }
+
+            if (0 != manifest_add_file(current, &input_file))
+            {
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+        }
+
+        closedir(directory);
+    }
+
+    /* Find the runs of the previous run which are still in the output directory */
+    if (NULL != (directory = opendir(options->output_dir_path)))
+    {
+        while (NULL != (file_from_dir = get_next_file_from_dir(directory)))
+        {
+            int task_id = INVALID_TASK_ID;
 
-                log_message(stdout, "Master: %s(): File '%s' is sent to worker %d.\n", __FUNCTION__, input_file_path, i + 1);
-                MPI_Send(input_file_path, strlen(input_file_path), MPI_CHAR, i + 1, TAG_WORK, MPI_COMM_WORLD);
-                /* One file sent to be parsed, increment the counter */
-                ++files_count;
-                /* clear the buffer to be reused */
-                memset(input_file_path, '\0', MAX_PATH);
+            if ((1 == sscanf(file_from_dir->d_name, MAP_RUN_FILE_FORMAT, &task_id)) && (0 <= task_id) && (previous->next_task_id > task_id))
+            {
+                snprintf(run_file_name, MAX_PATH, MAP_RUN_FILE_FORMAT, task_id);
+                kept_tasks[task_id] = (0 == strcmp(run_file_name, file_from_dir->d_name)) ? 1 : 0;
             }
         }
 
-        /* Now wait untill workers finishes their job and send another file untill all are parsed. */
+        closedir(directory);
+    }
 
-        do
+    /* The runs of the changed and deleted files are dropped */
+    for (int i = 0; i < previous->files_length; ++i)
+    {
+        for (int j = previous->files[i].first_task; (0 == previous_kept[i]) && (0 <= j) && (j <= previous->files[i].last_task) && (j < previous->next_task_id); ++j)
         {
-            char parsed_file_name[MAX_PATH] = {'\0'};
-            MPI_Status worker_status = {0};
+            kept_tasks[j] = 0;
+        }
+    }
+
+    /* A file is mapped again if one of its runs is dropped. Then its other runs are dropped too,
+     * so the files packed with it are mapped again untill no other run is dropped. */
+    while (0 != changed)
+    {
+        changed = 0;
 
-            MPI_Recv(parsed_file_name, MAX_PATH, MPI_CHAR, MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &worker_status);
-            /* One file was parsed, decrement the counter */
-            --files_count;
-            log_message(stdout, "Master: %s(): The worker nr. %d finished to parse file: '%s'.\n", __FUNCTION__, worker_status.MPI_SOURCE, parsed_file_name);
+        for (int i = 0; i < current->files_length; ++i)
+        {
+            ManifestFile *input_file = &current->files[i];
+            int kept = (0 <= input_file->first_task) && (input_file->first_task <= input_file->last_task) &&
+                       (input_file->last_task < previous->next_task_id);
 
-            errno = 0;
-            input_file = get_next_file_from_dir(input_directory);
+            for (int j = input_file->first_task; (0 != kept) && (j <= input_file->last_task); ++j)
+            {
+                kept = kept_tasks[j];
+            }
 
-            if (NULL == input_file)
+            if ((0 == kept) && (INVALID_TASK_ID != input_file->first_task))
             {
-                /* In case of end of stream or error.
-                 * If errno changed means that a problem occured while trying to read the file from directory.
-                 * Print error message and continue as usual */
-                if (0 != errno)
+                for (int j = input_file->first_task; (0 <= j) && (j <= input_file->last_task) && (j < previous->next_task_id); ++j)
                 {
-                    log_message(stderr, "Master: %s(): Failed to read file from directory. Errno %s", __FUNCTION__, strerror(errno));
+                    kept_tasks[j] = 0;
                 }
 
-                log_message(stdout, "Master: %s(): There is no more work to do. Send the stop signal to the worker %d.\n", __FUNCTION__, worker_status.MPI_SOURCE);
-                /* Send to worker that he has nothing to do in the phase */
-                MPI_Send(INVALID_FILE, strlen(INVALID_FILE), MPI_CHAR, worker_status.MPI_SOURCE, TAG_SLEEP, MPI_COMM_WORLD);
+                input_file->first_task = INVALID_TASK_ID;
+                input_file->last_task = INVALID_TASK_ID;
+                changed = 1;
             }
-            else if (DT_REG == input_file->d_type)
+        }
+    }
+
+    /* The runs of a job which didn't finish, with no file recorded in its journal, are removed too */
+    memset(kept_tasks, 0, previous->next_task_id);
+
+    for (int i = 0; i < current->files_length; ++i)
+    {
+        for (int j = current->files[i].first_task; (0 <= j) && (j <= current->files[i].last_task); ++j)
+        {
+            kept_tasks[j] = 1;
+        }
+    }
+
+    /* A failed job may have left the partial runs and the spilled words of its tasks.
+     * Every worker also clears its own files from its scratch directory. */
+    remove_temporary_runs(options->output_dir_path, 0);
+
+    if (0 != strcmp(options->scratch_dir_path, options->output_dir_path))
+    {
+        remove_temporary_runs(options->scratch_dir_path, 0);
+    }
+
+    /* Remove the runs which are not kept, with the ones left by a failed run */
+    if (NULL != (directory = opendir(options->output_dir_path)))
+    {
+        while (NULL != (file_from_dir = get_next_file_from_dir(directory)))
+        {
+            int task_id = INVALID_TASK_ID;
+
+            if (1 == sscanf(file_from_dir->d_name, MAP_RUN_FILE_FORMAT, &task_id))
             {
-                /* Found a file, send it to worker */
-                if ('/' != input_dir_path[strlen(input_dir_path) - 1])
-                {
-                    snprintf(input_file_path, MAX_PATH, "%s/%s", input_dir_path, input_file->d_name);
-                }
-                else
+                snprintf(run_file_name, MAX_PATH, MAP_RUN_FILE_FORMAT, task_id);
+
+                if ((0 == strcmp(run_file_name, file_from_dir->d_name)) &&
+                    ((0 > task_id) || (previous->next_task_id <= task_id) || (0 == kept_tasks[task_id])))
                 {
-                    snprintf(input_file_path, MAX_PATH, "%s%s", input_dir_path, input_file->d_name);
+                    utils_join_path(run_file_path, options->output_dir_path, file_from_dir->d_name);
+                    master_drop_run(update, run_file_path);
                 }
-
-                log_message(stdout, "Master: %s(): File '%s' is sent to worker %d.\n", __FUNCTION__, input_file_path, worker_status.MPI_SOURCE);
-                MPI_Send(input_file_path, strlen(input_file_path), MPI_CHAR, worker_status.MPI_SOURCE, TAG_WORK, MPI_COMM_WORLD);
-                /* One file sent to be parsed, increment the counter */
-                ++files_count;
-                /* clear the buffer to be reused */
-                memset(input_file_path, '\0', MAX_PATH);
             }
-        } while (0 < files_count);
+        }
+
+        closedir(directory);
+    }
 
-        log_message(stdout, "Master: %s(): The workers parsed all the files from directory: '%s'. Map phase done!\n", __FUNCTION__, input_dir_path);
+    /* The documents table has all the files, the kept ones too */
+    if (NULL == (documents_file = fopen(documents_file_path, "w")))
+    {
+        log_message(LOG_ERROR, "Master: %s(): Failed to open file: %s. Errno: %s.\n", __FUNCTION__, documents_file_path, strerror(errno));
+    }
+    else
+    {
+        for (int i = 0; i < current->files_length; ++i)
+        {
+            fprintf(documents_file, "%d %s\n", current->files[i].document_id, current->files[i].path);
+            kept_files += (INVALID_TASK_ID != current->files[i].first_task) ? 1 : 0;
+        }
 
-        closedir(input_directory);
+        if (0 != fclose(documents_file))
+        {
+            log_message(LOG_ERROR, "Master: %s(): Failed to close file: %s.\n", __FUNCTION__, documents_file_path);
+        }
     }
+
+    current->next_document_id = next_document_id;
+    log_message(LOG_INFO, "Master: %s(): %d files in directory: '%s', %d of them kept from the previous run.\n",
+                __FUNCTION__, current->files_length, options->input_dir_path, kept_files);
+
+    free(previous_kept);
+    free(kept_tasks);
 }
 
 /**
- * @brief Function called by master to signal workers to start the reduce phase
- * @param[in] number_of_workers - Number of workers
+ * @brief Function called by master to remove a run which is not used anymore.
+ *        The key ranges of its terms are reduced again.
+ * @param[in,out] update     - The update of the output directory
+ * @param[in] run_file_path  - Path of the run
  * @return void
  **/
-static void master_reduce_phase(const int number_of_workers)
+static void master_drop_run(IndexUpdate *update, const char *run_file_path)
 {
-    /* Number of english alphabetic characters every worker should process.
-     * e.g For 4 workers, the first worker should process every word that start with a caracter
-     * from the interval: [a, g] (7 characters) */
-    int bounds_step = ENGLISH_ALPHABET_SIZE / number_of_workers;
-    char bounds_for_reduce[] = {'a' - 1, 'a' - 1};
+    RunReader run = {0};
+    int read_result = 0;
+
+    if (0 != update->previous.splits.partitions_count)
+    {
+        if (0 != run_reader_open_partition(&run, run_file_path, 0))
+        {
+            read_result = -1;
+        }
+        else
+        {
+            while (1 == (read_result = run_reader_next(&run)))
+            {
+                update->reduced[term_partition(&update->previous.splits, run.term, run.term_length)] = 1;
+            }
+
+            run_reader_close(&run);
+        }
 
-    /* Increment bounds step in case that the ENGLISH_ALPHABET_SIZE > number_of_workers * bounds_step */
-    if (0 != ENGLISH_ALPHABET_SIZE % number_of_workers)
+        /* A run which can't be read may have any term */
+        if (0 > read_result)
+        {
+            memset(update->reduced, 1, update->previous.splits.partitions_count);
+        }
+    }
+
+    log_message(LOG_DEBUG, "Master: %s(): The run '%s' is removed.\n", __FUNCTION__, run_file_path);
+
+    if (0 != unlink(run_file_path))
     {
-        ++bounds_step;
+        log_message(LOG_ERROR, "Master: %s(): Failed to remove file: %s. Errno: %s.\n", __FUNCTION__, run_file_path, strerror(errno));
     }
+}
 
-    for (int i = 0; i < number_of_workers; ++i)
+/**
+ * @brief Function called by master to assign tasks the workers durring map phase
+ * @param[in] number_of_workers - Number of workers
+ * @param[in] options           - The command line options
+ * @param[in,out] update        - The files to map. Their tasks are stored into it.
+ * @return void
+ **/
+static void master_map_phase(const Options *options, const int number_of_workers, IndexUpdate *update)
+{
+    TaskSource source = {0};
+    TaskTracker tracker = {0};
+    int active_workers = number_of_workers; /* Workers which didn't receive the stop signal */
+    MPI_Request *requests = (MPI_Request *)calloc(number_of_workers, sizeof(MPI_Request));
+    TaskRequest *worker_requests = (TaskRequest *)calloc(number_of_workers, sizeof(TaskRequest));
+
+    source.files = &update->current;
+    source.split_size = options->split_size;
+    source.next_task_id = update->current.next_task_id;
+    source.ready_tasks = (MapTask *)calloc(MAX_BATCH_TASKS, sizeof(MapTask));
+    source.document_files = (int *)calloc(update->current.next_document_id + 1, sizeof(int));
+    source.hashed_lengths = (uint64_t *)calloc(update->current.files_length + 1, sizeof(uint64_t));
+    update->journal.first_task_id = source.next_task_id;
+    update->journal.recorded_files = (char *)calloc(update->current.files_length + 1, sizeof(char));
+
+    if ((NULL != update->journal.file) && (NULL == update->journal.recorded_files))
     {
-        /* Calculate the bounds for the i + 1 worker
-         * The left limit is the previous right limit + 1
-         * e.g. If the previous iteration the bounds were [a, d] the current one the bounds are [e, h]
-         * The right limit is the current left limit + bounds_step */
-        bounds_for_reduce[0] = bounds_for_reduce[1] + 1;
-        bounds_for_reduce[1] = bounds_for_reduce[0] + bounds_step - 1;
+        /* The job goes on, it is just not resumed if it fails */
+        log_message(LOG_ERROR, "Master: %s(): Out of memory! The journal is closed.\n", __FUNCTION__);
+        fclose(update->journal.file);
+        update->journal.file = NULL;
+    }
 
-        /* If the bounds are not in the range a-z, the worker will process only the words
-         * in range [a, z] & [bound0, bound1] */
+    /* The copies of a task write the same run, which is renamed into place, so either of them can be kept.
+     * The map output kept in memory or written as text would be doubled. */
+    tracker.speculate = ((0 == options->memory_shuffle) && (0 == options->text_map_output)) ? 1 : 0;
+    tracker.number_of_workers = number_of_workers;
+    /* A worker has at most a running task and the next batch */
+    tracker.tasks = (RunningTask *)calloc(number_of_workers * (MAX_BATCH_TASKS + 1), sizeof(RunningTask));
+    tracker.last_tasks = (int *)calloc(number_of_workers, sizeof(int));
+    tracker.idle_workers = (char *)calloc(number_of_workers, sizeof(char));
 
-        log_message(stdout, "Master: %s(): Send start reduce phase to worker %d with bounds: [%c, %c].\n",
-                    __FUNCTION__, i + 1, bounds_for_reduce[0], bounds_for_reduce[1]);
-        MPI_Send(bounds_for_reduce, sizeof(bounds_for_reduce), MPI_CHAR, i + 1, TAG_WORK, MPI_COMM_WORLD);
+    if ((NULL == requests) || (NULL == worker_requests) || (NULL == source.ready_tasks) || (NULL == source.document_files) ||
+        (NULL == source.hashed_lengths) || (NULL == tracker.tasks) || (NULL == tracker.last_tasks) || (NULL == tracker.idle_workers))
+    {
+        /* The workers are waiting for tasks, so this can't be recovered */
+        log_message(LOG_ERROR, "Master: %s(): Out of memory! .\n", __FUNCTION__);
+        MPI_Abort(MPI_COMM_WORLD, 1);
     }
 
-    /* Now wait untill workers finishes their job and signal when to write the result . */
-    log_message(stdout, "Master: %s(): The workers are in the reduce phase. Wait untill they finish their job!\n", __FUNCTION__);
+    for (int i = 0; i < update->current.files_length; ++i)
+    {
+        source.document_files[update->current.files[i].document_id] = i;
+    }
 
+    /* Every worker has a posted receive for its next request.
+     * A worker asks for the next batch when it starts the last task of the current one. */
     for (int i = 0; i < number_of_workers; ++i)
     {
+        MPI_Irecv(&worker_requests[i], sizeof(TaskRequest), MPI_BYTE, i + 1, TAG_WORK, MPI_COMM_WORLD, &requests[i]);
+    }
+
+    /* Answer the workers' requests untill all of them received the stop signal.
+     * While no request is waiting, the next tasks are built ahead.
+     * When there is no task left, the idle workers back up the slow tasks of the other ones. */
+    while (0 < active_workers)
+    {
+        int index = MPI_UNDEFINED;
+        int completed = 0;
         MPI_Status worker_status = {0};
 
-        MPI_Recv(bounds_for_reduce, sizeof(bounds_for_reduce), MPI_CHAR, MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &worker_status);
-        log_message(stdout, "Master: %s(): The worker nr. %d finished the reduce phase for bounds: [%c, %c].\n",
-                    __FUNCTION__, worker_status.MPI_SOURCE, bounds_for_reduce[0], bounds_for_reduce[1]);
+        MPI_Testany(number_of_workers, requests, &index, &completed, &worker_status);
+
+        if ((0 == completed) && (0 == master_prepare_task(&source)))
+        {
+            if (0 != tracker.idle_count)
+            {
+                /* The held workers wait for a task to become slow enough to be backed up */
+                usleep(SPECULATION_POLL_MICROSECONDS);
+            }
+            else
+            {
+                /* Nothing left to build ahead, block untill a worker asks */
+                double wait_start = MPI_Wtime();
+
+                MPI_Waitany(number_of_workers, requests, &index, &worker_status);
+                metrics_add_time(METRIC_RECV_BLOCKED_SECONDS, wait_start);
+                completed = 1;
+            }
+        }
+
+        if ((0 != completed) && (MPI_UNDEFINED != index))
+        {
+            log_message(LOG_DEBUG, "Master: %s(): The worker nr. %d finished %d tasks in %.3f seconds.\n",
+                        __FUNCTION__, index + 1, worker_requests[index].tasks_done, worker_requests[index].tasks_seconds);
+
+            master_finish_tasks(&tracker, index + 1, &worker_requests[index]);
+            master_store_hashes(&source, &worker_requests[index]);
+            master_journal_tasks(update, &source, &worker_requests[index]);
+
+            if (0 != worker_requests[index].tasks_failed)
+            {
+                /* The result would miss the keys of the failed tasks, so the manifest is not saved.
+                 * The committed tasks are in the journal, the next run resumes the job. */
+                log_message(LOG_ERROR, "Master: %s(): The worker nr. %d failed to write the runs of %d tasks. The job is stopped.\n",
+                            __FUNCTION__, index + 1, worker_requests[index].tasks_failed);
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+
+            if ((0 != tracker.speculate) && (0 != worker_requests[index].idle) && (0 != tracker.length) && (0 == master_tasks_left(&source)))
+            {
+                /* Hold the worker, it may back up a slow task */
+                tracker.idle_workers[index] = 1;
+                ++tracker.idle_count;
+            }
+            else if (0 != master_send_next_batch(&source, &tracker, index + 1, &worker_requests[index]))
+            {
+                MPI_Irecv(&worker_requests[index], sizeof(TaskRequest), MPI_BYTE, index + 1, TAG_WORK, MPI_COMM_WORLD, &requests[index]);
+            }
+            else
+            {
+                --active_workers;
+            }
+        }
+
+        active_workers -= master_serve_idle_workers(&tracker, requests, worker_requests);
     }
 
-    log_message(stdout, "Master: %s(): The workers finished. The reduce phase is done!\n", __FUNCTION__);
+    log_message(LOG_INFO, "Master: %s(): The files from directory: '%s' were sent to the workers in %d tasks. Map phase done!\n",
+                __FUNCTION__, options->input_dir_path, source.next_task_id - update->current.next_task_id);
+    update->current.next_task_id = source.next_task_id;
+
+    free(requests);
+    free(worker_requests);
+    free(source.ready_tasks);
+    free(source.document_files);
+    free(source.hashed_lengths);
+    free(tracker.tasks);
+    free(tracker.last_tasks);
+    free(tracker.idle_workers);
 }
 
 /**
- * @brief Function called by master to signal workers to write the result
- * @param[in] output_file_name  - The output file name in which the result will be stored
- * @param[in] number_of_workers - Number of workers
- * @return void
+ * @brief Function called by master to build the next map task. The files bigger than the split size
+ *        are cut into splits of that size, the smaller ones are packed together untill they reach it.
+ *        The files which kept their runs from the previous run are skipped.
+ * @param[in,out] source - The input files
+ * @param[out] task      - The task
+ * @return 1 if a task was built or 0 if there is no input left
  **/
-static void master_store_result_phase(const char *output_file_name, const int number_of_workers)
+static int master_next_task(TaskSource *source, MapTask *task)
 {
-    MPI_Status worker_status = {0};
-    char temp_buffer[MAX_PATH] = {'\0'};
+    uint64_t task_size = 0;
+    int items_files[MAX_TASK_ITEMS] = {0}; /* Index of the file of every item */
 
-    for (int i = 0; i < number_of_workers; ++i)
+    memset(task, 0, sizeof(MapTask));
+
+    while ((MAX_TASK_ITEMS > task->items_length) && (source->split_size > task_size))
+    {
+        ManifestFile *input_file = NULL;
+        MapTaskItem *item = &task->items[task->items_length];
+
+        if (0 != source->split_file_size)
+        {
+            /* A split is a task on its own. Send the small files packed so far first. */
+            if (0 == task->items_length)
+            {
+                *item = source->split_file;
+                items_files[0] = source->split_file_index;
+                item->length = (source->split_file_size - item->offset < source->split_size) ? source->split_file_size - item->offset : source->split_size;
+                ++task->items_length;
+
+                source->split_file.offset += item->length;
+
+                if (source->split_file.offset >= source->split_file_size)
+                {
+                    source->split_file_size = 0;
+                }
+            }
+
+            break;
+        }
+
+        if (source->files->files_length == source->next_file)
+        {
+            break;
+        }
+
+        input_file = &source->files->files[source->next_file++];
+
+        if (INVALID_TASK_ID != input_file->first_task)
+        {
+            /* The file didn't change, its postings are in the runs of the previous run */
+            continue;
+        }
+
+        snprintf(item->file_path, MAX_PATH, "%s", input_file->path);
+        item->document_id = input_file->document_id;
+        item->offset = 0;
+        item->length = input_file->size;
+        /* The workers hash the ranges of the file while they map them */
+        input_file->hash = 0;
+        input_file->has_hash = 0;
+
+        if (input_file->size > source->split_size)
+        {
+            /* A big file, it is split by the next iterations */
+            source->split_file = *item;
+            source->split_file_size = input_file->size;
+            source->split_file_index = source->next_file - 1;
+        }
+        else
+        {
+            items_files[task->items_length] = source->next_file - 1;
+            task_size += item->length;
+            ++task->items_length;
+        }
+    }
+
+    if (0 != task->items_length)
     {
-        MPI_Send(output_file_name, strlen(output_file_name), MPI_CHAR, i + 1, TAG_WORK, MPI_COMM_WORLD);
-        log_message(stdout, "Master: %s(): Sent the signal to worker nr. %d to write the result into file: %s.\n",
-                    __FUNCTION__, i + 1, output_file_name);
+        task->task_id = source->next_task_id++;
+
+        /* The tasks of a file are consecutive */
+        for (int i = 0; i < task->items_length; ++i)
+        {
+            ManifestFile *input_file = &source->files->files[items_files[i]];
 
-        MPI_Recv(temp_buffer, sizeof(temp_buffer), MPI_CHAR, MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &worker_status);
-        log_message(stdout, "Master: %s(): The worker nr. %d wrote the result into file: %s.\n",
-                    __FUNCTION__, i + 1, temp_buffer);
+            if (INVALID_TASK_ID == input_file->first_task)
+            {
+                input_file->first_task = task->task_id;
+            }
 
-        MPI_Send("You did well. It's time to go home.", strlen("You did well. It's time to go home."), MPI_CHAR, i + 1, TAG_SLEEP, MPI_COMM_WORLD);
-        log_message(stdout, "Master: %s(): Sent the signal to worker nr. %d to go to his family.\n",
-                    __FUNCTION__, i + 1);
+            input_file->last_task = task->task_id;
+        }
     }
-}
 
-/*******************************************
- *          FUNCTION DEFINITION
- ******************************************/
+    return (0 != task->items_length) ? 1 : 0;
+}
 
 /**
- * @brief Function called by master to schedule the workers
- * @param[in] input_dir_path - Input directory path
+ * @brief Function called by master to build a task ahead, while no worker waits for one
+ * @param[in,out] source - The input files
+ * @return 1 if a task was built or 0 if there is no input left or the ready tasks are full
+ **/
+static int master_prepare_task(TaskSource *source)
+{
+    int task_built = 0;
+
+    if (MAX_BATCH_TASKS > source->ready_length)
+    {
+        task_built = master_next_task(source, &source->ready_tasks[(source->ready_first + source->ready_length) % MAX_BATCH_TASKS]);
+        source->ready_length += task_built;
+    }
+
+    return task_built;
+}
+
+/**
+ * @brief Function called by master to get the next task to send, a ready one or a new one
+ * @param[in,out] source - The input files
+ * @param[out] task      - The task
+ * @return 1 if there is a task or 0 if there is no input left
+ **/
+static int master_take_task(TaskSource *source, MapTask *task)
+{
+    if (0 == source->ready_length)
+    {
+        return master_next_task(source, task);
+    }
+
+    *task = source->ready_tasks[source->ready_first];
+    source->ready_first = (source->ready_first + 1) % MAX_BATCH_TASKS;
+    --source->ready_length;
+
+    return 1;
+}
+
+/**
+ * @brief Function called by master to check if there are tasks left to send
+ * @param[in,out] source - The input files
+ * @return 1 if there is a task or 0 if there is no input left
+ **/
+static int master_tasks_left(TaskSource *source)
+{
+    return ((0 != source->ready_length) || (0 != master_prepare_task(source))) ? 1 : 0;
+}
+
+/**
+ * @brief Function called by master to send the next batch of tasks to a worker.
+ *        The batch is sized from the worker's timing, so that it keeps the worker busy for BATCH_TARGET_SECONDS.
+ *        If there is no task left, the worker is signaled that the map phase is over, unless it is still parsing
+ *        a task and the tasks are backed up. Then it gets an empty batch and asks again when it is idle.
+ * @param[in,out] source  - The input files
+ * @param[in,out] tracker - The running tasks, the sent ones are added
+ * @param[in] worker_rank - The worker's rank
+ * @param[in] request     - The worker's request
+ * @return 1 if a batch was sent or 0 if the stop signal was sent
+ **/
+static int master_send_next_batch(TaskSource *source, TaskTracker *tracker, const int worker_rank, const TaskRequest *request)
+{
+    MapTask batch[MAX_BATCH_TASKS];
+    int batch_capacity = 1;
+    int batch_length = 0;
+    double now = MPI_Wtime();
+    double mean_seconds = (0 != tracker->tasks_done) ? tracker->tasks_seconds / tracker->tasks_done : 0.0;
+
+    /* Without a timing (the first request) the worker gets a single task */
+    if ((0 < request->tasks_done) && (0.0 < request->tasks_seconds))
+    {
+        double batch_tasks = BATCH_TARGET_SECONDS * request->tasks_done / request->tasks_seconds;
+
+        batch_capacity = (MAX_BATCH_TASKS < batch_tasks) ? MAX_BATCH_TASKS : ((1 > batch_tasks) ? 1 : (int)batch_tasks);
+    }
+
+    while ((batch_length < batch_capacity) && (0 != master_take_task(source, &batch[batch_length])))
+    {
+        log_message(LOG_DEBUG, "Master: %s(): Task %d (%d files) is sent to worker %d.\n",
+                    __FUNCTION__, batch[batch_length].task_id, batch[batch_length].items_length, worker_rank);
+
+        for (int i = 0; i < batch[batch_length].items_length; ++i)
+        {
+            const MapTaskItem *item = &batch[batch_length].items[i];
+
+            log_message(LOG_DEBUG, "Master: %s(): Task %d: file '%s' (document %d) bytes [%llu, %llu).\n",
+                        __FUNCTION__, batch[batch_length].task_id, item->file_path, item->document_id,
+                        (unsigned long long)item->offset, (unsigned long long)(item->offset + item->length));
+        }
+
+        if (0 != tracker->speculate)
+        {
+            RunningTask *running = &tracker->tasks[tracker->length++];
+
+            /* A busy worker starts the batch after its running task */
+            running->task = batch[batch_length];
+            running->worker_rank = worker_rank;
+            running->backup_rank = 0;
+            running->start_time = now + (batch_length + ((0 != request->idle) ? 0 : 1)) * mean_seconds;
+            tracker->last_tasks[worker_rank - 1] = batch[batch_length].task_id;
+        }
+
+        ++batch_length;
+    }
+
+    if ((0 == batch_length) && (0 != tracker->speculate) && (0 == request->idle))
+    {
+        /* The worker asks again when its running task is done, then it may back up a slow task */
+        MPI_Send(batch, 0, MPI_BYTE, worker_rank, TAG_WORK, MPI_COMM_WORLD);
+        return 1;
+    }
+
+    if (0 == batch_length)
+    {
+        log_message(LOG_DEBUG, "Master: %s(): There is no more work to do. Send the stop signal to the worker %d.\n", __FUNCTION__, worker_rank);
+        /* Send to worker that he has nothing to do in the phase */
+        MPI_Send(batch, 0, MPI_BYTE, worker_rank, TAG_SLEEP, MPI_COMM_WORLD);
+    }
+    else
+    {
+        MPI_Send(batch, batch_length * sizeof(MapTask), MPI_BYTE, worker_rank, TAG_WORK, MPI_COMM_WORLD);
+    }
+
+    return (0 != batch_length) ? 1 : 0;
+}
+
+/**
+ * @brief Function called by master to remove the tasks done by a worker from the running ones.
+ *        The other copy of a backed up task is cancelled.
+ * @param[in,out] tracker - The running tasks
+ * @param[in] worker_rank - The worker's rank
+ * @param[in,out] request - The worker's request. The tasks which the other copy did first are marked with INVALID_TASK_ID.
+ * @return void
+ **/
+static void master_finish_tasks(TaskTracker *tracker, const int worker_rank, TaskRequest *request)
+{
+    if (0 == tracker->speculate)
+    {
+        return;
+    }
+
+    for (int i = 0; i < request->tasks_done; ++i)
+    {
+        int task_id = request->finished_tasks[i];
+
+        /* Both copies may be done before the cancel arrives, the second one is not committed again */
+        request->finished_tasks[i] = INVALID_TASK_ID;
+
+        for (int j = 0; j < tracker->length; ++j)
+        {
+            RunningTask *running = &tracker->tasks[j];
+
+            if (task_id != running->task.task_id)
+            {
+                continue;
+            }
+
+            request->finished_tasks[i] = task_id;
+
+            if (0 != running->backup_rank)
+            {
+                /* The copy which is still running is dropped */
+                int other_rank = (worker_rank == running->worker_rank) ? running->backup_rank : running->worker_rank;
+
+                log_message(LOG_DEBUG, "Master: %s(): The worker nr. %d did the task %d first, cancel it on the worker %d.\n",
+                            __FUNCTION__, worker_rank, task_id, other_rank);
+                MPI_Send(&task_id, 1, MPI_INT, other_rank, TAG_CANCEL, MPI_COMM_WORLD);
+            }
+
+            tracker->tasks[j] = tracker->tasks[--tracker->length];
+            break;
+        }
+    }
+
+    tracker->tasks_done += request->tasks_done;
+    tracker->tasks_seconds += request->tasks_seconds;
+
+    /* A busy worker asks when it starts the last task of its batch, so that task starts now */
+    if (0 == request->idle)
+    {
+        for (int j = 0; j < tracker->length; ++j)
+        {
+            if ((tracker->last_tasks[worker_rank - 1] == tracker->tasks[j].task.task_id) && (worker_rank == tracker->tasks[j].worker_rank))
+            {
+                tracker->tasks[j].start_time = MPI_Wtime();
+            }
+        }
+    }
+}
+
+/**
+ * @brief Function called by master to give work to the held workers, when there is no task left to send.
+ *        A held worker gets a backup copy of the slowest running task. All of them are stopped when no task runs.
+ * @param[in,out] tracker      - The running tasks
+ * @param[in,out] requests     - The posted receives of the workers' requests
+ * @param[out] worker_requests - The buffers of the workers' requests
+ * @return The number of workers which received the stop signal
+ **/
+static int master_serve_idle_workers(TaskTracker *tracker, MPI_Request *requests, TaskRequest *worker_requests)
+{
+    int stopped_workers = 0;
+    double now = MPI_Wtime();
+    double mean_seconds = (0 != tracker->tasks_done) ? tracker->tasks_seconds / tracker->tasks_done : 0.0;
+    double slow_seconds = (SPECULATION_FACTOR * mean_seconds > SPECULATION_MIN_SECONDS) ? SPECULATION_FACTOR * mean_seconds : SPECULATION_MIN_SECONDS;
+
+    for (int i = 0; (0 != tracker->idle_count) && (0 != tracker->length) && (i < tracker->number_of_workers); ++i)
+    {
+        RunningTask *slowest = NULL;
+
+        if (0 == tracker->idle_workers[i])
+        {
+            continue;
+        }
+
+        /* A task is backed up once, and not on the worker which runs it */
+        for (int j = 0; j < tracker->length; ++j)
+        {
+            RunningTask *running = &tracker->tasks[j];
+
+            if ((0 == running->backup_rank) && (i + 1 != running->worker_rank) && (now - running->start_time > slow_seconds) &&
+                ((NULL == slowest) || (running->start_time < slowest->start_time)))
+            {
+                slowest = running;
+            }
+        }
+
+        if (NULL == slowest)
+        {
+            continue;
+        }
+
+        log_message(LOG_INFO, "Master: %s(): The task %d runs for %.3f seconds on the worker %d, it is backed up on the worker %d.\n",
+                    __FUNCTION__, slowest->task.task_id, now - slowest->start_time, slowest->worker_rank, i + 1);
+
+        slowest->backup_rank = i + 1;
+        tracker->last_tasks[i] = INVALID_TASK_ID;
+        tracker->idle_workers[i] = 0;
+        --tracker->idle_count;
+        metrics_add(METRIC_BACKUP_TASKS, 1);
+
+        MPI_Irecv(&worker_requests[i], sizeof(TaskRequest), MPI_BYTE, i + 1, TAG_WORK, MPI_COMM_WORLD, &requests[i]);
+        MPI_Send(&slowest->task, sizeof(MapTask), MPI_BYTE, i + 1, TAG_WORK, MPI_COMM_WORLD);
+    }
+
+    /* All the tasks are done, the map phase is over */
+    for (int i = 0; (0 != tracker->idle_count) && (0 == tracker->length); ++i)
+    {
+        if (0 != tracker->idle_workers[i])
+        {
+            log_message(LOG_DEBUG, "Master: %s(): There is no more work to do. Send the stop signal to the worker %d.\n", __FUNCTION__, i + 1);
+            MPI_Send(NULL, 0, MPI_BYTE, i + 1, TAG_SLEEP, MPI_COMM_WORLD);
+            tracker->idle_workers[i] = 0;
+            --tracker->idle_count;
+            ++stopped_workers;
+        }
+    }
+
+    return stopped_workers;
+}
+
+/**
+ * @brief Function called by master to add the hashes of the ranges mapped by the tasks done by a worker to their files.
+ *        A file gets its hash when the hashed ranges cover it.
+ * @param[in,out] source - The input files
+ * @param[in] request    - The worker's request
+ * @return void
+ **/
+static void master_store_hashes(TaskSource *source, const TaskRequest *request)
+{
+    for (int i = 0; i < request->hashes_length; ++i)
+    {
+        const FileHash *file_hash = &request->file_hashes[i];
+        int committed = 0;
+
+        /* The ranges of a task which the other copy did first are already added */
+        for (int j = 0; (0 == committed) && (j < request->tasks_done); ++j)
+        {
+            committed = (file_hash->task_id == request->finished_tasks[j]) ? 1 : 0;
+        }
+
+        if ((0 != committed) && (0 <= file_hash->document_id) && (source->files->next_document_id > file_hash->document_id))
+        {
+            int file_index = source->document_files[file_hash->document_id];
+            ManifestFile *input_file = &source->files->files[file_index];
+
+            input_file->hash += file_hash->hash;
+            source->hashed_lengths[file_index] += file_hash->length;
+            input_file->has_hash = (source->hashed_lengths[file_index] == input_file->size) ? 1 : 0;
+        }
+    }
+}
+
+/**
+ * @brief Function called by master to mark the tasks done by a worker as committed and to record the files
+ *        whose runs are all committed into the journal
+ * @param[in,out] update  - The update of the output directory, with the journal
+ * @param[in] source      - The input files
+ * @param[in] request     - The worker's request
+ * @return void
+ **/
+static void master_journal_tasks(IndexUpdate *update, const TaskSource *source, const TaskRequest *request)
+{
+    TaskJournal *journal = &update->journal;
+
+    if ((NULL == journal->file) || (0 != master_journal_reserve(journal, source->next_task_id)))
+    {
+        return;
+    }
+
+    /* A task is reported once it is renamed into place */
+    for (int i = 0; i < request->tasks_done; ++i)
+    {
+        int task_id = request->finished_tasks[i];
+
+        if ((journal->first_task_id <= task_id) && (source->next_task_id > task_id))
+        {
+            journal->done_tasks[task_id - journal->first_task_id] = 1;
+        }
+    }
+
+    /* The file which is split has more tasks to build */
+    master_journal_files(update, source->next_file - ((0 != source->split_file_size) ? 1 : 0));
+}
+
+/**
+ * @brief Function called by master to make room for the tasks built so far in the committed tasks of the journal.
+ *        The journal is closed if there is no memory.
+ * @param[in,out] journal  - The journal
+ * @param[in] next_task_id - The ID of the next task which is built
+ * @return 0 for success or -1 in case of error
+ **/
+static int master_journal_reserve(TaskJournal *journal, int next_task_id)
+{
+    int tasks_count = next_task_id - journal->first_task_id;
+
+    if (tasks_count > journal->done_capacity)
+    {
+        int capacity = 2 * tasks_count;
+        char *done_tasks = (char *)realloc(journal->done_tasks, capacity);
+
+        if (NULL == done_tasks)
+        {
+            /* The job goes on, it is just not resumed if it fails */
+            log_message(LOG_ERROR, "Master: %s(): Out of memory! The journal is closed.\n", __FUNCTION__);
+            fclose(journal->file);
+            journal->file = NULL;
+            return -1;
+        }
+
+        memset(done_tasks + journal->done_capacity, 0, capacity - journal->done_capacity);
+        journal->done_tasks = done_tasks;
+        journal->done_capacity = capacity;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Function called by master to record into the journal the files whose runs are all committed.
+ *        Only the files after the first one which is not recorded are looked at.
+ * @param[in,out] update  - The update of the output directory, with the journal
+ * @param[in] built_files - Number of files whose tasks are all built
+ * @return void
+ **/
+static void master_journal_files(IndexUpdate *update, int built_files)
+{
+    TaskJournal *journal = &update->journal;
+    int recorded_files = 0;
+
+    for (int i = journal->next_file; (NULL != journal->file) && (i < built_files); ++i)
+    {
+        const ManifestFile *input_file = &update->current.files[i];
+        int committed = (0 == journal->recorded_files[i]) ? 1 : 0;
+
+        /* The files kept from the previous run are already in its manifest or journal */
+        for (int j = input_file->first_task; (0 != committed) && (journal->first_task_id <= j) && (j <= input_file->last_task); ++j)
+        {
+            committed = journal->done_tasks[j - journal->first_task_id];
+        }
+
+        if ((0 != committed) && (journal->first_task_id <= input_file->first_task))
+        {
+            if (0 != manifest_journal_add_file(journal->file, input_file))
+            {
+                log_message(LOG_ERROR, "Master: %s(): Failed to write the journal.\n", __FUNCTION__);
+            }
+
+            ++recorded_files;
+        }
+
+        journal->recorded_files[i] |= committed;
+        journal->next_file += ((journal->next_file == i) && (0 != journal->recorded_files[i])) ? 1 : 0;
+    }
+
+    if ((0 != recorded_files) && (0 != manifest_journal_sync(journal->file)))
+    {
+        log_message(LOG_ERROR, "Master: %s(): Failed to write the journal.\n", __FUNCTION__);
+    }
+}
+
+/**
+ * @brief Function called by master to compute the key ranges of the reducers from the histograms of the workers.
+ *        An update keeps the key ranges of the previous run and reduces only the ones with new postings.
+ * @param[in] number_of_workers - Number of workers
+ * @param[in,out] update        - The update of the output directory
+ * @return void
+ **/
+static void master_partition_phase(const int number_of_workers, IndexUpdate *update)
+{
+    uint64_t *histogram = (uint64_t *)calloc(PREFIX_HISTOGRAM_SIZE, sizeof(uint64_t));
+    uint64_t *partition_postings = (uint64_t *)calloc(number_of_workers, sizeof(uint64_t));
+    KeySplits splits = {number_of_workers, (char *)calloc(number_of_workers, SPLIT_KEY_SIZE)};
+
+    if ((NULL == histogram) || (NULL == partition_postings) || (NULL == splits.splits))
+    {
+        /* The workers are waiting in the collectives, so this can't be recovered */
+        log_message(LOG_ERROR, "Master: %s(): Out of memory! .\n", __FUNCTION__);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    /* Sum the number of postings of every 2 bytes prefix over all the workers */
+    MPI_Reduce(MPI_IN_PLACE, histogram, PREFIX_HISTOGRAM_SIZE, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    /* The histogram of an update has only the new runs, so the key ranges of the previous run are kept */
+    if (0 != update->previous.splits.partitions_count)
+    {
+        memcpy(splits.splits, update->previous.splits.splits, (number_of_workers - 1) * SPLIT_KEY_SIZE);
+    }
+    else
+    {
+        compute_key_splits(histogram, &splits);
+    }
+
+    /* The workers sent their histograms after their last request, so all the committed tasks were reported.
+     * They are recorded before the workers get the key ranges, so a job which fails from now on is resumed at the reduce phase. */
+    if ((NULL != update->journal.file) && (0 == master_journal_reserve(&update->journal, update->current.next_task_id)))
+    {
+        master_journal_files(update, update->current.files_length);
+
+        if ((0 != manifest_journal_add_splits(update->journal.file, &splits)) || (0 != manifest_journal_sync(update->journal.file)))
+        {
+            log_message(LOG_ERROR, "Master: %s(): Failed to write the journal.\n", __FUNCTION__);
+        }
+    }
+
+    MPI_Bcast(splits.splits, (number_of_workers - 1) * SPLIT_KEY_SIZE, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    for (int i = 0; i < PREFIX_HISTOGRAM_SIZE; ++i)
+    {
+        char prefix[] = {(char)(i >> 8), (char)(i & 0xff)};
+        int partition = term_partition(&splits, prefix, (0 == prefix[1]) ? 1 : 2);
+
+        /* The split keys are prefixes, so all the terms of a prefix are in the same key range */
+        partition_postings[partition] += histogram[i];
+        update->reduced[partition] |= (0 != histogram[i]) ? 1 : 0;
+    }
+
+    for (int i = 0; i < number_of_workers; ++i)
+    {
+        log_message(LOG_INFO, "Master: %s(): The worker nr. %d %s the keys in ['%s', '%s') (%llu new postings).\n", __FUNCTION__, i + 1,
+                    (0 != update->reduced[i]) ? "reduces" : "copies",
+                    (0 == i) ? "" : splits.splits + (i - 1) * SPLIT_KEY_SIZE,
+                    (number_of_workers - 1 == i) ? "" : splits.splits + i * SPLIT_KEY_SIZE,
+                    (unsigned long long)partition_postings[i]);
+    }
+
+    /* The key ranges are stored into the manifest */
+    update->current.splits = splits;
+    update->current.partition_lengths = (uint64_t *)calloc(number_of_workers, sizeof(uint64_t));
+    update->current.index_lengths = (uint64_t *)calloc(number_of_workers, sizeof(uint64_t));
+
+    if ((NULL == update->current.partition_lengths) || (NULL == update->current.index_lengths))
+    {
+        log_message(LOG_ERROR, "Master: %s(): Out of memory! .\n", __FUNCTION__);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    free(histogram);
+    free(partition_postings);
+}
+
+/**
+ * @brief Function called by master to signal workers to start the reduce phase
+ * @param[in] output_dir_path   - Path of the directory in which the result is stored
+ * @param[in] number_of_workers - Number of workers
+ * @param[in,out] update        - The update of the output directory
+ * @return void
+ **/
+static void master_reduce_phase(const char *output_dir_path, const int number_of_workers, IndexUpdate *update)
+{
+    char result_file_path[MAX_PATH] = {'\0'};
+    char previous_result_file_path[MAX_PATH] = {'\0'};
+    char index_file_path[MAX_PATH] = {'\0'};
+    char previous_index_file_path[MAX_PATH] = {'\0'};
+    uint64_t previous_offset = 0;
+    uint64_t previous_index_offset = index_header_size(number_of_workers);
+
+    utils_join_path(result_file_path, output_dir_path, RESULT_FILE_NAME);
+    utils_join_path(previous_result_file_path, output_dir_path, PREVIOUS_RESULT_FILE_NAME);
+    utils_join_path(index_file_path, output_dir_path, INDEX_FILE_NAME);
+    utils_join_path(previous_index_file_path, output_dir_path, PREVIOUS_INDEX_FILE_NAME);
+
+    /* The key ranges which didn't change are copied from the previous result and index, which are replaced in the store phase */
+    if ((NULL != memchr(update->reduced, 0, number_of_workers)) &&
+        ((0 != rename(result_file_path, previous_result_file_path)) || (0 != rename(index_file_path, previous_index_file_path))))
+    {
+        log_message(LOG_ERROR, "Master: %s(): Failed to rename the previous result. Errno: %s.\n", __FUNCTION__, strerror(errno));
+        memset(update->reduced, 1, number_of_workers);
+    }
+
+    /* The map output is range partitioned, one key range for every worker.
+     * The worker i + 1 reduces the partition i. */
+    for (int i = 0; i < number_of_workers; ++i)
+    {
+        ReduceTask task = {i, (0 == update->reduced[i]) ? 1 : 0, previous_offset, 0, previous_index_offset, 0, 0};
+
+        if (0 != update->previous.splits.partitions_count)
+        {
+            task.length = update->previous.partition_lengths[i];
+            task.index_length = update->previous.index_lengths[i];
+            previous_offset += task.length;
+            previous_index_offset += task.index_length;
+        }
+
+        log_message(LOG_DEBUG, "Master: %s(): Send start reduce phase to worker %d for partition %d.\n", __FUNCTION__, i + 1, i);
+        MPI_Send(&task, sizeof(ReduceTask), MPI_BYTE, i + 1, TAG_WORK, MPI_COMM_WORLD);
+    }
+
+    /* The completions are taken in the store phase */
+    log_message(LOG_INFO, "Master: %s(): The workers are in the reduce phase. Wait untill they finish their job!\n", __FUNCTION__);
+}
+
+/**
+ * @brief Function called by master to wait for the reduce phase and to take part in the write of the result and index.
+ *        The workers write their key ranges together into the result file, the master writes nothing.
+ *        Then the workers write their blocks into the index, after the header written by the master.
+ *        Then the manifest is written if no rank failed to write, so that the next run updates the output directory.
+ * @param[in] options           - The command line options
+ * @param[in] number_of_workers - Number of workers
+ * @param[in,out] update        - The update of the output directory
+ * @return void
+ **/
+static void master_store_result_phase(const Options *options, const int number_of_workers, IndexUpdate *update)
+{
+    MPI_Request *requests = (MPI_Request *)calloc(number_of_workers, sizeof(MPI_Request));
+    ReduceTask *reduced_tasks = (ReduceTask *)calloc(number_of_workers, sizeof(ReduceTask));
+    char output_file_path[MAX_PATH] = {'\0'};
+    char previous_result_file_path[MAX_PATH] = {'\0'};
+    char index_file_path[MAX_PATH] = {'\0'};
+    char previous_index_file_path[MAX_PATH] = {'\0'};
+    char manifest_file_path[MAX_PATH] = {'\0'};
+    char journal_file_path[MAX_PATH] = {'\0'};
+    OrderedFile output_file = {0};
+    OrderedFile index_file = {0};
+    ByteBuffer index_header = {0};
+    int index_error_code = 0;
+    int error_code = 0;
+
+    if ((NULL == requests) || (NULL == reduced_tasks))
+    {
+        /* The workers are waiting in the collectives, so this can't be recovered */
+        log_message(LOG_ERROR, "Master: %s(): Out of memory! .\n", __FUNCTION__);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    for (int i = 0; i < number_of_workers; ++i)
+    {
+        MPI_Irecv(&reduced_tasks[i], sizeof(ReduceTask), MPI_BYTE, i + 1, TAG_SLEEP, MPI_COMM_WORLD, &requests[i]);
+    }
+
+    /* Take the reduce completions in the order they come */
+    for (int i = 0; i < number_of_workers; ++i)
+    {
+        int index = MPI_UNDEFINED;
+        double wait_start = MPI_Wtime();
+
+        MPI_Waitany(number_of_workers, requests, &index, MPI_STATUS_IGNORE);
+        metrics_add_time(METRIC_RECV_BLOCKED_SECONDS, wait_start);
+        log_message(LOG_DEBUG, "Master: %s(): The worker nr. %d finished the reduce phase for partition %d (%llu bytes).\n",
+                    __FUNCTION__, index + 1, reduced_tasks[index].partition, (unsigned long long)reduced_tasks[index].length);
+        update->current.partition_lengths[index] = reduced_tasks[index].length;
+        update->current.index_lengths[index] = reduced_tasks[index].index_length;
+
+        if (0 != reduced_tasks[index].failed)
+        {
+            log_message(LOG_ERROR, "Master: %s(): The worker nr. %d failed to reduce the partition %d.\n",
+                        __FUNCTION__, index + 1, reduced_tasks[index].partition);
+            error_code = -1;
+        }
+    }
+
+    log_message(LOG_INFO, "Master: %s(): The workers finished. The reduce phase is done!\n", __FUNCTION__);
+
+    utils_join_path(output_file_path, options->output_dir_path, RESULT_FILE_NAME);
+    utils_join_path(previous_result_file_path, options->output_dir_path, PREVIOUS_RESULT_FILE_NAME);
+    utils_join_path(index_file_path, options->output_dir_path, INDEX_FILE_NAME);
+    utils_join_path(previous_index_file_path, options->output_dir_path, PREVIOUS_INDEX_FILE_NAME);
+    utils_join_path(manifest_file_path, options->output_dir_path, MANIFEST_FILE_NAME);
+    utils_join_path(journal_file_path, options->output_dir_path, JOURNAL_FILE_NAME);
+    ordered_file_open(&output_file, output_file_path, 0);
+
+    if (0 != ordered_file_close(&output_file))
+    {
+        log_message(LOG_ERROR, "Master: %s(): Failed to write the result into file: %s.\n", __FUNCTION__, output_file_path);
+        error_code = -1;
+    }
+    else
+    {
+        log_message(LOG_INFO, "Master: %s(): The workers wrote the result into file: %s.\n", __FUNCTION__, output_file_path);
+    }
+
+    /* The master is the first rank, so its header is at the start of the index */
+    index_error_code = index_encode_header(&index_header, update->current.index_lengths, number_of_workers);
+
+    if ((0 == ordered_file_open(&index_file, index_file_path, index_header.length)) &&
+        (0 != ordered_file_write(&index_file, index_header.data, index_header.length)))
+    {
+        log_message(LOG_ERROR, "Master: %s(): Failed to write the header of the index.\n", __FUNCTION__);
+    }
+
+    if ((0 != ordered_file_close(&index_file)) || (0 != index_error_code))
+    {
+        log_message(LOG_ERROR, "Master: %s(): Failed to write the index into file: %s.\n", __FUNCTION__, index_file_path);
+        error_code = -1;
+    }
+    else
+    {
+        log_message(LOG_INFO, "Master: %s(): The workers wrote the index into file: %s.\n", __FUNCTION__, index_file_path);
+    }
+
+    /* The workers only know their own writes, so all the ranks agree on whether one of them failed */
+    error_code = (0 != error_code) ? 1 : 0;
+    MPI_Allreduce(MPI_IN_PLACE, &error_code, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+
+    if (0 != error_code)
+    {
+        log_message(LOG_ERROR, "Master: %s(): A rank failed to write the output, the manifest is not saved.\n", __FUNCTION__);
+    }
+
+    if (NULL != update->journal.file)
+    {
+        fclose(update->journal.file);
+        update->journal.file = NULL;
+    }
+
+    if ((0 != error_code) || ((0 == options->memory_shuffle) && (0 != manifest_save(&update->current, manifest_file_path))))
+    {
+        /* The next run rebuilds the output directory, with the runs of the journal */
+        remove(manifest_file_path);
+    }
+    else
+    {
+        /* The manifest has all the files of the job */
+        remove(journal_file_path);
+    }
+
+    remove(previous_result_file_path);
+    remove(previous_index_file_path);
+    byte_buffer_free(&index_header);
+
+    free(requests);
+    free(reduced_tasks);
+}
+
+/**
+ * @brief Function called by master to log the wall time of a phase and to add it to the metrics
+ * @param[in] phase           - The phase name
+ * @param[in] metric          - The timer of the phase (METRIC_*_SECONDS)
+ * @param[in,out] phase_start - The start of the phase, which becomes the start of the next one
+ * @return void
+ **/
+static void master_phase_done(const char *phase, const int metric, double *phase_start)
+{
+    double now = metrics_add_time(metric, *phase_start);
+
+    log_message(LOG_INFO, "Master: %s(): The %s phase took %.3f seconds.\n", __FUNCTION__, phase, now - *phase_start);
+    *phase_start = now;
+}
+
+/*******************************************
+ *          FUNCTION DEFINITION
+ ******************************************/
+
+/**
+ * @brief Function called by master to schedule the workers
+ * @param[in] options - The command line options
  * @param[in] number_of_workers - Number of workers
  * @return void
  **/
-void do_master(const char *input_dir_path, const int number_of_workers)
+void do_master(const Options *options, const int number_of_workers)
 {
-    log_message(stdout, "Master: %s(): The master: Hello world!\n", __FUNCTION__);
-    master_map_phase(input_dir_path, number_of_workers);
-    master_reduce_phase(number_of_workers);
-    master_store_result_phase(RESULT_FILE_NAME, number_of_workers);
-    log_message(stdout, "Master: %s(): The master: Good bye cruel world!\n", __FUNCTION__);
+    MPI_Comm workers_comm = MPI_COMM_NULL;
+    IndexUpdate update = {0};
+    double start = MPI_Wtime();
+    double phase_start = start;
+
+    if (0 != options->memory_shuffle)
+    {
+        /* The workers exchange the map output between them, the master is not part of their communicator */
+        MPI_Comm_split(MPI_COMM_WORLD, MPI_UNDEFINED, 0, &workers_comm);
+    }
+
+    log_message(LOG_INFO, "Master: %s(): The master: Hello world!\n", __FUNCTION__);
+    master_update_phase(options, number_of_workers, &update);
+    master_phase_done("update", METRIC_UPDATE_SECONDS, &phase_start);
+    master_map_phase(options, number_of_workers, &update);
+    master_phase_done("map", METRIC_MAP_SECONDS, &phase_start);
+    master_partition_phase(number_of_workers, &update);
+    master_phase_done("partition", METRIC_PARTITION_SECONDS, &phase_start);
+
+    /* The master waits for the reduce in the store phase, so they are timed together */
+    master_reduce_phase(options->output_dir_path, number_of_workers, &update);
+    master_store_result_phase(options, number_of_workers, &update);
+    master_phase_done("reduce", METRIC_REDUCE_SECONDS, &phase_start);
+    metrics_add(METRIC_JOB_SECONDS, phase_start - start);
+    log_message(LOG_INFO, "Master: %s(): The job took %.3f seconds.\n", __FUNCTION__, phase_start - start);
+    log_message(LOG_INFO, "Master: %s(): The master: Good bye cruel world!\n", __FUNCTION__);
+
+    manifest_free(&update.previous);
+    manifest_free(&update.current);
+    free(update.reduced);
+    free(update.journal.done_tasks);
+    free(update.journal.recorded_files);
 }
\ No newline at end of file
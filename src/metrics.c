@@ -0,0 +1,231 @@
+/*******************************************
+ *              INCLUDES
+ ******************************************/
+#include <stdio.h>   /* FILE            */
+#include <stdlib.h>  /* dynamic memory  */
+#include "mpi.h"
+#include "metrics.h"
+#include "utils.h"   /* MAX_PATH        */
+#include "logger.h"
+#include "trace.h"
+
+/*******************************************
+ *              STATIC DATA
+ ******************************************/
+static double metrics[METRICS_COUNT] = {0};
+
+/* The timers are named with a "_seconds" suffix in the report, the spans of the trace have their bare names */
+static const char *metric_names[METRICS_COUNT] = {"update", "map", "partition", "shuffle", "reduce", "store", "job", "recv_blocked",
+                                                  "bytes_read", "tokens", "unique_terms", "dictionary_probes", "bytes_shuffled",
+                                                  "backup_tasks", "cancelled_tasks"};
+
+/*******************************************
+ *       STATIC FUNCTION DECLARATION
+ ******************************************/
+
+/**
+ * @brief   Function used to write the name of a metric as JSON
+ * @param[in] file   - The report
+ * @param[in] metric - The metric
+ * @return  void
+ **/
+static void metrics_write_name(FILE *file, const int metric);
+
+/**
+ * @brief   Function used to write the value of a metric as JSON
+ * @param[in] file   - The report
+ * @param[in] metric - The metric
+ * @param[in] value  - The value
+ * @return  void
+ **/
+static void metrics_write_value(FILE *file, const int metric, double value);
+
+/**
+ * @brief   Function used by master to write the report
+ * @param[in] file  - The report
+ * @param[in] all   - The metrics of every rank, one rank after another
+ * @param[in] ranks - Number of ranks
+ * @return  void
+ **/
+static void metrics_write_report(FILE *file, const double *all, int ranks);
+
+/*******************************************
+ *       STATIC FUNCTION DEFINITION
+ ******************************************/
+
+/**
+ * @brief   Function used to write the name of a metric as JSON
+ * @param[in] file   - The report
+ * @param[in] metric - The metric
+ * @return  void
+ **/
+static void metrics_write_name(FILE *file, const int metric)
+{
+    fprintf(file, "\"%s%s\": ", metric_names[metric], (METRIC_FIRST_COUNTER > metric) ? "_seconds" : "");
+}
+
+/**
+ * @brief   Function used to write the value of a metric as JSON
+ * @param[in] file   - The report
+ * @param[in] metric - The metric
+ * @param[in] value  - The value
+ * @return  void
+ **/
+static void metrics_write_value(FILE *file, const int metric, double value)
+{
+    fprintf(file, (METRIC_FIRST_COUNTER > metric) ? "%.6f" : "%.0f", value);
+}
+
+/**
+ * @brief   Function used by master to write the report
+ * @param[in] file  - The report
+ * @param[in] all   - The metrics of every rank, one rank after another
+ * @param[in] ranks - Number of ranks
+ * @return  void
+ **/
+static void metrics_write_report(FILE *file, const double *all, int ranks)
+{
+    fprintf(file, "{\n  \"ranks\": %d,\n  \"master\": {", ranks);
+
+    for (int i = 0; i < METRICS_COUNT; ++i)
+    {
+        fprintf(file, "%s", (0 == i) ? "" : ", ");
+        metrics_write_name(file, i);
+        metrics_write_value(file, i, all[i]);
+    }
+
+    /* The workers are compared with each other, the slowest one is the max_rank of a timer */
+    fprintf(file, "},\n  \"workers\": {\n");
+
+    for (int i = 0; i < METRICS_COUNT; ++i)
+    {
+        double min = 0;
+        double max = 0;
+        double sum = 0;
+        int max_rank = 0;
+
+        for (int rank = 1; rank < ranks; ++rank)
+        {
+            double value = all[rank * METRICS_COUNT + i];
+
+            if ((1 == rank) || (value < min))
+            {
+                min = value;
+            }
+
+            if ((1 == rank) || (value > max))
+            {
+                max = value;
+                max_rank = rank;
+            }
+
+            sum += value;
+        }
+
+        fprintf(file, "    ");
+        metrics_write_name(file, i);
+        fprintf(file, "{\"min\": ");
+        metrics_write_value(file, i, min);
+        fprintf(file, ", \"avg\": ");
+        metrics_write_value(file, i, (1 < ranks) ? sum / (ranks - 1) : 0);
+        fprintf(file, ", \"max\": ");
+        metrics_write_value(file, i, max);
+        fprintf(file, ", \"sum\": ");
+        metrics_write_value(file, i, sum);
+        fprintf(file, ", \"max_rank\": %d}%s\n", max_rank, (METRICS_COUNT - 1 == i) ? "" : ",");
+    }
+
+    fprintf(file, "  }\n}\n");
+}
+
+/*******************************************
+ *          FUNCTION DEFINITION
+ ******************************************/
+
+/**
+ * @brief   Function used to add a value to a metric of the current rank. Not thread safe.
+ * @param[in] metric - The metric (METRIC_*)
+ * @param[in] value  - The value
+ * @return  void
+ **/
+void metrics_add(const int metric, double value)
+{
+    metrics[metric] += value;
+}
+
+/**
+ * @brief   Function used to add the time elapsed since a moment to a timer of the current rank.
+ *          The time is also recorded as a span of the trace.
+ * @param[in] metric - The timer (METRIC_*_SECONDS)
+ * @param[in] start  - The moment, from MPI_Wtime()
+ * @return  The current time, so the next timer can start from it
+ **/
+double metrics_add_time(const int metric, double start)
+{
+    double now = MPI_Wtime();
+
+    metrics[metric] += now - start;
+    trace_span((METRIC_RECV_BLOCKED_SECONDS == metric) ? "mpi" : "phase", metric_names[metric], -1, NULL, start, now);
+
+    return now;
+}
+
+/**
+ * @brief   Function called by all the ranks at the end of the job to gather their metrics to master.
+ *          The master writes the min/avg/max of the workers and its own metrics as JSON into the output directory.
+ * @param[in] rank            - The current process rank
+ * @param[in] output_dir_path - Path of the output directory
+ * @return  0 for success or -1 in case of error
+ **/
+int metrics_report(const int rank, const char *output_dir_path)
+{
+    char report_file_path[MAX_PATH] = {'\0'};
+    int error_code = 0;
+    int ranks = 0;
+    double *all = NULL;
+    FILE *file = NULL;
+
+    if (0 != rank)
+    {
+        MPI_Gather(metrics, METRICS_COUNT, MPI_DOUBLE, NULL, METRICS_COUNT, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        return 0;
+    }
+
+    MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+    all = (double *)malloc(ranks * METRICS_COUNT * sizeof(double));
+
+    if (NULL == all)
+    {
+        /* The workers are waiting in the gather, so this can't be recovered */
+        log_message(LOG_ERROR, "Metrics: %s(): Out of memory! .\n", __FUNCTION__);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    MPI_Gather(metrics, METRICS_COUNT, MPI_DOUBLE, all, METRICS_COUNT, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    utils_join_path(report_file_path, output_dir_path, METRICS_FILE_NAME);
+
+    if (NULL == (file = fopen(report_file_path, "w")))
+    {
+        log_message(LOG_ERROR, "Metrics: %s(): Failed to open file '%s'.\n", __FUNCTION__, report_file_path);
+        error_code = -1;
+    }
+    else
+    {
+        metrics_write_report(file, all, ranks);
+        error_code = (0 != ferror(file)) ? -1 : 0;
+
+        if ((0 != fclose(file)) || (0 != error_code))
+        {
+            log_message(LOG_ERROR, "Metrics: %s(): Failed to write file '%s'.\n", __FUNCTION__, report_file_path);
+            error_code = -1;
+        }
+        else
+        {
+            log_message(LOG_INFO, "Metrics: %s(): The metrics were written into '%s'.\n", __FUNCTION__, report_file_path);
+        }
+    }
+
+    free(all);
+
+    return error_code;
+}
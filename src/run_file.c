@@ -0,0 +1,1073 @@
+/*******************************************
+ *              INCLUDES
+ ******************************************/
+#include <stdio.h>     /* FILE            */
+#include <stdlib.h>    /* dynamic memory  */
+#include <string.h>    /* memcmp          */
+#include <errno.h>     /* errno           */
+#include <fcntl.h>     /* open            */
+#include <unistd.h>    /* close           */
+#include <sys/mman.h>  /* mmap            */
+#include <sys/stat.h>  /* fstat           */
+#include <dirent.h>    /* DIR             */
+#include "run_file.h"
+#include "logger.h"
+
+/*******************************************
+ *                DEFINES
+ ******************************************/
+#define RUN_TRAILER_SIZE (3 * sizeof(uint64_t) + RUN_MAGIC_SIZE)
+#define PARTITION_TRAILER_SIZE (sizeof(uint64_t) + PARTITION_MAGIC_SIZE)
+#define RUN_WRITE_BUFFER_SIZE (1024 * 1024) /* Bytes encoded before they are written */
+#define MIN_MERGER_CAPACITY 16
+
+/*******************************************
+ *       STATIC FUNCTION DECLARATION
+ ******************************************/
+
+/**
+ * @brief   Function used to write the buffered records into the run file or output buffer
+ * @param[in] writer - The writer
+ * @return  0 for success or -1 in case of error
+ **/
+static int run_writer_flush(RunWriter *writer);
+
+/**
+ * @brief   Function used to write all the terms of a Dictionary as one run for every partition,
+ *          into a file or a memory buffer
+ * @param[in] dic              - The dictionary
+ * @param[in] file             - The file (NULL if the runs are written into output)
+ * @param[out] output          - The buffer (NULL if the runs are written into file)
+ * @param[in] splits           - The split points of the partitions
+ * @param[out] segment_offsets - splits->partitions_count + 1 offsets of the runs
+ * @return  0 for success or -1 in case of error
+ **/
+static int run_file_write_partitions(Dictionary *dic, FILE *file, ByteBuffer *output, const KeySplits *splits, uint64_t *segment_offsets);
+
+/**
+ * @brief   Function used to decode the record which starts at a given offset
+ * @param[in] reader   - The reader
+ * @param[in] position - Offset of the record
+ * @return  Offset of the next record or 0 in case of error
+ **/
+static size_t run_reader_decode(RunReader *reader, size_t position);
+
+/**
+ * @brief   Function used to read the bounds of a segment from the table of a partitioned run file
+ * @param[in] fd        - The run file
+ * @param[in] file_size - The file size
+ * @param[in] trailer   - The last PARTITION_TRAILER_SIZE bytes of the file
+ * @param[in] partition - The partition of the segment
+ * @param[out] segment  - The offsets of the segment's first and last + 1 bytes
+ * @return  0 for success or -1 in case of error
+ **/
+static int run_file_read_segment(int fd, uint64_t file_size, const unsigned char *trailer, int partition, uint64_t *segment);
+
+/**
+ * @brief   Function used to compare the current terms of two runs of a merger (the run index breaks the ties)
+ * @param[in] merger - The merger
+ * @param[in] first  - Index of the first run
+ * @param[in] second - Index of the second run
+ * @return  1 if the first run comes before the second one, 0 otherwise
+ **/
+static int run_merger_before(const RunMerger *merger, int first, int second);
+
+/**
+ * @brief   Function used to read the next record of a run and to add the run to the heap if the record is in the key range
+ * @param[in] merger - The merger
+ * @param[in] run    - Index of the run
+ * @return  0 for success or -1 in case of error
+ **/
+static int run_merger_push(RunMerger *merger, int run);
+
+/**
+ * @brief   Function used to remove the run with the smallest term from the heap
+ * @param[in] merger - The merger
+ * @return  Index of the run
+ **/
+static int run_merger_pop(RunMerger *merger);
+
+/**
+ * @brief   Function used by qsort to compare two postings by document ID
+ * @param[in] first  - The first posting
+ * @param[in] second - The second posting
+ * @return  < 0, 0 or > 0 if the first document ID is smaller, equal or greater than the second one
+ **/
+static int compare_postings(const void *first, const void *second);
+
+/*******************************************
+ *       STATIC FUNCTION DEFINITION
+ ******************************************/
+
+/**
+ * @brief   Function used to write the buffered records into the run file or output buffer
+ * @param[in] writer - The writer
+ * @return  0 for success or -1 in case of error
+ **/
+static int run_writer_flush(RunWriter *writer)
+{
+    int error_code = 0;
+
+    if (NULL != writer->output)
+    {
+        error_code = byte_buffer_append(writer->output, writer->records.data, writer->records.length);
+    }
+    else if (writer->records.length != fwrite(writer->records.data, 1, writer->records.length, writer->file))
+    {
+        log_message(LOG_ERROR, "Run: %s(): Failed to write the run. Errno: %s.\n", __FUNCTION__, strerror(errno));
+        error_code = -1;
+    }
+
+    writer->records.length = 0;
+
+    return error_code;
+}
+
+/**
+ * @brief   Function used to decode the record which starts at a given offset
+ * @param[in] reader   - The reader
+ * @param[in] position - Offset of the record
+ * @return  Offset of the next record or 0 in case of error
+ **/
+static size_t run_reader_decode(RunReader *reader, size_t position)
+{
+    uint64_t term_length = 0;
+    uint64_t postings = 0;
+    size_t used = varint_decode(reader->data + position, reader->records_end - position, &term_length);
+
+    if ((0 == used) || (reader->records_end - position - used < term_length))
+    {
+        return 0;
+    }
+
+    position += used;
+    reader->term = (const char *)reader->data + position;
+    reader->term_length = term_length;
+    position += term_length;
+
+    used = varint_decode(reader->data + position, reader->records_end - position, &postings);
+
+    if (0 == used)
+    {
+        return 0;
+    }
+
+    position += used;
+
+    if ((int)postings > reader->postings_capacity)
+    {
+        int *new_documents = (int *)realloc(reader->documents, postings * sizeof(int));
+        int *new_counts = NULL;
+
+        if (NULL != new_documents)
+        {
+            reader->documents = new_documents;
+            new_counts = (int *)realloc(reader->counts, postings * sizeof(int));
+        }
+
+        if (NULL == new_counts)
+        {
+            log_message(LOG_ERROR, "Run: %s(): Out of memory! .\n", __FUNCTION__);
+            return 0;
+        }
+
+        reader->counts = new_counts;
+        reader->postings_capacity = postings;
+    }
+
+    for (uint64_t i = 0; i < postings; ++i)
+    {
+        uint64_t delta = 0;
+        uint64_t count = 0;
+
+        used = varint_decode(reader->data + position, reader->records_end - position, &delta);
+        position += used;
+
+        if ((0 == used) || (0 == (used = varint_decode(reader->data + position, reader->records_end - position, &count))))
+        {
+            return 0;
+        }
+
+        /* The document IDs are zigzag encoded differences from the previous one */
+        position += used;
+        reader->documents[i] = ((0 == i) ? 0 : reader->documents[i - 1]) + (int64_t)((delta >> 1) ^ (0 - (delta & 1)));
+        reader->counts[i] = count;
+    }
+
+    reader->postings_length = postings;
+
+    return position;
+}
+
+/**
+ * @brief   Function used to read the bounds of a segment from the table of a partitioned run file
+ * @param[in] fd        - The run file
+ * @param[in] file_size - The file size
+ * @param[in] trailer   - The last PARTITION_TRAILER_SIZE bytes of the file
+ * @param[in] partition - The partition of the segment
+ * @param[out] segment  - The offsets of the segment's first and last + 1 bytes
+ * @return  0 for success or -1 in case of error
+ **/
+static int run_file_read_segment(int fd, uint64_t file_size, const unsigned char *trailer, int partition, uint64_t *segment)
+{
+    uint64_t partitions_count = 0;
+    uint64_t table_offset = 0;
+
+    memcpy(&partitions_count, trailer, sizeof(uint64_t));
+
+    if ((0 > partition) || ((uint64_t)partition >= partitions_count) ||
+        ((partitions_count + 1) * sizeof(uint64_t) > file_size - PARTITION_TRAILER_SIZE))
+    {
+        return -1;
+    }
+
+    table_offset = file_size - PARTITION_TRAILER_SIZE - (partitions_count + 1) * sizeof(uint64_t);
+
+    if ((2 * sizeof(uint64_t) != pread(fd, segment, 2 * sizeof(uint64_t), table_offset + partition * sizeof(uint64_t))) ||
+        (segment[0] > segment[1]) || (segment[1] > table_offset))
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief   Function used to write all the terms of a Dictionary as one run for every partition,
+ *          into a file or a memory buffer
+ * @param[in] dic              - The dictionary
+ * @param[in] file             - The file (NULL if the runs are written into output)
+ * @param[out] output          - The buffer (NULL if the runs are written into file)
+ * @param[in] splits           - The split points of the partitions
+ * @param[out] segment_offsets - splits->partitions_count + 1 offsets of the runs
+ * @return  0 for success or -1 in case of error
+ **/
+static int run_file_write_partitions(Dictionary *dic, FILE *file, ByteBuffer *output, const KeySplits *splits, uint64_t *segment_offsets)
+{
+    int error_code = -1;
+    int *sorted = sort_dictionary(dic);
+    int next = 0; /* The next term in sorted order */
+    RunWriter writer = {0};
+
+    if (NULL == sorted)
+    {
+        log_message(LOG_ERROR, "Run: %s(): Out of memory! .\n", __FUNCTION__);
+    }
+    else
+    {
+        error_code = 0;
+
+        /* The partitions are key ranges, so the sorted terms are already grouped by partition */
+        for (int p = 0; (0 == error_code) && (p < splits->partitions_count); ++p)
+        {
+            segment_offsets[p] = (NULL != output) ? output->length : (uint64_t)ftell(file);
+            error_code = (NULL != output) ? run_writer_begin_buffer(&writer, output) : run_writer_begin(&writer, file);
+
+            while ((0 == error_code) && (next < dic[0].elements_length))
+            {
+                const Pair *pair = &dic[0].elements[sorted[next]];
+                size_t key_length = strlen(pair->key);
+
+                if (p != term_partition(splits, pair->key, key_length))
+                {
+                    break;
+                }
+
+                error_code = run_writer_add(&writer, pair->key, key_length, pair->documents, pair->counts, pair->values_length);
+                ++next;
+            }
+
+            error_code |= run_writer_end(&writer);
+        }
+
+        segment_offsets[splits->partitions_count] = (NULL != output) ? output->length : (uint64_t)ftell(file);
+    }
+
+    return error_code;
+}
+
+/**
+ * @brief   Function used to compare the current terms of two runs of a merger (the run index breaks the ties)
+ * @param[in] merger - The merger
+ * @param[in] first  - Index of the first run
+ * @param[in] second - Index of the second run
+ * @return  1 if the first run comes before the second one, 0 otherwise
+ **/
+static int run_merger_before(const RunMerger *merger, int first, int second)
+{
+    const RunReader *first_run = &merger->runs[first];
+    const RunReader *second_run = &merger->runs[second];
+    int result = compare_terms(first_run->term, first_run->term_length, second_run->term, second_run->term_length);
+
+    return (0 > result) || ((0 == result) && (first < second));
+}
+
+/**
+ * @brief   Function used to read the next record of a run and to add the run to the heap if the record is in the key range
+ * @param[in] merger - The merger
+ * @param[in] run    - Index of the run
+ * @return  0 for success or -1 in case of error
+ **/
+static int run_merger_push(RunMerger *merger, int run)
+{
+    RunReader *reader = &merger->runs[run];
+    int result = run_reader_next(reader);
+    int index = merger->heap_length;
+
+    if (0 > result)
+    {
+        log_message(LOG_ERROR, "Run: %s(): The run %d is corrupted.\n", __FUNCTION__, run);
+        return -1;
+    }
+
+    /* The run is sorted, so it is done at the first term after the key range */
+    if ((0 == result) || (merger->partition != term_partition(merger->splits, reader->term, reader->term_length)))
+    {
+        return 0;
+    }
+
+    /* Sift up */
+    while ((0 < index) && (0 != run_merger_before(merger, run, merger->heap[(index - 1) / 2])))
+    {
+        merger->heap[index] = merger->heap[(index - 1) / 2];
+        index = (index - 1) / 2;
+    }
+
+    merger->heap[index] = run;
+    ++merger->heap_length;
+
+    return 0;
+}
+
+/**
+ * @brief   Function used to remove the run with the smallest term from the heap
+ * @param[in] merger - The merger
+ * @return  Index of the run
+ **/
+static int run_merger_pop(RunMerger *merger)
+{
+    int top = merger->heap[0];
+    int last = merger->heap[--merger->heap_length];
+    int index = 0;
+
+    /* Sift down the last run from the root */
+    while (2 * index + 1 < merger->heap_length)
+    {
+        int child = 2 * index + 1;
+
+        if ((child + 1 < merger->heap_length) && (0 != run_merger_before(merger, merger->heap[child + 1], merger->heap[child])))
+        {
+            ++child;
+        }
+
+        if (0 == run_merger_before(merger, merger->heap[child], last))
+        {
+            break;
+        }
+
+        merger->heap[index] = merger->heap[child];
+        index = child;
+    }
+
+    merger->heap[index] = last;
+
+    return top;
+}
+
+/**
+ * @brief   Function used by qsort to compare two postings by document ID
+ * @param[in] first  - The first posting
+ * @param[in] second - The second posting
+ * @return  < 0, 0 or > 0 if the first document ID is smaller, equal or greater than the second one
+ **/
+static int compare_postings(const void *first, const void *second)
+{
+    const RunPosting *first_posting = (const RunPosting *)first;
+    const RunPosting *second_posting = (const RunPosting *)second;
+
+    return (first_posting->document_id > second_posting->document_id) - (first_posting->document_id < second_posting->document_id);
+}
+
+/*******************************************
+ *          FUNCTION DEFINITION
+ ******************************************/
+
+/**
+ * @brief   Function used to start writing a run at the current position of a file
+ * @param[out] writer - The writer
+ * @param[in] file    - The file. It must stay open untill the run is ended
+ * @return  0 for success or -1 in case of error
+ **/
+int run_writer_begin(RunWriter *writer, FILE *file)
+{
+    int error_code = -1;
+
+    memset(writer, 0, sizeof(RunWriter));
+    writer->file = file;
+
+    if (0 == byte_buffer_append(&writer->records, RUN_MAGIC, RUN_MAGIC_SIZE))
+    {
+        writer->offset = RUN_MAGIC_SIZE;
+        error_code = 0;
+    }
+
+    return error_code;
+}
+
+/**
+ * @brief   Function used to start writing a run at the end of a memory buffer
+ * @param[out] writer - The writer
+ * @param[in] output  - The buffer. It must stay valid untill the run is ended
+ * @return  0 for success or -1 in case of error
+ **/
+int run_writer_begin_buffer(RunWriter *writer, ByteBuffer *output)
+{
+    int error_code = run_writer_begin(writer, NULL);
+
+    writer->output = output;
+
+    return error_code;
+}
+
+/**
+ * @brief   Function used to add a record to a run. The terms must be added in increasing order.
+ * @param[in] writer          - The writer
+ * @param[in] term            - The term (it doesn't have to be NUL terminated)
+ * @param[in] term_length     - The term length
+ * @param[in] documents       - The document IDs of the postings
+ * @param[in] counts          - The counts of the postings
+ * @param[in] postings_length - Number of postings
+ * @return  0 for success or -1 in case of error
+ **/
+int run_writer_add(RunWriter *writer, const char *term, size_t term_length,
+                   const int *documents, const int *counts, int postings_length)
+{
+    int error_code = 0;
+    size_t initial_length = writer->records.length;
+
+    if (0 == writer->records_count % RUN_INDEX_INTERVAL)
+    {
+        error_code |= byte_buffer_append_varint(&writer->index, term_length);
+        error_code |= byte_buffer_append(&writer->index, term, term_length);
+        error_code |= byte_buffer_append_varint(&writer->index, writer->offset);
+        ++writer->index_entries;
+    }
+
+    error_code |= byte_buffer_append_varint(&writer->records, term_length);
+    error_code |= byte_buffer_append(&writer->records, term, term_length);
+    error_code |= byte_buffer_append_varint(&writer->records, postings_length);
+
+    /* The postings of a merged run are sorted, so the differences are small. The ones of a map task may be out of order,
+     * so the differences are zigzag encoded (0, -1, 1, -2... as 0, 1, 2, 3...). */
+    for (int i = 0; i < postings_length; ++i)
+    {
+        int64_t delta = (int64_t)documents[i] - ((0 == i) ? 0 : documents[i - 1]);
+
+        error_code |= byte_buffer_append_varint(&writer->records, ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+        error_code |= byte_buffer_append_varint(&writer->records, counts[i]);
+    }
+
+    writer->offset += writer->records.length - initial_length;
+    ++writer->records_count;
+
+    if (RUN_WRITE_BUFFER_SIZE <= writer->records.length)
+    {
+        error_code |= run_writer_flush(writer);
+    }
+
+    return (0 == error_code) ? 0 : -1;
+}
+
+/**
+ * @brief   Function used to write the index and the trailer of a run
+ * @param[in] writer - The writer
+ * @return  0 for success or -1 in case of error
+ **/
+int run_writer_end(RunWriter *writer)
+{
+    int error_code = 0;
+    uint64_t trailer[3] = {writer->offset, writer->index_entries, writer->records_count};
+
+    error_code |= byte_buffer_append(&writer->records, writer->index.data, writer->index.length);
+    error_code |= byte_buffer_append(&writer->records, trailer, sizeof(trailer));
+    error_code |= byte_buffer_append(&writer->records, RUN_MAGIC, RUN_MAGIC_SIZE);
+    error_code |= run_writer_flush(writer);
+
+    byte_buffer_free(&writer->records);
+    byte_buffer_free(&writer->index);
+    writer->file = NULL;
+
+    return (0 == error_code) ? 0 : -1;
+}
+
+/**
+ * @brief   Function used to write all the terms of a Dictionary as a partitioned run file.
+ *          Every term goes into the segment given by term_partition(), in term order.
+ * @param[in] dic              - The dictionary (< termk, {docIDx : countk} [] >)
+ * @param[in] file_path        - Path of the run file
+ * @param[in] splits           - The split points of the partitions (reducers)
+ * @return  0 for success or -1 in case of error
+ **/
+int write_partitioned_run(Dictionary *dic, const char *file_path, const KeySplits *splits)
+{
+    int error_code = -1;
+    uint64_t *segment_offsets = (uint64_t *)calloc(splits->partitions_count + 2, sizeof(uint64_t));
+    FILE *file = NULL;
+
+    if (NULL == segment_offsets)
+    {
+        log_message(LOG_ERROR, "Run: %s(): Out of memory! .\n", __FUNCTION__);
+    }
+    else if (NULL == (file = fopen(file_path, "wb")))
+    {
+        log_message(LOG_ERROR, "Run: %s(): Failed to open file '%s'. Errno: %s.\n", __FUNCTION__, file_path, strerror(errno));
+    }
+    else
+    {
+        error_code = run_file_write_partitions(dic, file, NULL, splits, segment_offsets);
+
+        /* Finally, the segments table */
+        segment_offsets[splits->partitions_count + 1] = splits->partitions_count;
+
+        if ((0 != error_code) ||
+            (splits->partitions_count + 2 != (int)fwrite(segment_offsets, sizeof(uint64_t), splits->partitions_count + 2, file)) ||
+            (PARTITION_MAGIC_SIZE != fwrite(PARTITION_MAGIC, 1, PARTITION_MAGIC_SIZE, file)))
+        {
+            log_message(LOG_ERROR, "Run: %s(): Failed to write file '%s'. Errno: %s.\n", __FUNCTION__, file_path, strerror(errno));
+            error_code = -1;
+        }
+
+        if (0 != fclose(file))
+        {
+            log_message(LOG_ERROR, "Run: %s(): Failed to close file '%s'. Errno: %s.\n", __FUNCTION__, file_path, strerror(errno));
+            error_code = -1;
+        }
+    }
+
+    free(segment_offsets);
+
+    return error_code;
+}
+
+/**
+ * @brief   Function used to encode all the terms of a Dictionary as one run for every partition, in memory.
+ *          The runs are appended to output one after another, in partition order.
+ * @param[in] dic              - The dictionary (< termk, {docIDx : countk} [] >)
+ * @param[out] output          - The buffer in which the runs are appended
+ * @param[in] splits           - The split points of the partitions (reducers)
+ * @param[out] segment_offsets - splits->partitions_count + 1 offsets of the runs into output
+ * @return  0 for success or -1 in case of error
+ **/
+int encode_partitioned_runs(Dictionary *dic, ByteBuffer *output, const KeySplits *splits, uint64_t *segment_offsets)
+{
+    return run_file_write_partitions(dic, NULL, output, splits, segment_offsets);
+}
+
+/**
+ * @brief   Function used to open a segment of a partitioned run file. Only the segment is mapped into memory.
+ * @param[out] reader   - The reader
+ * @param[in] file_path - Path of the run file
+ * @param[in] partition - The partition of the segment
+ * @return  0 for success or -1 in case of error
+ **/
+int run_reader_open_partition(RunReader *reader, const char *file_path, int partition)
+{
+    int error_code = -1;
+    int fd = open(file_path, O_RDONLY);
+    struct stat file_stat = {0};
+    unsigned char trailer[PARTITION_TRAILER_SIZE] = {0};
+    uint64_t segment[2] = {0};
+
+    memset(reader, 0, sizeof(RunReader));
+
+    if ((-1 == fd) || (0 != fstat(fd, &file_stat)))
+    {
+        log_message(LOG_ERROR, "Run: %s(): Failed to open file '%s'. Errno: %s.\n", __FUNCTION__, file_path, strerror(errno));
+    }
+    else if (((size_t)file_stat.st_size < PARTITION_TRAILER_SIZE) ||
+             (PARTITION_TRAILER_SIZE != pread(fd, trailer, PARTITION_TRAILER_SIZE, file_stat.st_size - PARTITION_TRAILER_SIZE)) ||
+             (0 != memcmp(trailer + sizeof(uint64_t), PARTITION_MAGIC, PARTITION_MAGIC_SIZE)))
+    {
+        log_message(LOG_ERROR, "Run: %s(): The file '%s' is not a partitioned run.\n", __FUNCTION__, file_path);
+    }
+    else if (0 != run_file_read_segment(fd, file_stat.st_size, trailer, partition, segment))
+    {
+        log_message(LOG_ERROR, "Run: %s(): The file '%s' has no valid segment %d.\n", __FUNCTION__, file_path, partition);
+    }
+    else
+    {
+        /* mmap() needs an offset aligned to the page size */
+        size_t page_offset = segment[0] % sysconf(_SC_PAGESIZE);
+        size_t mapped_size = segment[1] - segment[0] + page_offset;
+        void *data = mmap(NULL, mapped_size, PROT_READ, MAP_PRIVATE, fd, segment[0] - page_offset);
+
+        if (MAP_FAILED == data)
+        {
+            log_message(LOG_ERROR, "Run: %s(): Failed to map file '%s'. Errno: %s.\n", __FUNCTION__, file_path, strerror(errno));
+        }
+        else if (0 != run_reader_open_buffer(reader, (const unsigned char *)data + page_offset, segment[1] - segment[0]))
+        {
+            log_message(LOG_ERROR, "Run: %s(): The segment %d of file '%s' is not a valid run.\n", __FUNCTION__, partition, file_path);
+            munmap(data, mapped_size);
+        }
+        else
+        {
+            reader->mapping = data;
+            reader->mapped_size = mapped_size;
+            error_code = 0;
+        }
+    }
+
+    if (-1 != fd)
+    {
+        close(fd);
+    }
+
+    return error_code;
+}
+
+/**
+ * @brief   Function used to open a run stored into memory
+ * @param[out] reader - The reader
+ * @param[in] data    - The run bytes. They must stay valid untill the reader is closed
+ * @param[in] size    - Number of bytes
+ * @return  0 for success or -1 in case of error
+ **/
+int run_reader_open_buffer(RunReader *reader, const unsigned char *data, size_t size)
+{
+    uint64_t trailer[3] = {0};
+    size_t position = 0;
+
+    memset(reader, 0, sizeof(RunReader));
+
+    if ((size < RUN_MAGIC_SIZE + RUN_TRAILER_SIZE) ||
+        (0 != memcmp(data, RUN_MAGIC, RUN_MAGIC_SIZE)) ||
+        (0 != memcmp(data + size - RUN_MAGIC_SIZE, RUN_MAGIC, RUN_MAGIC_SIZE)))
+    {
+        return -1;
+    }
+
+    memcpy(trailer, data + size - RUN_TRAILER_SIZE, sizeof(trailer));
+
+    if ((trailer[0] < RUN_MAGIC_SIZE) || (trailer[0] > size - RUN_TRAILER_SIZE))
+    {
+        return -1;
+    }
+
+    reader->data = data;
+    reader->size = size;
+    reader->records_end = trailer[0];
+    reader->index_entries = trailer[1];
+    reader->records_count = trailer[2];
+    reader->position = RUN_MAGIC_SIZE;
+
+    reader->index_terms = (const unsigned char **)calloc(reader->index_entries + 1, sizeof(unsigned char *));
+    reader->index_terms_lengths = (size_t *)calloc(reader->index_entries + 1, sizeof(size_t));
+    reader->index_offsets = (uint64_t *)calloc(reader->index_entries + 1, sizeof(uint64_t));
+
+    if ((NULL == reader->index_terms) || (NULL == reader->index_terms_lengths) || (NULL == reader->index_offsets))
+    {
+        log_message(LOG_ERROR, "Run: %s(): Out of memory! .\n", __FUNCTION__);
+        run_reader_close(reader);
+        return -1;
+    }
+
+    /* Decode the index */
+    position = reader->records_end;
+
+    for (uint64_t i = 0; i < reader->index_entries; ++i)
+    {
+        uint64_t term_length = 0;
+        size_t used = varint_decode(data + position, size - RUN_TRAILER_SIZE - position, &term_length);
+
+        if ((0 == used) || (size - RUN_TRAILER_SIZE - position - used < term_length))
+        {
+            run_reader_close(reader);
+            return -1;
+        }
+
+        reader->index_terms[i] = data + position + used;
+        reader->index_terms_lengths[i] = term_length;
+        position += used + term_length;
+        used = varint_decode(data + position, size - RUN_TRAILER_SIZE - position, &reader->index_offsets[i]);
+
+        if (0 == used)
+        {
+            run_reader_close(reader);
+            return -1;
+        }
+
+        position += used;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief   Function used to position the reader before the first record with term >= the given one
+ * @param[in] reader      - The reader
+ * @param[in] term        - The term (it doesn't have to be NUL terminated)
+ * @param[in] term_length - The term length
+ * @return  void
+ **/
+void run_reader_seek(RunReader *reader, const char *term, size_t term_length)
+{
+    size_t low = 0;
+    size_t high = reader->index_entries;
+    size_t position = RUN_MAGIC_SIZE;
+
+    /* Find the last indexed record with a term < the searched one */
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+
+        if (0 > compare_terms((const char *)reader->index_terms[middle], reader->index_terms_lengths[middle], term, term_length))
+        {
+            position = reader->index_offsets[middle];
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    /* Then scan at most RUN_INDEX_INTERVAL records */
+    while (position < reader->records_end)
+    {
+        size_t next_position = run_reader_decode(reader, position);
+
+        if ((0 == next_position) || (0 <= compare_terms(reader->term, reader->term_length, term, term_length)))
+        {
+            break;
+        }
+
+        position = next_position;
+    }
+
+    reader->position = position;
+}
+
+/**
+ * @brief   Function used to read the next record (term, documents, counts, postings_length)
+ * @param[in] reader - The reader
+ * @return  1 if a record was read, 0 at the end of the run or -1 in case of error
+ **/
+int run_reader_next(RunReader *reader)
+{
+    size_t next_position = 0;
+
+    if (reader->position >= reader->records_end)
+    {
+        return 0;
+    }
+
+    next_position = run_reader_decode(reader, reader->position);
+
+    if (0 == next_position)
+    {
+        log_message(LOG_ERROR, "Run: %s(): The run is corrupted at offset %zu.\n", __FUNCTION__, reader->position);
+        reader->position = reader->records_end;
+        return -1;
+    }
+
+    reader->position = next_position;
+
+    return 1;
+}
+
+/**
+ * @brief   Function used to close a reader and free its memory
+ * @param[in] reader - The reader
+ * @return  void
+ **/
+void run_reader_close(RunReader *reader)
+{
+    if (NULL != reader->mapping)
+    {
+        munmap(reader->mapping, reader->mapped_size);
+    }
+
+    free(reader->index_terms);
+    free(reader->index_terms_lengths);
+    free(reader->index_offsets);
+    free(reader->documents);
+    free(reader->counts);
+    memset(reader, 0, sizeof(RunReader));
+}
+
+/**
+ * @brief   Function used to add a run to a merger
+ * @param[in] merger - The merger (initialized with 0 when it is empty)
+ * @param[in] reader - The run. The merger owns it from now on and closes it.
+ * @return  0 for success or -1 in case of error (the run is closed)
+ **/
+int run_merger_add(RunMerger *merger, RunReader *reader)
+{
+    if (merger->runs_length == merger->runs_capacity)
+    {
+        int capacity = (0 == merger->runs_capacity) ? MIN_MERGER_CAPACITY : 2 * merger->runs_capacity;
+        RunReader *runs = (RunReader *)realloc(merger->runs, capacity * sizeof(RunReader));
+        int *heap = (NULL == runs) ? NULL : (int *)realloc(merger->heap, capacity * sizeof(int));
+
+        if (NULL != runs)
+        {
+            merger->runs = runs;
+        }
+
+        if (NULL == heap)
+        {
+            log_message(LOG_ERROR, "Run: %s(): Out of memory! .\n", __FUNCTION__);
+            run_reader_close(reader);
+            return -1;
+        }
+
+        merger->heap = heap;
+        merger->runs_capacity = capacity;
+    }
+
+    merger->runs[merger->runs_length++] = *reader;
+    memset(reader, 0, sizeof(RunReader));
+
+    return 0;
+}
+
+/**
+ * @brief   Function used to start (or restart) merging the terms of a key range of all the runs
+ * @param[in] merger    - The merger
+ * @param[in] splits    - The key ranges
+ * @param[in] partition - The key range that is merged
+ * @return  void
+ **/
+void run_merger_begin(RunMerger *merger, const KeySplits *splits, int partition)
+{
+    const char *lower_bound = (0 < partition) ? splits->splits + (partition - 1) * SPLIT_KEY_SIZE : "";
+
+    merger->splits = splits;
+    merger->partition = partition;
+    merger->heap_length = 0;
+
+    /* Jump to the first term of the key range of every run. A corrupted run is left out. */
+    for (int i = 0; i < merger->runs_length; ++i)
+    {
+        run_reader_seek(&merger->runs[i], lower_bound, strlen(lower_bound));
+        run_merger_push(merger, i);
+    }
+}
+
+/**
+ * @brief   Function used to merge the next term (term, documents, counts, postings_length) in term order
+ * @param[in] merger - The merger
+ * @return  1 if a term was merged, 0 at the end of the key range or -1 in case of error
+ **/
+int run_merger_next(RunMerger *merger)
+{
+    int run = -1;
+    int merged_length = 0;
+
+    if (0 == merger->heap_length)
+    {
+        return 0;
+    }
+
+    run = run_merger_pop(merger);
+    merger->term = merger->runs[run].term;
+    merger->term_length = merger->runs[run].term_length;
+    merger->postings_length = 0;
+
+    /* Take the postings of the term from all the runs which have it.
+     * The term stays valid, it points into the run's data and not into the reader. */
+    while (1)
+    {
+        const RunReader *reader = &merger->runs[run];
+
+        if (merger->postings_length + reader->postings_length > merger->postings_capacity)
+        {
+            int capacity = 2 * (merger->postings_length + reader->postings_length);
+            RunPosting *postings = (RunPosting *)realloc(merger->postings, capacity * sizeof(RunPosting));
+            int *documents = (NULL == postings) ? NULL : (int *)realloc(merger->documents, capacity * sizeof(int));
+            int *counts = (NULL == documents) ? NULL : (int *)realloc(merger->counts, capacity * sizeof(int));
+
+            merger->postings = (NULL != postings) ? postings : merger->postings;
+            merger->documents = (NULL != documents) ? documents : merger->documents;
+
+            if (NULL == counts)
+            {
+                log_message(LOG_ERROR, "Run: %s(): Out of memory! .\n", __FUNCTION__);
+                return -1;
+            }
+
+            merger->counts = counts;
+            merger->postings_capacity = capacity;
+        }
+
+        for (int i = 0; i < reader->postings_length; ++i)
+        {
+            merger->postings[merger->postings_length].document_id = reader->documents[i];
+            merger->postings[merger->postings_length].count = reader->counts[i];
+            ++merger->postings_length;
+        }
+
+        if (0 != run_merger_push(merger, run))
+        {
+            return -1;
+        }
+
+        if ((0 == merger->heap_length) ||
+            (0 != compare_terms(merger->runs[merger->heap[0]].term, merger->runs[merger->heap[0]].term_length, merger->term, merger->term_length)))
+        {
+            break;
+        }
+
+        run = run_merger_pop(merger);
+    }
+
+    /* A document split between several map tasks has a posting in every one of their runs */
+    qsort(merger->postings, merger->postings_length, sizeof(RunPosting), compare_postings);
+
+    for (int i = 0; i < merger->postings_length; ++i)
+    {
+        if ((0 < merged_length) && (merger->documents[merged_length - 1] == merger->postings[i].document_id))
+        {
+            merger->counts[merged_length - 1] = add_counts(merger->counts[merged_length - 1], merger->postings[i].count);
+        }
+        else
+        {
+            merger->documents[merged_length] = merger->postings[i].document_id;
+            merger->counts[merged_length] = merger->postings[i].count;
+            ++merged_length;
+        }
+    }
+
+    merger->postings_length = merged_length;
+
+    return 1;
+}
+
+/**
+ * @brief   Function used to merge all the terms of all the runs into a partitioned run file with a single segment
+ * @param[in] merger     - The merger
+ * @param[in] file_path  - Path of the run file
+ * @param[out] histogram - Number of postings of every 2 bytes prefix, which is increased (may be NULL)
+ * @return  0 for success or -1 in case of error
+ **/
+int write_merged_run(RunMerger *merger, const char *file_path, uint64_t *histogram)
+{
+    int error_code = 0;
+    int merge_result = 0;
+    KeySplits whole_range = {1, NULL};
+    uint64_t table[3] = {0, 0, 1}; /* segment_offsets[2] | partitions */
+    RunWriter writer = {0};
+    FILE *file = fopen(file_path, "wb");
+
+    if (NULL == file)
+    {
+        log_message(LOG_ERROR, "Run: %s(): Failed to open file '%s'. Errno: %s.\n", __FUNCTION__, file_path, strerror(errno));
+        return -1;
+    }
+
+    error_code = run_writer_begin(&writer, file);
+    run_merger_begin(merger, &whole_range, 0);
+
+    while ((0 == error_code) && (1 == (merge_result = run_merger_next(merger))))
+    {
+        error_code = run_writer_add(&writer, merger->term, merger->term_length, merger->documents, merger->counts, merger->postings_length);
+
+        if (NULL != histogram)
+        {
+            histogram[term_prefix(merger->term, merger->term_length)] += merger->postings_length;
+        }
+    }
+
+    error_code |= (0 > merge_result) ? -1 : 0;
+    error_code |= run_writer_end(&writer);
+    table[1] = ftell(file);
+
+    if ((0 != error_code) ||
+        (3 != fwrite(table, sizeof(uint64_t), 3, file)) ||
+        (PARTITION_MAGIC_SIZE != fwrite(PARTITION_MAGIC, 1, PARTITION_MAGIC_SIZE, file)))
+    {
+        log_message(LOG_ERROR, "Run: %s(): Failed to write file '%s'. Errno: %s.\n", __FUNCTION__, file_path, strerror(errno));
+        error_code = -1;
+    }
+
+    if (0 != fclose(file))
+    {
+        log_message(LOG_ERROR, "Run: %s(): Failed to close file '%s'. Errno: %s.\n", __FUNCTION__, file_path, strerror(errno));
+        error_code = -1;
+    }
+
+    return error_code;
+}
+
+/**
+ * @brief   Function used to close all the runs of a merger and free its memory
+ * @param[in] merger - The merger
+ * @return  void
+ **/
+void run_merger_close(RunMerger *merger)
+{
+    for (int i = 0; i < merger->runs_length; ++i)
+    {
+        run_reader_close(&merger->runs[i]);
+    }
+
+    free(merger->runs);
+    free(merger->heap);
+    free(merger->postings);
+    free(merger->documents);
+    free(merger->counts);
+    memset(merger, 0, sizeof(RunMerger));
+}
+
+/**
+ * @brief   Function used to remove the files left in a directory by the workers of a job which failed:
+ *          the partial runs and the spilled words
+ * @param[in] dir_path    - The directory
+ * @param[in] worker_rank - The worker whose files are removed, or 0 for the files of all the workers
+ * @return  void
+ **/
+void remove_temporary_runs(const char *dir_path, int worker_rank)
+{
+    char file_name[MAX_PATH] = {'\0'};
+    char file_path[MAX_PATH] = {'\0'};
+    DIR *directory = opendir(dir_path);
+    File *file_from_dir = NULL;
+
+    while ((NULL != directory) && (NULL != (file_from_dir = get_next_file_from_dir(directory))))
+    {
+        int number = 0;
+        int file_rank = 0;
+
+        if (2 == sscanf(file_from_dir->d_name, PARTIAL_RUN_FILE_FORMAT, &number, &file_rank))
+        {
+            snprintf(file_name, MAX_PATH, PARTIAL_RUN_FILE_FORMAT, number, file_rank);
+        }
+        else if (2 == sscanf(file_from_dir->d_name, SPILL_FILE_FORMAT, &file_rank, &number))
+        {
+            snprintf(file_name, MAX_PATH, SPILL_FILE_FORMAT, file_rank, number);
+        }
+        else
+        {
+            continue;
+        }
+
+        /* A worker leaves the files of the other workers, which may share its directory and be running already */
+        if ((0 == strcmp(file_name, file_from_dir->d_name)) && ((0 == worker_rank) || (worker_rank == file_rank)))
+        {
+            utils_join_path(file_path, dir_path, file_from_dir->d_name);
+            log_message(LOG_DEBUG, "Run: %s(): The file '%s' left by a failed job is removed.\n", __FUNCTION__, file_path);
+
+            /* Another process may have removed it first */
+            if ((0 != unlink(file_path)) && (ENOENT != errno))
+            {
+                log_message(LOG_ERROR, "Run: %s(): Failed to remove file: %s. Errno: %s.\n", __FUNCTION__, file_path, strerror(errno));
+            }
+        }
+    }
+
+    if (NULL != directory)
+    {
+        closedir(directory);
+    }
+}
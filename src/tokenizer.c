@@ -0,0 +1,627 @@
+/*******************************************
+ *              INCLUDES
+ ******************************************/
+#include <stdio.h>     /* stdout/stderr   */
+#include <stdint.h>    /* uint64_t        */
+#include <stdlib.h>    /* getenv, realloc */
+#include <string.h>    /* strcmp          */
+#include <errno.h>     /* errno           */
+#include <fcntl.h>     /* open            */
+#include <unistd.h>    /* close           */
+#include <pthread.h>   /* pthread_once    */
+#include <sys/mman.h>  /* mmap            */
+#include <sys/stat.h>  /* fstat           */
+#include "tokenizer.h"
+#include "logger.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h> /* SSE2 / AVX2     */
+#define TOKENIZER_X86 1
+#endif
+
+/*******************************************
+ *                DEFINES
+ ******************************************/
+#define BLOCK_SIZE 64 /* Bytes classified at once. One bit per byte in a uint64_t mask */
+#define WHITE_SPACES " \t\n\v\f\r"
+
+/*******************************************
+ *                TYPES
+ ******************************************/
+
+/**
+ * @brief   Function used to classify a block of BLOCK_SIZE bytes
+ * @param[in] block  - The block
+ * @param[out] upper - Mask with the bit i set if the byte i is an upper case letter
+ * @return  Mask with the bit i set if the byte i is a delimiter
+ **/
+typedef uint64_t (*ClassifyFunction)(const char *block, uint64_t *upper);
+
+/* struct used by a thread to convert to lower case the words with upper case letters.
+ * The file is mapped read only, so its pages are never copied. */
+typedef struct LowerCaseBuffer_
+{
+    char *data;
+    size_t size;
+} LowerCaseBuffer;
+
+/* struct used to store a range of consecutive delimiter bytes: [low, high] */
+typedef struct DelimiterRange_
+{
+    unsigned char low;
+    unsigned char high;
+} DelimiterRange;
+
+/*******************************************
+ *              STATIC DATA
+ ******************************************/
+static pthread_once_t tokenizer_once = PTHREAD_ONCE_INIT;
+
+/* delimiter_table[byte] is 1 if the byte is a delimiter */
+static unsigned char delimiter_table[256];
+
+/* The delimiters grouped in ranges, used by the SSE2 implementation */
+static DelimiterRange delimiter_ranges[256];
+static int delimiter_ranges_length;
+
+/* Nibble lookup tables used by the AVX2 implementation.
+ * For a byte with the nibbles hi:lo, it is a delimiter if
+ * (low_nibble_table[hi < 8 ? 0 : 1][lo] & high_nibble_bit[hi]) != 0 */
+static unsigned char low_nibble_table[2][16];
+static unsigned char high_nibble_bit[16];
+
+static ClassifyFunction classify_block;
+static const char *implementation_name;
+
+/*******************************************
+ *       STATIC FUNCTION DECLARATION
+ ******************************************/
+
+/**
+ * @brief   Function used to build the lookup tables and select the implementation (called once)
+ * @return  void
+ **/
+static void tokenizer_init(void);
+
+/**
+ * @brief   Function used to classify a block of BLOCK_SIZE bytes one by one
+ * @param[in] block  - The block
+ * @param[out] upper - Mask with the bit i set if the byte i is an upper case letter
+ * @return  Mask with the bit i set if the byte i is a delimiter
+ **/
+static uint64_t classify_block_scalar(const char *block, uint64_t *upper);
+
+#ifdef TOKENIZER_X86
+/**
+ * @brief   Function used to classify a block of BLOCK_SIZE bytes with SSE2 range compares
+ * @param[in] block  - The block
+ * @param[out] upper - Mask with the bit i set if the byte i is an upper case letter
+ * @return  Mask with the bit i set if the byte i is a delimiter
+ **/
+static uint64_t classify_block_sse2(const char *block, uint64_t *upper);
+
+/**
+ * @brief   Function used to classify a block of BLOCK_SIZE bytes with AVX2 nibble lookups
+ * @param[in] block  - The block
+ * @param[out] upper - Mask with the bit i set if the byte i is an upper case letter
+ * @return  Mask with the bit i set if the byte i is a delimiter
+ **/
+static uint64_t classify_block_avx2(const char *block, uint64_t *upper) __attribute__((target("avx2")));
+#endif
+
+/**
+ * @brief   Function used to give a word to the callback, converted to lower case if it has upper case letters
+ * @param[in] word       - The word
+ * @param[in] length     - The word length
+ * @param[in] has_upper  - Non zero if the word has upper case letters
+ * @param[in,out] buffer - The buffer in which the word is converted
+ * @param[in] callback   - Function called for the word
+ * @param[in] context    - Context given to the callback
+ * @return  0 for success or -1 in case of error
+ **/
+static int tokenizer_emit_word(const char *word, size_t length, uint64_t has_upper, LowerCaseBuffer *buffer, WordCallback callback, void *context);
+
+/**
+ * @brief   Function used to split a buffer into words on multiple threads (OpenMP).
+ *          The buffer is cut into up to contexts_count chunks of at least PARALLEL_CHUNK_MIN_SIZE bytes,
+ *          which end at a delimiter. The words of the chunk i are given to the callback with contexts[i].
+ * @param[in] data           - The buffer
+ * @param[in] size           - The buffer size
+ * @param[in] min_word_size  - The words shorter than this are skipped
+ * @param[in] callback       - Function called for every word
+ * @param[in] contexts       - Context given to the callback for every chunk
+ * @param[in] contexts_count - Maximum number of chunks
+ * @return  0 for success or -1 if a callback failed
+ **/
+static int tokenize_chunks(const char *data, size_t size, size_t min_word_size, WordCallback callback, void **contexts, int contexts_count);
+
+/*******************************************
+ *       STATIC FUNCTION DEFINITION
+ ******************************************/
+
+/**
+ * @brief   Function used to build the lookup tables and select the implementation (called once)
+ * @return  void
+ **/
+static void tokenizer_init(void)
+{
+    const char *forced = getenv(TOKENIZER_ENV);
+
+    /* NUL ends a word like in the old strtok based parser */
+    delimiter_table[0] = 1;
+
+    for (const unsigned char *p = (const unsigned char *)WORD_DELIMITER; '\0' != *p; ++p)
+    {
+        delimiter_table[*p] = 1;
+    }
+
+    for (const unsigned char *p = (const unsigned char *)WHITE_SPACES; '\0' != *p; ++p)
+    {
+        delimiter_table[*p] = 1;
+    }
+
+    for (int c = 0; c < 256; ++c)
+    {
+        if (0 != delimiter_table[c])
+        {
+            if ((0 != delimiter_ranges_length) && (delimiter_ranges[delimiter_ranges_length - 1].high + 1 == c))
+            {
+                delimiter_ranges[delimiter_ranges_length - 1].high = c;
+            }
+            else
+            {
+                delimiter_ranges[delimiter_ranges_length].low = c;
+                delimiter_ranges[delimiter_ranges_length].high = c;
+                ++delimiter_ranges_length;
+            }
+
+            low_nibble_table[c >> 7][c & 0x0F] |= 1 << ((c >> 4) & 0x07);
+        }
+    }
+
+    for (int hi = 0; hi < 16; ++hi)
+    {
+        high_nibble_bit[hi] = 1 << (hi & 0x07);
+    }
+
+    classify_block = classify_block_scalar;
+    implementation_name = "scalar";
+
+#ifdef TOKENIZER_X86
+    if ((NULL == forced) || (0 != strcmp(forced, "scalar")))
+    {
+        classify_block = classify_block_sse2;
+        implementation_name = "sse2";
+
+        __builtin_cpu_init();
+
+        if (((NULL == forced) || (0 == strcmp(forced, "avx2"))) && __builtin_cpu_supports("avx2"))
+        {
+            classify_block = classify_block_avx2;
+            implementation_name = "avx2";
+        }
+    }
+#else
+    (void)forced;
+#endif
+}
+
+/**
+ * @brief   Function used to classify a block of BLOCK_SIZE bytes one by one
+ * @param[in] block  - The block
+ * @param[out] upper - Mask with the bit i set if the byte i is an upper case letter
+ * @return  Mask with the bit i set if the byte i is a delimiter
+ **/
+static uint64_t classify_block_scalar(const char *block, uint64_t *upper)
+{
+    uint64_t mask = 0;
+
+    *upper = 0;
+
+    for (int i = 0; i < BLOCK_SIZE; ++i)
+    {
+        unsigned char c = (unsigned char)block[i];
+
+        if (0 != delimiter_table[c])
+        {
+            mask |= (uint64_t)1 << i;
+        }
+        else if (('A' <= c) && (c <= 'Z'))
+        {
+            *upper |= (uint64_t)1 << i;
+        }
+    }
+
+    return mask;
+}
+
+#ifdef TOKENIZER_X86
+/**
+ * @brief   Function used to classify a block of BLOCK_SIZE bytes with SSE2 range compares
+ * @param[in] block  - The block
+ * @param[out] upper - Mask with the bit i set if the byte i is an upper case letter
+ * @return  Mask with the bit i set if the byte i is a delimiter
+ **/
+static uint64_t classify_block_sse2(const char *block, uint64_t *upper)
+{
+    const __m128i upper_a = _mm_set1_epi8('A');
+    const __m128i upper_range = _mm_set1_epi8('Z' - 'A');
+    uint64_t mask = 0;
+
+    *upper = 0;
+
+    for (int offset = 0; offset < BLOCK_SIZE; offset += 16)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(block + offset));
+        __m128i delimiters = _mm_setzero_si128();
+        __m128i shifted = _mm_sub_epi8(bytes, upper_a);
+        __m128i is_upper = _mm_cmpeq_epi8(_mm_min_epu8(shifted, upper_range), shifted);
+
+        /* byte in [low, high] <=> (byte - low) <= (high - low) as unsigned */
+        for (int i = 0; i < delimiter_ranges_length; ++i)
+        {
+            if (delimiter_ranges[i].low == delimiter_ranges[i].high)
+            {
+                delimiters = _mm_or_si128(delimiters, _mm_cmpeq_epi8(bytes, _mm_set1_epi8(delimiter_ranges[i].low)));
+            }
+            else
+            {
+                __m128i relative = _mm_sub_epi8(bytes, _mm_set1_epi8(delimiter_ranges[i].low));
+                __m128i width = _mm_set1_epi8(delimiter_ranges[i].high - delimiter_ranges[i].low);
+
+                delimiters = _mm_or_si128(delimiters, _mm_cmpeq_epi8(_mm_min_epu8(relative, width), relative));
+            }
+        }
+
+        *upper |= (uint64_t)(unsigned int)_mm_movemask_epi8(is_upper) << offset;
+        mask |= (uint64_t)(unsigned int)_mm_movemask_epi8(delimiters) << offset;
+    }
+
+    return mask;
+}
+
+/**
+ * @brief   Function used to classify a block of BLOCK_SIZE bytes with AVX2 nibble lookups
+ * @param[in] block  - The block
+ * @param[out] upper - Mask with the bit i set if the byte i is an upper case letter
+ * @return  Mask with the bit i set if the byte i is a delimiter
+ **/
+static uint64_t classify_block_avx2(const char *block, uint64_t *upper)
+{
+    const __m256i low_table_ascii = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)low_nibble_table[0]));
+    const __m256i low_table_high = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)low_nibble_table[1]));
+    const __m256i high_table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)high_nibble_bit));
+    const __m256i nibble_mask = _mm256_set1_epi8(0x0F);
+    const __m256i upper_a = _mm256_set1_epi8('A');
+    const __m256i upper_range = _mm256_set1_epi8('Z' - 'A');
+    uint64_t mask = 0;
+
+    *upper = 0;
+
+    for (int offset = 0; offset < BLOCK_SIZE; offset += 32)
+    {
+        __m256i bytes = _mm256_loadu_si256((const __m256i *)(block + offset));
+        __m256i low = _mm256_and_si256(bytes, nibble_mask);
+        __m256i high = _mm256_and_si256(_mm256_srli_epi16(bytes, 4), nibble_mask);
+        /* The sign bit of every byte selects the table of the bytes >= 0x80 */
+        __m256i row_bits = _mm256_blendv_epi8(_mm256_shuffle_epi8(low_table_ascii, low),
+                                              _mm256_shuffle_epi8(low_table_high, low), bytes);
+        __m256i matches = _mm256_and_si256(row_bits, _mm256_shuffle_epi8(high_table, high));
+        __m256i not_delimiters = _mm256_cmpeq_epi8(matches, _mm256_setzero_si256());
+        __m256i shifted = _mm256_sub_epi8(bytes, upper_a);
+        __m256i is_upper = _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, upper_range), shifted);
+
+        *upper |= (uint64_t)(unsigned int)_mm256_movemask_epi8(is_upper) << offset;
+        mask |= (uint64_t)(unsigned int)~_mm256_movemask_epi8(not_delimiters) << offset;
+    }
+
+    return mask;
+}
+#endif
+
+/**
+ * @brief   Function used to give a word to the callback, converted to lower case if it has upper case letters
+ * @param[in] word       - The word
+ * @param[in] length     - The word length
+ * @param[in] has_upper  - Non zero if the word has upper case letters
+ * @param[in,out] buffer - The buffer in which the word is converted
+ * @param[in] callback   - Function called for the word
+ * @param[in] context    - Context given to the callback
+ * @return  0 for success or -1 in case of error
+ **/
+static int tokenizer_emit_word(const char *word, size_t length, uint64_t has_upper, LowerCaseBuffer *buffer, WordCallback callback, void *context)
+{
+    if (0 == has_upper)
+    {
+        return callback(word, length, context);
+    }
+
+    if (buffer->size < length)
+    {
+        char *data = (char *)realloc(buffer->data, length);
+
+        if (NULL == data)
+        {
+            log_message(LOG_ERROR, "Tokenizer: %s(): Out of memory! .\n", __FUNCTION__);
+            return -1;
+        }
+
+        buffer->data = data;
+        buffer->size = length;
+    }
+
+    for (size_t i = 0; i < length; ++i)
+    {
+        unsigned char c = (unsigned char)word[i];
+
+        buffer->data[i] = (('A' <= c) && (c <= 'Z')) ? (char)(c | 0x20) : (char)c;
+    }
+
+    return callback(buffer->data, length, context);
+}
+
+/**
+ * @brief   Function used to split a buffer into words on multiple threads (OpenMP).
+ *          The buffer is cut into up to contexts_count chunks of at least PARALLEL_CHUNK_MIN_SIZE bytes,
+ *          which end at a delimiter. The words of the chunk i are given to the callback with contexts[i].
+ * @param[in] data           - The buffer
+ * @param[in] size           - The buffer size
+ * @param[in] min_word_size  - The words shorter than this are skipped
+ * @param[in] callback       - Function called for every word
+ * @param[in] contexts       - Context given to the callback for every chunk
+ * @param[in] contexts_count - Maximum number of chunks
+ * @return  0 for success or -1 if a callback failed
+ **/
+static int tokenize_chunks(const char *data, size_t size, size_t min_word_size, WordCallback callback, void **contexts, int contexts_count)
+{
+    int error_code = 0;
+    int chunks_count = (size / PARALLEL_CHUNK_MIN_SIZE < (size_t)contexts_count) ? (int)(size / PARALLEL_CHUNK_MIN_SIZE) : contexts_count;
+
+    if (1 >= chunks_count)
+    {
+        error_code = tokenize_buffer(data, size, min_word_size, callback, contexts[0]);
+    }
+    else
+    {
+        /* A chunk starts at the first delimiter from its share of the buffer and ends where the next one starts */
+        size_t bounds[chunks_count + 1];
+
+        bounds[0] = 0;
+        bounds[chunks_count] = size;
+
+        for (int i = 1; i < chunks_count; ++i)
+        {
+            bounds[i] = tokenizer_next_delimiter(data, size, size / chunks_count * i);
+        }
+
+        #pragma omp parallel for num_threads(chunks_count) schedule(static, 1) reduction(|:error_code)
+        for (int i = 0; i < chunks_count; ++i)
+        {
+            if (bounds[i] < bounds[i + 1])
+            {
+                error_code |= tokenize_buffer(data + bounds[i], bounds[i + 1] - bounds[i], min_word_size, callback, contexts[i]);
+            }
+        }
+    }
+
+    return (0 == error_code) ? 0 : -1;
+}
+
+/*******************************************
+ *          FUNCTION DEFINITION
+ ******************************************/
+
+/**
+ * @brief   Function used to get the name of the implementation selected for the current CPU
+ * @return  "scalar", "sse2" or "avx2"
+ **/
+const char *tokenizer_implementation(void)
+{
+    pthread_once(&tokenizer_once, tokenizer_init);
+
+    return implementation_name;
+}
+
+/**
+ * @brief   Function used to split a buffer into words. Every word with at least min_word_size bytes
+ *          is given to the callback in lower case. The buffer isn't modified.
+ * @param[in] data            - The buffer
+ * @param[in] size            - The buffer size
+ * @param[in] min_word_size   - The words shorter than this are skipped
+ * @param[in] callback        - Function called for every word
+ * @param[in] context         - Context given to the callback
+ * @return  0 for success or -1 if a callback failed
+ **/
+int tokenize_buffer(const char *data, size_t size, size_t min_word_size, WordCallback callback, void *context)
+{
+    int error_code = 0;
+    int in_word = 0;
+    int word_block_start = 0; /* First byte of the word into the current block */
+    uint64_t word_upper = 0;  /* The upper case letters of the word, found in the blocks so far */
+    size_t word_start = 0;
+    size_t block_start = 0;
+    LowerCaseBuffer buffer = {NULL, 0};
+
+    pthread_once(&tokenizer_once, tokenizer_init);
+
+    for (block_start = 0; (0 == error_code) && (block_start < size); block_start += BLOCK_SIZE)
+    {
+        uint64_t mask = 0;
+        uint64_t upper = 0;
+        int block_length = BLOCK_SIZE;
+        int i = 0;
+
+        if (BLOCK_SIZE <= size - block_start)
+        {
+            mask = classify_block(data + block_start, &upper);
+        }
+        else
+        {
+            /* The tail of the buffer is shorter than a block.
+             * The missing bytes are handled as delimiters, so they never extend a word */
+            char tail[BLOCK_SIZE] = {'\0'};
+
+            block_length = size - block_start;
+            memcpy(tail, data + block_start, block_length);
+            mask = classify_block(tail, &upper);
+        }
+
+        /* Walk the word boundaries of the block */
+        while ((0 == error_code) && (i < block_length))
+        {
+            uint64_t rest = (0 != in_word) ? (mask >> i) : (~mask >> i);
+
+            if (0 == rest)
+            {
+                break;
+            }
+
+            i += __builtin_ctzll(rest);
+
+            if (i >= block_length)
+            {
+                break;
+            }
+
+            if (0 != in_word)
+            {
+                size_t word_length = block_start + i - word_start;
+
+                word_upper |= (upper >> word_block_start) & (((uint64_t)1 << (i - word_block_start)) - 1);
+
+                if (min_word_size <= word_length)
+                {
+                    error_code = tokenizer_emit_word(data + word_start, word_length, word_upper, &buffer, callback, context);
+                }
+
+                in_word = 0;
+            }
+            else
+            {
+                word_start = block_start + i;
+                word_block_start = i;
+                word_upper = 0;
+                in_word = 1;
+            }
+        }
+
+        /* The word goes on into the next block */
+        if (0 != in_word)
+        {
+            word_upper |= upper >> word_block_start;
+            word_block_start = 0;
+        }
+    }
+
+    /* The last word ends with the buffer */
+    if ((0 == error_code) && (0 != in_word) && (min_word_size <= size - word_start))
+    {
+        error_code = tokenizer_emit_word(data + word_start, size - word_start, word_upper, &buffer, callback, context);
+    }
+
+    free(buffer.data);
+
+    return error_code;
+}
+
+/**
+ * @brief   Function used to split a file into words. The file is mapped into memory (read only),
+ *          so the words in lower case are given to the callback without being copied.
+ * @param[in] file_path     - Path of the file
+ * @param[in] min_word_size - The words shorter than this are skipped
+ * @param[in] callback      - Function called for every word
+ * @param[in] context       - Context given to the callback
+ * @return  0 for success or -1 in case of error
+ **/
+int tokenize_file(const char *file_path, size_t min_word_size, WordCallback callback, void *context)
+{
+    return tokenize_file_range(file_path, 0, UINT64_MAX, min_word_size, callback, &context, 1);
+}
+
+/**
+ * @brief   Function used to split a byte range of a file into words on multiple threads (OpenMP).
+ *          The range owns the words which start inside it: the word cut by its start is skipped
+ *          and the word cut by its end is read untill its last byte, so consecutive ranges count every word once.
+ *          The range is cut into up to contexts_count chunks which end at a delimiter, so no word is split.
+ *          The words of the chunk i are given to the callback with contexts[i].
+ * @param[in] file_path      - Path of the file
+ * @param[in] offset         - Offset of the range
+ * @param[in] length         - Length of the range (it may go past the end of the file)
+ * @param[in] min_word_size  - The words shorter than this are skipped
+ * @param[in] callback       - Function called for every word. It is called from several threads at once.
+ * @param[in] contexts       - Context given to the callback for every chunk
+ * @param[in] contexts_count - Maximum number of chunks
+ * @return  0 for success or -1 in case of error
+ **/
+int tokenize_file_range(const char *file_path, uint64_t offset, uint64_t length, size_t min_word_size,
+                        WordCallback callback, void **contexts, int contexts_count)
+{
+    int error_code = -1;
+    int fd = open(file_path, O_RDONLY);
+    struct stat file_stat = {0};
+
+    if (-1 == fd)
+    {
+        log_message(LOG_ERROR, "Tokenizer: %s(): Failed to open file '%s'. Errno: %s.\n", __FUNCTION__, file_path, strerror(errno));
+    }
+    else if (0 != fstat(fd, &file_stat))
+    {
+        log_message(LOG_ERROR, "Tokenizer: %s(): Failed to stat file '%s'. Errno: %s.\n", __FUNCTION__, file_path, strerror(errno));
+    }
+    else if (offset >= (uint64_t)file_stat.st_size)
+    {
+        /* Nothing to map */
+        error_code = 0;
+    }
+    else
+    {
+        /* The byte before the range tells if the range starts inside a word, so it is mapped too.
+         * The mapping goes untill the end of the file, because the last word may end after the range. */
+        uint64_t first = (0 == offset) ? 0 : offset - 1;
+        uint64_t map_offset = first - first % sysconf(_SC_PAGESIZE);
+        size_t size = file_stat.st_size - map_offset;
+        /* Read only mapping: the words with upper case letters are converted in a buffer of the thread,
+         * so the pages of the file are never copied on write */
+        const char *data = (const char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, map_offset);
+
+        if (MAP_FAILED == data)
+        {
+            log_message(LOG_ERROR, "Tokenizer: %s(): Failed to map file '%s'. Errno: %s.\n", __FUNCTION__, file_path, strerror(errno));
+        }
+        else
+        {
+            size_t start = (0 == offset) ? 0 : tokenizer_next_delimiter(data, size, first - map_offset);
+            size_t end = (length >= (uint64_t)file_stat.st_size - offset) ? size : tokenizer_next_delimiter(data, size, offset + length - 1 - map_offset);
+
+            madvise((void *)data, size, MADV_SEQUENTIAL);
+            error_code = (start < end) ? tokenize_chunks(data + start, end - start, min_word_size, callback, contexts, contexts_count) : 0;
+            munmap((void *)data, size);
+        }
+    }
+
+    if (-1 != fd)
+    {
+        close(fd);
+    }
+
+    return error_code;
+}
+
+/**
+ * @brief   Function used to find the first delimiter from a buffer, starting with a given offset
+ * @param[in] data   - The buffer
+ * @param[in] size   - The buffer size
+ * @param[in] offset - The offset from which the search starts
+ * @return  The offset of the delimiter or size if there is none
+ **/
+size_t tokenizer_next_delimiter(const char *data, size_t size, size_t offset)
+{
+    pthread_once(&tokenizer_once, tokenizer_init);
+
+    while ((offset < size) && (0 == delimiter_table[(unsigned char)data[offset]]))
+    {
+        ++offset;
+    }
+
+    return offset;
+}
@@ -0,0 +1,433 @@
+/*******************************************
+ *              INCLUDES
+ ******************************************/
+#include <stdio.h>   /* FILE            */
+#include <stdlib.h>  /* dynamic memory  */
+#include <string.h>  /* strlen          */
+#include "mpi.h"
+#include "trace.h"
+#include "utils.h"   /* MAX_PATH, TAG_WORK */
+#include "logger.h"
+
+/*******************************************
+ *                TYPES
+ ******************************************/
+
+/* struct used to store a span. It has no pointers, so the spans of a rank are sent as bytes to master. */
+typedef struct TraceEvent_
+{
+    double begin;
+    double end;
+    int id;
+    char category[TRACE_CATEGORY_SIZE];
+    char name[TRACE_NAME_SIZE];
+    char detail[TRACE_DETAIL_SIZE];
+} TraceEvent;
+
+/* struct used to store the spans of the current rank */
+typedef struct Trace_
+{
+    TraceEvent *events;  /* NULL if the trace is not started */
+    int length;          /* Spans reserved, it goes over TRACE_MAX_EVENTS when the spans are dropped */
+} Trace;
+
+/*******************************************
+ *              STATIC DATA
+ ******************************************/
+static Trace trace = {NULL, 0};
+
+/*******************************************
+ *       STATIC FUNCTION DECLARATION
+ ******************************************/
+
+/**
+ * @brief   Function used to copy a string into a field of a span, cutting it if it is too long
+ * @param[out] destination - The field
+ * @param[in] source       - The string or NULL for an empty one
+ * @param[in] size         - The field size
+ * @param[in] keep_end     - 1 to keep the end of a string which is too long (e.g. a path), 0 to keep its start
+ * @return  void
+ **/
+static void trace_copy(char *destination, const char *source, size_t size, int keep_end);
+
+/**
+ * @brief   Function used by master to measure the clock offset of a worker, with the round trip of a message.
+ *          The shortest round trip gives the offset with the smallest error.
+ * @param[in] worker_rank - The worker rank
+ * @return  The worker clock minus the master clock, in seconds
+ **/
+static double trace_clock_offset(const int worker_rank);
+
+/**
+ * @brief   Function used to write a string as JSON
+ * @param[in] file   - The file
+ * @param[in] string - The string
+ * @return  void
+ **/
+static void trace_write_string(FILE *file, const char *string);
+
+/**
+ * @brief   Function used by master to write the spans of all the ranks as Chrome trace events
+ * @param[in] file    - The trace file
+ * @param[in] events  - The spans of every rank, one rank after another
+ * @param[in] counts  - Number of spans of every rank
+ * @param[in] dropped - Number of spans dropped by every rank
+ * @param[in] offsets - The clock offset of every rank
+ * @param[in] ranks   - Number of ranks
+ * @return  void
+ **/
+static void trace_write_events(FILE *file, const TraceEvent *events, const int *counts, const int *dropped, const double *offsets, int ranks);
+
+/*******************************************
+ *       STATIC FUNCTION DEFINITION
+ ******************************************/
+
+/**
+ * @brief   Function used to copy a string into a field of a span, cutting it if it is too long
+ * @param[out] destination - The field
+ * @param[in] source       - The string or NULL for an empty one
+ * @param[in] size         - The field size
+ * @param[in] keep_end     - 1 to keep the end of a string which is too long (e.g. a path), 0 to keep its start
+ * @return  void
+ **/
+static void trace_copy(char *destination, const char *source, size_t size, int keep_end)
+{
+    size_t length = (NULL == source) ? 0 : strlen(source);
+
+    if (length >= size)
+    {
+        source += (0 != keep_end) ? length - (size - 1) : 0;
+        length = size - 1;
+    }
+
+    if (0 != length)
+    {
+        memcpy(destination, source, length);
+    }
+
+    destination[length] = '\0';
+}
+
+/**
+ * @brief   Function used by master to measure the clock offset of a worker, with the round trip of a message.
+ *          The shortest round trip gives the offset with the smallest error.
+ * @param[in] worker_rank - The worker rank
+ * @return  The worker clock minus the master clock, in seconds
+ **/
+static double trace_clock_offset(const int worker_rank)
+{
+    double offset = 0.0;
+    double best_round_trip = -1.0;
+
+    for (int i = 0; i < TRACE_SYNC_ROUNDS; ++i)
+    {
+        double worker_time = 0.0;
+        double send_time = MPI_Wtime();
+        double receive_time = 0.0;
+
+        MPI_Send(NULL, 0, MPI_BYTE, worker_rank, TAG_WORK, MPI_COMM_WORLD);
+        MPI_Recv(&worker_time, 1, MPI_DOUBLE, worker_rank, TAG_WORK, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        receive_time = MPI_Wtime();
+
+        /* The worker read its clock about the middle of the round trip */
+        if ((0 > best_round_trip) || (receive_time - send_time < best_round_trip))
+        {
+            best_round_trip = receive_time - send_time;
+            offset = worker_time - (send_time + receive_time) / 2;
+        }
+    }
+
+    return offset;
+}
+
+/**
+ * @brief   Function used to write a string as JSON
+ * @param[in] file   - The file
+ * @param[in] string - The string
+ * @return  void
+ **/
+static void trace_write_string(FILE *file, const char *string)
+{
+    fputc('"', file);
+
+    for (const unsigned char *p = (const unsigned char *)string; '\0' != *p; ++p)
+    {
+        if (('"' == *p) || ('\\' == *p))
+        {
+            fputc('\\', file);
+            fputc(*p, file);
+        }
+        else if (0x20 > *p)
+        {
+            fprintf(file, "\\u%04x", *p);
+        }
+        else
+        {
+            fputc(*p, file);
+        }
+    }
+
+    fputc('"', file);
+}
+
+/**
+ * @brief   Function used by master to write the spans of all the ranks as Chrome trace events
+ * @param[in] file    - The trace file
+ * @param[in] events  - The spans of every rank, one rank after another
+ * @param[in] counts  - Number of spans of every rank
+ * @param[in] dropped - Number of spans dropped by every rank
+ * @param[in] offsets - The clock offset of every rank
+ * @param[in] ranks   - Number of ranks
+ * @return  void
+ **/
+static void trace_write_events(FILE *file, const TraceEvent *events, const int *counts, const int *dropped, const double *offsets, int ranks)
+{
+    const TraceEvent *event = events;
+    double origin = 0.0;
+    int first = 1;
+
+    /* The timeline starts with the first span, on the master's clock */
+    for (int rank = 0; rank < ranks; ++rank)
+    {
+        for (int i = 0; i < counts[rank]; ++i, ++event)
+        {
+            if ((0 != first) || (event->begin - offsets[rank] < origin))
+            {
+                origin = event->begin - offsets[rank];
+                first = 0;
+            }
+        }
+    }
+
+    fprintf(file, "{\"displayTimeUnit\": \"ms\",\n \"otherData\": {\"clock_offsets_us\": [");
+
+    for (int rank = 0; rank < ranks; ++rank)
+    {
+        fprintf(file, "%s%.3f", (0 == rank) ? "" : ", ", offsets[rank] * 1e6);
+    }
+
+    fprintf(file, "], \"dropped_events\": [");
+
+    for (int rank = 0; rank < ranks; ++rank)
+    {
+        fprintf(file, "%s%d", (0 == rank) ? "" : ", ", dropped[rank]);
+    }
+
+    fprintf(file, "]},\n \"traceEvents\": [\n");
+
+    /* A process for every rank, named after its role */
+    for (int rank = 0; rank < ranks; ++rank)
+    {
+        if (0 == rank)
+        {
+            fprintf(file, "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": 0, \"args\": {\"name\": \"master\"}}");
+        }
+        else
+        {
+            fprintf(file, ",\n  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": 0, \"args\": {\"name\": \"worker %d\"}}", rank, rank);
+        }
+    }
+
+    event = events;
+
+    for (int rank = 0; rank < ranks; ++rank)
+    {
+        for (int i = 0; i < counts[rank]; ++i, ++event)
+        {
+            fprintf(file, ",\n  {\"name\": ");
+            trace_write_string(file, event->name);
+            fprintf(file, ", \"cat\": ");
+            trace_write_string(file, event->category);
+            fprintf(file, ", \"ph\": \"X\", \"pid\": %d, \"tid\": 0, \"ts\": %.3f, \"dur\": %.3f, \"args\": {\"id\": %d, \"detail\": ",
+                    rank, (event->begin - offsets[rank] - origin) * 1e6, (event->end - event->begin) * 1e6, event->id);
+            trace_write_string(file, event->detail);
+            fprintf(file, "}}");
+        }
+    }
+
+    fprintf(file, "\n ]}\n");
+}
+
+/*******************************************
+ *          FUNCTION DEFINITION
+ ******************************************/
+
+/**
+ * @brief   Function called to start recording the timeline of the current rank.
+ *          Without it, trace_span() records nothing.
+ * @return  0 for success or -1 in case of error
+ **/
+int trace_init(void)
+{
+    trace.events = (TraceEvent *)malloc(TRACE_MAX_EVENTS * sizeof(TraceEvent));
+    trace.length = 0;
+
+    if (NULL == trace.events)
+    {
+        log_message(LOG_ERROR, "Trace: %s(): Out of memory! .\n", __FUNCTION__);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief   Function used to record a span of the current rank. It can be called by several threads at once.
+ * @param[in] category - The category (e.g. "phase", "mpi")
+ * @param[in] name     - The span name
+ * @param[in] id       - The ID of the task or document, -1 for none
+ * @param[in] detail   - A detail (e.g. a file path) or NULL
+ * @param[in] begin    - The begin, from MPI_Wtime()
+ * @param[in] end      - The end, from MPI_Wtime()
+ * @return  void
+ **/
+void trace_span(const char *category, const char *name, int id, const char *detail, double begin, double end)
+{
+    TraceEvent *event = NULL;
+    int index = 0;
+
+    if (NULL == trace.events)
+    {
+        return;
+    }
+
+    /* Every thread reserves its own slot, so no lock is needed */
+    index = __atomic_fetch_add(&trace.length, 1, __ATOMIC_RELAXED);
+
+    if (TRACE_MAX_EVENTS <= index)
+    {
+        /* The buffer is full, the span is dropped */
+        return;
+    }
+
+    event = &trace.events[index];
+    event->begin = begin;
+    event->end = end;
+    event->id = id;
+    trace_copy(event->category, category, TRACE_CATEGORY_SIZE, 0);
+    trace_copy(event->name, name, TRACE_NAME_SIZE, 0);
+    trace_copy(event->detail, detail, TRACE_DETAIL_SIZE, 1);
+}
+
+/**
+ * @brief   Function called by all the ranks at the end of the job, when the trace was started, to gather the
+ *          spans to master. The master measures the clock offset of every worker, moves its spans on the
+ *          master's clock and writes them as Chrome trace events into the output directory.
+ * @param[in] rank            - The current process rank
+ * @param[in] output_dir_path - Path of the output directory
+ * @return  0 for success or -1 in case of error
+ **/
+int trace_report(const int rank, const char *output_dir_path)
+{
+    char trace_file_path[MAX_PATH] = {'\0'};
+    int error_code = 0;
+    int ranks = 0;
+    int length = (NULL == trace.events) ? 0 : trace.length;
+    int sizes[2] = {(TRACE_MAX_EVENTS < length) ? TRACE_MAX_EVENTS : length, 0}; /* The spans kept and the dropped ones */
+    int *all_sizes = NULL;
+    int *counts = NULL;
+    int *dropped = NULL;
+    int *displacements = NULL;
+    double *offsets = NULL;
+    TraceEvent *events = NULL;
+    FILE *file = NULL;
+
+    sizes[1] = length - sizes[0];
+
+    if (0 != rank)
+    {
+        /* Answer the clock measurement of master with the current time */
+        for (int i = 0; i < TRACE_SYNC_ROUNDS; ++i)
+        {
+            double now = 0.0;
+
+            MPI_Recv(NULL, 0, MPI_BYTE, 0, TAG_WORK, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            now = MPI_Wtime();
+            MPI_Send(&now, 1, MPI_DOUBLE, 0, TAG_WORK, MPI_COMM_WORLD);
+        }
+
+        MPI_Gather(sizes, 2, MPI_INT, NULL, 2, MPI_INT, 0, MPI_COMM_WORLD);
+        MPI_Gatherv(trace.events, sizes[0] * sizeof(TraceEvent), MPI_BYTE, NULL, NULL, NULL, MPI_BYTE, 0, MPI_COMM_WORLD);
+        free(trace.events);
+        trace.events = NULL;
+
+        return 0;
+    }
+
+    MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+    all_sizes = (int *)malloc(2 * ranks * sizeof(int));
+    counts = (int *)malloc(ranks * sizeof(int));
+    dropped = (int *)malloc(ranks * sizeof(int));
+    displacements = (int *)malloc(ranks * sizeof(int));
+    offsets = (double *)calloc(ranks, sizeof(double));
+
+    if ((NULL == all_sizes) || (NULL == counts) || (NULL == dropped) || (NULL == displacements) || (NULL == offsets))
+    {
+        /* The workers are waiting for the clock measurement, so this can't be recovered */
+        log_message(LOG_ERROR, "Trace: %s(): Out of memory! .\n", __FUNCTION__);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    for (int i = 1; i < ranks; ++i)
+    {
+        offsets[i] = trace_clock_offset(i);
+    }
+
+    MPI_Gather(sizes, 2, MPI_INT, all_sizes, 2, MPI_INT, 0, MPI_COMM_WORLD);
+
+    for (int i = 0; i < ranks; ++i)
+    {
+        counts[i] = all_sizes[2 * i] * sizeof(TraceEvent);
+        dropped[i] = all_sizes[2 * i + 1];
+        displacements[i] = (0 == i) ? 0 : displacements[i - 1] + counts[i - 1];
+    }
+
+    events = (TraceEvent *)malloc(displacements[ranks - 1] + counts[ranks - 1] + 1);
+
+    if (NULL == events)
+    {
+        log_message(LOG_ERROR, "Trace: %s(): Out of memory! .\n", __FUNCTION__);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    MPI_Gatherv(trace.events, counts[0], MPI_BYTE, events, counts, displacements, MPI_BYTE, 0, MPI_COMM_WORLD);
+
+    for (int i = 0; i < ranks; ++i)
+    {
+        counts[i] = all_sizes[2 * i];
+    }
+
+    utils_join_path(trace_file_path, output_dir_path, TRACE_FILE_NAME);
+
+    if (NULL == (file = fopen(trace_file_path, "w")))
+    {
+        log_message(LOG_ERROR, "Trace: %s(): Failed to open file '%s'.\n", __FUNCTION__, trace_file_path);
+        error_code = -1;
+    }
+    else
+    {
+        trace_write_events(file, events, counts, dropped, offsets, ranks);
+        error_code = (0 != ferror(file)) ? -1 : 0;
+
+        if ((0 != fclose(file)) || (0 != error_code))
+        {
+            log_message(LOG_ERROR, "Trace: %s(): Failed to write file '%s'.\n", __FUNCTION__, trace_file_path);
+            error_code = -1;
+        }
+        else
+        {
+            log_message(LOG_INFO, "Trace: %s(): The timeline was written into '%s'.\n", __FUNCTION__, trace_file_path);
+        }
+    }
+
+    free(trace.events);
+    trace.events = NULL;
+    free(all_sizes);
+    free(counts);
+    free(dropped);
+    free(displacements);
+    free(offsets);
+    free(events);
+
+    return error_code;
+}
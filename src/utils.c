@@ -2,51 +2,451 @@
  *              INCLUDES
  ******************************************/
 #include <stdio.h>  /* stdout/stderr   */
-#include <stdarg.h> /* varargs         */
 #include <stdlib.h> /* NULL            */
-#include <ctype.h>  /* tolower         */
 #include <string.h> /* strerror        */
+#include <stddef.h> /* size_t          */
+#include <limits.h> /* INT_MAX         */
 #include "utils.h"
+#include "logger.h"
+#include "mpi.h"
 
 /*******************************************
  *                DEFINES
  ******************************************/
-#define LOG_FILE "log.txt"
+#define FNV_OFFSET_BASIS 2166136261U
+#define FNV_PRIME 16777619U
+#define MIN_SLOTS_LENGTH 16          /* Must be a power of 2 */
+#define MIN_VALUES_CAPACITY 4        /* First capacity of a Pair's postings arrays */
+#define PAIR_LINEAR_SCAN_LIMIT 8     /* Pairs with fewer postings are scanned instead of hashed */
+#define DOCUMENT_HASH_MULTIPLIER 2654435761U
+#define ARENA_ALIGNMENT 8            /* Must be a power of 2 */
+#define ARENA_MIN_CHUNK_SIZE (64 * 1024)
+#define ARENA_MAX_CHUNK_SIZE (16 * 1024 * 1024)
+#define BYTE_BUFFER_MIN_CAPACITY 256
+#define MAX_VARINT_SIZE 10 /* Bytes needed to encode 64 bits */
 
 /*******************************************
- *          FUNCTION DEFINITION
+ *                TYPES
  ******************************************/
 
+/* struct used to store a chunk of memory owned by an Arena */
+struct ArenaChunk_
+{
+    struct ArenaChunk_ *next;
+    size_t size;
+    size_t used;
+    char data[];
+};
+
+/*******************************************
+ *              STATIC DATA
+ ******************************************/
+
+/* The elements sorted by sort_dictionary(), used by compare_pair_indexes() */
+static __thread const Pair *sorted_elements;
+
+/*******************************************
+ *       STATIC FUNCTION DECLARATION
+ ******************************************/
+
+/**
+ * @brief   Function used to compute the hash of a string (32 bits FNV-1a)
+ * @param[in] str    - The string that will be hashed
+ * @param[in] length - The length of the string
+ * @return  The hash of the string
+ **/
+static unsigned int hash_string(const char *str, size_t length);
+
 /**
- * @brief   Function called to log a message
- *          to the provided stream (stdio, stderr)
- *          and into log.txt file
- * @param[in] stream - The stream in which the message will be printed
- * @param[in] format - The format of the message
- * @param[in] ...    - Variable length parameters list
+ * @brief   Function used to rebuild an open addressing table from the precomputed hashes
+ * @param[in] arena            - Arena from which the new table is allocated
+ * @param[in,out] slots        - The table. On success it is replaced with the new one
+ * @param[in,out] slots_length - The table length (power of 2). On success it is updated
+ * @param[in] hashes           - Function used to get the precomputed hash of an entry
+ * @param[in] entries          - The entries indexed by the table
+ * @param[in] entries_length   - Number of entries
+ * @return  0 for success or -1 in case or error
+ **/
+static int rehash_slots(Arena *arena, int **slots, int *slots_length,
+                        unsigned int (*hashes)(const void *entries, int index),
+                        const void *entries, int entries_length);
+
+/**
+ * @brief   Function used to get the precomputed hash of the key of a Pair
+ * @param[in] entries - Array of pairs
+ * @param[in] index   - Index of the pair
+ * @return  The hash of the key
+ **/
+static unsigned int pair_key_hash(const void *entries, int index);
+
+/**
+ * @brief   Function used to get the hash of a document ID from an array of IDs
+ * @param[in] entries - Array of document IDs
+ * @param[in] index   - Index of the document ID
+ * @return  The hash
+ **/
+static unsigned int document_hash(const void *entries, int index);
+
+/**
+ * @brief   Function used to find a key into a Dictionary. If the key is missing, a new Pair is added.
+ * @param[in] dic        - Dictionary in which the key is searched
+ * @param[in] key        - The key (it doesn't have to be NUL terminated)
+ * @param[in] key_length - The length of the key
+ * @return  The index of the Pair or -1 in case of error
+ **/
+static int dictionary_get_key(Dictionary *dic, const char *key, size_t key_length);
+
+/**
+ * @brief   Function used to find a document into a Pair. If the document is missing, it is added with count 0.
+ * @param[in] dic         - Dictionary which owns the Pair
+ * @param[in] pair        - Pair in which the document is searched
+ * @param[in] document_id - ID of the document
+ * @param[out] found      - Set to 1 if the document already existed, 0 otherwise
+ * @return  The index of the document or -1 in case of error
+ **/
+static int pair_get_document(Dictionary *dic, Pair *pair, int document_id, int *found);
+
+/**
+ * @brief   Function used by qsort to compare the keys of two Pairs given by their indexes
+ * @param[in] first  - Pointer to the index of the first Pair
+ * @param[in] second - Pointer to the index of the second Pair
+ * @return  < 0, 0 or > 0 like strcmp
+ **/
+static int compare_pair_indexes(const void *first, const void *second);
+
+/**
+ * @brief   Function used to write the next chunk of bytes of an OrderedFile with a collective write.
+ *          The processes with no bytes left write nothing.
+ * @param[in] file - The file
  * @return  void
  **/
-void log_message(FILE *stream, const char *format, ...)
+static void ordered_file_write_round(OrderedFile *file);
+
+/*******************************************
+ *       STATIC FUNCTION DEFINITION
+ ******************************************/
+
+/**
+ * @brief   Function used to compute the hash of a string (32 bits FNV-1a)
+ * @param[in] str    - The string that will be hashed
+ * @param[in] length - The length of the string
+ * @return  The hash of the string
+ **/
+static unsigned int hash_string(const char *str, size_t length)
 {
-    FILE *log_file = fopen(LOG_FILE, "a");
-    va_list vargs_stream;
-    va_list vargs_file;
+    const unsigned char *p = (const unsigned char *)str;
+    unsigned int hash = FNV_OFFSET_BASIS;
+
+    for (size_t i = 0; i < length; ++i)
+    {
+        hash ^= p[i];
+        hash *= FNV_PRIME;
+    }
 
-    va_start(vargs_stream, format);
-    va_start(vargs_file, format);
+    return hash;
+}
 
-    vfprintf(stream, format, vargs_stream);
+/**
+ * @brief   Function used to rebuild an open addressing table from the precomputed hashes
+ * @param[in] arena            - Arena from which the new table is allocated
+ * @param[in,out] slots        - The table. On success it is replaced with the new one
+ * @param[in,out] slots_length - The table length (power of 2). On success it is updated
+ * @param[in] hashes           - Function used to get the precomputed hash of an entry
+ * @param[in] entries          - The entries indexed by the table
+ * @param[in] entries_length   - Number of entries
+ * @return  0 for success or -1 in case or error
+ **/
+static int rehash_slots(Arena *arena, int **slots, int *slots_length,
+                        unsigned int (*hashes)(const void *entries, int index),
+                        const void *entries, int entries_length)
+{
+    int error_code = -1;
+    int new_length = (0 == *slots_length) ? MIN_SLOTS_LENGTH : 2 * *slots_length;
+    int *new_slots = NULL;
 
-    if (NULL != log_file)
+    /* The table must be at least twice as big as the number of entries */
+    while (new_length < 2 * (entries_length + 1))
     {
-        vfprintf(log_file, format, vargs_file);
-        fclose(log_file);
+        new_length *= 2;
     }
 
-    va_end(vargs_stream);
-    va_end(vargs_file);
+    new_slots = (int *)arena_alloc(arena, new_length * sizeof(int));
+
+    if (NULL == new_slots)
+    {
+        log_message(LOG_ERROR, "UTILS: %s(): Out of memory! .\n", __FUNCTION__);
+    }
+    else
+    {
+        for (int i = 0; i < entries_length; ++i)
+        {
+            unsigned int slot = hashes(entries, i) & (new_length - 1);
+
+            while (0 != new_slots[slot])
+            {
+                slot = (slot + 1) & (new_length - 1);
+            }
+
+            new_slots[slot] = i + 1;
+        }
+
+        /* The old table stays in the arena untill the dictionary is freed */
+        *slots = new_slots;
+        *slots_length = new_length;
+        error_code = 0;
+    }
+
+    return error_code;
+}
+
+/**
+ * @brief   Function used to get the precomputed hash of the key of a Pair
+ * @param[in] entries - Array of pairs
+ * @param[in] index   - Index of the pair
+ * @return  The hash of the key
+ **/
+static unsigned int pair_key_hash(const void *entries, int index)
+{
+    return ((const Pair *)entries)[index].key_hash;
 }
 
+/**
+ * @brief   Function used to get the hash of a document ID from an array of IDs
+ * @param[in] entries - Array of document IDs
+ * @param[in] index   - Index of the document ID
+ * @return  The hash
+ **/
+static unsigned int document_hash(const void *entries, int index)
+{
+    return (unsigned int)((const int *)entries)[index] * DOCUMENT_HASH_MULTIPLIER;
+}
+
+/**
+ * @brief   Function used to find a key into a Dictionary. If the key is missing, a new Pair is added.
+ * @param[in] dic        - Dictionary in which the key is searched
+ * @param[in] key        - The key (it doesn't have to be NUL terminated)
+ * @param[in] key_length - The length of the key
+ * @return  The index of the Pair or -1 in case of error
+ **/
+static int dictionary_get_key(Dictionary *dic, const char *key, size_t key_length)
+{
+    int key_index = -1;
+    char *new_key = NULL;
+    unsigned int hash = hash_string(key, key_length);
+    unsigned int slot = 0;
+
+    /* Keep the load factor under 1/2 */
+    if ((2 * (dic[0].elements_length + 1) > dic[0].slots_length) &&
+        (0 != rehash_slots(&dic[0].arena, &dic[0].slots, &dic[0].slots_length, pair_key_hash, dic[0].elements, dic[0].elements_length)))
+    {
+        return -1;
+    }
+
+    /* Check if the key already exists. The hashes are compared first, so the other keys are rarely read */
+    slot = hash & (dic[0].slots_length - 1);
+    ++dic[0].probes;
+
+    while (0 != dic[0].slots[slot])
+    {
+        const Pair *pair = &dic[0].elements[dic[0].slots[slot] - 1];
+
+        if ((hash == pair->key_hash) && (key_length == pair->key_length) && (0 == memcmp(key, pair->key, key_length)))
+        {
+            return dic[0].slots[slot] - 1;
+        }
+
+        slot = (slot + 1) & (dic[0].slots_length - 1);
+        ++dic[0].probes;
+    }
+
+    /* The key does not exist in the dictionary
+     * Create a new Pair and insert it into dictionary */
+    new_key = (char *)arena_alloc(&dic[0].arena, key_length + 1);
+
+    if (NULL == new_key)
+    {
+        log_message(LOG_ERROR, "UTILS: %s(): Out of memory! .\n", __FUNCTION__);
+        return -1;
+    }
+
+    memcpy(new_key, key, key_length);
+    new_key[key_length] = '\0';
+
+    if (dic[0].elements_length == dic[0].elements_capacity)
+    {
+        int new_capacity = (0 == dic[0].elements_capacity) ? MIN_SLOTS_LENGTH : 2 * dic[0].elements_capacity;
+        Pair *new_elements = (Pair *)arena_alloc(&dic[0].arena, new_capacity * sizeof(Pair));
+
+        if (NULL == new_elements)
+        {
+            log_message(LOG_ERROR, "UTILS: %s(): Out of memory! .\n", __FUNCTION__);
+            return -1;
+        }
+
+        if (0 != dic[0].elements_length)
+        {
+            memcpy(new_elements, dic[0].elements, dic[0].elements_length * sizeof(Pair));
+        }
+
+        dic[0].elements = new_elements;
+        dic[0].elements_capacity = new_capacity;
+    }
+
+    key_index = dic[0].elements_length++;
+    memset(&dic[0].elements[key_index], 0, sizeof(Pair));
+    dic[0].elements[key_index].key = new_key;
+    dic[0].elements[key_index].key_hash = hash;
+    dic[0].elements[key_index].key_length = key_length;
+    dic[0].slots[slot] = key_index + 1;
+
+    return key_index;
+}
+
+/**
+ * @brief   Function used to find a document into a Pair. If the document is missing, it is added with count 0.
+ * @param[in] dic         - Dictionary which owns the Pair
+ * @param[in] pair        - Pair in which the document is searched
+ * @param[in] document_id - ID of the document
+ * @param[out] found      - Set to 1 if the document already existed, 0 otherwise
+ * @return  The index of the document or -1 in case of error
+ **/
+static int pair_get_document(Dictionary *dic, Pair *pair, int document_id, int *found)
+{
+    int value_index = -1;
+    unsigned int slot = 0;
+
+    *found = 0;
+
+    /* The documents are usually inserted one after another, so check the last one first.
+     * The small lists are scanned, the big ones are indexed by values_slots */
+    if ((0 != pair->values_length) && (document_id == pair->documents[pair->values_length - 1]))
+    {
+        *found = 1;
+        return pair->values_length - 1;
+    }
+    else if (PAIR_LINEAR_SCAN_LIMIT >= pair->values_length)
+    {
+        for (int i = 0; i < pair->values_length; ++i)
+        {
+            if (document_id == pair->documents[i])
+            {
+                *found = 1;
+                return i;
+            }
+        }
+    }
+    else
+    {
+        /* Keep the load factor under 1/2 */
+        if ((2 * (pair->values_length + 1) > pair->values_slots_length) &&
+            (0 != rehash_slots(&dic[0].arena, &pair->values_slots, &pair->values_slots_length, document_hash, pair->documents, pair->values_length)))
+        {
+            return -1;
+        }
+
+        slot = document_hash(&document_id, 0) & (pair->values_slots_length - 1);
+
+        while (0 != pair->values_slots[slot])
+        {
+            if (document_id == pair->documents[pair->values_slots[slot] - 1])
+            {
+                *found = 1;
+                return pair->values_slots[slot] - 1;
+            }
+
+            slot = (slot + 1) & (pair->values_slots_length - 1);
+        }
+    }
+
+    /* The document does not exist, grow the arrays geometrically if needed */
+    if (pair->values_length == pair->values_capacity)
+    {
+        int new_capacity = (0 == pair->values_capacity) ? MIN_VALUES_CAPACITY : 2 * pair->values_capacity;
+        int *new_documents = (int *)arena_alloc(&dic[0].arena, new_capacity * sizeof(int));
+        int *new_counts = (int *)arena_alloc(&dic[0].arena, new_capacity * sizeof(int));
+
+        if ((NULL == new_documents) || (NULL == new_counts))
+        {
+            log_message(LOG_ERROR, "UTILS: %s(): Out of memory! .\n", __FUNCTION__);
+            return -1;
+        }
+
+        if (0 != pair->values_length)
+        {
+            memcpy(new_documents, pair->documents, pair->values_length * sizeof(int));
+            memcpy(new_counts, pair->counts, pair->values_length * sizeof(int));
+        }
+
+        pair->documents = new_documents;
+        pair->counts = new_counts;
+        pair->values_capacity = new_capacity;
+    }
+
+    value_index = pair->values_length++;
+    pair->documents[value_index] = document_id;
+    pair->counts[value_index] = 0;
+
+    if (0 != pair->values_slots_length)
+    {
+        /* The table was probed above, so the slot is the free one */
+        pair->values_slots[slot] = value_index + 1;
+    }
+    else if (PAIR_LINEAR_SCAN_LIMIT < pair->values_length)
+    {
+        /* The list became too long to be scanned, index it */
+        if (0 != rehash_slots(&dic[0].arena, &pair->values_slots, &pair->values_slots_length, document_hash, pair->documents, pair->values_length))
+        {
+            return -1;
+        }
+    }
+
+    return value_index;
+}
+
+/**
+ * @brief   Function used by qsort to compare the keys of two Pairs given by their indexes
+ * @param[in] first  - Pointer to the index of the first Pair
+ * @param[in] second - Pointer to the index of the second Pair
+ * @return  < 0, 0 or > 0 like strcmp
+ **/
+static int compare_pair_indexes(const void *first, const void *second)
+{
+    /* The keys never contain '\0' and strcmp compares them as unsigned chars */
+    return strcmp(sorted_elements[*(const int *)first].key, sorted_elements[*(const int *)second].key);
+}
+
+/**
+ * @brief   Function used to write the next chunk of bytes of an OrderedFile with a collective write.
+ *          The processes with no bytes left write nothing.
+ * @param[in] file - The file
+ * @return  void
+ **/
+static void ordered_file_write_round(OrderedFile *file)
+{
+    int count = (ORDERED_FILE_CHUNK_SIZE < file->buffer.length) ? ORDERED_FILE_CHUNK_SIZE : (int)file->buffer.length;
+
+    if ((MPI_FILE_NULL != file->file) &&
+        (MPI_SUCCESS != MPI_File_write_at_all(file->file, file->offset, file->buffer.data, count, MPI_BYTE, MPI_STATUS_IGNORE)))
+    {
+        log_message(LOG_ERROR, "UTILS: %s(): Failed to write %d bytes at offset %llu.\n", __FUNCTION__, count, (unsigned long long)file->offset);
+        file->error_code = -1;
+    }
+
+    if (0 != count)
+    {
+        memmove(file->buffer.data, file->buffer.data + count, file->buffer.length - count);
+        file->buffer.length -= count;
+        file->offset += count;
+        file->length -= count;
+    }
+
+    ++file->rounds_done;
+}
+
+/*******************************************
+ *          FUNCTION DEFINITION
+ ******************************************/
+
 /**
  * @brief   Function called to retrieve the next 'File' found in a directory given as argument
  * @param[in] input_dir - The directory structure from which the file will be retrieved
@@ -74,283 +474,495 @@ File *get_next_file_from_dir(DIR *input_dir)
 }
 
 /**
- * @brief   The implementation for built-in strlwr funtion
- * @param[in] str - The string that will be processed
- * @return  The input pointer.
- * @note    The input string is modified and the retrieved pointer to string is returned.
- *          Do not try to free it.
+ * @brief   Function used to build the path of a file from a directory
+ * @param[out] path    - Buffer of MAX_PATH bytes in which the path is stored
+ * @param[in] dir_path - The directory path (with or without the trailing '/')
+ * @param[in] name     - The file name
+ * @return  void
+ **/
+void utils_join_path(char *path, const char *dir_path, const char *name)
+{
+    if ((0 != strlen(dir_path)) && ('/' != dir_path[strlen(dir_path) - 1]))
+    {
+        snprintf(path, MAX_PATH, "%s/%s", dir_path, name);
+    }
+    else
+    {
+        snprintf(path, MAX_PATH, "%s%s", dir_path, name);
+    }
+}
+
+/**
+ * @brief   Function used by all the processes to open a file which they write together, one after another in rank order.
+ *          The offsets are computed with MPI_Exscan from the data lengths and the whole file is allocated.
+ *          It is collective over MPI_COMM_WORLD.
+ * @param[out] file  - The file
+ * @param[in] path   - The file path. A previous file is overwritten.
+ * @param[in] length - Number of bytes this process writes
+ * @return  0 for success or -1 in case of error
+ * @note    The file must be closed with ordered_file_close() even if the function failed.
  **/
-char *utils_strlwr(char *str)
+int ordered_file_open(OrderedFile *file, const char *path, uint64_t length)
 {
-    unsigned char *p = (unsigned char *)str;
+    int rank = 0;
+    uint64_t total_length = 0;
+
+    memset(file, 0, sizeof(OrderedFile));
+    file->file = MPI_FILE_NULL;
+    file->length = length;
+    file->rounds = (length + ORDERED_FILE_CHUNK_SIZE - 1) / ORDERED_FILE_CHUNK_SIZE;
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Exscan(&length, &file->offset, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
 
-    while (*p)
+    /* The result of MPI_Exscan is undefined on the first process */
+    if (0 == rank)
+    {
+        file->offset = 0;
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &file->rounds, 1, MPI_UINT64_T, MPI_MAX, MPI_COMM_WORLD);
+    MPI_Allreduce(&length, &total_length, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+
+    if (MPI_SUCCESS != MPI_File_open(MPI_COMM_WORLD, path, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &file->file))
+    {
+        log_message(LOG_ERROR, "UTILS: %s(): Failed to open file: %s.\n", __FUNCTION__, path);
+        file->file = MPI_FILE_NULL;
+        file->error_code = -1;
+    }
+    /* Drop a previous file and allocate the whole one, so the processes write at their offsets */
+    else if (MPI_SUCCESS != MPI_File_set_size(file->file, total_length))
     {
-        *p = tolower((unsigned char)*p);
-        p++;
+        log_message(LOG_ERROR, "UTILS: %s(): Failed to resize file: %s.\n", __FUNCTION__, path);
+        file->error_code = -1;
     }
 
-    return str;
+    return file->error_code;
 }
 
 /**
- * @brief   Function used to insert a new pair file_name, word into a Dictionary.
- *          This function consider the dictionary as being of type: < docIDx, {termk : countk} [] >
- * @param[in] dic       - Dictionary in which the pair will be stored
- * @param[in] file_name - Name of the file
- * @param[in] word      - Word
- * @return  0 for success or -1 in case or error
- * @note    Doesn't matter if the dictionary is empty.
- *          If it is initialized with 0, the memory will be allocated with malloc.
+ * @brief   Function used to write the next bytes of this process into an OrderedFile.
+ *          Every ORDERED_FILE_CHUNK_SIZE bytes are written with a collective write.
+ * @param[in] file   - The file
+ * @param[in] data   - The data
+ * @param[in] length - The data length
+ * @return  0 for success or -1 in case of error (more bytes than the ones given to ordered_file_open() is an error)
  **/
-int insert_word_into_dictionary(Dictionary *dic, const char *file_name, const char *word)
+int ordered_file_write(OrderedFile *file, const void *data, size_t length)
 {
-    int error_code = -1;
-    int key_index = -1;
-    void *temp_pointer = NULL; /* In case that realloc fails. Exit the program without memory leak */
+    if (file->buffer.length + length > file->length)
+    {
+        log_message(LOG_ERROR, "UTILS: %s(): More bytes than announced! .\n", __FUNCTION__);
+        file->error_code = -1;
+        return -1;
+    }
+
+    if (0 != byte_buffer_append(&file->buffer, data, length))
+    {
+        file->error_code = -1;
+        return -1;
+    }
+
+    while (ORDERED_FILE_CHUNK_SIZE <= file->buffer.length)
+    {
+        ordered_file_write_round(file);
+    }
+
+    return file->error_code;
+}
+
+/**
+ * @brief   Function used to write the last bytes of this process and to close an OrderedFile.
+ *          It is collective over MPI_COMM_WORLD.
+ * @param[in] file - The file
+ * @return  0 for success or -1 in case of error
+ **/
+int ordered_file_close(OrderedFile *file)
+{
+    /* A collective write is called by all the processes, even by the ones which have nothing left to write */
+    while (file->rounds_done < file->rounds)
+    {
+        ordered_file_write_round(file);
+    }
+
+    if ((MPI_FILE_NULL != file->file) && (MPI_SUCCESS != MPI_File_close(&file->file)))
+    {
+        log_message(LOG_ERROR, "UTILS: %s(): Failed to close file.\n", __FUNCTION__);
+        file->error_code = -1;
+    }
+
+    byte_buffer_free(&file->buffer);
 
-    //log_message(stderr, "UTILS: %s(): TEST: size %d .\n", __FUNCTION__, dic[0].size);
+    return file->error_code;
+}
+
+/**
+ * @brief   Function used to compare two terms byte by byte (as unsigned chars)
+ * @param[in] first         - The first term
+ * @param[in] first_length  - The first term length
+ * @param[in] second        - The second term
+ * @param[in] second_length - The second term length
+ * @return  < 0, 0 or > 0 if the first term is smaller, equal or greater than the second one
+ **/
+int compare_terms(const char *first, size_t first_length, const char *second, size_t second_length)
+{
+    int result = memcmp(first, second, (first_length < second_length) ? first_length : second_length);
+
+    if (0 == result)
+    {
+        result = (first_length > second_length) - (first_length < second_length);
+    }
+
+    return result;
+}
+
+/**
+ * @brief   Function used to get the 2 bytes prefix of a term. The prefixes keep the order of the terms.
+ * @param[in] term        - The term (it doesn't have to be NUL terminated)
+ * @param[in] term_length - The term length
+ * @return  The prefix, in range [0, PREFIX_HISTOGRAM_SIZE)
+ **/
+int term_prefix(const char *term, size_t term_length)
+{
+    int prefix = (0 < term_length) ? ((unsigned char)term[0] << 8) : 0;
+
+    /* A missing second byte is 0, which is smaller than any byte of a term */
+    return (1 < term_length) ? (prefix | (unsigned char)term[1]) : prefix;
+}
+
+/**
+ * @brief   Function used to add two counts of a posting. The sum saturates at INT_MAX, like the counts of the counting jobs.
+ * @param[in] first  - The first count, not negative
+ * @param[in] second - The second count, not negative
+ * @return  The sum, at most INT_MAX
+ **/
+int add_counts(int first, int second)
+{
+    return (INT_MAX - first < second) ? INT_MAX : first + second;
+}
+
+/**
+ * @brief   Function used to get the partition (the reducer) of a term
+ * @param[in] splits      - The split points of the partitions
+ * @param[in] term        - The term (it doesn't have to be NUL terminated)
+ * @param[in] term_length - The term length
+ * @return  The partition, in range [0, splits->partitions_count)
+ **/
+int term_partition(const KeySplits *splits, const char *term, size_t term_length)
+{
+    int low = 0;
+    int high = splits->partitions_count - 1;
 
-    /* Check if the file_name already exists. If not, allocate memory for it */
-    for (int i = 0; i < dic[0].elements_length; ++i)
+    /* Find the number of split points <= term */
+    while (low < high)
     {
-        if (0 == strcmp(file_name, dic[0].elements[i].key))
+        int middle = low + (high - low) / 2;
+        const char *split = splits->splits + middle * SPLIT_KEY_SIZE;
+
+        if (0 <= compare_terms(term, term_length, split, strlen(split)))
+        {
+            low = middle + 1;
+        }
+        else
         {
-            key_index = i;
+            high = middle;
         }
     }
 
-    if (-1 == key_index)
+    return low;
+}
+
+/**
+ * @brief   Function used to compute balanced split points from a histogram of the terms' prefixes
+ * @param[in] histogram - PREFIX_HISTOGRAM_SIZE weights (the number of postings of every prefix)
+ * @param[out] splits   - The split points. splits->partitions_count must be set and splits->splits allocated
+ * @return  void
+ **/
+void compute_key_splits(const uint64_t *histogram, KeySplits *splits)
+{
+    uint64_t total = 0;
+    uint64_t accumulated = 0;
+    int prefix = 0;
+
+    for (int i = 0; i < PREFIX_HISTOGRAM_SIZE; ++i)
+    {
+        total += histogram[i];
+    }
+
+    /* The split p starts at the first prefix after the one in which the accumulated weight reaches
+     * (p + 1) / partitions_count of the total. A prefix is never split, so a heavy prefix may leave
+     * the next partitions empty. */
+    for (int p = 0; p < splits->partitions_count - 1; ++p)
     {
-        //log_message(stderr, "UTILS: %s(): TEST: -1 == index .\n", __FUNCTION__);
-        /* The file_name does not exist in the dictionary
-         * Create a new Pair and insert it into dictionary */
-        temp_pointer = (Pair *)realloc(dic[0].elements, (dic[0].elements_length + 1) * sizeof(Pair));
+        uint64_t target = total / splits->partitions_count * (p + 1) + total % splits->partitions_count * (p + 1) / splits->partitions_count;
+        char *split = splits->splits + p * SPLIT_KEY_SIZE;
 
-        if (NULL != temp_pointer)
+        while ((PREFIX_HISTOGRAM_SIZE > prefix) && (accumulated + histogram[prefix] <= target))
         {
-            //log_message(stderr, "UTILS: %s(): TEST: NULL != temp_pointer .\n", __FUNCTION__);
-            dic[0].elements = temp_pointer;
-            key_index = dic[0].elements_length++;
-
-            /* initialize the new allocated memory */
-            dic[0].elements[key_index].key = (char *)calloc(strlen(file_name) + 1, sizeof(char));
-            dic[0].elements[key_index].values = (char **)calloc(1, sizeof(char *));
-            dic[0].elements[key_index].counts = (int *)calloc(1, sizeof(int));
-            dic[0].elements[key_index].values_length = 0;
-
-            if ((NULL != dic[0].elements[key_index].key) &&
-                (NULL != dic[0].elements[key_index].values) &&
-                (NULL != dic[0].elements[key_index].counts))
-            {
-                strcpy(dic[0].elements[key_index].key, file_name);
-                dic[0].elements[key_index].values_length = 1;
-                dic[0].elements[key_index].values[0] = (char *)calloc(strlen(word) + 1, sizeof(char));
-
-                if (NULL != dic[0].elements[key_index].values[0])
-                {
-                    dic[0].elements[key_index].counts[0] = 1;
-                    strcpy(dic[0].elements[key_index].values[0], word);
-                    error_code = 0;
-                }
-                else
-                {
-                    log_message(stderr, "UTILS: %s(): Out of memory! .\n", __FUNCTION__);
-                }
-            }
-            else
-            {
-                log_message(stderr, "UTILS: %s(): Out of memory! .\n", __FUNCTION__);
-            }
+            accumulated += histogram[prefix++];
+        }
+
+        /* Without any weight the partitions get equal ranges of the first byte */
+        if (0 == total)
+        {
+            prefix = (p + 1) * PREFIX_HISTOGRAM_SIZE / splits->partitions_count;
+        }
+        else if ((PREFIX_HISTOGRAM_SIZE > prefix) && (2 * (target - accumulated) > histogram[prefix]))
+        {
+            /* The prefix which crosses the target goes into the partition it fills the most */
+            accumulated += histogram[prefix++];
+        }
+
+        memset(split, 0, SPLIT_KEY_SIZE);
+
+        if (PREFIX_HISTOGRAM_SIZE <= prefix)
+        {
+            /* No prefix left, the next partitions stay empty */
+            memset(split, 0xff, SPLIT_KEY_SIZE - 1);
+        }
+        else
+        {
+            split[0] = (char)(prefix >> 8);
+            split[1] = (char)(prefix & 0xff);
         }
     }
-    else
+}
+
+/**
+ * @brief   Function used to append bytes to a ByteBuffer. The buffer grows geometrically.
+ * @param[in] buffer - The buffer
+ * @param[in] data   - The bytes
+ * @param[in] length - Number of bytes
+ * @return  0 for success or -1 in case of error
+ **/
+int byte_buffer_append(ByteBuffer *buffer, const void *data, size_t length)
+{
+    if (buffer->capacity - buffer->length < length)
     {
-        /* The file_name exists in the dictionary
-         * Check if the word already exists in the word's list 
-         * If not, write it*/
-        int word_found = 0;
+        size_t new_capacity = (0 == buffer->capacity) ? BYTE_BUFFER_MIN_CAPACITY : buffer->capacity;
+        unsigned char *new_data = NULL;
 
-        for (int i = 0; i < dic[0].elements[key_index].values_length; ++i)
+        while (new_capacity - buffer->length < length)
         {
-            if (0 == strcmp(dic[0].elements[key_index].values[i], word))
-            {
-                word_found = 1;
-                ++dic[0].elements[key_index].counts[i];
-                error_code = 0;
-            }
+            new_capacity *= 2;
         }
 
-        /* word not found, allocate memory for it */
-        if (0 == word_found)
-        {
-            temp_pointer = (char **)realloc(dic[0].elements[key_index].values, (dic[0].elements[key_index].values_length + 1) * sizeof(char *));
+        new_data = (unsigned char *)realloc(buffer->data, new_capacity);
 
-            if (NULL != temp_pointer)
-            {
-                dic[0].elements[key_index].values = temp_pointer;
-                temp_pointer = (char **)realloc(dic[0].elements[key_index].counts, (dic[0].elements[key_index].values_length + 1) * sizeof(int));
-
-                if (NULL != temp_pointer)
-                {
-                    int value_index = 0;
-
-                    dic[0].elements[key_index].counts = temp_pointer;
-                    value_index = dic[0].elements[key_index].values_length++;
-
-                    dic[0].elements[key_index].values[value_index] = (char *)calloc(strlen(word) + 1, sizeof(char));
-
-                    if (NULL != dic[0].elements[key_index].values[value_index])
-                    {
-                        strcpy(dic[0].elements[key_index].values[value_index], word);
-                        dic[0].elements[key_index].counts[value_index] = 1;
-                    }
-                    else
-                    {
-                        log_message(stderr, "UTILS: %s(): Out of memory! .\n", __FUNCTION__);
-                    }
-                }
-                else
-                {
-                    log_message(stderr, "UTILS: %s(): Out of memory! .\n", __FUNCTION__);
-                }
-            }
-            else
-            {
-                log_message(stderr, "UTILS: %s(): Out of memory! .\n", __FUNCTION__);
-            }
+        if (NULL == new_data)
+        {
+            log_message(LOG_ERROR, "UTILS: %s(): Out of memory! .\n", __FUNCTION__);
+            return -1;
         }
+
+        buffer->data = new_data;
+        buffer->capacity = new_capacity;
     }
 
-    return error_code;
+    if (0 != length)
+    {
+        memcpy(buffer->data + buffer->length, data, length);
+        buffer->length += length;
+    }
+
+    return 0;
 }
 
 /**
- * @brief   Function used to insert a new pair word, file_name into a Dictionary.
- *          This function consider the dictionary as being of type: < termk,{docIDx : countk} >
- * @param[in] dic       - Dictionary in which the pair will be stored
- * @param[in] word      - Word
- * @param[in] file_name - Name of the file
- * @param[in] count     - Word count
- * @return  0 for success or -1 in case or error
- * @note    Doesn't matter if the dictionary is empty.
- *          If it is initialized with 0, the memory will be allocated with malloc.
+ * @brief   Function used to append an unsigned integer to a ByteBuffer as a varint (LEB128)
+ * @param[in] buffer - The buffer
+ * @param[in] value  - The value
+ * @return  0 for success or -1 in case of error
  **/
-int insert_file_into_dictionary(Dictionary *dic, const char *word, const char *file_name, int count)
+int byte_buffer_append_varint(ByteBuffer *buffer, uint64_t value)
 {
-    int error_code = -1;
-    int key_index = -1;
-    void *temp_pointer = NULL; /* In case that realloc fails. Exit the program without memory leak */
+    unsigned char bytes[MAX_VARINT_SIZE] = {0};
+    size_t length = 0;
+
+    do
+    {
+        bytes[length] = value & 0x7F;
+        value >>= 7;
+
+        if (0 != value)
+        {
+            bytes[length] |= 0x80;
+        }
+
+        ++length;
+    } while (0 != value);
 
-    //log_message(stderr, "UTILS: %s(): TEST: size %d .\n", __FUNCTION__, dic[0].elements_length);
+    return byte_buffer_append(buffer, bytes, length);
+}
+
+/**
+ * @brief   Function used to free the memory of a ByteBuffer
+ * @param[in] buffer - The buffer
+ * @return  void
+ **/
+void byte_buffer_free(ByteBuffer *buffer)
+{
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->length = 0;
+    buffer->capacity = 0;
+}
+
+/**
+ * @brief   Function used to decode a varint (LEB128)
+ * @param[in] data   - The encoded bytes
+ * @param[in] size   - Number of bytes available
+ * @param[out] value - The decoded value
+ * @return  Number of bytes read or 0 if the varint is truncated or invalid
+ **/
+size_t varint_decode(const unsigned char *data, size_t size, uint64_t *value)
+{
+    uint64_t result = 0;
 
-    /* Check if the word already exists. If not, allocate memory for it */
-    for (int i = 0; i < dic[0].elements_length; ++i)
+    for (size_t i = 0; (i < size) && (i < MAX_VARINT_SIZE); ++i)
     {
-        if (0 == strcmp(word, dic[0].elements[i].key))
+        result |= (uint64_t)(data[i] & 0x7F) << (7 * i);
+
+        if (0 == (data[i] & 0x80))
         {
-            key_index = i;
+            *value = result;
+            return i + 1;
         }
     }
 
-    if (-1 == key_index)
+    return 0;
+}
+
+/**
+ * @brief   Function used to allocate memory from an Arena
+ * @param[in] arena - The arena from which the memory is allocated
+ * @param[in] size  - Number of bytes
+ * @return  Pointer to the zero initialized memory or NULL in case of error
+ * @note    The memory is released only by arena_release(). Do not try to free it.
+ **/
+void *arena_alloc(Arena *arena, size_t size)
+{
+    ArenaChunk *chunk = arena->chunks;
+    void *memory = NULL;
+
+    size = (size + ARENA_ALIGNMENT - 1) & ~((size_t)ARENA_ALIGNMENT - 1);
+
+    if ((NULL == chunk) || (chunk->size - chunk->used < size))
     {
-        //log_message(stderr, "UTILS: %s(): TEST: -1 == index .\n", __FUNCTION__);
-        /* The word does not exist in the dictionary
-         * Create a new Pair and insert it into dictionary */
-        temp_pointer = (Pair *)realloc(dic[0].elements, (dic[0].elements_length + 1) * sizeof(Pair));
+        /* The chunks grow geometrically, so a big dictionary uses only a few of them */
+        size_t chunk_size = (NULL == chunk) ? ARENA_MIN_CHUNK_SIZE : 2 * chunk->size;
 
-        if (NULL != temp_pointer)
+        if (ARENA_MAX_CHUNK_SIZE < chunk_size)
         {
-            //log_message(stderr, "UTILS: %s(): TEST: NULL != temp_pointer .\n", __FUNCTION__);
-            dic[0].elements = temp_pointer;
-            key_index = dic[0].elements_length++;
-
-            /* initialize the new allocated memory */
-            dic[0].elements[key_index].key = (char *)calloc(strlen(word) + 1, sizeof(char));
-            dic[0].elements[key_index].values = (char **)calloc(1, sizeof(char *));
-            dic[0].elements[key_index].counts = (int *)calloc(1, sizeof(int));
-            dic[0].elements[key_index].values_length = 0;
-
-            if ((NULL != dic[0].elements[key_index].key) &&
-                (NULL != dic[0].elements[key_index].values) &&
-                (NULL != dic[0].elements[key_index].counts))
-            {
-                dic[0].elements[key_index].values_length = 1;
-                strcpy(dic[0].elements[key_index].key, word);
-                dic[0].elements[key_index].values[0] = (char *)calloc(strlen(file_name) + 1, sizeof(char));
-
-                if (NULL != dic[0].elements[key_index].values[0])
-                {
-                    dic[0].elements[key_index].counts[0] = count;
-                    strcpy(dic[0].elements[key_index].values[0], file_name);
-                    error_code = 0;
-                }
-                else
-                {
-                    log_message(stderr, "UTILS: %s(): Out of memory! .\n", __FUNCTION__);
-                }
-            }
-            else
-            {
-                log_message(stderr, "UTILS: %s(): Out of memory! .\n", __FUNCTION__);
-            }
+            chunk_size = ARENA_MAX_CHUNK_SIZE;
+        }
+
+        if (chunk_size < size)
+        {
+            chunk_size = size;
+        }
+
+        chunk = (ArenaChunk *)malloc(sizeof(ArenaChunk) + chunk_size);
+
+        if (NULL == chunk)
+        {
+            return NULL;
         }
+
+        chunk->next = arena->chunks;
+        chunk->size = chunk_size;
+        chunk->used = 0;
+        arena->chunks = chunk;
+        arena->allocated_bytes += sizeof(ArenaChunk) + chunk_size;
     }
-    else
+
+    memory = chunk->data + chunk->used;
+    chunk->used += size;
+    memset(memory, 0, size);
+
+    return memory;
+}
+
+/**
+ * @brief   Function used to release all the memory allocated from an Arena
+ * @param[in] arena - The arena which will be released
+ * @return  void
+ **/
+void arena_release(Arena *arena)
+{
+    ArenaChunk *chunk = arena->chunks;
+
+    while (NULL != chunk)
+    {
+        ArenaChunk *next = chunk->next;
+
+        free(chunk);
+        chunk = next;
+    }
+
+    arena->chunks = NULL;
+    arena->allocated_bytes = 0;
+}
+
+/**
+ * @brief   Function used to count a word found in a document.
+ *          This function consider the dictionary as being of type: < termk, {docIDx : countk} [] >
+ * @param[in] dic         - Dictionary in which the pair will be stored
+ * @param[in] document_id - ID of the document
+ * @param[in] word        - Word (it doesn't have to be NUL terminated)
+ * @param[in] word_length - The length of the word
+ * @return  0 for success or -1 in case or error
+ * @note    Doesn't matter if the dictionary is empty.
+ *          If it is initialized with 0, the memory will be allocated from its arena.
+ **/
+int insert_word_into_dictionary(Dictionary *dic, int document_id, const char *word, size_t word_length)
+{
+    int error_code = -1;
+    int key_index = dictionary_get_key(dic, word, word_length);
+
+    if (-1 != key_index)
     {
-        /* The word exists in the dictionary
-         * Check if the file_name already exists in the file_name's list 
-         * If not, write it*/
-        int file_name_found = 0;
+        int value_found = 0;
+        int value_index = pair_get_document(dic, &dic[0].elements[key_index], document_id, &value_found);
 
-        for (int i = 0; i < dic[0].elements[key_index].values_length; ++i)
+        if (-1 != value_index)
         {
-            if (0 == strcmp(dic[0].elements[key_index].values[i], file_name))
-            {
-                file_name_found = 1;
-                error_code = 0;
-            }
+            dic[0].elements[key_index].counts[value_index] = add_counts(dic[0].elements[key_index].counts[value_index], 1);
+            error_code = 0;
         }
+    }
+
+    return error_code;
+}
 
-        /* if file_name not found, allocate memory for it */
-        if (0 == file_name_found)
+/**
+ * @brief   Function used to insert a new pair word, document_id into a Dictionary.
+ *          This function consider the dictionary as being of type: < termk, {docIDx : countk} [] >
+ * @param[in] dic         - Dictionary in which the pair will be stored
+ * @param[in] word        - Word (it doesn't have to be NUL terminated)
+ * @param[in] word_length - The length of the word
+ * @param[in] document_id - ID of the document
+ * @param[in] count       - Word count. It is added to the count of the document if it exists.
+ * @return  0 for success or -1 in case or error
+ * @note    Doesn't matter if the dictionary is empty.
+ *          If it is initialized with 0, the memory will be allocated from its arena.
+ **/
+int insert_document_into_dictionary(Dictionary *dic, const char *word, size_t word_length, int document_id, int count)
+{
+    int error_code = -1;
+    int key_index = dictionary_get_key(dic, word, word_length);
+
+    if (-1 != key_index)
+    {
+        int value_found = 0;
+        int value_index = pair_get_document(dic, &dic[0].elements[key_index], document_id, &value_found);
+
+        if (-1 != value_index)
         {
-            temp_pointer = (char **)realloc(dic[0].elements[key_index].values, (dic[0].elements[key_index].values_length + 1) * sizeof(char *));
+            /* If the document was already in the list, its parts were counted apart (e.g. by threads), add them */
+            dic[0].elements[key_index].counts[value_index] = add_counts(dic[0].elements[key_index].counts[value_index], count);
 
-            if (NULL != temp_pointer)
-            {
-                dic[0].elements[key_index].values = temp_pointer;
-                temp_pointer = (char **)realloc(dic[0].elements[key_index].counts, (dic[0].elements[key_index].values_length + 1) * sizeof(int));
-
-                if (NULL != temp_pointer)
-                {
-                    int value_index = 0;
-
-                    dic[0].elements[key_index].counts = temp_pointer;
-                    value_index = dic[0].elements[key_index].values_length++;
-                    dic[0].elements[key_index].values[value_index] = (char *)calloc(strlen(file_name) + 1, sizeof(char));
-
-                    if (NULL != dic[0].elements[key_index].values[value_index])
-                    {
-                        strcpy(dic[0].elements[key_index].values[value_index], file_name);
-                        dic[0].elements[key_index].counts[value_index] = count;
-                        error_code = 0;
-                    }
-                    else
-                    {
-                        log_message(stderr, "UTILS: %s(): Out of memory! .\n", __FUNCTION__);
-                    }
-                }
-                else
-                {
-                    log_message(stderr, "UTILS: %s(): Out of memory! .\n", __FUNCTION__);
-                }
-            }
-            else
-            {
-                log_message(stderr, "UTILS: %s(): Out of memory! .\n", __FUNCTION__);
-            }
+            error_code = 0;
         }
     }
 
@@ -361,27 +973,39 @@ int insert_file_into_dictionary(Dictionary *dic, const char *word, const char *f
  * @brief   Function used to free the dynamically allocated memory from a Dictionary.
  * @param[in] dic - Dictionary which will be deleted
  * @return  void
+ * @note    The memory is owned by the dictionary's arena, so it is released at once.
  **/
 void free_dictionary(Dictionary *dic)
 {
-    for (int i = 0; i < dic[0].elements_length; ++i)
+    arena_release(&dic[0].arena);
+    memset(dic, 0, sizeof(Dictionary));
+}
+
+/**
+ * @brief   Function used to sort the elements of a Dictionary by key
+ * @param[in] dic - The dictionary
+ * @return  Array of dic->elements_length indexes of the elements in key order or NULL in case of error
+ * @note    The array is allocated from the dictionary's arena. Do not try to free it.
+ **/
+int *sort_dictionary(Dictionary *dic)
+{
+    int *indexes = (int *)arena_alloc(&dic[0].arena, (dic[0].elements_length + 1) * sizeof(int));
+
+    if (NULL == indexes)
+    {
+        log_message(LOG_ERROR, "UTILS: %s(): Out of memory! .\n", __FUNCTION__);
+    }
+    else
     {
-        for (int j = 0; j < dic[0].elements[i].values_length; ++j)
+        for (int i = 0; i < dic[0].elements_length; ++i)
         {
-            free(dic[0].elements[i].values[j]);
-            dic[0].elements[i].values[j] = NULL;
-            dic[0].elements[i].counts[j] = 0;
+            indexes[i] = i;
         }
 
-        free(dic[0].elements[i].key);
-        free(dic[0].elements[i].values);
-        free(dic[0].elements[i].counts);
-
-        dic[0].elements[i].key = NULL;
-        dic[0].elements[i].values = NULL;
-        dic[0].elements[i].counts = NULL;
+        sorted_elements = dic[0].elements;
+        qsort(indexes, dic[0].elements_length, sizeof(int), compare_pair_indexes);
+        sorted_elements = NULL;
     }
 
-    free(dic[0].elements);
-    dic[0].elements = NULL;
-}
\ No newline at end of file
+    return indexes;
+}
@@ -3,17 +3,71 @@
  ******************************************/
 #include <stdio.h>  /* stdout/stderr   */
 #include <string.h> /* strcmp */
+#include <stdlib.h> /* atoi   */
+#include <limits.h> /* INT_MAX */
+#include <unistd.h> /* unlink  */
+#include <omp.h>    /* OpenMP  */
 #include "mpi.h"
 #include "worker.h"
 #include "utils.h"
+#include "logger.h"
+#include "tokenizer.h"
+#include "run_file.h"
+#include "index_file.h"
+#include "job.h"
+#include "manifest.h"
+#include "metrics.h"
+#include "trace.h"
 
 /*******************************************
  *                DEFINES
  ******************************************/
-#define MIN_WORD_SIZE 3
-#define MAX_WORD_SIZE 128
-#define MAX_LINE_SIZE (MAX_WORD_SIZE + 10)
-#define WORD_DELIMITER "�!?.,_-*&()[]{}|/:;~\" \t\n1234567890"
+#define MAP_TEXT_FILE_FORMAT "map%d.txt" /* Debug output of a worker */
+#define SHUFFLE_CHUNK_SIZE (1 << 30) /* Bytes of a message when the shuffle doesn't fit MPI_Alltoallv's int counts */
+#define MAP_PIECE_SIZE (16 * 1024 * 1024) /* Bytes of a file counted between two checks of the memory budget and of the cancels */
+#define SPOOL_FILE_FORMAT "spool%d.%s" /* The reduced key range of a worker, kept until the offsets of the store phase are known */
+
+/*******************************************
+ *                TYPES
+ ******************************************/
+
+/* struct used to count the keys mapped from a document durring map phase */
+typedef struct WordCounter_
+{
+    Dictionary *dictionary;
+    int document_id;
+    uint64_t tokens;
+} WordCounter;
+
+/* struct used to describe where a worker stores its map output */
+typedef struct MapOutput_
+{
+    const char *output_dir_path; /* Directory of the runs */
+    uint64_t *histogram;         /* Number of postings of every 2 bytes prefix, used for the reduce key ranges */
+    Dictionary *memory;          /* Not NULL if the map output is kept in memory for the MPI shuffle */
+    FILE *text_file;             /* Not NULL if the map output is also written as text */
+    uint64_t memory_budget;      /* Bytes of words a task keeps in memory before it spills them, 0 for no limit */
+    const char *scratch_dir_path;
+    int spills_count;            /* Used for the names of the spilled runs */
+    const Job *job;              /* The job which maps the files */
+} MapOutput;
+
+/* struct used to keep the output of the reduce phase of a worker until the store phase.
+ * The runs are merged once, the lines of the result and the block of the index are written into spools,
+ * which are removed from the scratch directory as soon as they are opened. */
+typedef struct ReduceOutput_
+{
+    FILE *result; /* The lines of the result */
+    FILE *index;  /* The block of the index */
+} ReduceOutput;
+
+/* struct used to store the runs received by a reducer in the MPI shuffle */
+typedef struct ShuffleInput_
+{
+    unsigned char *data;         /* The runs received from every worker, one after another */
+    uint64_t *sizes;             /* Bytes received from every worker */
+    int sources_count;
+} ShuffleInput;
 
 /*******************************************
  *      STATIC FUNCTION DECLARATION
@@ -21,38 +75,205 @@
 
 /**
  * @brief Function called by a worker to do the work durring map phase
- * @param[in] worker_rank     - The process rank
- * @param[in] output_dir_path - Path of the directory in which the result of the map phase will be stored
+ * @param[in] worker_rank    - The process rank
+ * @param[in] options        - The command line options
+ * @param[in,out] map_output - Where the map output is stored
  * @return void
  **/
-static void worker_map_phase(const int worker_rank, const char *output_dir_path);
+static void worker_map_phase(const int worker_rank, const Options *options, MapOutput *map_output);
 
 /**
- * @brief Function called by worker to parse a file durring in map phase
- * @param[in] worker_rank      - The process rank
- * @param[in] input_file_path  - Path of the file that will be parsed
- * @param[in] output_file_path - Path of the file in which the result will be stored
+ * @brief Function called by a worker to ask master for the next batch of map tasks.
+ *        The batch is received into a posted nonblocking receive.
+ * @param[in,out] request    - The timing of the tasks done since the previous request. It is reset.
+ * @param[out] batch         - Buffer of MAX_BATCH_TASKS tasks in which the batch is received
+ * @param[out] pending_batch - The receive of the batch
  * @return void
  **/
-static void worker_parse_file(const int worker_rank, const char *input_file_path, const char *output_file_path);
+static void worker_request_tasks(TaskRequest *request, MapTask *batch, MPI_Request *pending_batch);
 
 /**
- * @brief Function called by a worker to do the work durring reduce phase
+ * @brief Function called by worker to parse the files of a task durring in map phase.
+ *        The words are stored as a sorted run into the output directory or kept in memory.
+ *        The run is written under a partial name and renamed when it is complete, so when a backup copy of the task
+ *        writes the same run, the reducers see one of the copies. The task is dropped as soon as master cancels it.
  * @param[in] worker_rank    - The process rank
- * @param[in] input_dir_path - Path of the directory that will be parsed
- * @param[out] result        - Dictionary in which the result is stored
+ * @param[in,out] queue      - The task, followed by the queued ones. The cancelled tasks are marked with INVALID_TASK_ID.
+ * @param[in] queue_length   - Number of tasks of the queue
+ * @param[in,out] map_output - Where the result will be stored
+ * @param[out] file_hashes   - The hashes of the ranges of the task, one for every item, for the manifest
+ * @return 1 if the task was done, 0 if it was cancelled or -1 if its run couldn't be written
+ **/
+static int worker_parse_task(const int worker_rank, MapTask *queue, int queue_length, MapOutput *map_output, FileHash *file_hashes);
+
+/**
+ * @brief Function called by worker to receive the tasks cancelled by master and to mark them in the queue.
+ *        A task is cancelled when its other copy (the original or the backup) was done first.
+ * @param[in] worker_rank  - The process rank
+ * @param[in,out] queue    - The running task, followed by the queued ones
+ * @param[in] queue_length - Number of tasks of the queue
+ * @return void
+ **/
+static void worker_receive_cancels(const int worker_rank, MapTask *queue, int queue_length);
+
+/**
+ * @brief Function called by worker to count the keys which the job maps from a byte range of a file durring map phase.
+ *        The range is split between the OpenMP threads, which count their keys apart.
+ * @param[in] worker_rank - The process rank
+ * @param[in] job         - The job
+ * @param[in] item        - The byte range of the file that will be parsed and its document ID
+ * @param[in,out] words   - Dictionary in which the keys are counted
+ * @return 0 for success or -1 in case of error
+ **/
+static int worker_tokenize_file(const int worker_rank, const Job *job, const MapTaskItem *item, Dictionary *words);
+
+/**
+ * @brief Function called by worker to fold the postings of every word of a task with the job's combine,
+ *        before the words leave the task. The words can't be counted anymore, only read.
+ * @param[in] job       - The job
+ * @param[in,out] words - The words
  * @return void
  **/
-static void worker_reduce_phase(const int worker_rank, const char *input_dir_path, Dictionary *result);
+static void worker_combine_words(const Job *job, Dictionary *words);
 
 /**
- * @brief Function called by worker to write the result
+ * @brief Function called by worker to spill the words of a task which went over the memory budget.
+ *        The words are written as a sorted run into the scratch directory, then they are freed.
+ * @param[in] worker_rank    - The process rank
+ * @param[in,out] map_output - Where the map output is stored
+ * @param[in,out] words      - The words. The dictionary is empty after the call.
+ * @param[in,out] spills     - The spilled runs of the task
+ * @return 0 for success or -1 in case of error
+ **/
+static int worker_spill_words(const int worker_rank, MapOutput *map_output, Dictionary *words, RunMerger *spills);
+
+/**
+ * @brief Function called by worker to write the words of a task as text, for debugging
+ * @param[in] text_file - The text file
+ * @param[in] task      - The task
+ * @param[in] words     - The words of the task which were not spilled
+ * @param[in] spills    - The spilled runs of the task
+ * @return void
+ **/
+static void worker_write_text(FILE *text_file, const MapTask *task, const Dictionary *words, RunMerger *spills);
+
+/**
+ * @brief Function called by the job for every key mapped from a file durring map phase
+ * @param[in] word    - The key (not NUL terminated)
+ * @param[in] length  - The key length
+ * @param[in] context - The WordCounter of the file
+ * @return 0 for success or -1 in case of error
+ **/
+static int worker_count_word(const char *word, size_t length, void *context);
+
+/**
+ * @brief Function called by worker to check if a file is a run written in the map phase
+ * @param[in] file_name - The file name
+ * @return 1 if the file is a run, 0 otherwise
+ **/
+static int worker_is_run_file(const char *file_name);
+
+/**
+ * @brief Function called by a worker to send the histogram of its map output to master
+ *        and to receive the key ranges of the reducers
+ * @param[in] histogram - Number of postings of every 2 bytes prefix of the worker's map output
+ * @param[out] splits   - The key ranges of the reducers
+ * @return void
+ **/
+static void worker_partition_phase(const uint64_t *histogram, KeySplits *splits);
+
+/**
+ * @brief Function called by a worker to exchange the map output kept in memory with the other workers.
+ *        Every worker receives the partition it reduces from all the workers.
+ * @param[in] worker_rank    - The process rank
+ * @param[in] workers_comm   - Communicator of the workers
+ * @param[in] splits         - The key ranges of the reducers
+ * @param[in,out] map_output - The map output of the worker. It is freed after it is sent.
+ * @param[out] shuffled      - The runs received by the worker
+ * @return void
+ **/
+static void worker_shuffle_phase(const int worker_rank, MPI_Comm workers_comm, const KeySplits *splits,
+                                 Dictionary *map_output, ShuffleInput *shuffled);
+
+/**
+ * @brief Function called by a worker to do the work durring reduce phase.
+ *        The runs of the key range are merged once, the lines of the result and the block of the index are spooled,
+ *        which gives their sizes. A key range copied from the previous result is not merged.
+ * @param[in] worker_rank      - The process rank
+ * @param[in] options          - The command line options
+ * @param[in] splits           - The key ranges of the reducers
+ * @param[in] shuffled         - The runs received in the MPI shuffle or NULL if they are read from the output directory
+ * @param[out] merger          - The merger of the runs
+ * @param[out] output          - The spooled result and index block
+ * @param[out] task            - The key range received from master and the bytes of the result and index of the worker
+ * @return void
+ **/
+static void worker_reduce_phase(const int worker_rank, const Options *options, const KeySplits *splits,
+                                const ShuffleInput *shuffled, RunMerger *merger, ReduceOutput *output, ReduceTask *task);
+
+/**
+ * @brief Function called by worker to open a spool of its reduce output into the scratch directory.
+ *        It is removed at once, so it disappears with the worker even if the job fails.
+ * @param[in] worker_rank      - The process rank
+ * @param[in] scratch_dir_path - The scratch directory
+ * @param[in] name             - Name of the spool ("result" or "index")
+ * @return The spool or NULL in case of error
+ **/
+static FILE *worker_open_spool(const int worker_rank, const char *scratch_dir_path, const char *name);
+
+/**
+ * @brief Function called by worker to write the result and the index from its spools.
+ *        The workers write their key ranges together into the result file, in the order of the ranges.
+ *        Then all the ranks agree on whether the write failed, so that master drops the manifest if one of them did.
  * @param[in] worker_rank     - The process rank
  * @param[in] output_dir_path - Path of the directory in which the result is stored
- * @param[in] result          - Dictionary that contains the result that will be stored
+ * @param[in] output          - The spooled result and index block
+ * @param[in] task            - The key range and the bytes of the result and index of the worker
  * @return void
  **/
-static void worker_store_result_phase(const int worker_rank, const char *output_dir_path, Dictionary *result);
+static void worker_store_result_phase(const int worker_rank, const char *output_dir_path, const ReduceOutput *output, const ReduceTask *task);
+
+/**
+ * @brief Function called by worker to write its block of the index, after the result
+ * @param[in] worker_rank     - The process rank
+ * @param[in] output_dir_path - Path of the directory in which the index is stored
+ * @param[in] output          - The spooled result and index block
+ * @param[in] task            - The key range and the bytes of the index block of the worker
+ * @return 0 for success or -1 in case of error
+ **/
+static int worker_store_index(const int worker_rank, const char *output_dir_path, const ReduceOutput *output, const ReduceTask *task);
+
+/**
+ * @brief Function called by worker to copy its key range from the previous result or index, when it didn't change
+ * @param[in] worker_rank        - The process rank
+ * @param[in] output_dir_path    - Path of the directory in which the result is stored
+ * @param[in] previous_file_name - Name of the previous result or index
+ * @param[in] offset             - Offset of the key range in the previous file
+ * @param[in] length             - Bytes of the key range
+ * @param[in,out] output_file    - The result or index file
+ * @return 0 for success or -1 in case of error
+ **/
+static int worker_copy_previous(const int worker_rank, const char *output_dir_path, const char *previous_file_name,
+                                 uint64_t offset, uint64_t length, OrderedFile *output_file);
+
+/**
+ * @brief Function called by worker to copy bytes of a file into the result or the index
+ * @param[in] worker_rank     - The process rank
+ * @param[in] input_file      - The file, at the first byte to copy
+ * @param[in] length          - Number of bytes to copy
+ * @param[in,out] output_file - The result or index file
+ * @return 0 for success or -1 in case of error
+ **/
+static int worker_copy_file(const int worker_rank, FILE *input_file, uint64_t length, OrderedFile *output_file);
+
+/**
+ * @brief Function called by worker to reduce the merged term into a line of the result, with the job's reduce
+ * @param[in] job    - The job
+ * @param[in] merger - The merger
+ * @param[out] line  - The buffer in which the line is appended
+ * @return 0 for success or -1 in case of error
+ **/
+static int worker_reduce_term(const Job *job, const RunMerger *merger, ByteBuffer *line);
 
 /*******************************************
  *      STATIC FUNCTION DEFINITION
@@ -60,289 +281,1157 @@ static void worker_store_result_phase(const int worker_rank, const char *output_
 
 /**
  * @brief Function called by a worker to do the work durring map phase
- * @param[in] worker_rank     - The process rank
- * @param[in] output_dir_path - Path of the directory in which the result of the map phase will be stored
+ * @param[in] worker_rank    - The process rank
+ * @param[in] options        - The command line options
+ * @param[in,out] map_output - Where the map output is stored
  * @return void
  **/
-static void worker_map_phase(const int worker_rank, const char *output_dir_path)
+static void worker_map_phase(const int worker_rank, const Options *options, MapOutput *map_output)
 {
-    char file_to_parse[MAX_PATH] = {'\0'};
-    char output_file_path[MAX_PATH] = {'\0'};
+    /* The batch which is parsed and the one which is received meanwhile */
+    MapTask *batches = (MapTask *)calloc(2 * MAX_BATCH_TASKS, sizeof(MapTask));
+    MapTask *current_batch = batches;
+    MapTask *next_batch = batches + MAX_BATCH_TASKS;
+    int batch_length = 0;
+    int task_index = 0;
+    int stop_received = 0;
+    double wait_start = 0.0;
+    char text_file_name[MAX_PATH] = {'\0'};
+    char text_file_path[MAX_PATH] = {'\0'};
+    TaskRequest request = {0};
+    /* The receive of the next batch (TAG_WORK) and the one of the stop signal (TAG_SLEEP).
+     * Neither matches TAG_CANCEL, the cancels are received only while a task is parsed. */
+    MPI_Request pending_receives[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+    MPI_Request *pending_batch = &pending_receives[0];
+    int completed_receive = 0;
     MPI_Status master_status = {0};
 
-    if ('/' != output_dir_path[strlen(output_dir_path) - 1])
+    if (NULL == batches)
     {
-        snprintf(output_file_path, MAX_PATH, "%s/map%d.txt", output_dir_path, worker_rank);
+        /* The master waits for the requests of this worker, so this can't be recovered */
+        log_message(LOG_ERROR, "Worker: %s(): The worker nr. %d is out of memory! .\n", __FUNCTION__, worker_rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
     }
-    else
+
+    if (0 != options->text_map_output)
     {
-        snprintf(output_file_path, MAX_PATH, "%smap%d.txt", output_dir_path, worker_rank);
+        snprintf(text_file_name, MAX_PATH, MAP_TEXT_FILE_FORMAT, worker_rank);
+        utils_join_path(text_file_path, options->output_dir_path, text_file_name);
+        map_output->text_file = fopen(text_file_path, "w");
+
+        if (NULL == map_output->text_file)
+        {
+            log_message(LOG_ERROR, "Worker: %s(): The worker nr. %d failed to open file '%s'.\n", __FUNCTION__, worker_rank, text_file_path);
+        }
     }
 
-    MPI_Recv(file_to_parse, MAX_PATH, MPI_CHAR, MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &master_status);
+    MPI_Irecv(NULL, 0, MPI_BYTE, 0, TAG_SLEEP, MPI_COMM_WORLD, &pending_receives[1]);
 
-    while (TAG_WORK == master_status.MPI_TAG)
+    /* Parse the queued tasks untill the master sends the stop signal */
+    while ((task_index < batch_length) || (0 == stop_received))
     {
-        log_message(stdout, "Worker: %s(): The worker nr. %d received file '%s' to parse.\n", __FUNCTION__, worker_rank, file_to_parse);
-        worker_parse_file(worker_rank, file_to_parse, output_file_path);
-        log_message(stdout, "Worker: %s(): The worker nr. %d finished to parse file '%s'.\n", __FUNCTION__, worker_rank, file_to_parse);
+        if (task_index == batch_length)
+        {
+            if (MPI_REQUEST_NULL == *pending_batch)
+            {
+                request.idle = 1;
+                worker_request_tasks(&request, next_batch, pending_batch);
+            }
+
+            /* The queue is empty, wait for the batch requested before or for the stop signal which answers the request */
+            wait_start = MPI_Wtime();
+            MPI_Waitany(2, pending_receives, &completed_receive, &master_status);
+            metrics_add_time(METRIC_RECV_BLOCKED_SECONDS, wait_start);
+
+            task_index = 0;
+            stop_received = (1 == completed_receive);
+
+            if (0 != stop_received)
+            {
+                /* No batch answers the last request */
+                MPI_Cancel(pending_batch);
+                MPI_Wait(pending_batch, MPI_STATUS_IGNORE);
+                batch_length = 0;
+                continue;
+            }
+
+            MPI_Get_count(&master_status, MPI_BYTE, &batch_length);
+            batch_length /= sizeof(MapTask);
+
+            current_batch = next_batch;
+            next_batch = (batches == next_batch) ? batches + MAX_BATCH_TASKS : batches;
+
+            log_message(LOG_DEBUG, "Worker: %s(): The worker nr. %d received %d tasks to parse.\n", __FUNCTION__, worker_rank, batch_length);
+        }
+        else
+        {
+            MapTask *task = &current_batch[task_index];
+            FileHash task_hashes[MAX_TASK_ITEMS];
+            int task_id = task->task_id;
+            int task_done = 0;
+            double start_time = 0.0;
+            double end_time = 0.0;
 
-        /* Notify that the worker finished. */
-        MPI_Send(file_to_parse, strlen(file_to_parse), MPI_CHAR, master_status.MPI_SOURCE, TAG_WORK, MPI_COMM_WORLD);
-        /* clear the buffer to be reused */
-        memset(file_to_parse, '\0', MAX_PATH);
-        /* Get the master's feedback. */
-        MPI_Recv(file_to_parse, MAX_PATH, MPI_CHAR, MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &master_status);
+            /* The last task of the queue is started, so ask for the next batch now.
+             * It is received while this task is parsed. */
+            if ((task_index + 1 == batch_length) && (0 == stop_received))
+            {
+                request.idle = 0;
+                worker_request_tasks(&request, next_batch, pending_batch);
+            }
+
+            ++task_index;
+
+            if (INVALID_TASK_ID == task_id)
+            {
+                /* Cancelled while it was queued */
+                metrics_add(METRIC_CANCELLED_TASKS, 1);
+                continue;
+            }
+
+            log_message(LOG_DEBUG, "Worker: %s(): The worker nr. %d started the task %d (%d files).\n",
+                        __FUNCTION__, worker_rank, task_id, task->items_length);
+
+            start_time = MPI_Wtime();
+            task_done = worker_parse_task(worker_rank, task, batch_length - task_index + 1, map_output, task_hashes);
+            end_time = MPI_Wtime();
+            trace_span("map", (1 == task_done) ? "task" : ((0 == task_done) ? "cancelled task" : "failed task"), task_id, NULL, start_time, end_time);
+
+            if (0 == task_done)
+            {
+                metrics_add(METRIC_CANCELLED_TASKS, 1);
+            }
+            else if (0 > task_done)
+            {
+                /* Master stops the job, the task is not committed */
+                ++request.tasks_failed;
+            }
+            else if (request.tasks_done < MAX_BATCH_TASKS)
+            {
+                request.finished_tasks[request.tasks_done++] = task_id;
+                request.tasks_seconds += end_time - start_time;
+                memcpy(&request.file_hashes[request.hashes_length], task_hashes, task->items_length * sizeof(FileHash));
+                request.hashes_length += task->items_length;
+            }
+
+            log_message(LOG_DEBUG, "Worker: %s(): The worker nr. %d finished to parse the task %d.\n", __FUNCTION__, worker_rank, task_id);
+        }
+    }
+
+    if ((NULL != map_output->text_file) && (0 != fclose(map_output->text_file)))
+    {
+        log_message(LOG_ERROR, "Worker: %s(): The worker nr. %d failed to close file '%s'.\n", __FUNCTION__, worker_rank, text_file_path);
     }
+
+    /* The cancels of the tasks done before their backups are left */
+    worker_receive_cancels(worker_rank, NULL, 0);
+
+    map_output->text_file = NULL;
+    free(batches);
 }
 
 /**
- * @brief Function called by worker to parse a file durring in map phase
- * @param[in] worker_rank      - The process rank
- * @param[in] input_file_path  - Path of the file that will be parsed
- * @param[in] output_file_path - Path of the file in which the result will be stored
+ * @brief Function called by a worker to ask master for the next batch of map tasks.
+ *        The batch is received into a posted nonblocking receive.
+ * @param[in,out] request    - The timing of the tasks done since the previous request. It is reset.
+ * @param[out] batch         - Buffer of MAX_BATCH_TASKS tasks in which the batch is received
+ * @param[out] pending_batch - The receive of the batch
  * @return void
  **/
-static void worker_parse_file(const int worker_rank, const char *input_file_path, const char *output_file_path)
+static void worker_request_tasks(TaskRequest *request, MapTask *batch, MPI_Request *pending_batch)
+{
+    /* Post the receive first, so the batch doesn't wait for a matching receive */
+    MPI_Irecv(batch, MAX_BATCH_TASKS * sizeof(MapTask), MPI_BYTE, 0, TAG_WORK, MPI_COMM_WORLD, pending_batch);
+    MPI_Send(request, sizeof(TaskRequest), MPI_BYTE, 0, TAG_WORK, MPI_COMM_WORLD);
+
+    request->tasks_done = 0;
+    request->tasks_seconds = 0.0;
+    request->tasks_failed = 0;
+    request->hashes_length = 0;
+}
+
+/**
+ * @brief Function called by worker to parse the files of a task durring in map phase.
+ *        The words are stored as a sorted run into the output directory or kept in memory.
+ *        The run is written under a partial name and renamed when it is complete, so when a backup copy of the task
+ *        writes the same run, the reducers see one of the copies. The task is dropped as soon as master cancels it.
+ * @param[in] worker_rank    - The process rank
+ * @param[in,out] queue      - The task, followed by the queued ones. The cancelled tasks are marked with INVALID_TASK_ID.
+ * @param[in] queue_length   - Number of tasks of the queue
+ * @param[in,out] map_output - Where the result will be stored
+ * @param[out] file_hashes   - The hashes of the ranges of the task, one for every item, for the manifest
+ * @return 1 if the task was done, 0 if it was cancelled or -1 if its run couldn't be written
+ **/
+static int worker_parse_task(const int worker_rank, MapTask *queue, int queue_length, MapOutput *map_output, FileHash *file_hashes)
 {
-    FILE *input_file = NULL;
-    FILE *output_file = NULL;
-    char *word = NULL;
-    char buffer[MAX_WORD_SIZE] = {'\0'};
-    Dictionary file_words = {0};
+    char run_file_name[MAX_PATH] = {'\0'};
+    char run_file_path[MAX_PATH] = {'\0'};
+    char partial_file_path[MAX_PATH] = {'\0'};
+    const MapTask *task = &queue[0];
+    int task_id = task->task_id;
+    Dictionary task_words = {0};
+    RunMerger spills = {0};
+    int error_code = 0;
+    int merge_result = 0;
+    /* The reduce key ranges are known only after the map phase, so a task writes a single sorted run.
+     * The reducers seek into it to the first key of their range. */
+    KeySplits whole_range = {1, NULL};
 
-    input_file = fopen(input_file_path, "r");
-    output_file = fopen(output_file_path, "a");
+    snprintf(run_file_name, MAX_PATH, PARTIAL_RUN_FILE_FORMAT, task_id, worker_rank);
+    utils_join_path(partial_file_path, map_output->output_dir_path, run_file_name);
+    snprintf(run_file_name, MAX_PATH, MAP_RUN_FILE_FORMAT, task_id);
+    utils_join_path(run_file_path, map_output->output_dir_path, run_file_name);
+    worker_receive_cancels(worker_rank, queue, queue_length);
 
-    if (NULL == input_file)
+    /* All the files of the task are counted into the same dictionary, so the task writes one run.
+     * A file is counted in pieces, after every one the cancels are checked and, with a memory budget,
+     * the words are spilled when they go over the budget.
+     * A piece owns the words which start inside it, like a split, so a word is never cut. */
+    for (int i = 0; (0 == error_code) && (INVALID_TASK_ID != task->task_id) && (i < task->items_length); ++i)
     {
-        log_message(stderr, "Worker: %s(): The worker nr. %d failed to open file '%s'.\n", __FUNCTION__, worker_rank, input_file_path);
+        const MapTaskItem *item = &task->items[i];
+        FileHash *file_hash = &file_hashes[i];
+        double start_time = MPI_Wtime();
+
+        file_hash->task_id = task_id;
+        file_hash->document_id = item->document_id;
+        file_hash->length = 0;
+        file_hash->hash = 0;
+
+        for (uint64_t offset = 0; (0 == error_code) && (INVALID_TASK_ID != task->task_id) && (offset < item->length); offset += MAP_PIECE_SIZE)
+        {
+            MapTaskItem piece = *item;
+            uint64_t piece_hash = 0;
+
+            piece.offset = item->offset + offset;
+            piece.length = (MAP_PIECE_SIZE < item->length - offset) ? MAP_PIECE_SIZE : item->length - offset;
+            error_code = worker_tokenize_file(worker_rank, map_output->job, &piece, &task_words);
+
+            if (0 != error_code)
+            {
+                log_message(LOG_ERROR, "Worker: %s(): The worker nr. %d failed to parse file '%s'.\n", __FUNCTION__, worker_rank, item->file_path);
+            }
+            else if ((0 != map_output->memory_budget) && (task_words.arena.allocated_bytes > map_output->memory_budget))
+            {
+                error_code = worker_spill_words(worker_rank, map_output, &task_words, &spills);
+            }
+
+            /* The piece was just read, so it is hashed from the page cache.
+             * A range which can't be hashed leaves its file without hash, it is mapped again when it is touched. */
+            if ((0 == error_code) && (0 == manifest_hash_range(item->file_path, piece.offset, piece.length, &piece_hash)))
+            {
+                file_hash->hash += piece_hash;
+                file_hash->length += piece.length;
+            }
+
+            worker_receive_cancels(worker_rank, queue, queue_length);
+        }
+
+        trace_span("map", "file", item->document_id, item->file_path, start_time, MPI_Wtime());
     }
-    else if (NULL == output_file)
+
+    if (INVALID_TASK_ID == task->task_id)
     {
-        log_message(stderr, "Worker: %s(): The worker nr. %d failed to open file '%s'.\n", __FUNCTION__, worker_rank, output_file_path);
+        /* The other copy of the task was done first, drop the words */
+        log_message(LOG_DEBUG, "Worker: %s(): The worker nr. %d dropped the task %d, another worker did it.\n", __FUNCTION__, worker_rank, task_id);
+        metrics_add(METRIC_DICTIONARY_PROBES, task_words.probes);
+        free_dictionary(&task_words);
+        run_merger_close(&spills);
+
+        return 0;
     }
-    else
+
+    /* The words which are left are spilled too, so all of them are merged from the runs */
+    if ((0 == error_code) && (0 != spills.runs_length) && (0 != task_words.elements_length))
+    {
+        error_code = worker_spill_words(worker_rank, map_output, &task_words, &spills);
+    }
+
+    if ((0 == error_code) && (0 != spills.runs_length))
     {
-        while (EOF != fscanf(input_file, "%s", buffer))
+        if (NULL != map_output->memory)
         {
-            word = strtok(buffer, WORD_DELIMITER);
+            /* Keep the merged words and counts untill the shuffle */
+            run_merger_begin(&spills, &whole_range, 0);
 
-            do
+            while ((0 == error_code) && (1 == (merge_result = run_merger_next(&spills))))
             {
-                if ((NULL != word) && (MIN_WORD_SIZE <= strlen(word)))
+                map_output->histogram[term_prefix(spills.term, spills.term_length)] += spills.postings_length;
+
+                for (int j = 0; (0 == error_code) && (j < spills.postings_length); ++j)
                 {
-                    insert_word_into_dictionary(&file_words, input_file_path, utils_strlwr(word));
+                    error_code = insert_document_into_dictionary(map_output->memory, spills.term, spills.term_length, spills.documents[j], spills.counts[j]);
                 }
+            }
 
-                word = strtok(NULL, WORD_DELIMITER);
-            } while (NULL != word);
+            if ((0 != error_code) || (0 > merge_result))
+            {
+                log_message(LOG_ERROR, "Worker: %s(): The worker nr. %d failed to merge the spilled words.\n", __FUNCTION__, worker_rank);
+                error_code = -1;
+            }
+        }
+        /* Now merge the spilled runs into the run of the task */
+        else if (0 != write_merged_run(&spills, partial_file_path, map_output->histogram))
+        {
+            log_message(LOG_ERROR, "Worker: %s(): The worker nr. %d failed to write file '%s'.\n", __FUNCTION__, worker_rank, partial_file_path);
+            error_code = -1;
+        }
+        else if (0 != rename(partial_file_path, run_file_path))
+        {
+            log_message(LOG_ERROR, "Worker: %s(): The worker nr. %d failed to rename file '%s'.\n", __FUNCTION__, worker_rank, partial_file_path);
+            error_code = -1;
+        }
+    }
+    else if (0 == error_code)
+    {
+        worker_combine_words(map_output->job, &task_words);
 
-            /* clear the buffer to be reused */
-            memset(buffer, '\0', MAX_WORD_SIZE);
+        for (int i = 0; i < task_words.elements_length; ++i)
+        {
+            map_output->histogram[term_prefix(task_words.elements[i].key, strlen(task_words.elements[i].key))] += task_words.elements[i].values_length;
         }
 
-        /* Now store the words and counts in worker's output file */
+        if (NULL != map_output->memory)
+        {
+            /* Keep the words and counts untill the shuffle */
+            for (int i = 0; (0 == error_code) && (i < task_words.elements_length); ++i)
+            {
+                const Pair *pair = &task_words.elements[i];
 
-        for (int i = 0; i < file_words.elements_length; ++i)
+                for (int j = 0; (0 == error_code) && (j < pair->values_length); ++j)
+                {
+                    error_code = insert_document_into_dictionary(map_output->memory, pair->key, strlen(pair->key), pair->documents[j], pair->counts[j]);
+                }
+            }
+
+            if (0 != error_code)
+            {
+                log_message(LOG_ERROR, "Worker: %s(): The worker nr. %d failed to insert into dictionary.\n", __FUNCTION__, worker_rank);
+            }
+        }
+        /* Now store the words and counts as a run sorted by word */
+        else if (0 != write_partitioned_run(&task_words, partial_file_path, &whole_range))
         {
-            /* First of all, write the file path */
-            fprintf(output_file, "%s\n", input_file_path);
+            log_message(LOG_ERROR, "Worker: %s(): The worker nr. %d failed to write file '%s'.\n", __FUNCTION__, worker_rank, partial_file_path);
+            error_code = -1;
+        }
+        else if (0 != rename(partial_file_path, run_file_path))
+        {
+            log_message(LOG_ERROR, "Worker: %s(): The worker nr. %d failed to rename file '%s'.\n", __FUNCTION__, worker_rank, partial_file_path);
+            error_code = -1;
+        }
+    }
+
+    if ((0 == error_code) && (NULL != map_output->text_file))
+    {
+        worker_write_text(map_output->text_file, task, &task_words, &spills);
+    }
+
+    if ((0 != error_code) && (NULL == map_output->memory))
+    {
+        /* The run of a failed task is never renamed into place */
+        unlink(partial_file_path);
+    }
+
+    /* Now free the memory */
+    metrics_add(METRIC_DICTIONARY_PROBES, task_words.probes);
+    free_dictionary(&task_words);
+    run_merger_close(&spills);
+
+    return (0 == error_code) ? 1 : -1;
+}
+
+/**
+ * @brief Function called by worker to receive the tasks cancelled by master and to mark them in the queue.
+ *        A task is cancelled when its other copy (the original or the backup) was done first.
+ * @param[in] worker_rank  - The process rank
+ * @param[in,out] queue    - The running task, followed by the queued ones
+ * @param[in] queue_length - Number of tasks of the queue
+ * @return void
+ **/
+static void worker_receive_cancels(const int worker_rank, MapTask *queue, int queue_length)
+{
+    int cancel_waiting = 0;
+    int cancelled_task = INVALID_TASK_ID;
 
-            /* Now, write all the words:counts contained in the file */
-            for (int j = 0; j < file_words.elements[i].values_length; ++j)
+    MPI_Iprobe(0, TAG_CANCEL, MPI_COMM_WORLD, &cancel_waiting, MPI_STATUS_IGNORE);
+
+    while (0 != cancel_waiting)
+    {
+        MPI_Recv(&cancelled_task, 1, MPI_INT, 0, TAG_CANCEL, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        log_message(LOG_DEBUG, "Worker: %s(): The worker nr. %d received the cancel of the task %d.\n", __FUNCTION__, worker_rank, cancelled_task);
+
+        /* The cancel of a task which is already done is ignored */
+        for (int i = 0; i < queue_length; ++i)
+        {
+            if (cancelled_task == queue[i].task_id)
+            {
+                queue[i].task_id = INVALID_TASK_ID;
+            }
+        }
+
+        MPI_Iprobe(0, TAG_CANCEL, MPI_COMM_WORLD, &cancel_waiting, MPI_STATUS_IGNORE);
+    }
+}
+
+/**
+ * @brief Function called by worker to count the keys which the job maps from a byte range of a file durring map phase.
+ *        The range is split between the OpenMP threads, which count their keys apart.
+ * @param[in] worker_rank - The process rank
+ * @param[in] job         - The job
+ * @param[in] item        - The byte range of the file that will be parsed and its document ID
+ * @param[in,out] words   - Dictionary in which the keys are counted
+ * @return 0 for success or -1 in case of error
+ **/
+static int worker_tokenize_file(const int worker_rank, const Job *job, const MapTaskItem *item, Dictionary *words)
+{
+    int error_code = -1;
+    int threads_count = omp_get_max_threads();
+    Dictionary *thread_words = (Dictionary *)calloc(threads_count, sizeof(Dictionary));
+    WordCounter *counters = (WordCounter *)calloc(threads_count, sizeof(WordCounter));
+    void **contexts = (void **)calloc(threads_count, sizeof(void *));
+
+    if ((NULL == thread_words) || (NULL == counters) || (NULL == contexts))
+    {
+        log_message(LOG_ERROR, "Worker: %s(): The worker nr. %d is out of memory! .\n", __FUNCTION__, worker_rank);
+    }
+    else
+    {
+        /* The first chunk is counted straight into words, the others into their own dictionaries */
+        for (int i = 0; i < threads_count; ++i)
+        {
+            counters[i].dictionary = (0 == i) ? words : &thread_words[i];
+            counters[i].document_id = item->document_id;
+            contexts[i] = &counters[i];
+        }
+
+        error_code = job->map(item, worker_count_word, contexts, threads_count);
+        metrics_add(METRIC_BYTES_READ, item->length);
+
+        /* Merge the words counted by the other threads. The counts of the same word are added. */
+        for (int i = 1; i < threads_count; ++i)
+        {
+            for (int j = 0; (0 == error_code) && (j < thread_words[i].elements_length); ++j)
             {
-                fprintf(output_file, "%s:%d\n", file_words.elements[i].values[j], file_words.elements[i].counts[j]);
+                const Pair *pair = &thread_words[i].elements[j];
+
+                error_code = insert_document_into_dictionary(words, pair->key, strlen(pair->key), item->document_id, pair->counts[0]);
             }
 
-            /* Finally, write an end of line representing the end of the word list */
-            fprintf(output_file, "\n");
+            metrics_add(METRIC_DICTIONARY_PROBES, thread_words[i].probes);
+            free_dictionary(&thread_words[i]);
         }
 
-        /* Now free the memory */
-        free_dictionary(&file_words);
+        for (int i = 0; i < threads_count; ++i)
+        {
+            metrics_add(METRIC_TOKENS, counters[i].tokens);
+        }
+    }
+
+    free(thread_words);
+    free(counters);
+    free(contexts);
+
+    return error_code;
+}
+
+/**
+ * @brief Function called by worker to fold the postings of every word of a task with the job's combine,
+ *        before the words leave the task. The words can't be counted anymore, only read.
+ * @param[in] job       - The job
+ * @param[in,out] words - The words
+ * @return void
+ **/
+static void worker_combine_words(const Job *job, Dictionary *words)
+{
+    for (int i = 0; (NULL != job->combine) && (i < words->elements_length); ++i)
+    {
+        Pair *pair = &words->elements[i];
+
+        /* The document index of the pair is not updated, so nothing is inserted after the combine */
+        pair->values_length = job->combine(pair->documents, pair->counts, pair->values_length);
+    }
+}
+
+/**
+ * @brief Function called by worker to spill the words of a task which went over the memory budget.
+ *        The words are written as a sorted run into the scratch directory, then they are freed.
+ * @param[in] worker_rank    - The process rank
+ * @param[in,out] map_output - Where the map output is stored
+ * @param[in,out] words      - The words. The dictionary is empty after the call.
+ * @param[in,out] spills     - The spilled runs of the task
+ * @return 0 for success or -1 in case of error
+ **/
+static int worker_spill_words(const int worker_rank, MapOutput *map_output, Dictionary *words, RunMerger *spills)
+{
+    char spill_file_name[MAX_PATH] = {'\0'};
+    char spill_file_path[MAX_PATH] = {'\0'};
+    int error_code = -1;
+    KeySplits whole_range = {1, NULL};
+    RunReader run = {0};
+    double start_time = MPI_Wtime();
+
+    snprintf(spill_file_name, MAX_PATH, SPILL_FILE_FORMAT, worker_rank, map_output->spills_count++);
+    utils_join_path(spill_file_path, map_output->scratch_dir_path, spill_file_name);
+    worker_combine_words(map_output->job, words);
+
+    if (0 != write_partitioned_run(words, spill_file_path, &whole_range))
+    {
+        log_message(LOG_ERROR, "Worker: %s(): The worker nr. %d failed to write file '%s'.\n", __FUNCTION__, worker_rank, spill_file_path);
+    }
+    else if (0 != run_reader_open_partition(&run, spill_file_path, 0))
+    {
+        log_message(LOG_ERROR, "Worker: %s(): The worker nr. %d failed to open file: %s.\n", __FUNCTION__, worker_rank, spill_file_path);
+    }
+    else
+    {
+        error_code = run_merger_add(spills, &run);
     }
 
-    if ((NULL != input_file) && (0 != fclose(input_file)))
+    log_message(LOG_DEBUG, "Worker: %s(): The worker nr. %d spilled %d words (%llu bytes) into file: %s.\n",
+                __FUNCTION__, worker_rank, words->elements_length, (unsigned long long)words->arena.allocated_bytes, spill_file_path);
+
+    trace_span("map", "spill", map_output->spills_count - 1, spill_file_path, start_time, MPI_Wtime());
+
+    /* The run is mapped, so the file is not needed anymore */
+    unlink(spill_file_path);
+    metrics_add(METRIC_DICTIONARY_PROBES, words->probes);
+    free_dictionary(words);
+    memset(words, 0, sizeof(Dictionary));
+
+    return error_code;
+}
+
+/**
+ * @brief Function called by worker to write the words of a task as text, for debugging
+ * @param[in] text_file - The text file
+ * @param[in] task      - The task
+ * @param[in] words     - The words of the task which were not spilled
+ * @param[in] spills    - The spilled runs of the task
+ * @return void
+ **/
+static void worker_write_text(FILE *text_file, const MapTask *task, const Dictionary *words, RunMerger *spills)
+{
+    KeySplits whole_range = {1, NULL};
+
+    for (int i = 0; i < task->items_length; ++i)
     {
-        log_message(stderr, "Worker: %s(): The worker nr. %d failed to close file '%s'.\n", __FUNCTION__, worker_rank, input_file_path);
+        /* First of all, write the document ID */
+        fprintf(text_file, "%d\n", task->items[i].document_id);
+
+        /* Now, write all the words:counts of the document */
+        for (int j = 0; j < words->elements_length; ++j)
+        {
+            const Pair *pair = &words->elements[j];
+
+            for (int k = 0; k < pair->values_length; ++k)
+            {
+                if (pair->documents[k] == task->items[i].document_id)
+                {
+                    fprintf(text_file, "%s:%d\n", pair->key, pair->counts[k]);
+                }
+            }
+        }
+
+        /* The spilled words are merged again for every document, this is only for debugging */
+        run_merger_begin(spills, &whole_range, 0);
+
+        while (1 == run_merger_next(spills))
+        {
+            for (int k = 0; k < spills->postings_length; ++k)
+            {
+                if (spills->documents[k] == task->items[i].document_id)
+                {
+                    fprintf(text_file, "%.*s:%d\n", (int)spills->term_length, spills->term, spills->counts[k]);
+                }
+            }
+        }
+
+        /* Finally, write an end of line representing the end of the word list */
+        fprintf(text_file, "\n");
     }
+}
 
-    if ((NULL != output_file) && (0 != fclose(output_file)))
+/**
+ * @brief Function called by the job for every key mapped from a file durring map phase
+ * @param[in] word    - The key (not NUL terminated)
+ * @param[in] length  - The key length
+ * @param[in] context - The WordCounter of the file
+ * @return 0 for success or -1 in case of error
+ **/
+static int worker_count_word(const char *word, size_t length, void *context)
+{
+    WordCounter *counter = (WordCounter *)context;
+
+    ++counter->tokens;
+
+    return insert_word_into_dictionary(counter->dictionary, counter->document_id, word, length);
+}
+
+/**
+ * @brief Function called by a worker to send the histogram of its map output to master
+ *        and to receive the key ranges of the reducers
+ * @param[in] histogram - Number of postings of every 2 bytes prefix of the worker's map output
+ * @param[out] splits   - The key ranges of the reducers
+ * @return void
+ **/
+static void worker_partition_phase(const uint64_t *histogram, KeySplits *splits)
+{
+    MPI_Comm_size(MPI_COMM_WORLD, &splits->partitions_count);
+    --splits->partitions_count; /* The master doesn't reduce */
+
+    splits->splits = (char *)calloc(splits->partitions_count, SPLIT_KEY_SIZE);
+
+    if (NULL == splits->splits)
     {
-        log_message(stderr, "Worker: %s(): The worker nr. %d failed to close file '%s'.\n", __FUNCTION__, worker_rank, output_file_path);
+        /* The others are waiting in the collectives, so this can't be recovered */
+        log_message(LOG_ERROR, "Worker: %s(): Out of memory! .\n", __FUNCTION__);
+        MPI_Abort(MPI_COMM_WORLD, 1);
     }
+
+    MPI_Reduce(histogram, NULL, PREFIX_HISTOGRAM_SIZE, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Bcast(splits->splits, (splits->partitions_count - 1) * SPLIT_KEY_SIZE, MPI_CHAR, 0, MPI_COMM_WORLD);
 }
 
 /**
- * @brief Function called by a worker to do the work durring reduce phase
+ * @brief Function called by a worker to exchange the map output kept in memory with the other workers.
+ *        Every worker receives the partition it reduces from all the workers.
  * @param[in] worker_rank    - The process rank
- * @param[in] input_dir_path - Path of the directory that will be parsed
- * @param[out] result        - Dictionary in which the result is stored
+ * @param[in] workers_comm   - Communicator of the workers
+ * @param[in] splits         - The key ranges of the reducers
+ * @param[in,out] map_output - The map output of the worker. It is freed after it is sent.
+ * @param[out] shuffled      - The runs received by the worker
  * @return void
  **/
-static void worker_reduce_phase(const int worker_rank, const char *input_dir_path, Dictionary *result)
+static void worker_shuffle_phase(const int worker_rank, MPI_Comm workers_comm, const KeySplits *splits,
+                                 Dictionary *map_output, ShuffleInput *shuffled)
 {
-    DIR *input_directory = opendir(input_dir_path);
-    File *file_from_dir = NULL;
+    int workers_count = 0;
+    int fits_alltoallv = 0;
+    ByteBuffer send_buffer = {0};
+    uint64_t send_total = 0;
+    uint64_t receive_total = 0;
+    uint64_t *send_offsets = NULL;
+    uint64_t *send_sizes = NULL;
+    uint64_t *receive_offsets = NULL;
 
-    char input_file_path[MAX_PATH] = {'\0'};
-    char file_name[MAX_PATH] = {'\0'};
-    char word[MAX_WORD_SIZE] = {'\0'};
-    char line[MAX_LINE_SIZE] = {'\0'};
-    char bounds_for_reduce[] = {'A' - 1, 'A' - 1};
-    int count = 0;
+    MPI_Comm_size(workers_comm, &workers_count);
 
-    MPI_Status master_status = {0};
-    FILE *input_file = NULL;
+    send_offsets = (uint64_t *)calloc(workers_count + 1, sizeof(uint64_t));
+    send_sizes = (uint64_t *)calloc(workers_count, sizeof(uint64_t));
+    receive_offsets = (uint64_t *)calloc(workers_count + 1, sizeof(uint64_t));
+    shuffled->sizes = (uint64_t *)calloc(workers_count, sizeof(uint64_t));
+    shuffled->sources_count = workers_count;
+
+    if ((NULL == send_offsets) || (NULL == send_sizes) || (NULL == receive_offsets) || (NULL == shuffled->sizes))
+    {
+        /* The other workers are waiting in the collectives, so this can't be recovered */
+        log_message(LOG_ERROR, "Worker: %s(): The worker nr. %d is out of memory! .\n", __FUNCTION__, worker_rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    /* Encode a run for every reducer. Without it the result would miss the map output of this worker. */
+    if (0 != encode_partitioned_runs(map_output, &send_buffer, splits, send_offsets))
+    {
+        /* The other workers are waiting in the collectives, so this can't be recovered */
+        log_message(LOG_ERROR, "Worker: %s(): The worker nr. %d failed to encode the map output.\n", __FUNCTION__, worker_rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    metrics_add(METRIC_DICTIONARY_PROBES, map_output->probes);
+    free_dictionary(map_output);
+
+    for (int i = 0; i < workers_count; ++i)
+    {
+        send_sizes[i] = send_offsets[i + 1] - send_offsets[i];
+    }
+
+    /* The run of the worker's own partition doesn't leave it (the worker i + 1 has the rank i) */
+    send_total = send_offsets[workers_count];
+    metrics_add(METRIC_BYTES_SHUFFLED, send_total - send_sizes[worker_rank - 1]);
+    MPI_Alltoall(send_sizes, 1, MPI_UINT64_T, shuffled->sizes, 1, MPI_UINT64_T, workers_comm);
+
+    for (int i = 0; i < workers_count; ++i)
+    {
+        receive_offsets[i + 1] = receive_offsets[i] + shuffled->sizes[i];
+    }
 
-    MPI_Recv(bounds_for_reduce, sizeof(bounds_for_reduce), MPI_CHAR, MPI_ANY_SOURCE, TAG_WORK, MPI_COMM_WORLD, &master_status);
-    log_message(stdout, "Worker: %s(): The worker nr. %d received the bounds: [%c, %c] for reduce phase.\n",
-                __FUNCTION__, worker_rank, bounds_for_reduce[0], bounds_for_reduce[1]);
+    receive_total = receive_offsets[workers_count];
+    shuffled->data = (unsigned char *)malloc(receive_total + 1);
 
-    if (NULL == input_directory)
+    if (NULL == shuffled->data)
     {
-        log_message(stderr, "Worker: %s(): The worker nr. %d failed to open dir: %s.\n", __FUNCTION__, worker_rank, input_dir_path);
+        log_message(LOG_ERROR, "Worker: %s(): The worker nr. %d is out of memory! .\n", __FUNCTION__, worker_rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    /* MPI_Alltoallv counts and displacements are ints. All the workers must take the same path. */
+    fits_alltoallv = (INT_MAX >= send_total) && (INT_MAX >= receive_total);
+    MPI_Allreduce(MPI_IN_PLACE, &fits_alltoallv, 1, MPI_INT, MPI_LAND, workers_comm);
+
+    if (0 != fits_alltoallv)
+    {
+        int *counts = (int *)calloc(4 * workers_count, sizeof(int));
+
+        if (NULL == counts)
+        {
+            log_message(LOG_ERROR, "Worker: %s(): The worker nr. %d is out of memory! .\n", __FUNCTION__, worker_rank);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+
+        for (int i = 0; i < workers_count; ++i)
+        {
+            counts[i] = send_sizes[i];
+            counts[workers_count + i] = send_offsets[i];
+            counts[2 * workers_count + i] = shuffled->sizes[i];
+            counts[3 * workers_count + i] = receive_offsets[i];
+        }
+
+        MPI_Alltoallv(send_buffer.data, counts, counts + workers_count, MPI_BYTE,
+                      shuffled->data, counts + 2 * workers_count, counts + 3 * workers_count, MPI_BYTE, workers_comm);
+        free(counts);
     }
     else
     {
-        /* parse all the files from the directory */
-        file_from_dir = get_next_file_from_dir(input_directory);
+        /* Large volumes are sent in chunks with nonblocking messages.
+         * The messages between two workers are not overtaking, so the chunks arrive in order. */
+        int requests_count = 0;
+        MPI_Request *requests = NULL;
 
-        while (NULL != file_from_dir)
+        for (int i = 0; i < workers_count; ++i)
+        {
+            requests_count += (send_sizes[i] + SHUFFLE_CHUNK_SIZE - 1) / SHUFFLE_CHUNK_SIZE;
+            requests_count += (shuffled->sizes[i] + SHUFFLE_CHUNK_SIZE - 1) / SHUFFLE_CHUNK_SIZE;
+        }
+
+        requests = (MPI_Request *)calloc(requests_count + 1, sizeof(MPI_Request));
+
+        if (NULL == requests)
         {
-            if ('/' != input_dir_path[strlen(input_dir_path) - 1])
+            log_message(LOG_ERROR, "Worker: %s(): The worker nr. %d is out of memory! .\n", __FUNCTION__, worker_rank);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+
+        requests_count = 0;
+
+        for (int i = 0; i < workers_count; ++i)
+        {
+            for (uint64_t offset = 0; offset < shuffled->sizes[i]; offset += SHUFFLE_CHUNK_SIZE)
             {
-                snprintf(input_file_path, MAX_PATH, "%s/%s", input_dir_path, file_from_dir->d_name);
+                int chunk = (shuffled->sizes[i] - offset < SHUFFLE_CHUNK_SIZE) ? (int)(shuffled->sizes[i] - offset) : SHUFFLE_CHUNK_SIZE;
+
+                MPI_Irecv(shuffled->data + receive_offsets[i] + offset, chunk, MPI_BYTE, i, TAG_WORK, workers_comm, &requests[requests_count++]);
             }
-            else
+
+            for (uint64_t offset = 0; offset < send_sizes[i]; offset += SHUFFLE_CHUNK_SIZE)
             {
-                snprintf(input_file_path, MAX_PATH, "%s%s", input_dir_path, file_from_dir->d_name);
+                int chunk = (send_sizes[i] - offset < SHUFFLE_CHUNK_SIZE) ? (int)(send_sizes[i] - offset) : SHUFFLE_CHUNK_SIZE;
+
+                MPI_Isend(send_buffer.data + send_offsets[i] + offset, chunk, MPI_BYTE, i, TAG_WORK, workers_comm, &requests[requests_count++]);
             }
+        }
+
+        MPI_Waitall(requests_count, requests, MPI_STATUSES_IGNORE);
+        free(requests);
+    }
+
+    log_message(LOG_DEBUG, "Worker: %s(): The worker nr. %d sent %llu bytes and received %llu bytes in the shuffle.\n",
+                __FUNCTION__, worker_rank, (unsigned long long)send_total, (unsigned long long)receive_total);
+
+    byte_buffer_free(&send_buffer);
+    free(send_offsets);
+    free(send_sizes);
+    free(receive_offsets);
+}
+
+/**
+ * @brief Function called by a worker to do the work durring reduce phase.
+ *        The runs of the key range are merged once, the lines of the result and the block of the index are spooled,
+ *        which gives their sizes. A key range copied from the previous result is not merged.
+ * @param[in] worker_rank      - The process rank
+ * @param[in] options          - The command line options
+ * @param[in] splits           - The key ranges of the reducers
+ * @param[in] shuffled         - The runs received in the MPI shuffle or NULL if they are read from the output directory
+ * @param[out] merger          - The merger of the runs
+ * @param[out] output          - The spooled result and index block
+ * @param[out] task            - The key range received from master and the bytes of the result and index of the worker
+ * @return void
+ **/
+static void worker_reduce_phase(const int worker_rank, const Options *options, const KeySplits *splits,
+                                const ShuffleInput *shuffled, RunMerger *merger, ReduceOutput *output, ReduceTask *task)
+{
+    DIR *input_directory = NULL;
+    File *file_from_dir = NULL;
+
+    const char *input_dir_path = options->output_dir_path;
+    char input_file_path[MAX_PATH] = {'\0'};
+    int merge_result = 0;
+    uint64_t offset = 0;
+    ByteBuffer line = {0};
+    IndexWriter writer = {0};
 
-            /* open the input file and reduce for the received bounds */
-            input_file = fopen(input_file_path, "r");
+    MPI_Status master_status = {0};
+    RunReader run = {0};
+    double wait_start = MPI_Wtime();
+
+    MPI_Recv(task, sizeof(ReduceTask), MPI_BYTE, MPI_ANY_SOURCE, TAG_WORK, MPI_COMM_WORLD, &master_status);
+    metrics_add_time(METRIC_RECV_BLOCKED_SECONDS, wait_start);
+    log_message(LOG_DEBUG, "Worker: %s(): The worker nr. %d received the partition %d for reduce phase.\n",
+                __FUNCTION__, worker_rank, task->partition);
+    task->failed = 0;
 
-            if (NULL == input_file)
+    if (0 != task->copy_previous)
+    {
+        /* The key range didn't change since the previous run, its length is known */
+    }
+    else if (NULL != shuffled)
+    {
+        /* The shuffle already delivered the partition of this worker (the worker i + 1 reduces the partition i) */
+        for (int i = 0; i < shuffled->sources_count; ++i)
+        {
+            if (0 != run_reader_open_buffer(&run, shuffled->data + offset, shuffled->sizes[i]))
+            {
+                log_message(LOG_ERROR, "Worker: %s(): The worker nr. %d received an invalid run from worker %d.\n", __FUNCTION__, worker_rank, i + 1);
+                task->failed = 1;
+            }
+            else if (0 != run_merger_add(merger, &run))
             {
-                log_message(stderr, "Worker: %s(): The worker nr. %d failed to open file: %s.\n", __FUNCTION__, worker_rank, input_file_path);
+                log_message(LOG_ERROR, "Worker: %s(): The worker nr. %d is out of memory! .\n", __FUNCTION__, worker_rank);
+                task->failed = 1;
             }
-            else
+
+            offset += shuffled->sizes[i];
+        }
+    }
+    else if (NULL == (input_directory = opendir(input_dir_path)))
+    {
+        log_message(LOG_ERROR, "Worker: %s(): The worker nr. %d failed to open dir: %s.\n", __FUNCTION__, worker_rank, input_dir_path);
+        task->failed = 1;
+    }
+    else
+    {
+        /* open all the runs from the directory */
+        file_from_dir = get_next_file_from_dir(input_directory);
+
+        while (NULL != file_from_dir)
+        {
+            /* The directory also holds the documents table and the result, skip them */
+            if (0 != worker_is_run_file(file_from_dir->d_name))
             {
-                /* Get the first line (representing the input file) */
-                while (NULL != fgets(file_name, MAX_PATH, input_file))
+                utils_join_path(input_file_path, input_dir_path, file_from_dir->d_name);
+
+                if (0 != run_reader_open_partition(&run, input_file_path, 0))
                 {
-                    file_name[strlen(file_name) - 1] = '\0';
-                    /* Now read all the words from that file */
-                    while ((NULL != fgets(line, MAX_LINE_SIZE, input_file)) && (0 != strcmp(line, "\n")))
-                    {
-                        line[strlen(line) - 1] = '\0';
-                        sscanf(line, "%[^:]:%d", word, &count);
-
-                        /* process only the words from the given limit */
-                        if ((bounds_for_reduce[0] <= word[0]) && (word[0] <= bounds_for_reduce[1]))
-                        {
-                            if (0 != insert_file_into_dictionary(result, word, file_name, count))
-                            {
-                                log_message(stderr, "Worker: %s(): The worker nr. %d failed to insert into dictionary.\n",
-                                            __FUNCTION__, worker_rank);
-                            }
-                        }
-
-                        /* clear the buffer to be reused */
-                        memset(line, '\0', MAX_LINE_SIZE);
-                        memset(word, '\0', MAX_WORD_SIZE);
-                        count = 0;
-                    }
-
-                    /* clear the buffer to be reused */
-                    memset(file_name, '\0', MAX_PATH);
+                    log_message(LOG_ERROR, "Worker: %s(): The worker nr. %d failed to open file: %s.\n", __FUNCTION__, worker_rank, input_file_path);
+                    task->failed = 1;
                 }
-
-                if (0 != fclose(input_file))
+                else if (0 != run_merger_add(merger, &run))
                 {
-                    log_message(stderr, "Worker: %s(): The worker nr. %d failed to close file '%s'.\n", __FUNCTION__, worker_rank, input_file_path);
+                    log_message(LOG_ERROR, "Worker: %s(): The worker nr. %d is out of memory! .\n", __FUNCTION__, worker_rank);
+                    task->failed = 1;
                 }
             }
 
             /* get another file */
             file_from_dir = get_next_file_from_dir(input_directory);
         }
+
+        closedir(input_directory);
+    }
+
+    /* The workers need the size of their results to write them together, so the merged key range is spooled */
+    if (0 == task->copy_previous)
+    {
+        task->length = 0;
+        task->index_length = 0;
+        output->result = worker_open_spool(worker_rank, options->scratch_dir_path, "result");
+        output->index = worker_open_spool(worker_rank, options->scratch_dir_path, "index");
+        merge_result = ((NULL == output->result) || (NULL == output->index)) ? -1 : 0;
+
+        if (0 == merge_result)
+        {
+            index_writer_begin(&writer, output->index);
+            run_merger_begin(merger, splits, task->partition);
+
+            while (1 == (merge_result = run_merger_next(merger)))
+            {
+                line.length = 0;
+
+                if ((0 != worker_reduce_term(options->job, merger, &line)) ||
+                    (line.length != fwrite(line.data, 1, line.length, output->result)) ||
+                    (0 != index_writer_add(&writer, merger->term, merger->term_length, merger->documents, merger->counts, merger->postings_length)))
+                {
+                    merge_result = -1;
+                    break;
+                }
+
+                task->length += line.length;
+            }
+
+            metrics_add(METRIC_UNIQUE_TERMS, writer.terms);
+
+            if ((0 != index_writer_end(&writer, &task->index_length)) || (0 != fflush(output->result)) || (0 != fflush(output->index)))
+            {
+                merge_result = -1;
+            }
+        }
+    }
+
+    if (0 != merge_result)
+    {
+        log_message(LOG_ERROR, "Worker: %s(): The worker nr. %d failed to merge the runs.\n", __FUNCTION__, worker_rank);
+        task->failed = 1;
     }
 
+    byte_buffer_free(&line);
+
     /* Notify that the worker finished */
-    log_message(stdout, "Worker: %s(): The worker nr. %d finished the reduce for the bounds: [%c, %c].\n",
-                __FUNCTION__, worker_rank, bounds_for_reduce[0], bounds_for_reduce[1]);
-    MPI_Send(bounds_for_reduce, sizeof(bounds_for_reduce), MPI_CHAR, master_status.MPI_SOURCE, TAG_SLEEP, MPI_COMM_WORLD);
+    log_message(LOG_DEBUG, "Worker: %s(): The worker nr. %d finished the reduce for the partition %d (%d runs, %llu bytes of result).\n",
+                __FUNCTION__, worker_rank, task->partition, merger->runs_length, (unsigned long long)task->length);
+    MPI_Send(task, sizeof(ReduceTask), MPI_BYTE, master_status.MPI_SOURCE, TAG_SLEEP, MPI_COMM_WORLD);
 }
 
 /**
- * @brief Function called by worker to write the result
+ * @brief Function called by worker to open a spool of its reduce output into the scratch directory.
+ *        It is removed at once, so it disappears with the worker even if the job fails.
+ * @param[in] worker_rank      - The process rank
+ * @param[in] scratch_dir_path - The scratch directory
+ * @param[in] name             - Name of the spool ("result" or "index")
+ * @return The spool or NULL in case of error
+ **/
+static FILE *worker_open_spool(const int worker_rank, const char *scratch_dir_path, const char *name)
+{
+    char spool_file_name[MAX_PATH] = {'\0'};
+    char spool_file_path[MAX_PATH] = {'\0'};
+    FILE *spool = NULL;
+
+    snprintf(spool_file_name, MAX_PATH, SPOOL_FILE_FORMAT, worker_rank, name);
+    utils_join_path(spool_file_path, scratch_dir_path, spool_file_name);
+
+    if (NULL == (spool = fopen(spool_file_path, "w+b")))
+    {
+        log_message(LOG_ERROR, "Worker: %s(): The worker nr. %d failed to open file '%s'.\n", __FUNCTION__, worker_rank, spool_file_path);
+    }
+    else if (0 != unlink(spool_file_path))
+    {
+        log_message(LOG_ERROR, "Worker: %s(): The worker nr. %d failed to remove file '%s'.\n", __FUNCTION__, worker_rank, spool_file_path);
+    }
+
+    return spool;
+}
+
+/**
+ * @brief Function called by worker to write the result and the index from its spools.
+ *        The workers write their key ranges together into the result file, in the order of the ranges.
+ *        Then all the ranks agree on whether the write failed, so that master drops the manifest if one of them did.
  * @param[in] worker_rank     - The process rank
  * @param[in] output_dir_path - Path of the directory in which the result is stored
- * @param[in] result          - Dictionary that contains the result that will be stored
+ * @param[in] output          - The spooled result and index block
+ * @param[in] task            - The key range and the bytes of the result and index of the worker
  * @return void
  **/
-static void worker_store_result_phase(const int worker_rank, const char *output_dir_path, Dictionary *result)
+static void worker_store_result_phase(const int worker_rank, const char *output_dir_path, const ReduceOutput *output, const ReduceTask *task)
 {
-    FILE *output_file = NULL;
-    char output_file_name[MAX_PATH] = {'\0'};
     char output_file_path[MAX_PATH] = {'\0'};
-    MPI_Status master_status = {0};
+    OrderedFile output_file = {0};
+    int error_code = 0;
+    double start_time = MPI_Wtime();
+    double end_time = 0.0;
 
-    MPI_Recv(output_file_name, MAX_PATH, MPI_CHAR, MPI_ANY_SOURCE, TAG_WORK, MPI_COMM_WORLD, &master_status);
+    utils_join_path(output_file_path, output_dir_path, RESULT_FILE_NAME);
 
-    log_message(stdout, "Worker: %s(): The worker nr. %d received signal to store the result into file: '%s'.\n",
-                __FUNCTION__, worker_rank, output_file_name);
+    if (0 != ordered_file_open(&output_file, output_file_path, task->length))
+    {
+        /* The other workers still write, the file is closed with them */
+    }
+    else if (0 != task->copy_previous)
+    {
+        error_code = worker_copy_previous(worker_rank, output_dir_path, PREVIOUS_RESULT_FILE_NAME, task->offset, task->length, &output_file);
+    }
+    else if (NULL != output->result)
+    {
+        rewind(output->result);
+        error_code = worker_copy_file(worker_rank, output->result, task->length, &output_file);
+    }
+    else
+    {
+        /* The reduce phase failed, there is nothing to write */
+        error_code = -1;
+    }
 
-    if ('/' != output_dir_path[strlen(output_dir_path) - 1])
+    if ((0 != ordered_file_close(&output_file)) || (0 != error_code))
     {
-        snprintf(output_file_path, MAX_PATH, "%s/%s", output_dir_path, output_file_name);
+        log_message(LOG_ERROR, "Worker: %s(): The worker nr. %d failed to write the result into file: '%s'.\n",
+                    __FUNCTION__, worker_rank, output_file_path);
+        error_code = -1;
     }
     else
     {
-        snprintf(output_file_path, MAX_PATH, "%s%s", output_dir_path, output_file_name);
+        log_message(LOG_DEBUG, "Worker: %s(): The worker nr. %d wrote %llu bytes of result into file: '%s'.\n",
+                    __FUNCTION__, worker_rank, (unsigned long long)task->length, output_file_path);
     }
 
-    /* open the file and write the result */
-    output_file = fopen(output_file_path, "a");
+    end_time = MPI_Wtime();
+    trace_span("store", "result", task->partition, NULL, start_time, end_time);
+
+    /* Two ordered files can't be written at the same time, so the index is written after the result is closed */
+    error_code |= worker_store_index(worker_rank, output_dir_path, output, task);
+    trace_span("store", "index", task->partition, NULL, end_time, MPI_Wtime());
+
+    /* The master saves the manifest only if no rank failed to write */
+    error_code = (0 != error_code) ? 1 : 0;
+    MPI_Allreduce(MPI_IN_PLACE, &error_code, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+}
+
+/**
+ * @brief Function called by worker to write its block of the index, after the result
+ * @param[in] worker_rank     - The process rank
+ * @param[in] output_dir_path - Path of the directory in which the index is stored
+ * @param[in] output          - The spooled result and index block
+ * @param[in] task            - The key range and the bytes of the index block of the worker
+ * @return 0 for success or -1 in case of error
+ **/
+static int worker_store_index(const int worker_rank, const char *output_dir_path, const ReduceOutput *output, const ReduceTask *task)
+{
+    char index_file_path[MAX_PATH] = {'\0'};
+    OrderedFile index_file = {0};
+    int error_code = 0;
+
+    utils_join_path(index_file_path, output_dir_path, INDEX_FILE_NAME);
 
-    if (NULL == output_file)
+    if (0 != ordered_file_open(&index_file, index_file_path, task->index_length))
     {
-        log_message(stdout, "Worker: %s(): The worker nr. %d failed to open file: '%s'.\n",
-                    __FUNCTION__, worker_rank, output_file_path);
+        /* The other workers still write, the file is closed with them */
+    }
+    else if (0 != task->copy_previous)
+    {
+        error_code = worker_copy_previous(worker_rank, output_dir_path, PREVIOUS_INDEX_FILE_NAME, task->index_offset, task->index_length, &index_file);
+    }
+    else if (NULL != output->index)
+    {
+        rewind(output->index);
+        error_code = worker_copy_file(worker_rank, output->index, task->index_length, &index_file);
     }
     else
     {
-        /* parse the dictionary and store the result */
-        /* free the dynamicaly allocated memory */
-        for (int i = 0; i < result[0].elements_length; ++i)
-        {
-            fprintf(output_file, "%s: ", result[0].elements[i].key);
+        /* The reduce phase failed, there is nothing to write */
+        error_code = -1;
+    }
 
-            for (int j = 0; j < result[0].elements[i].values_length; ++j)
-            {
-                fprintf(output_file, "<%s: %d>", result[0].elements[i].values[j], result[0].elements[i].counts[j]);
-            }
+    if ((0 != ordered_file_close(&index_file)) || (0 != error_code))
+    {
+        log_message(LOG_ERROR, "Worker: %s(): The worker nr. %d failed to write the index into file: '%s'.\n",
+                    __FUNCTION__, worker_rank, index_file_path);
+        error_code = -1;
+    }
+    else
+    {
+        log_message(LOG_DEBUG, "Worker: %s(): The worker nr. %d wrote %llu bytes of index into file: '%s'.\n",
+                    __FUNCTION__, worker_rank, (unsigned long long)task->index_length, index_file_path);
+    }
 
-            fprintf(output_file, "\n");
-        }
+    return error_code;
+}
 
-        log_message(stdout, "Worker: %s(): The worker nr. %d finished to write the result into file: '%s'.\n",
-                    __FUNCTION__, worker_rank, output_file_path);
+/**
+ * @brief Function called by worker to copy its key range from the previous result or index, when it didn't change
+ * @param[in] worker_rank        - The process rank
+ * @param[in] output_dir_path    - Path of the directory in which the result is stored
+ * @param[in] previous_file_name - Name of the previous result or index
+ * @param[in] offset             - Offset of the key range in the previous file
+ * @param[in] length             - Bytes of the key range
+ * @param[in,out] output_file    - The result or index file
+ * @return 0 for success or -1 in case of error
+ **/
+static int worker_copy_previous(const int worker_rank, const char *output_dir_path, const char *previous_file_name,
+                                 uint64_t offset, uint64_t length, OrderedFile *output_file)
+{
+    char previous_file_path[MAX_PATH] = {'\0'};
+    FILE *previous_file = NULL;
+    int error_code = -1;
+
+    utils_join_path(previous_file_path, output_dir_path, previous_file_name);
+
+    if ((NULL == (previous_file = fopen(previous_file_path, "rb"))) || (0 != fseeko(previous_file, offset, SEEK_SET)))
+    {
+        log_message(LOG_ERROR, "Worker: %s(): The worker nr. %d failed to open file: %s.\n", __FUNCTION__, worker_rank, previous_file_path);
+    }
+    else if (0 != worker_copy_file(worker_rank, previous_file, length, output_file))
+    {
+        log_message(LOG_ERROR, "Worker: %s(): The worker nr. %d failed to read file: %s.\n", __FUNCTION__, worker_rank, previous_file_path);
+    }
+    else
+    {
+        error_code = 0;
+    }
+
+    if (NULL != previous_file)
+    {
+        fclose(previous_file);
+    }
+
+    return error_code;
+}
 
-        if (0 != fclose(output_file))
+/**
+ * @brief Function called by worker to copy bytes of a file into the result or the index
+ * @param[in] worker_rank     - The process rank
+ * @param[in] input_file      - The file, at the first byte to copy
+ * @param[in] length          - Number of bytes to copy
+ * @param[in,out] output_file - The result or index file
+ * @return 0 for success or -1 in case of error
+ **/
+static int worker_copy_file(const int worker_rank, FILE *input_file, uint64_t length, OrderedFile *output_file)
+{
+    char *buffer = (char *)malloc(ORDERED_FILE_CHUNK_SIZE);
+    uint64_t copied = 0;
+
+    if (NULL == buffer)
+    {
+        log_message(LOG_ERROR, "Worker: %s(): The worker nr. %d is out of memory! .\n", __FUNCTION__, worker_rank);
+        return -1;
+    }
+
+    while (copied < length)
+    {
+        size_t chunk_size = (ORDERED_FILE_CHUNK_SIZE < length - copied) ? ORDERED_FILE_CHUNK_SIZE : length - copied;
+
+        if ((chunk_size != fread(buffer, 1, chunk_size, input_file)) || (0 != ordered_file_write(output_file, buffer, chunk_size)))
         {
-            log_message(stderr, "Worker: %s(): The worker nr. %d failed to close file '%s'.\n", __FUNCTION__, worker_rank, output_file_path);
+            break;
         }
+
+        copied += chunk_size;
     }
 
-    /* Notify that the worker finished */
-    MPI_Send(output_file_path, MAX_PATH, MPI_CHAR, master_status.MPI_SOURCE, TAG_WORK, MPI_COMM_WORLD);
+    free(buffer);
+
+    return (copied == length) ? 0 : -1;
+}
 
-    /* Receive the master's feedback */
-    MPI_Recv(output_file_path, MAX_PATH, MPI_CHAR, MPI_ANY_SOURCE, TAG_SLEEP, MPI_COMM_WORLD, &master_status);
-    /* My job is done here */
+/**
+ * @brief Function called by worker to reduce the merged term into a line of the result, with the job's reduce
+ * @param[in] job    - The job
+ * @param[in] merger - The merger
+ * @param[out] line  - The buffer in which the line is appended
+ * @return 0 for success or -1 in case of error
+ **/
+static int worker_reduce_term(const Job *job, const RunMerger *merger, ByteBuffer *line)
+{
+    return job->reduce(merger->term, merger->term_length, merger->documents, merger->counts, merger->postings_length, line);
+}
+
+/**
+ * @brief Function called by worker to check if a file is a run written in the map phase
+ * @param[in] file_name - The file name
+ * @return 1 if the file is a run, 0 otherwise
+ **/
+static int worker_is_run_file(const char *file_name)
+{
+    size_t name_length = strlen(file_name);
+    size_t suffix_length = strlen(RUN_FILE_SUFFIX);
+
+    return (name_length > suffix_length) && (0 == strcmp(file_name + name_length - suffix_length, RUN_FILE_SUFFIX));
 }
 
 /*******************************************
@@ -352,19 +1441,75 @@ static void worker_store_result_phase(const int worker_rank, const char *output_
 /**
  * @brief   Function called by a worker to do the tasks assigned by master
  * @param[in] worker_rank - The curently process rank
- * @param[in] output_dir_path - The directory path in which the result will be stored
+ * @param[in] options     - The command line options
  * @return void
  **/
-void do_worker(const int worker_rank, const char *output_dir_path)
+void do_worker(const int worker_rank, const Options *options)
 {
-    Dictionary reduce_phase_result = {0};
+    RunMerger reduce_runs = {0};
+    ReduceTask reduce_task = {0};
+    ReduceOutput reduce_output = {NULL, NULL};
+    Dictionary memory_map_output = {0};
+    MapOutput map_output = {options->output_dir_path, NULL, NULL, NULL, options->memory_budget, options->scratch_dir_path, 0, options->job};
+    ShuffleInput shuffled = {0};
+    KeySplits splits = {0};
+    MPI_Comm workers_comm = MPI_COMM_NULL;
+    double start = MPI_Wtime();
+    double phase_start = start;
+
+    map_output.histogram = (uint64_t *)calloc(PREFIX_HISTOGRAM_SIZE, sizeof(uint64_t));
+
+    if (NULL == map_output.histogram)
+    {
+        log_message(LOG_ERROR, "Worker: %s(): The worker nr. %d is out of memory! .\n", __FUNCTION__, worker_rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    if (0 != options->memory_shuffle)
+    {
+        /* The ranks keep their order, so the worker i + 1 has the rank i into workers_comm */
+        MPI_Comm_split(MPI_COMM_WORLD, 1, worker_rank, &workers_comm);
+        map_output.memory = &memory_map_output;
+    }
 
-    log_message(stdout, "Worker: %s(): The worker nr. %d: Hello guys!\n", __FUNCTION__, worker_rank);
-    worker_map_phase(worker_rank, output_dir_path);
-    worker_reduce_phase(worker_rank, output_dir_path, &reduce_phase_result);
-    worker_store_result_phase(worker_rank, output_dir_path, &reduce_phase_result);
-    log_message(stdout, "Worker: %s(): The worker nr. %d: Good bye guys! See you tomorrow!\n", __FUNCTION__, worker_rank);
+    log_message(LOG_INFO, "Worker: %s(): The worker nr. %d: Hello guys! I run the job '%s' and tokenize with %s.\n",
+                __FUNCTION__, worker_rank, options->job->name, tokenizer_implementation());
+
+    /* The scratch directory may be local to the node of the worker, so master can't see it */
+    remove_temporary_runs(options->scratch_dir_path, worker_rank);
+    worker_map_phase(worker_rank, options, &map_output);
+    phase_start = metrics_add_time(METRIC_MAP_SECONDS, phase_start);
+    worker_partition_phase(map_output.histogram, &splits);
+    phase_start = metrics_add_time(METRIC_PARTITION_SECONDS, phase_start);
+
+    if (0 != options->memory_shuffle)
+    {
+        worker_shuffle_phase(worker_rank, workers_comm, &splits, &memory_map_output, &shuffled);
+        MPI_Comm_free(&workers_comm);
+        phase_start = metrics_add_time(METRIC_SHUFFLE_SECONDS, phase_start);
+    }
+
+    worker_reduce_phase(worker_rank, options, &splits, (0 != options->memory_shuffle) ? &shuffled : NULL,
+                        &reduce_runs, &reduce_output, &reduce_task);
+    run_merger_close(&reduce_runs);
+    phase_start = metrics_add_time(METRIC_REDUCE_SECONDS, phase_start);
+    worker_store_result_phase(worker_rank, options->output_dir_path, &reduce_output, &reduce_task);
+    metrics_add(METRIC_JOB_SECONDS, metrics_add_time(METRIC_STORE_SECONDS, phase_start) - start);
+    log_message(LOG_INFO, "Worker: %s(): The worker nr. %d: Good bye guys! See you tomorrow!\n", __FUNCTION__, worker_rank);
 
     /* free the dynamicaly allocated memory */
-    free_dictionary(&reduce_phase_result);
+    if (NULL != reduce_output.result)
+    {
+        fclose(reduce_output.result);
+    }
+
+    if (NULL != reduce_output.index)
+    {
+        fclose(reduce_output.index);
+    }
+
+    free(shuffled.data);
+    free(shuffled.sizes);
+    free(splits.splits);
+    free(map_output.histogram);
 }
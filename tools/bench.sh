@@ -0,0 +1,127 @@
+#!/bin/bash
+# End-to-end benchmark of bin/dmr.out over synthetic corpora (see tools/dmr_corpus.c).
+#
+# For every process count of BENCH_NP the job is run over
+#   strong: the same corpus of BENCH_FILES files
+#   weak  : a corpus of BENCH_FILES_PER_WORKER files for every worker
+# and one JSON line is appended to BENCH_RESULTS for every run, with the phase wall times
+# from the master log, MB/s, tokens/s, the scaling efficiency against the first process count
+# and the metrics of all the ranks (metrics.json).
+# The corpora are generated once and kept in BENCH_DIR.
+#
+# Usage: tools/bench.sh (or make bench), configured with the variables below.
+
+BENCH_NP=${BENCH_NP:-"2 3 5"}
+BENCH_FILES=${BENCH_FILES:-64}
+BENCH_FILES_PER_WORKER=${BENCH_FILES_PER_WORKER:-16}
+BENCH_FILE_SIZE=${BENCH_FILE_SIZE:-1048576}
+BENCH_VOCABULARY=${BENCH_VOCABULARY:-50000}
+BENCH_SKEW=${BENCH_SKEW:-1.0}
+BENCH_SIZE_SPREAD=${BENCH_SIZE_SPREAD:-1.0}
+BENCH_SEED=${BENCH_SEED:-1}
+BENCH_DIR=${BENCH_DIR:-bench}
+BENCH_RESULTS=${BENCH_RESULTS:-$BENCH_DIR/results.jsonl}
+MPIRUN=${MPIRUN:-mpirun}
+MPIRUN_FLAGS=${MPIRUN_FLAGS:-}
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+BENCH_LABEL=${BENCH_LABEL:-$(git -C "$ROOT" describe --always --dirty 2>/dev/null || echo unknown)}
+DMR="$ROOT/bin/dmr.out"
+CORPUS="$ROOT/bin/dmr_corpus.out"
+
+mkdir -p "$BENCH_DIR" || exit 1
+BENCH_DIR=$(cd "$BENCH_DIR" && pwd)
+BENCH_RESULTS=$(cd "$(dirname "$BENCH_RESULTS")" && pwd)/$(basename "$BENCH_RESULTS")
+
+# corpus_dir <files>: the directory of a corpus, named after all its parameters
+corpus_dir()
+{
+    echo "$BENCH_DIR/corpus-f$1-s$BENCH_FILE_SIZE-v$BENCH_VOCABULARY-z$BENCH_SKEW-S$BENCH_SIZE_SPREAD-r$BENCH_SEED"
+}
+
+# corpus <files>: generates the corpus once, prints its JSON description
+corpus()
+{
+    local dir
+
+    dir=$(corpus_dir "$1")
+
+    if [ ! -f "$dir.json" ]; then
+        rm -rf "$dir"
+        "$CORPUS" -f "$1" -s "$BENCH_FILE_SIZE" -v "$BENCH_VOCABULARY" -z "$BENCH_SKEW" -S "$BENCH_SIZE_SPREAD" \
+                  -r "$BENCH_SEED" "$dir" > "$dir.json" || { rm -f "$dir.json"; return 1; }
+    fi
+
+    cat "$dir.json"
+}
+
+# json_field <json> <field>
+json_field()
+{
+    echo "$1" | sed -n "s/.*\"$2\": \([0-9.e+-]*\).*/\1/p"
+}
+
+# run <mode> <np> <files> <base seconds> <base workers>: runs the job, prints its seconds
+run()
+{
+    local mode=$1 np=$2 files=$3 base_seconds=$4 base_workers=$5
+    local workers=$((np - 1))
+    local description bytes tokens work seconds phases metrics efficiency
+
+    description=$(corpus "$files") || { echo "Failed to generate the corpus of $files files" >&2; return 1; }
+    bytes=$(json_field "$description" bytes)
+    tokens=$(json_field "$description" tokens)
+
+    # A fresh output directory, so the job is not an incremental update. The logs go into the work directory.
+    work="$BENCH_DIR/run"
+    rm -rf "$work" && mkdir -p "$work/output" || return 1
+
+    if ! (cd "$work" && DMR_LOG_LEVEL=info $MPIRUN $MPIRUN_FLAGS -np "$np" "$DMR" "$(corpus_dir "$files")" "$work/output" > run.txt 2>&1); then
+        echo "The run $mode np=$np failed, see $work/run.txt" >&2
+        return 1
+    fi
+
+    seconds=$(sed -n 's/.*The job took \([0-9.]*\) seconds.*/\1/p' "$work/log0.txt")
+    phases=$(sed -n 's/.*The \([a-z]*\) phase took \([0-9.]*\) seconds.*/"\1": \2/p' "$work/log0.txt" | paste -sd, - | sed 's/,/, /g')
+    metrics=$(tr -s ' \n' ' ' < "$work/output/metrics.json")
+
+    # strong: T(base) * base workers / (T * workers), weak: T(base) / T
+    if [ "$mode" = strong ]; then
+        efficiency=$(awk -v b="${base_seconds:-$seconds}" -v bw="${base_workers:-$workers}" -v t="$seconds" -v w="$workers" 'BEGIN { printf "%.3f", b * bw / (t * w) }')
+    else
+        efficiency=$(awk -v b="${base_seconds:-$seconds}" -v t="$seconds" 'BEGIN { printf "%.3f", b / t }')
+    fi
+
+    awk -v label="$BENCH_LABEL" -v mode="$mode" -v np="$np" -v w="$workers" -v bytes="$bytes" -v tokens="$tokens" \
+        -v t="$seconds" -v phases="$phases" -v e="$efficiency" -v metrics="${metrics:-null}" -v corpus="$description" 'BEGIN {
+        printf "{\"label\": \"%s\", \"mode\": \"%s\", \"np\": %d, \"workers\": %d, \"seconds\": %.3f, \"phases\": {%s}, ", label, mode, np, w, t, phases
+        printf "\"mb_per_s\": %.2f, \"tokens_per_s\": %.0f, \"efficiency\": %s, \"metrics\": %s, \"corpus\": %s}\n", bytes / t / 1e6, tokens / t, e, metrics, corpus
+    }' >> "$BENCH_RESULTS"
+
+    printf "%-6s np=%-3d workers=%-3d %8.3f s %9.2f MB/s %12.0f tokens/s  efficiency %s  (%s)\n" \
+           "$mode" "$np" "$workers" "$seconds" "$(awk -v b="$bytes" -v t="$seconds" 'BEGIN { print b / t / 1e6 }')" \
+           "$(awk -v n="$tokens" -v t="$seconds" 'BEGIN { print n / t }')" "$efficiency" "$phases" >&2
+    echo "$seconds"
+}
+
+for mode in strong weak; do
+    base_seconds=""
+    base_workers=""
+
+    for np in $BENCH_NP; do
+        workers=$((np - 1))
+        files=$BENCH_FILES
+
+        if [ "$mode" = weak ]; then
+            files=$((BENCH_FILES_PER_WORKER * workers))
+        fi
+
+        seconds=$(run "$mode" "$np" "$files" "$base_seconds" "$base_workers") || exit 1
+
+        base_seconds=${base_seconds:-$seconds}
+        base_workers=${base_workers:-$workers}
+    done
+done
+
+rm -rf "$BENCH_DIR/run"
+echo "Results appended to $BENCH_RESULTS" >&2
@@ -0,0 +1,332 @@
+/*******************************************
+ *              INCLUDES
+ ******************************************/
+#include <stdio.h>     /* FILE            */
+#include <stdlib.h>    /* dynamic memory  */
+#include <string.h>    /* strerror        */
+#include <errno.h>     /* errno           */
+#include <math.h>      /* pow             */
+#include <unistd.h>    /* getopt          */
+#include <sys/stat.h>  /* mkdir           */
+#include "utils.h"     /* MAX_PATH        */
+
+/*******************************************
+ *                DEFINES
+ ******************************************/
+#define DEFAULT_FILES 64
+#define DEFAULT_FILE_SIZE (1024 * 1024)
+#define DEFAULT_VOCABULARY 50000
+#define DEFAULT_SKEW 1.0
+#define DEFAULT_SIZE_SPREAD 1.0
+#define MAX_WORD_SIZE 32
+#define MIN_WORD_LENGTH 2
+#define MAX_WORD_LENGTH 12
+#define WORDS_PER_LINE 12
+#define CORPUS_FILE_FORMAT "doc%06d.txt"
+
+/*******************************************
+ *                TYPES
+ ******************************************/
+
+/* struct used to store the parameters of a corpus. The same parameters always give the same corpus. */
+typedef struct CorpusOptions_
+{
+    int files;
+    uint64_t file_size;   /* Mean bytes of a file */
+    int vocabulary;       /* Number of different words */
+    double skew;          /* Exponent of the Zipf distribution of the words (0 is uniform) */
+    double size_spread;   /* Sigma of the log-normal distribution of the file sizes (0 is equal sizes) */
+    uint64_t seed;
+} CorpusOptions;
+
+/*******************************************
+ *       STATIC FUNCTION DECLARATION
+ ******************************************/
+
+/**
+ * @brief   Function used to generate the next pseudo random number (splitmix64)
+ * @param[in,out] state - The generator state
+ * @return  The number
+ **/
+static uint64_t corpus_random(uint64_t *state);
+
+/**
+ * @brief   Function used to generate a pseudo random number in [0, 1)
+ * @param[in,out] state - The generator state
+ * @return  The number
+ **/
+static double corpus_uniform(uint64_t *state);
+
+/**
+ * @brief   Function used to generate the words. Every word ends with its index in base 26, so they are different.
+ * @param[in] options - The corpus parameters
+ * @param[in,out] state - The generator state
+ * @return  options->vocabulary words of MAX_WORD_SIZE bytes or NULL in case of error
+ **/
+static char *corpus_words(const CorpusOptions *options, uint64_t *state);
+
+/**
+ * @brief   Function used to compute the cumulative Zipf distribution of the words
+ * @param[in] options - The corpus parameters
+ * @return  options->vocabulary cumulative weights or NULL in case of error
+ **/
+static double *corpus_distribution(const CorpusOptions *options);
+
+/**
+ * @brief   Function used to pick a word from the cumulative distribution
+ * @param[in] distribution - The cumulative weights
+ * @param[in] length       - Number of words
+ * @param[in,out] state    - The generator state
+ * @return  The index of the word
+ **/
+static int corpus_pick_word(const double *distribution, int length, uint64_t *state);
+
+/*******************************************
+ *       STATIC FUNCTION DEFINITION
+ ******************************************/
+
+/**
+ * @brief   Function used to generate the next pseudo random number (splitmix64)
+ * @param[in,out] state - The generator state
+ * @return  The number
+ **/
+static uint64_t corpus_random(uint64_t *state)
+{
+    uint64_t value = (*state += 0x9E3779B97F4A7C15ULL);
+
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+
+    return value ^ (value >> 31);
+}
+
+/**
+ * @brief   Function used to generate a pseudo random number in [0, 1)
+ * @param[in,out] state - The generator state
+ * @return  The number
+ **/
+static double corpus_uniform(uint64_t *state)
+{
+    return (corpus_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * @brief   Function used to generate the words. Every word ends with its index in base 26, so they are different.
+ * @param[in] options - The corpus parameters
+ * @param[in,out] state - The generator state
+ * @return  options->vocabulary words of MAX_WORD_SIZE bytes or NULL in case of error
+ **/
+static char *corpus_words(const CorpusOptions *options, uint64_t *state)
+{
+    char *words = (char *)calloc(options->vocabulary, MAX_WORD_SIZE);
+    int suffix_length = 1;
+
+    for (int capacity = 26; capacity < options->vocabulary; capacity *= 26)
+    {
+        ++suffix_length;
+    }
+
+    for (int i = 0; (NULL != words) && (i < options->vocabulary); ++i)
+    {
+        char *word = words + i * MAX_WORD_SIZE;
+        int length = MIN_WORD_LENGTH + corpus_random(state) % (MAX_WORD_LENGTH - MIN_WORD_LENGTH + 1);
+        int index = i;
+
+        length = (length > suffix_length) ? length : suffix_length;
+
+        for (int j = 0; j < length - suffix_length; ++j)
+        {
+            word[j] = 'a' + corpus_random(state) % 26;
+        }
+
+        for (int j = length - 1; j >= length - suffix_length; --j)
+        {
+            word[j] = 'a' + index % 26;
+            index /= 26;
+        }
+    }
+
+    return words;
+}
+
+/**
+ * @brief   Function used to compute the cumulative Zipf distribution of the words
+ * @param[in] options - The corpus parameters
+ * @return  options->vocabulary cumulative weights or NULL in case of error
+ **/
+static double *corpus_distribution(const CorpusOptions *options)
+{
+    double *distribution = (double *)malloc(options->vocabulary * sizeof(double));
+    double sum = 0;
+
+    for (int i = 0; (NULL != distribution) && (i < options->vocabulary); ++i)
+    {
+        sum += 1.0 / pow(i + 1, options->skew);
+        distribution[i] = sum;
+    }
+
+    return distribution;
+}
+
+/**
+ * @brief   Function used to pick a word from the cumulative distribution
+ * @param[in] distribution - The cumulative weights
+ * @param[in] length       - Number of words
+ * @param[in,out] state    - The generator state
+ * @return  The index of the word
+ **/
+static int corpus_pick_word(const double *distribution, int length, uint64_t *state)
+{
+    double value = corpus_uniform(state) * distribution[length - 1];
+    int low = 0;
+    int high = length - 1;
+
+    while (low < high)
+    {
+        int middle = low + (high - low) / 2;
+
+        if (distribution[middle] <= value)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+/*******************************************
+ *                 MAIN
+ ******************************************/
+int main(int argc, char **argv)
+{
+    char file_path[MAX_PATH] = {'\0'};
+    char file_name[MAX_PATH] = {'\0'};
+    int option = -1;
+    int invalid_option = 0;
+    int error_code = 0;
+    uint64_t state = 0;
+    uint64_t total_bytes = 0;
+    uint64_t total_words = 0;
+    char *words = NULL;
+    double *distribution = NULL;
+    CorpusOptions options = {DEFAULT_FILES, DEFAULT_FILE_SIZE, DEFAULT_VOCABULARY, DEFAULT_SKEW, DEFAULT_SIZE_SPREAD, 1};
+
+    /* -f: the number of files
+     * -s: the mean bytes of a file
+     * -v: the number of different words
+     * -z: the skew of the words (Zipf exponent)
+     * -S: the spread of the file sizes (log-normal sigma)
+     * -r: the seed */
+    while (-1 != (option = getopt(argc, argv, "f:s:v:z:S:r:")))
+    {
+        switch (option)
+        {
+            case 'f':
+                options.files = atoi(optarg);
+                invalid_option |= (0 >= options.files);
+                break;
+            case 's':
+                options.file_size = strtoull(optarg, NULL, 10);
+                invalid_option |= (0 == options.file_size);
+                break;
+            case 'v':
+                options.vocabulary = atoi(optarg);
+                invalid_option |= (0 >= options.vocabulary);
+                break;
+            case 'z':
+                options.skew = atof(optarg);
+                invalid_option |= (0 > options.skew);
+                break;
+            case 'S':
+                options.size_spread = atof(optarg);
+                invalid_option |= (0 > options.size_spread);
+                break;
+            case 'r':
+                options.seed = strtoull(optarg, NULL, 10);
+                break;
+            default:
+                invalid_option = 1;
+                break;
+        }
+    }
+
+    if ((0 != invalid_option) || (1 != argc - optind))
+    {
+        fprintf(stderr, "Usage: %s [-f files] [-s file_size] [-v vocabulary] [-z skew] [-S size_spread] [-r seed] output_dir\n", argv[0]);
+        return 1;
+    }
+
+    if ((0 != mkdir(argv[optind], 0755)) && (EEXIST != errno))
+    {
+        fprintf(stderr, "Failed to create dir: %s. Errno: %s.\n", argv[optind], strerror(errno));
+        return 1;
+    }
+
+    state = options.seed;
+    words = corpus_words(&options, &state);
+    distribution = corpus_distribution(&options);
+
+    if ((NULL == words) || (NULL == distribution))
+    {
+        fprintf(stderr, "Out of memory!\n");
+        error_code = 1;
+    }
+
+    for (int i = 0; (0 == error_code) && (i < options.files); ++i)
+    {
+        /* Box-Muller normal number, the log-normal size keeps the mean */
+        double normal = sqrt(-2.0 * log(1.0 - corpus_uniform(&state))) * cos(2.0 * M_PI * corpus_uniform(&state));
+        uint64_t size = options.file_size * exp(options.size_spread * normal - options.size_spread * options.size_spread / 2);
+        uint64_t written = 0;
+        FILE *file = NULL;
+
+        snprintf(file_name, MAX_PATH, CORPUS_FILE_FORMAT, i);
+        utils_join_path(file_path, argv[optind], file_name);
+
+        if (NULL == (file = fopen(file_path, "w")))
+        {
+            fprintf(stderr, "Failed to open file: %s. Errno: %s.\n", file_path, strerror(errno));
+            error_code = 1;
+            break;
+        }
+
+        /* At least one word in every file */
+        for (uint64_t j = 0; (0 == j) || (written < size); ++j)
+        {
+            const char *word = words + corpus_pick_word(distribution, options.vocabulary, &state) * MAX_WORD_SIZE;
+            size_t length = strlen(word);
+
+            fwrite(word, 1, length, file);
+            fputc((WORDS_PER_LINE - 1 == j % WORDS_PER_LINE) ? '\n' : ' ', file);
+            written += length + 1;
+            ++total_words;
+        }
+
+        total_bytes += written;
+
+        error_code = (0 != ferror(file)) ? 1 : 0;
+
+        if ((0 != fclose(file)) || (0 != error_code))
+        {
+            fprintf(stderr, "Failed to write file: %s.\n", file_path);
+            error_code = 1;
+        }
+    }
+
+    /* The description of the corpus, for the benchmark */
+    if (0 == error_code)
+    {
+        printf("{\"files\": %d, \"bytes\": %llu, \"tokens\": %llu, \"vocabulary\": %d, \"skew\": %g, \"size_spread\": %g, \"seed\": %llu}\n",
+               options.files, (unsigned long long)total_bytes, (unsigned long long)total_words, options.vocabulary,
+               options.skew, options.size_spread, (unsigned long long)options.seed);
+    }
+
+    free(words);
+    free(distribution);
+
+    return error_code;
+}
@@ -0,0 +1,434 @@
+/*******************************************
+ *              INCLUDES
+ ******************************************/
+#include <stdio.h>      /* stdout/stderr   */
+#include <stdlib.h>     /* dynamic memory  */
+#include <string.h>     /* strlen          */
+#include <time.h>       /* clock_gettime   */
+#include <unistd.h>     /* getopt          */
+#include "index_file.h" /* index           */
+#include "utils.h"      /* utils           */
+#include "logger.h"     /* log             */
+
+/*******************************************
+ *                DEFINES
+ ******************************************/
+#define BENCHMARK_TERMS_COUNT 2 /* Terms of a query of the benchmark */
+
+/*******************************************
+ *                TYPES
+ ******************************************/
+
+/* struct used to map the document IDs to their paths (see DOCUMENTS_FILE_NAME) */
+typedef struct DocumentPaths_
+{
+    char **paths; /* Indexed by document ID, NULL for a missing ID */
+    int length;
+} DocumentPaths;
+
+/*******************************************
+ *       STATIC FUNCTION DECLARATION
+ ******************************************/
+
+/**
+ * @brief   Function used to read the paths of the documents
+ * @param[out] documents      - The paths
+ * @param[in] output_dir_path - The output directory of dmr.out
+ * @return  0 for success or -1 in case of error
+ **/
+static int query_load_documents(DocumentPaths *documents, const char *output_dir_path);
+
+/**
+ * @brief   Function used to get the path of a document
+ * @param[in] documents   - The paths
+ * @param[in] document_id - The document ID
+ * @return  The path or "?" if the ID is unknown
+ **/
+static const char *query_document_path(const DocumentPaths *documents, int document_id);
+
+/**
+ * @brief   Function used to print the terms which start with a prefix, with their number of documents
+ * @param[in] reader - The index
+ * @param[in] prefix - The prefix
+ * @return  void
+ **/
+static void query_print_prefix(const IndexReader *reader, const char *prefix);
+
+/**
+ * @brief   Function used to measure the latency of the lookups and of the queries with BENCHMARK_TERMS_COUNT terms.
+ *          The terms are taken at random from the index.
+ * @param[in] reader     - The index
+ * @param[in] iterations - Number of lookups and of queries
+ * @return  0 for success or -1 in case of error
+ **/
+static int query_benchmark(const IndexReader *reader, int iterations);
+
+/**
+ * @brief   Function used to print the mean, p50 and p99 of the latencies
+ * @param[in] name      - The name of the operation
+ * @param[in] latencies - The latencies in microseconds. They are sorted.
+ * @param[in] length    - Number of latencies
+ * @return  void
+ **/
+static void query_print_latencies(const char *name, double *latencies, int length);
+
+/**
+ * @brief   Function used to compare two latencies for qsort()
+ * @param[in] first  - The first latency
+ * @param[in] second - The second latency
+ * @return  <0, 0 or >0
+ **/
+static int query_compare_latencies(const void *first, const void *second);
+
+/**
+ * @brief   Function used to get the elapsed microseconds from a moment
+ * @param[in] start - The moment
+ * @return  The microseconds
+ **/
+static double query_elapsed_us(const struct timespec *start);
+
+/*******************************************
+ *       STATIC FUNCTION DEFINITION
+ ******************************************/
+
+/**
+ * @brief   Function used to read the paths of the documents
+ * @param[out] documents      - The paths
+ * @param[in] output_dir_path - The output directory of dmr.out
+ * @return  0 for success or -1 in case of error
+ **/
+static int query_load_documents(DocumentPaths *documents, const char *output_dir_path)
+{
+    char documents_file_path[MAX_PATH] = {'\0'};
+    char line[MAX_PATH + 32] = {'\0'};
+    FILE *documents_file = NULL;
+
+    memset(documents, 0, sizeof(DocumentPaths));
+    utils_join_path(documents_file_path, output_dir_path, DOCUMENTS_FILE_NAME);
+
+    if (NULL == (documents_file = fopen(documents_file_path, "r")))
+    {
+        log_message(LOG_ERROR, "Query: %s(): Failed to open file: %s.\n", __FUNCTION__, documents_file_path);
+        return -1;
+    }
+
+    while (NULL != fgets(line, sizeof(line), documents_file))
+    {
+        int document_id = -1;
+        int path_offset = 0;
+
+        line[strcspn(line, "\n")] = '\0';
+
+        if ((1 != sscanf(line, "%d %n", &document_id, &path_offset)) || (0 > document_id) || (0 == path_offset))
+        {
+            continue;
+        }
+
+        if (document_id >= documents->length)
+        {
+            int length = 2 * document_id + 1;
+            char **paths = (char **)realloc(documents->paths, length * sizeof(char *));
+
+            if (NULL == paths)
+            {
+                break;
+            }
+
+            memset(paths + documents->length, 0, (length - documents->length) * sizeof(char *));
+            documents->paths = paths;
+            documents->length = length;
+        }
+
+        free(documents->paths[document_id]);
+        documents->paths[document_id] = strdup(line + path_offset);
+    }
+
+    fclose(documents_file);
+
+    return 0;
+}
+
+/**
+ * @brief   Function used to get the path of a document
+ * @param[in] documents   - The paths
+ * @param[in] document_id - The document ID
+ * @return  The path or "?" if the ID is unknown
+ **/
+static const char *query_document_path(const DocumentPaths *documents, int document_id)
+{
+    if ((0 <= document_id) && (document_id < documents->length) && (NULL != documents->paths[document_id]))
+    {
+        return documents->paths[document_id];
+    }
+
+    return "?";
+}
+
+/**
+ * @brief   Function used to print the terms which start with a prefix, with their number of documents
+ * @param[in] reader - The index
+ * @param[in] prefix - The prefix
+ * @return  void
+ **/
+static void query_print_prefix(const IndexReader *reader, const char *prefix)
+{
+    size_t prefix_length = strlen(prefix);
+    IndexCursor cursor = {0};
+    IndexTerm term = {0};
+
+    index_cursor_seek(&cursor, reader, prefix, prefix_length);
+
+    /* The terms with the prefix follow each other */
+    while ((0 != index_cursor_next(&cursor, &term)) && (term.term_length >= prefix_length) &&
+           (0 == memcmp(term.term, prefix, prefix_length)))
+    {
+        printf("%.*s: %d\n", (int)term.term_length, term.term, term.documents_count);
+    }
+}
+
+/**
+ * @brief   Function used to measure the latency of the lookups and of the queries with BENCHMARK_TERMS_COUNT terms.
+ *          The terms are taken at random from the index.
+ * @param[in] reader     - The index
+ * @param[in] iterations - Number of lookups and of queries
+ * @return  0 for success or -1 in case of error
+ **/
+static int query_benchmark(const IndexReader *reader, int iterations)
+{
+    IndexCursor cursor = {0};
+    IndexTerm term = {0};
+    IndexDocuments result = {0};
+    IndexTerm *terms = NULL;
+    char *names = NULL;
+    size_t names_length = 0;
+    size_t *name_offsets = NULL;
+    int terms_length = 0;
+    int terms_capacity = 0;
+    int found = 0;
+    uint64_t documents_found = 0;
+    double *latencies = (double *)malloc(iterations * sizeof(double));
+    struct timespec start = {0};
+
+    /* Collect the terms, NUL terminated, as a user would type them */
+    index_cursor_seek(&cursor, reader, "", 0);
+
+    while (0 != index_cursor_next(&cursor, &term))
+    {
+        if (terms_length == terms_capacity)
+        {
+            int capacity = (0 == terms_capacity) ? 1024 : 2 * terms_capacity;
+            IndexTerm *new_terms = (IndexTerm *)realloc(terms, capacity * sizeof(IndexTerm));
+
+            if (NULL == new_terms)
+            {
+                break;
+            }
+
+            terms = new_terms;
+            terms_capacity = capacity;
+        }
+
+        terms[terms_length++] = term;
+        names_length += term.term_length + 1;
+    }
+
+    names = (char *)malloc(names_length + 1);
+    name_offsets = (size_t *)malloc((terms_length + 1) * sizeof(size_t));
+
+    if ((NULL == latencies) || (NULL == terms) || (NULL == names) || (NULL == name_offsets))
+    {
+        log_message(LOG_ERROR, "Query: %s(): Out of memory or empty index! .\n", __FUNCTION__);
+        free(latencies);
+        free(terms);
+        free(names);
+        free(name_offsets);
+        return -1;
+    }
+
+    names_length = 0;
+
+    for (int i = 0; i < terms_length; ++i)
+    {
+        name_offsets[i] = names_length;
+        memcpy(names + names_length, terms[i].term, terms[i].term_length);
+        names[names_length + terms[i].term_length] = '\0';
+        names_length += terms[i].term_length + 1;
+    }
+
+    srand(1);
+
+    for (int i = 0; i < iterations; ++i)
+    {
+        const char *name = names + name_offsets[rand() % terms_length];
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        found += index_reader_find(reader, name, strlen(name), &term);
+        latencies[i] = query_elapsed_us(&start);
+    }
+
+    printf("%d terms, %d of %d lookups found\n", terms_length, found, iterations);
+    query_print_latencies("lookup", latencies, iterations);
+
+    for (int i = 0; i < iterations; ++i)
+    {
+        const char *query[BENCHMARK_TERMS_COUNT] = {NULL};
+
+        for (int j = 0; j < BENCHMARK_TERMS_COUNT; ++j)
+        {
+            query[j] = names + name_offsets[rand() % terms_length];
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        index_query(reader, query, BENCHMARK_TERMS_COUNT, 1, &result);
+        latencies[i] = query_elapsed_us(&start);
+        documents_found += result.length;
+    }
+
+    printf("%llu documents found by %d AND queries\n", (unsigned long long)documents_found, iterations);
+    query_print_latencies("and", latencies, iterations);
+
+    index_documents_free(&result);
+    free(latencies);
+    free(terms);
+    free(names);
+    free(name_offsets);
+
+    return 0;
+}
+
+/**
+ * @brief   Function used to print the mean, p50 and p99 of the latencies
+ * @param[in] name      - The name of the operation
+ * @param[in] latencies - The latencies in microseconds. They are sorted.
+ * @param[in] length    - Number of latencies
+ * @return  void
+ **/
+static void query_print_latencies(const char *name, double *latencies, int length)
+{
+    double sum = 0;
+
+    qsort(latencies, length, sizeof(double), query_compare_latencies);
+
+    for (int i = 0; i < length; ++i)
+    {
+        sum += latencies[i];
+    }
+
+    printf("%-6s: mean %.3f us, p50 %.3f us, p99 %.3f us\n", name, sum / length,
+           latencies[length / 2], latencies[(int)((length - 1) * 0.99)]);
+}
+
+/**
+ * @brief   Function used to compare two latencies for qsort()
+ * @param[in] first  - The first latency
+ * @param[in] second - The second latency
+ * @return  <0, 0 or >0
+ **/
+static int query_compare_latencies(const void *first, const void *second)
+{
+    double difference = *(const double *)first - *(const double *)second;
+
+    return (0 > difference) ? -1 : ((0 < difference) ? 1 : 0);
+}
+
+/**
+ * @brief   Function used to get the elapsed microseconds from a moment
+ * @param[in] start - The moment
+ * @return  The microseconds
+ **/
+static double query_elapsed_us(const struct timespec *start)
+{
+    struct timespec now = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) * 1e6 + (now.tv_nsec - start->tv_nsec) / 1e3;
+}
+
+/*******************************************
+ *                 MAIN
+ ******************************************/
+int main(int argc, char **argv)
+{
+    char index_file_path[MAX_PATH] = {'\0'};
+    int option = -1;
+    int invalid_option = 0;
+    int prefix = 0;
+    int all_terms = 1;
+    int iterations = 0;
+    int error_code = 0;
+    DocumentPaths documents = {0};
+    IndexDocuments result = {0};
+    IndexReader reader = {0};
+
+    /* -p: list the terms which start with the given prefixes
+     * -a: the documents which have all the terms (default)
+     * -o: the documents which have any of the terms
+     * -B: measure the latency of the given number of lookups and queries */
+    while (-1 != (option = getopt(argc, argv, "paoB:")))
+    {
+        switch (option)
+        {
+            case 'p':
+                prefix = 1;
+                break;
+            case 'a':
+                all_terms = 1;
+                break;
+            case 'o':
+                all_terms = 0;
+                break;
+            case 'B':
+                iterations = atoi(optarg);
+                invalid_option |= (0 >= iterations);
+                break;
+            default:
+                invalid_option = 1;
+                break;
+        }
+    }
+
+    if ((0 != invalid_option) || (optind >= argc) || ((0 == iterations) && (optind + 1 >= argc)))
+    {
+        log_message(LOG_ERROR, "%s():Invalid input parameters! Usage: %s [-p] [-a | -o] [-B iterations] output_dir [term ...].\n", __FUNCTION__, argv[0]);
+        return 1;
+    }
+
+    utils_join_path(index_file_path, argv[optind], INDEX_FILE_NAME);
+
+    if (0 != index_reader_open(&reader, index_file_path))
+    {
+        return 1;
+    }
+
+    if (0 != iterations)
+    {
+        error_code = query_benchmark(&reader, iterations);
+    }
+    else if (0 != prefix)
+    {
+        for (int i = optind + 1; i < argc; ++i)
+        {
+            query_print_prefix(&reader, argv[i]);
+        }
+    }
+    else if ((0 == (error_code = query_load_documents(&documents, argv[optind]))) &&
+             (0 == (error_code = index_query(&reader, (const char **)(argv + optind + 1), argc - optind - 1, all_terms, &result))))
+    {
+        for (int i = 0; i < result.length; ++i)
+        {
+            printf("%s: %d\n", query_document_path(&documents, result.documents[i]), result.counts[i]);
+        }
+    }
+
+    for (int i = 0; i < documents.length; ++i)
+    {
+        free(documents.paths[i]);
+    }
+
+    free(documents.paths);
+    index_documents_free(&result);
+    index_reader_close(&reader);
+
+    return (0 == error_code) ? 0 : 1;
+}